@@ -0,0 +1,49 @@
+// Test benchRun's latency percentiles, per interval reports and target rate.
+
+t = db.bench_test4;
+t.drop();
+
+t.insert( { _id : 1 , x : 1 } )
+
+ops = [
+    { op : "findOne" , ns : t.getFullName() , query : { _id : 1 } } ,
+    { op : "update" , ns : t.getFullName() , query : { _id : 1 } , update : { $inc : { x : 1 } } }
+]
+
+seconds = 2
+
+benchArgs = { ops : ops , parallel : 2 , seconds : seconds , host : db.getMongo().host ,
+              opsPerSecond : 200 , intervalSeconds : 0.5 };
+
+if (jsTest.options().auth) {
+    benchArgs['db'] = 'admin';
+    benchArgs['username'] = jsTest.options().adminUser;
+    benchArgs['password'] = jsTest.options().adminPassword;
+}
+res = benchRun( benchArgs );
+
+[ "findOneLatencyMicros" , "updateLatencyMicros" ].forEach( function( name ) {
+    var l = res[name];
+    assert( l , name + " missing: " + tojson( res ) );
+    assert.lte( l.p50 , l.p99 , tojson( l ) );
+    assert.lte( l.p99 , l.p999 , tojson( l ) );
+    assert.lte( l.p999 , l.max , tojson( l ) );
+} );
+
+// 200 ops per second split between findOne and update, give or take startup and scheduling.
+var updates = t.findOne( { _id : 1 } ).x - 1;
+assert.gt( updates , 0.5 * 100 * seconds , "rate too low: " + updates );
+assert.lt( updates , 1.2 * 100 * seconds , "rate too high: " + updates );
+
+assert( res.intervals.length >= 3 , tojson( res.intervals ) );
+var counted = 0;
+for ( var i = 0; i < res.intervals.length; i++ ) {
+    var interval = res.intervals[i];
+    if ( i > 0 )
+        assert.lt( res.intervals[i - 1].t , interval.t , tojson( res.intervals ) );
+    if ( interval.update ) {
+        assert.lte( interval.update.p50 , interval.update.max , tojson( interval ) );
+        counted += interval.update.ops;
+    }
+}
+assert.eq( updates , counted , tojson( res.intervals ) );
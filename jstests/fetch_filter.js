@@ -0,0 +1,40 @@
+// Documents a clustering index fetches along with its keys are checked against the query as
+// they're fetched, and the ones that don't match aren't kept.
+
+t = db.fetch_filter;
+t.drop();
+t.ensureIndex( { a : 1 }, { clustering : true } );
+
+for ( var i = 0; i < 1000; i++ ) {
+    t.insert( { _id : i, a : i, b : i % 10, c : { d : i % 7 } } );
+}
+db.getLastError();
+
+function check( query, sort ) {
+    var expected = t.find( query ).hint( { _id : 1 } ).sort( sort ).toArray();
+    var results = t.find( query ).hint( { a : 1 } ).sort( sort ).batchSize( 20 ).toArray();
+    assert.eq( expected, results );
+    return t.find( query ).hint( { a : 1 } ).sort( sort ).explain();
+}
+
+// The index bounds still decide what's scanned; the filter only decides what's kept.
+var explain = check( { a : { $gte : 100, $lt : 600 }, b : 3 }, { a : 1 } );
+assert.eq( 50, explain.n );
+assert.eq( 500, explain.nscanned );
+assert.lte( 450, explain.nfilteredInCallback, tojson( explain ) );
+
+explain = check( { a : { $gte : 0 }, "c.d" : { $in : [ 1, 2 ] } }, { a : -1 } );
+assert.lt( 0, explain.nfilteredInCallback, tojson( explain ) );
+check( { a : { $lt : 300 }, $or : [ { b : 1 }, { "c.d" : 6 } ] }, { a : 1 } );
+check( { a : { $gte : 900 }, b : { $ne : 4 } }, { _id : 1 } );
+
+// With a projection, the filter sees the whole document.
+var o = t.find( { a : { $gte : 10 }, b : 7 }, { a : 1 } ).hint( { a : 1 } ).next();
+assert.eq( { _id : 17, a : 17 }, o );
+
+// $where runs JavaScript, so it isn't checked while fetching.
+explain = t.find( { a : { $lt : 50 }, $where : "this.b == 2" } ).hint( { a : 1 } ).explain();
+assert.eq( 5, explain.n );
+assert.eq( undefined, explain.nfilteredInCallback );
+
+t.drop();
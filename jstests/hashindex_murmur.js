@@ -0,0 +1,49 @@
+// Hashed indexes with hashVersion 1 (MurmurHash3).
+
+var t = db.hashindex_murmur;
+t.drop();
+
+// Unknown versions are refused.
+t.ensureIndex( {a : "hashed"} , {hashVersion : 2} );
+assert( db.getLastError() , "hashVersion 2 should be refused" );
+assert.eq( t.getIndexes().length , 0 , "no index should be created" );
+
+var spec = {a : "hashed"};
+t.ensureIndex( spec , {hashVersion : 1} );
+assert.eq( t.getIndexes().length , 2 , "hashed index didn't get created" );
+assert.eq( t.getIndexes()[1].hashVersion , 1 );
+
+for ( var i = 0; i < 100; i++ ) {
+    t.insert( {_id : i , a : i} );
+}
+t.insert( {_id : 100 , a : 3.1} );
+t.insert( {_id : 101 , a : {b : "sub"}} );
+t.insert( {_id : 102} );
+assert.eq( t.find().hint( spec ).itcount() , 103 );
+
+for ( var i = 0; i < 100; i += 7 ) {
+    assert.eq( t.find( {a : i} ).hint( spec ).toArray() , [ {_id : i , a : i} ] ,
+               "lookup of " + i );
+}
+// 3 and 3.1 have the same hash but only the right document comes back.
+assert.eq( t.find( {a : 3.1} ).hint( spec ).toArray()[0]._id , 100 );
+assert.eq( t.find( {a : 3} ).hint( spec ).toArray()[0]._id , 3 );
+assert.eq( t.find( {a : {b : "sub"}} ).hint( spec ).toArray()[0]._id , 101 );
+assert.eq( t.find( {a : null} ).hint( spec ).toArray()[0]._id , 102 );
+assert.eq( t.find( {a : {$in : [1, 2, 50]}} ).hint( spec ).itcount() , 3 );
+
+// Updates and deletes maintain the index.
+t.update( {_id : 5} , {$set : {a : 500}} );
+assert.eq( t.find( {a : 5} ).hint( spec ).itcount() , 0 );
+assert.eq( t.find( {a : 500} ).hint( spec ).itcount() , 1 );
+t.remove( {_id : 6} );
+assert.eq( t.find( {a : 6} ).hint( spec ).itcount() , 0 );
+
+// An MD5 index on another field of the same collection still works.
+t.ensureIndex( {c : "hashed"} );
+t.update( {} , {$set : {c : "x"}} , false , true );
+assert.eq( t.find( {c : "x"} ).hint( {c : "hashed"} ).itcount() , 102 );
+
+// Survives a reIndex.
+t.reIndex();
+assert.eq( t.find( {a : 7} ).hint( spec ).itcount() , 1 );
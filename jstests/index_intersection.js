@@ -0,0 +1,49 @@
+// Test that a conjunction over separately indexed fields is answered by intersecting the
+// indexes' primary keys, both when the primary keys can be merged in order and when they can't.
+
+var t = db.index_intersection;
+t.drop();
+
+t.ensureIndex({ a: 1 });
+t.ensureIndex({ b: 1 });
+t.ensureIndex({ c: 1 });
+for (var i = 0; i < 20000; i++) {
+    t.insert({ _id: i, a: i % 100, b: Math.floor(i / 100) % 10, c: i % 10 });
+}
+assert.eq(null, db.getLastError());
+
+function checkIntersection(query, merged) {
+    var explain = t.find(query).explain(true);
+    assert(/^IntersectionCursor /.test(explain.cursor), tojson(explain));
+    assert.eq(merged, explain.intersectionMerged, tojson(explain));
+    assert.eq(200, explain.n);
+    // Only the surviving documents are fetched.
+    assert.eq(200, explain.nscannedObjects);
+
+    var n = 0;
+    t.find(query).forEach(function(o) {
+        for (var f in query) {
+            if (typeof query[f] == 'number') {
+                assert.eq(query[f], o[f], tojson(o));
+            }
+        }
+        n++;
+    });
+    assert.eq(200, n);
+    assert.eq(200, t.find(query).count());
+}
+
+// Both ranges are single points, so each index returns its primary keys in order.
+checkIntersection({ b: 7, c: 3 }, true);
+
+// The range on a is not a point.
+checkIntersection({ a: { $gte: 30, $lt: 40 }, b: 7 }, false);
+
+var admin = db.getSisterDB('admin');
+assert.commandWorked(admin.runCommand({ setParameter: 1, queryPlanIntersection: false }));
+var explain = t.find({ b: 7, c: 3 }).explain();
+assert(!/^IntersectionCursor/.test(explain.cursor), tojson(explain));
+assert.eq(200, explain.n);
+assert.commandWorked(admin.runCommand({ setParameter: 1, queryPlanIntersection: true }));
+
+t.drop();
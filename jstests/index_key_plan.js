@@ -0,0 +1,74 @@
+// Test that keys generated for several indexes in one pass over each document match what each
+// index's own key generator produces, for documents the single pass can and can't handle.
+
+var t = db.index_key_plan;
+t.drop();
+
+t.ensureIndex({ a: 1 });
+t.ensureIndex({ a: 1, b: -1 });
+t.ensureIndex({ c: 1 }, { sparse: true });
+t.ensureIndex({ b: 1, c: 1 }, { sparse: true });
+t.ensureIndex({ 'd.e': 1 });
+t.ensureIndex({ f: 'hashed' });
+
+var docs = [
+    { _id: 0, a: 1, b: 2, c: 3, d: { e: 4 }, f: 5 },
+    { _id: 1, a: 1 },                               // missing fields, sparse indexes skip it
+    { _id: 2, b: null, c: 'x' },
+    { _id: 3, a: [ 1, 2, 3 ], b: 2 },              // arrays go through the general path
+    { _id: 4, a: [], c: [ 'x', 'y' ] },
+    { _id: 5, a: { z: 1 }, b: 'str', d: [ { e: 1 }, { e: 2 } ] },
+    { _id: 6, c: 3, a: 2, b: 1 },                  // field order differs from the key patterns
+    { _id: 7 }
+];
+docs.forEach(function(d) { t.insert(d); });
+assert.eq(null, db.getLastError());
+
+function check(query) {
+    var expected = t.find(query).hint({ $natural: 1 }).sort({ _id: 1 }).toArray();
+    t.getIndexes().forEach(function(idx) {
+        if (idx.key.f == 'hashed') {
+            return;
+        }
+        var field = Object.keySet(idx.key)[0];
+        if (!(field in query)) {
+            return;
+        }
+        if (idx.sparse && query[field] === null) {
+            return;
+        }
+        var actual = t.find(query).hint(idx.key).sort({ _id: 1 }).toArray();
+        assert.eq(expected, actual, tojson(query) + ' ' + tojson(idx.key));
+    });
+}
+
+function checkAll() {
+    [ { a: 1 }, { a: 2 }, { a: null }, { a: { z: 1 } },
+      { b: 2 }, { b: null }, { b: 'str' },
+      { c: 3 }, { c: 'x' }, { c: 'y' },
+      { 'd.e': 1 }, { 'd.e': 4 }, { 'd.e': null } ].forEach(check);
+    assert.eq(1, t.find({ f: 5 }).hint({ f: 'hashed' }).itcount());
+    assert(t.validate().valid);
+}
+
+checkAll();
+
+// Updates need the old and new keys of every index.
+t.update({ _id: 1 }, { $set: { b: 2, c: 3 } });
+t.update({ _id: 3 }, { $set: { a: 2 } });
+t.update({ _id: 6 }, { $set: { a: [ 2, 1 ] } });
+t.update({ _id: 0 }, { $unset: { c: 1 } });
+assert.eq(null, db.getLastError());
+checkAll();
+
+t.remove({ _id: { $in: [ 0, 3, 5 ] } });
+assert.eq(null, db.getLastError());
+checkAll();
+
+// Dropping an index changes the plan.
+t.dropIndex({ a: 1, b: -1 });
+t.insert({ _id: 8, a: 1, b: 2, c: 3 });
+assert.eq(null, db.getLastError());
+checkAll();
+
+t.drop();
@@ -0,0 +1,45 @@
+// Test that row lock conflicts are accounted per dictionary in serverStatus().lockTree,
+// in top, and show up in showContendedRanges.
+
+var t = db.lock_tree_stats;
+t.drop();
+t.insert({ _id: 0 });
+assert.eq(null, db.getLastError());
+
+var admin = db.getSisterDB('admin');
+assert.commandWorked(admin.runCommand({ setParameter: 1, lockTimeout: 100 }));
+
+var before = db.serverStatus().lockTree;
+assert(before, 'serverStatus should have a lockTree section');
+
+// Hold a row lock on _id: 1 while another client tries to take it.
+assert.commandWorked(db.beginTransaction());
+t.insert({ _id: 1 });
+assert.eq(null, db.getLastError());
+startParallelShell('db.lock_tree_stats.insert({ _id: 1 }); assert.neq(null, db.getLastError());')();
+db.rollbackTransaction();
+
+var after = db.serverStatus().lockTree;
+assert.gt(after.conflicts, before.conflicts);
+var found = false;
+for (var dname in after.dictionaries) {
+    if (dname.indexOf('lock_tree_stats') >= 0) {
+        assert.gt(after.dictionaries[dname].conflicts, 0);
+        found = true;
+    }
+}
+assert(found, 'no lockTree entry for the collection: ' + tojson(after));
+
+var o = db.showContendedRanges(5);
+assert.commandWorked(o);
+assert.gt(o.ranges.length, 0);
+assert.lte(o.ranges.length, 5);
+assert.gt(o.ranges[0].conflicts, 0);
+assert.eq(2, o.ranges[0].bounds.length);
+
+var top = admin.runCommand('top');
+assert.commandWorked(top);
+assert.gt(top.totals[t.getFullName()].lockConflicts.count, 0);
+
+assert.commandWorked(admin.runCommand({ setParameter: 1, lockTimeout: 4000 }));
+t.drop();
@@ -0,0 +1,34 @@
+// Test that index maintenance draws its keys from the per-operation arena.
+
+var t = db.operation_arena;
+t.drop();
+t.ensureIndex({ a: 1 });
+t.ensureIndex({ b: 1 }, { sparse: true });
+
+function arenaStats() {
+    var s = db.serverStatus().operationArena;
+    assert(s, "no operationArena section in serverStatus");
+    return s;
+}
+
+var before = arenaStats();
+for (var i = 0; i < 1000; i++) {
+    t.insert({ _id: i, a: i, b: [i, i + 1] });
+}
+assert.eq(null, db.getLastError());
+t.update({}, { $inc: { a: 1 } }, false, true);
+assert.eq(null, db.getLastError());
+t.remove({ _id: { $lt: 500 } });
+assert.eq(null, db.getLastError());
+var after = arenaStats();
+
+// Three keys per insert at least, plus the updates and deletes.
+assert.gte(after.allocations - before.allocations, 3000, tojson(after));
+assert.gt(after.bytes, before.bytes, tojson(after));
+
+// The keys are still found through the indexes.
+assert.eq(500, t.find({ a: { $gt: 0 } }).hint({ a: 1 }).itcount());
+assert.eq(1, t.find({ b: 600 }).hint({ b: 1 }).itcount());
+assert.eq(2, t.find({ b: 601 }).hint({ b: 1 }).itcount());
+
+t.drop();
@@ -0,0 +1,43 @@
+// Test that a plan whose estimated cost is far below the others' runs without racing them and is
+// recorded, and that explain reports the estimates.
+
+var t = db.plan_cost;
+t.drop();
+
+t.ensureIndex({ a: 1 }, { clustering: true });
+t.ensureIndex({ b: 1 });
+for (var i = 0; i < 20000; i++) {
+    t.insert({ a: i, b: i % 2 });
+}
+assert.eq(null, db.getLastError());
+
+var query = { a: { $lt: 1500 }, b: 0 };
+
+var explain = t.find(query).explain(true);
+assert.eq('IndexCursor a_1', explain.cursor);
+assert.eq(750, explain.n);
+assert.eq(1, explain.allPlans.length, tojson(explain));
+assert(explain.estimatedNscanned > 0, tojson(explain));
+assert.eq(explain.estimatedNscanned, explain.allPlans[0].estimatedNscanned);
+
+// The chosen plan is recorded, so later queries of the same pattern skip estimation.
+assert.eq(750, t.find(query).itcount());
+explain = t.find(query).explain(true);
+assert.eq('IndexCursor a_1', explain.oldPlan.cursor, tojson(explain));
+
+// With cost based selection disabled, all candidate plans are raced again.
+var admin = db.getSisterDB('admin');
+assert.commandWorked(admin.runCommand({ setParameter: 1, queryPlanCostRatio: 0 }));
+explain = t.find(query).explain(true);
+assert.eq('IndexCursor a_1', explain.cursor);
+assert.eq(3, explain.allPlans.length, tojson(explain));
+explain.allPlans.forEach(function(plan) {
+    assert(plan.estimatedNscanned >= 0, tojson(plan));
+});
+assert.commandWorked(admin.runCommand({ setParameter: 1, queryPlanCostRatio: 10 }));
+
+// Small ranges are cheap to race, so the race is kept.
+explain = t.find({ a: { $lt: 10 }, b: 0 }).explain(true);
+assert.eq(3, explain.allPlans.length, tojson(explain));
+
+t.drop();
@@ -0,0 +1,62 @@
+// Queries with a projection only keep the fields they need of the documents a clustering index
+// fetches along with its keys.
+
+t = db.projection_pushdown;
+t.drop();
+t.ensureIndex( { a : 1 }, { clustering : true } );
+
+var wide = new Array( 2048 ).join( "w" );
+for ( var i = 0; i < 500; i++ ) {
+    t.insert( { _id : i, a : i, b : { c : i * 2 }, d : i % 5, w : wide } );
+}
+db.getLastError();
+
+function check( query, fields, sort, expectedFetched ) {
+    var expected = [];
+    t.find( query ).hint( { _id : 1 } ).sort( sort ).forEach( function( o ) {
+        var p = { _id : o._id };
+        for ( var f in fields ) {
+            if ( f == "_id" ) {
+                if ( !fields[f] ) {
+                    delete p._id;
+                }
+            }
+            else {
+                p[f] = o[f.split( "." )[0]];
+            }
+        }
+        expected.push( p );
+    } );
+    var c = t.find( query, fields ).hint( { a : 1 } ).sort( sort ).batchSize( 50 );
+    var results = c.toArray();
+    assert.eq( expected.length, results.length );
+    for ( var i = 0; i < results.length; i++ ) {
+        assert.eq( expected[i]._id, results[i]._id );
+        assert.eq( undefined, results[i].w );
+    }
+    var explain = t.find( query, fields ).hint( { a : 1 } ).sort( sort ).explain();
+    assert.eq( expectedFetched, explain.fieldsFetched, tojson( explain ) );
+}
+
+// The matcher's and the sort's fields are kept too.
+check( { a : { $gte : 100 } }, { a : 1 }, { a : 1 }, [ "_id", "a" ] );
+check( { a : { $gte : 100 }, d : 3 }, { a : 1 }, { a : 1 }, [ "_id", "a", "d" ] );
+check( { a : { $lt : 50 }, $or : [ { d : 1 }, { "b.c" : 4 } ] }, { d : 1 }, { a : -1 },
+       [ "_id", "a", "b", "d" ] );
+check( { a : { $gte : 0 } }, { "b.c" : 1, _id : 0 }, { d : 1, _id : 1 }, [ "_id", "a", "b", "d" ] );
+
+// Projected fields come back intact.
+var o = t.find( { a : 7 }, { b : 1, d : 1 } ).hint( { a : 1 } ).next();
+assert.eq( { _id : 7, b : { c : 14 }, d : 2 }, o );
+
+// Exclusions and $where need the whole document.
+assert.eq( undefined, t.find( { a : 7 }, { w : 0 } ).hint( { a : 1 } ).explain().fieldsFetched );
+assert.eq( 1, t.find( { a : 7, $where : "this.w.length > 0" }, { a : 1 } ).hint( { a : 1 } ).itcount() );
+assert.eq( undefined,
+           t.find( { a : 7, $where : "this.w.length > 0" }, { a : 1 } ).hint( { a : 1 } ).explain().fieldsFetched );
+
+// Covered queries don't keep the documents at all.
+assert.eq( [], t.find( { a : { $gte : 10 } }, { _id : 0, a : 1 } ).hint( { a : 1 } ).explain().fieldsFetched );
+assert.eq( 490, t.find( { a : { $gte : 10 } }, { _id : 0, a : 1 } ).hint( { a : 1 } ).itcount() );
+
+t.drop();
@@ -0,0 +1,46 @@
+//
+// Tests exhaust queries through mongos, on sharded and unsharded collections.  mongos pushes the
+// batches to the client itself, without getMores.
+//
+
+var st = new ShardingTest({ shards : 2, mongos : 1, other : { separateConfig : true } });
+st.stopBalancer();
+
+var mongos = st.s0;
+var admin = mongos.getDB( "admin" );
+var db = mongos.getDB( "test" );
+
+assert.commandWorked( admin.runCommand({ enableSharding : "test" }) );
+assert.commandWorked( admin.runCommand({ shardCollection : "test.sharded", key : { _id : 1 } }) );
+assert.commandWorked( admin.runCommand({ split : "test.sharded", middle : { _id : 1000 } }) );
+assert.commandWorked( admin.runCommand({ moveChunk : "test.sharded", find : { _id : 0 },
+                                         to : st.getNonPrimaries( "test" )[0] }) );
+
+var padding = new Array( 1024 ).join( "x" );
+for ( var i = 0; i < 2000; i++ ) {
+    db.sharded.insert({ _id : i, padding : padding });
+    db.unsharded.insert({ _id : i, padding : padding });
+}
+assert.eq( null, db.getLastError() );
+
+function checkExhaust( coll, query, expected ) {
+    var cursor = coll.find( query ).sort({ _id : 1 }).addOption( DBQuery.Option.exhaust );
+    var n = 0;
+    while ( cursor.hasNext() ) {
+        assert.eq( n, cursor.next()._id );
+        n++;
+    }
+    assert.eq( expected, n );
+}
+
+checkExhaust( db.sharded, {}, 2000 );
+checkExhaust( db.sharded, { _id : { $gte : 1500 } }, 500 );
+checkExhaust( db.unsharded, {}, 2000 );
+
+// The connection is still usable afterwards, and no cursors are left open.
+assert.eq( 2000, db.sharded.count() );
+var info = admin.runCommand({ cursorInfo : 1 });
+assert.eq( 0, info.sharded );
+assert.eq( 0, info.refs );
+
+st.stop();
@@ -0,0 +1,56 @@
+//
+// Tests that mongos's unversioned shard connections work when they share a few multiplexed
+// sockets per shard (multiplexedSocketsPerShard), with many threads using them at once.
+//
+
+var st = new ShardingTest({ shards : 2,
+                            mongos : 1,
+                            other : { separateConfig : true,
+                                      mongosOptions : { setParameter : "multiplexedSocketsPerShard=2" } } });
+st.stopBalancer();
+
+var db = st.getDB( "test" ); // db variable name is required due to startParallelShell()
+var admin = st.s0.getDB( "admin" );
+
+var res = admin.runCommand({ getParameter : 1, multiplexedSocketsPerShard : 1 });
+assert.commandWorked( res );
+assert.eq( 2, res.multiplexedSocketsPerShard );
+
+assert.commandWorked( admin.runCommand({ enableSharding : "test" }) );
+assert.commandWorked( admin.runCommand({ shardCollection : "test.foo", key : { _id : 1 } }) );
+assert.commandWorked( admin.runCommand({ split : "test.foo", middle : { _id : 500 } }) );
+assert.commandWorked( admin.runCommand({ moveChunk : "test.foo", find : { _id : 0 },
+                                         to : st.getNonPrimaries( "test" )[0] }) );
+
+for ( var i = 0; i < 1000; i++ ) {
+    db.foo.insert({ _id : i, x : i });
+}
+db.getLastError();
+
+// collStats and dataSize go to the shards over the shared sockets.
+var statsLoop = "for ( var i = 0; i < 200; i++ ) { " +
+                "    var stats = db.foo.stats(); " +
+                "    assert.commandWorked( stats ); " +
+                "    assert.eq( 1000, stats.count ); " +
+                "    var size = db.runCommand({ dataSize : 'test.foo', keyPattern : { _id : 1 }, " +
+                "                               min : { _id : 0 }, max : { _id : 1000 } }); " +
+                "    assert.commandWorked( size ); " +
+                "    assert.eq( 1000, size.numObjects ); " +
+                "} " +
+                "db.done.insert({ ok : 1 }); " +
+                "db.getLastError();";
+
+var joins = [];
+for ( var i = 0; i < 8; i++ ) {
+    joins.push( startParallelShell( statsLoop ) );
+}
+for ( var i = 0; i < joins.length; i++ ) {
+    joins[i]();
+}
+assert.eq( joins.length, db.done.count() );
+
+// Writes that go through the same pool move their connection to a socket of its own.
+assert.commandWorked( admin.runCommand({ split : "test.foo", middle : { _id : 250 } }) );
+assert.eq( 1000, db.foo.count() );
+
+st.stop();
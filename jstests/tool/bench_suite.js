@@ -0,0 +1,52 @@
+// Test running a workload suite with mongobench, and comparing a run against a baseline.
+
+t = new ToolTest( "bench_suite" );
+t.startDB();
+var benchDB = t.m.getDB( "mongobench" );
+
+var out = t.ext + "results.json";
+assert.eq( 0 , t.runTool( "bench" , "--out" , out , "jstests/libs/bench_suite.json" ) );
+
+function results() {
+    return cat( out ).split( "\n" ).filter( function( line ) {
+        return line.length > 0;
+    } ).map( function( line ) {
+        return eval( "(" + line + ")" );
+    } );
+}
+
+var res = results();
+assert.eq( 1 , res.length , tojson( res ) );
+assert.eq( "bench_suite_test" , res[0].suite );
+assert.eq( 1 , res[0].workloads.length , tojson( res[0] ) );
+var w = res[0].workloads[0];
+assert.eq( "mixed" , w.name );
+assert.eq( 0 , w.errCount , tojson( w ) );
+assert.gt( w.ops.insert.ops , 0 , tojson( w ) );
+assert.gt( w.ops.query.ops , 0 , tojson( w ) );
+// A beginTransaction and a commitTransaction per insert, give or take where each worker stopped.
+assert.lte( Math.abs( 2 * w.ops.insert.ops - w.ops.command.ops ) , 2 * w.parallel , tojson( w ) );
+assert.lte( w.ops.query.p50 , w.ops.query.p99 , tojson( w ) );
+assert.lte( w.ops.query.p99 , w.ops.query.max , tojson( w ) );
+assert( w.intervals.length >= 3 , tojson( w ) );
+
+// The teardown dropped the collection.
+assert.eq( 0 , benchDB.t.count() );
+
+// A second run is compared to the first, and appended to the results.
+assert.eq( 0 , t.runTool( "bench" , "--out" , out , "--baseline" , out , "--tolerance" , "100000" ,
+                          "jstests/libs/bench_suite.json" ) );
+assert.eq( 2 , results().length );
+
+// With --db, the suite's "$db" namespaces are in that database instead.
+benchDB.dropDatabase();
+assert.eq( 0 , t.runTool( "bench" , "--db" , "bench_suite_other" , "--out" , out ,
+                          "jstests/libs/bench_suite.json" ) );
+assert.eq( 3 , results().length );
+assert.eq( -1 , t.m.getDBNames().indexOf( "mongobench" ) , tojson( t.m.getDBNames() ) );
+assert.neq( -1 , t.m.getDBNames().indexOf( "bench_suite_other" ) , tojson( t.m.getDBNames() ) );
+
+// Suites that need a mongos are skipped against a mongod.
+assert.eq( 0 , t.runTool( "bench" , "src/mongo/tools/benchsuites/sharded_scatter_gather.json" ) );
+
+t.stop();
@@ -0,0 +1,48 @@
+// Test restoring several collections in parallel with --numParallelCollections.
+
+t = new ToolTest( "dumprestore_parallel" );
+
+c = t.startDB( "foo" );
+db = c.getDB();
+
+var ncolls = 5;
+for ( var i = 0; i < ncolls; i++ ) {
+    var coll = db["coll" + i];
+    coll.ensureIndex( { a : 1 } );
+    for ( var j = 0; j < 1000 * ( i + 1 ); j++ ) {
+        coll.insert( { _id : j , a : j % 7 } );
+    }
+}
+db.system.users.insert( { user : "restoreuser" , pwd : "x" } );
+assert.eq( null , db.getLastError() );
+
+t.runTool( "dump" , "--out" , t.ext );
+
+function check( msg ) {
+    for ( var i = 0; i < ncolls; i++ ) {
+        var coll = db["coll" + i];
+        assert.eq( 1000 * ( i + 1 ) , coll.count() , msg + ": count " + coll );
+        assert.eq( 2 , coll.getIndexes().length , msg + ": indexes " + coll );
+        assert.eq( Math.ceil( 1000 * ( i + 1 ) / 7 ) , coll.find( { a : 0 } ).hint( { a : 1 } ).itcount() ,
+                   msg + ": index contents " + coll );
+    }
+    assert.eq( 1 , db.system.users.count( { user : "restoreuser" } ) , msg + ": users" );
+}
+
+db.dropDatabase();
+t.runTool( "restore" , "--dir" , t.ext , "--numParallelCollections" , "3" );
+check( "bulk load" );
+
+// Without --drop, restoring again inserts nothing new since every _id already exists.
+t.runTool( "restore" , "--dir" , t.ext , "-j" , "4" );
+check( "no drop" );
+
+// Batches that mix objects already there with missing ones still insert the missing ones.
+for ( var i = 0; i < ncolls; i++ ) {
+    db["coll" + i].remove( { _id : { $mod : [ 3 , 0 ] } } );
+}
+assert.eq( null , db.getLastError() );
+t.runTool( "restore" , "--dir" , t.ext , "-j" , "4" );
+check( "partial" );
+
+t.stop();
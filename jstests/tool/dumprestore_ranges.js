@@ -0,0 +1,48 @@
+// Test dumping a collection as several _id ranges with --numRanges, and restoring the segments.
+
+t = new ToolTest( "dumprestore_ranges" );
+
+c = t.startDB( "foo" );
+db = c.getDB();
+
+var str = 'a';
+while ( str.length < 1024 ) {
+    str += str;
+}
+c.ensureIndex( { a : 1 } );
+var n = 10000;
+for ( var i = 0; i < n; i++ ) {
+    c.insert( { _id : i , a : i % 13 , s : str } );
+}
+db.small.insert( { _id : 0 } );
+assert.eq( null , db.getLastError() );
+
+t.runTool( "dump" , "--out" , t.ext , "--numRanges" , "4" );
+
+// The big collection is split, the small one isn't.
+var files = listFiles( t.ext + "/foo" ).map( function( f ) {
+    return f.name.substring( f.name.lastIndexOf( "/" ) + 1 );
+} );
+assert.contains( "foo.bson" , files , tojson( files ) );
+assert.contains( "foo.bson.1" , files , tojson( files ) );
+assert.contains( "small.bson" , files , tojson( files ) );
+assert( files.indexOf( "small.bson.1" ) < 0 , tojson( files ) );
+var metadata = cat( t.ext + "/foo/foo.metadata.json" );
+assert( /"segments"/.test( metadata ) , metadata );
+
+function check( msg ) {
+    assert.eq( n , c.count() , msg );
+    assert.eq( n - 1 , c.find().sort( { _id : -1 } ).limit( 1 ).next()._id , msg );
+    assert.eq( Math.ceil( n / 13 ) , c.find( { a : 0 } ).hint( { a : 1 } ).itcount() , msg );
+    assert.eq( 1 , db.small.count() , msg );
+}
+
+db.dropDatabase();
+t.runTool( "restore" , "--dir" , t.ext );
+check( "serial restore" );
+
+db.dropDatabase();
+t.runTool( "restore" , "--dir" , t.ext , "--numParallelCollections" , "2" );
+check( "parallel restore" );
+
+t.stop();
@@ -0,0 +1,30 @@
+// Test that mongo2toku replays a batch of inserts that overlaps documents already there, without
+// losing the new ones.  The source oplog is a capped collection in the vanilla oplog format.
+
+t = new ToolTest( "mongo2toku_dupkey" );
+
+c = t.startDB( "foo" );
+db = c.getDB();
+
+db.createCollection( "oplog" , { capped : true , size : 1024 * 1024 } );
+db.oplog.insert( { ts : new Timestamp( 1000 , 0 ) , h : 0 , op : "n" , ns : "" , o : {} } );
+for ( var i = 1; i <= 10; i++ ) {
+    db.oplog.insert( { ts : new Timestamp( 1000 , i ) , h : 0 , op : "i" , ns : "foo.dest" ,
+                       o : { _id : i , a : i } } );
+}
+// Already copied, so the inserts of _id 5 and 6 fail with duplicate keys.
+db.dest.insert( { _id : 5 , a : 5 } );
+db.dest.insert( { _id : 6 , a : 6 } );
+assert.eq( null , db.getLastError() );
+
+var pid = startMongoProgramNoConnect( "mongo2toku" , "--host" , "127.0.0.1:" + t.port ,
+                                      "--from" , "127.0.0.1:" + t.port ,
+                                      "--oplogns" , "foo.oplog" , "--ts" , "1000:0" );
+assert.soon( function() { return db.dest.count() == 10; } , "not all documents were replayed" );
+stopMongoProgramByPid( pid );
+
+for ( var i = 1; i <= 10; i++ ) {
+    assert.eq( { _id : i , a : i } , db.dest.findOne( { _id : i } ) );
+}
+
+t.stop();
@@ -0,0 +1,43 @@
+// Test that top still sums usage correctly when it is recorded from many connections, and that
+// it reports latency histograms per op type.
+
+var t = db.top_partitioned;
+t.drop();
+t.insert({ _id: 0 });
+assert.eq(null, db.getLastError());
+
+function usage() {
+    var res = db.getSisterDB('admin').runCommand('top');
+    assert.commandWorked(res);
+    return res.totals[t.getFullName()];
+}
+
+var before = usage();
+
+var nshells = 8;
+var ninserts = 100;
+var shells = [];
+for (var i = 0; i < nshells; i++) {
+    shells.push(startParallelShell(
+        'for (var j = 0; j < ' + ninserts + '; j++) {' +
+        '    db.top_partitioned.insert({ s: ' + i + ', j: j });' +
+        '}' +
+        'assert.eq(null, db.getLastError());'
+    ));
+}
+for (var i = 0; i < nshells; i++) {
+    shells[i]();
+}
+
+var after = usage();
+assert.eq(before.insert.count + nshells * ninserts, after.insert.count);
+
+var inLatency = 0;
+for (var bucket in after.insert.latency) {
+    inLatency += after.insert.latency[bucket];
+}
+assert.eq(after.insert.count, inLatency);
+
+// Dropping the collection removes it from top, no matter which connection recorded it.
+t.drop();
+assert.eq(undefined, usage());
@@ -0,0 +1,45 @@
+// Test that an update only writes the secondary indexes whose keys it changes.
+
+var t = db.update_index_skip;
+t.drop();
+
+t.ensureIndex({ a: 1 });
+t.ensureIndex({ b: 1 });
+t.ensureIndex({ 'c.d': 1 });
+t.ensureIndex({ e: 1 }, { clustering: true });
+for (var i = 0; i < 10; i++) {
+    t.insert({ _id: i, a: i, b: i, c: { d: i, x: i }, e: i, z: i });
+}
+assert.eq(null, db.getLastError());
+
+function metrics() {
+    return db.serverStatus().metrics.index.update;
+}
+
+function checkUpdate(query, update, written, skipped) {
+    var before = metrics();
+    t.update(query, update);
+    assert.eq(null, db.getLastError());
+    var after = metrics();
+    assert.eq(written, after.written - before.written, tojson(update));
+    assert.eq(skipped, after.skipped - before.skipped, tojson(update));
+}
+
+// Only the index on a changes, the clustering index always gets the new document.
+checkUpdate({ _id: 1 }, { $set: { a: 100 } }, 2, 2);
+// A replacement that keeps every indexed field.
+checkUpdate({ _id: 2 }, { a: 2, b: 2, c: { d: 2, x: 2 }, e: 2, z: 200 }, 1, 3);
+// A replacement that changes a field outside c.d under c, c.d's keys may differ.
+checkUpdate({ _id: 3 }, { a: 3, b: 3, c: { d: 3, x: 300 }, e: 3, z: 3 }, 2, 2);
+// A replacement that changes b only.
+checkUpdate({ _id: 4 }, { a: 4, b: 400, c: { d: 4, x: 4 }, e: 4, z: 4 }, 2, 2);
+
+assert.eq(1, t.find({ a: 100 }).hint({ a: 1 }).itcount());
+assert.eq(0, t.find({ a: 1 }).hint({ a: 1 }).itcount());
+assert.eq(1, t.find({ b: 400 }).hint({ b: 1 }).itcount());
+assert.eq(0, t.find({ b: 4 }).hint({ b: 1 }).itcount());
+assert.eq(200, t.find({ e: 2 }).hint({ e: 1 }).next().z);
+assert.eq(1, t.find({ 'c.d': 3 }).hint({ 'c.d': 1 }).itcount());
+assert(t.validate().valid);
+
+t.drop();
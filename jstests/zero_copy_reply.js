@@ -0,0 +1,50 @@
+// Large documents are sent from the cursor's memory instead of being copied into the reply.
+// Check that replies mixing copied and referenced documents come back intact.
+
+t = db.zero_copy_reply;
+t.drop();
+
+var big = new Array( 4096 ).join( "x" );
+for ( var i = 0; i < 300; i++ ) {
+    t.insert( { _id : i, s : ( i % 3 == 0 ) ? "small" : big + i } );
+}
+db.getLastError();
+
+var before = db.serverStatus().metrics.query.zeroCopy;
+
+function check( cursor ) {
+    var n = 0;
+    while ( cursor.hasNext() ) {
+        var o = cursor.next();
+        assert.eq( n, o._id );
+        assert.eq( ( n % 3 == 0 ) ? "small" : big + n, o.s );
+        n++;
+    }
+    assert.eq( 300, n );
+}
+
+// The first batch and the getMores after it.
+check( t.find().sort( { _id : 1 } ).batchSize( 7 ) );
+check( t.find().sort( { _id : 1 } ) );
+check( t.find().hint( { _id : 1 } ).addOption( DBQuery.Option.exhaust ) );
+
+var after = db.serverStatus().metrics.query.zeroCopy;
+assert.lt( before.documents, after.documents );
+assert.lt( before.bytes, after.bytes );
+
+// Projected documents are always copied.
+var n = 0;
+t.find( {}, { s : 1 } ).sort( { _id : 1 } ).forEach( function( o ) {
+    assert.eq( ( n % 3 == 0 ) ? "small" : big + n, o.s );
+    n++;
+} );
+assert.eq( 300, n );
+
+// 0 turns it off.
+assert.commandWorked( db.adminCommand( { setParameter : 1, zeroCopyReplyMinObjSize : 0 } ) );
+before = db.serverStatus().metrics.query.zeroCopy;
+check( t.find().sort( { _id : 1 } ).batchSize( 7 ) );
+assert.eq( before.documents, db.serverStatus().metrics.query.zeroCopy.documents );
+assert.commandWorked( db.adminCommand( { setParameter : 1, zeroCopyReplyMinObjSize : 1024 } ) );
+
+t.drop();
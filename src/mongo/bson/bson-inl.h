@@ -24,6 +24,8 @@
 #include <map>
 #include <limits>
 
+#include "mongo/bson/bson_scan.h"
+
 
 #if defined(_WIN32)
 #undef max
@@ -266,11 +268,21 @@ dodouble:
     }
 
     inline BSONElement BSONObj::getField(const StringData& name) const {
-        BSONObjIterator i(*this);
-        while ( i.more() ) {
-            BSONElement e = i.next();
-            if ( name == e.fieldName() )
+        const size_t len = name.size();
+        const char *p = objdata() + 4;
+        const char *end = objdata() + objsize();
+        while ( p < end && *p != EOO ) {
+            // Find the end of the field name once, e.size() reuses it to skip the element.
+            const long long nameLen = bsonscan::cstringLength( p + 1, end );
+            dassert( nameLen >= 0 );
+            if ( nameLen < 0 ) {
+                // Unterminated field name, like BSONObjIterator stop at the end of the object.
+                break;
+            }
+            BSONElement e( p, static_cast<int>( nameLen ) + 1, BSONElement::FieldNameSizeTag() );
+            if ( static_cast<size_t>( nameLen ) == len && memcmp( p + 1, name.rawData(), len ) == 0 )
                 return e;
+            p += e.size();
         }
         return BSONElement();
     }
@@ -0,0 +1,144 @@
+// bson_scan.h
+
+/*    Copyright (c) Tokutek Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MONGO_BSON_SCAN_SSE2 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#include "mongo/platform/cstdint.h"
+
+namespace mongo {
+
+    /**
+     * Kernels for the loops that walk raw BSON bytes: finding the end of field names and
+     * C strings, and checking UTF-8.  With SSE2, which every x86-64 processor has so no runtime
+     * dispatch is needed, they look at 16 bytes at a time.  Elsewhere they are plain loops.
+     */
+    namespace bsonscan {
+
+#if defined(MONGO_BSON_SCAN_SSE2)
+        inline int lowestBitSet(unsigned mask) {
+#if defined(_MSC_VER)
+            unsigned long i;
+            _BitScanForward(&i, mask);
+            return static_cast<int>(i);
+#else
+            return __builtin_ctz(mask);
+#endif
+        }
+#endif
+
+        /**
+         * @return the length of the NUL terminated string starting at p, or -1 if there is no
+         *         NUL in [p, end).
+         */
+        inline long long cstringLength(const char *p, const char *end) {
+#if defined(MONGO_BSON_SCAN_SSE2)
+            // Only [p, end) may be read: bytes are checked one at a time up to the first 16 byte
+            // boundary, then 16 at a time while a whole block fits, then one at a time again.
+            const char *s = p;
+            while (s < end && (reinterpret_cast<uintptr_t>(s) & 15) != 0) {
+                if (*s == '\0') {
+                    return s - p;
+                }
+                ++s;
+            }
+            const __m128i zero = _mm_setzero_si128();
+            while (end - s >= 16) {
+                const unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                        _mm_load_si128(reinterpret_cast<const __m128i *>(s)), zero));
+                if (mask != 0) {
+                    return s + lowestBitSet(mask) - p;
+                }
+                s += 16;
+            }
+            for (; s < end; ++s) {
+                if (*s == '\0') {
+                    return s - p;
+                }
+            }
+            return -1;
+#else
+            const void *nul = memchr(p, 0, end - p);
+            return nul != NULL ? static_cast<const char *>(nul) - p : -1;
+#endif
+        }
+
+        /**
+         * @return true if the len bytes at p are valid UTF-8, with the same rules as
+         *         isValidUTF8() in util/text.h.
+         */
+        inline bool isValidUTF8(const char *p, size_t len) {
+            const unsigned char *s = reinterpret_cast<const unsigned char *>(p);
+            const unsigned char *const end = s + len;
+            while (s < end) {
+#if defined(MONGO_BSON_SCAN_SSE2)
+                // Skip ASCII 16 bytes at a time, most field names and many strings are all ASCII.
+                while (end - s >= 16) {
+                    const unsigned high = _mm_movemask_epi8(
+                            _mm_loadu_si128(reinterpret_cast<const __m128i *>(s)));
+                    if (high != 0) {
+                        s += lowestBitSet(high);
+                        break;
+                    }
+                    s += 16;
+                }
+                if (s == end) {
+                    break;
+                }
+#endif
+                const unsigned char c = *s++;
+                if (c < 0x80) {
+                    continue;
+                }
+                int more;
+                if (c < 0xC2) {
+                    // A continuation byte, or a 2 byte encoding of a codepoint <= 0x7F.
+                    return false;
+                } else if (c < 0xE0) {
+                    more = 1;
+                } else if (c < 0xF0) {
+                    more = 2;
+                } else if (c <= 0xF4) {
+                    more = 3;
+                } else {
+                    // Codepoint too large (> 0x10FFFF).
+                    return false;
+                }
+                if (end - s < more) {
+                    return false;
+                }
+                for (; more > 0; more--) {
+                    if ((*s++ & 0xC0) != 0x80) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+    } // namespace bsonscan
+
+} // namespace mongo
@@ -0,0 +1,246 @@
+// bson_scan_test.cpp
+
+/*    Copyright (c) Tokutek Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/unittest/unittest.h"
+
+#include "mongo/bson/bson_scan.h"
+#include "mongo/bson/bson_validate.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/random.h"
+#include "mongo/util/log.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/text.h"
+#include "mongo/util/timer.h"
+
+namespace {
+    using namespace mongo;
+
+    TEST(BSONScan, CStringLengthAllAlignments) {
+        char buf[128];
+        for (int start = 0; start < 32; start++) {
+            for (int len = 0; len < 64; len++) {
+                memset(buf, 'x', sizeof(buf));
+                buf[start + len] = '\0';
+                const char *p = buf + start;
+                ASSERT_EQUALS(len, bsonscan::cstringLength(p, buf + sizeof(buf)));
+                ASSERT_EQUALS(len, bsonscan::cstringLength(p, p + len + 1));
+                // The NUL is at end, which is outside the range.
+                ASSERT_EQUALS(-1, bsonscan::cstringLength(p, p + len));
+            }
+        }
+    }
+
+    TEST(BSONScan, CStringLengthRandom) {
+        PseudoRandom r(17);
+        char buf[256];
+        for (int i = 0; i < 10000; i++) {
+            const int start = r.nextInt32(32);
+            const int n = r.nextInt32(200) + 1;
+            for (int j = 0; j < n; j++) {
+                buf[start + j] = r.nextInt32(16) == 0 ? '\0' : 'a' + r.nextInt32(26);
+            }
+            const char *p = buf + start;
+            const void *nul = memchr(p, 0, n);
+            const long long expected = nul != NULL ? static_cast<const char *>(nul) - p : -1;
+            ASSERT_EQUALS(expected, bsonscan::cstringLength(p, p + n));
+        }
+    }
+
+    TEST(BSONScan, UTF8) {
+        ASSERT_TRUE(bsonscan::isValidUTF8("", 0));
+        ASSERT_TRUE(bsonscan::isValidUTF8("abc", 3));
+        // Long enough runs to go through the 16 byte path, with multibyte characters straddling
+        // the blocks.
+        const string ascii(40, 'a');
+        const string twoByte = "\xc2\xa2";
+        const string threeByte = "\xe2\x82\xac";
+        const string fourByte = "\xf0\xa4\xad\xa2";
+        for (size_t i = 0; i <= ascii.size(); i++) {
+            for (int k = 0; k < 3; k++) {
+                const string &mb = k == 0 ? twoByte : k == 1 ? threeByte : fourByte;
+                string s = ascii.substr(0, i) + mb + ascii.substr(i);
+                ASSERT_TRUE(bsonscan::isValidUTF8(s.data(), s.size()));
+                ASSERT_TRUE(isValidUTF8(s));
+                // Truncated.
+                ASSERT_FALSE(bsonscan::isValidUTF8(s.data(), i + mb.size() - 1));
+                // Missing a continuation byte.
+                s.erase(i + mb.size() - 1, 1);
+                ASSERT_FALSE(bsonscan::isValidUTF8(s.data(), s.size()));
+            }
+        }
+        ASSERT_FALSE(bsonscan::isValidUTF8("\x80", 1));
+        ASSERT_FALSE(bsonscan::isValidUTF8("\xc0\x80", 2));
+        ASSERT_FALSE(bsonscan::isValidUTF8("\xc1\xbf", 2));
+        ASSERT_FALSE(bsonscan::isValidUTF8("\xf5\x80\x80\x80", 4));
+        ASSERT_FALSE(bsonscan::isValidUTF8("\xff", 1));
+    }
+
+    TEST(BSONScan, GetField) {
+        BSONObjBuilder b;
+        for (int i = 0; i < 40; i++) {
+            b.append(string(i, 'f') + "x", i);
+        }
+        BSONObj o = b.obj();
+        for (int i = 0; i < 40; i++) {
+            ASSERT_EQUALS(i, o.getField(string(i, 'f') + "x").numberInt());
+            // Prefixes and extensions of a field name don't match it.
+            ASSERT_TRUE(o.getField(string(i, 'f')).eoo());
+            ASSERT_TRUE(o.getField(string(i, 'f') + "xx").eoo());
+        }
+        ASSERT_TRUE(BSONObj().getField("a").eoo());
+        ASSERT_EQUALS(3, BSON("a" << BSON("b" << BSON("c" << 3))).getFieldDotted("a.b.c").numberInt());
+    }
+
+    TEST(BSONScan, GetFieldStopsAtObjectEnd) {
+        // An object missing its terminating EOO, followed by more non-zero bytes.
+        BSONObj full = BSON("a" << 1 << "b" << 2);
+        std::vector<char> buf(full.objdata(), full.objdata() + full.objsize());
+        buf.back() = 'c';
+        buf.insert(buf.end(), 64, 'c');
+        const int size = full.objsize() - 1;
+        memcpy(&buf[0], &size, 4);
+        BSONObj o(&buf[0]);
+        ASSERT_EQUALS(2, o.getField("b").numberInt());
+        ASSERT_TRUE(o.getField("c").eoo());
+    }
+
+    // Document shapes from our insert and matcher workloads.
+
+    BSONObj smallDocument() {
+        return BSON("_id" << OID::gen() << "name" << "Jane Doe" << "age" << 37
+                    << "email" << "jane.doe@example.com" << "active" << true
+                    << "created" << Date_t(1371040000000ULL) << "score" << 98.6);
+    }
+
+    BSONObj wideDocument() {
+        BSONObjBuilder b;
+        b.append("_id", 1);
+        for (int i = 0; i < 100; i++) {
+            b.append(string(mongoutils::str::stream() << "attribute_" << i), i);
+        }
+        return b.obj();
+    }
+
+    BSONObj nestedDocument() {
+        return BSON("_id" << 1
+                    << "user" << BSON("name" << "jdoe"
+                                      << "address" << BSON("street" << "100 Main St"
+                                                           << "city" << "Lexington"
+                                                           << "zip" << "02421"))
+                    << "tags" << BSON_ARRAY("a" << "b" << "c")
+                    << "history" << BSON_ARRAY(BSON("t" << 1 << "v" << 2) << BSON("t" << 2 << "v" << 3)));
+    }
+
+    BSONObj stringDocument() {
+        BSONObjBuilder b;
+        b.append("_id", 1);
+        for (int i = 0; i < 10; i++) {
+            b.append(string(mongoutils::str::stream() << "paragraph" << i), string(200, 'a' + i));
+        }
+        return b.obj();
+    }
+
+    // What getField() did before, for comparison.
+    BSONElement iteratorGetField(const BSONObj &o, const StringData &name) {
+        BSONObjIterator i(o);
+        while (i.more()) {
+            BSONElement e = i.next();
+            if (name == e.fieldName()) {
+                return e;
+            }
+        }
+        return BSONElement();
+    }
+
+    template<typename F>
+    unsigned long long timeLookups(const BSONObj &o, const char *name, F getField) {
+        const int N = 200000;
+        Timer t;
+        long long sum = 0;
+        for (int i = 0; i < N; i++) {
+            sum += getField(o, name).size();
+        }
+        ASSERT_NOT_EQUALS(0, sum);
+        return t.micros();
+    }
+
+    BSONElement kernelGetField(const BSONObj &o, const StringData &name) {
+        return o.getField(name);
+    }
+
+#if !defined(_DEBUG)
+    TEST(BSONScan, PerfGetField) {
+        const BSONObj small = smallDocument();
+        const BSONObj wide = wideDocument();
+        const BSONObj nested = nestedDocument();
+        const struct {
+            const char *shape;
+            const BSONObj &o;
+            const char *field;
+        } cases[] = {
+            { "small, first field", small, "_id" },
+            { "small, last field", small, "score" },
+            { "wide, last field", wide, "attribute_99" },
+            { "wide, missing field", wide, "attribute_100" },
+            { "nested, last field", nested, "history" },
+        };
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            const unsigned long long iterator = timeLookups(cases[i].o, cases[i].field, iteratorGetField);
+            const unsigned long long kernel = timeLookups(cases[i].o, cases[i].field, kernelGetField);
+            log() << "getField " << cases[i].shape << ":\titerator " << iterator
+                  << "us\tscan " << kernel << "us" << std::endl;
+        }
+    }
+
+    TEST(BSONScan, PerfValidate) {
+        const BSONObj docs[] = { smallDocument(), wideDocument(), nestedDocument(), stringDocument() };
+        const char *shapes[] = { "small", "wide", "nested", "strings" };
+        for (size_t i = 0; i < sizeof(docs) / sizeof(docs[0]); i++) {
+            const int N = 100000;
+            Timer t;
+            for (int j = 0; j < N; j++) {
+                ASSERT_OK(validateBSON(docs[i].objdata(), docs[i].objsize()));
+            }
+            const unsigned long long micros = t.micros();
+            log() << "validateBSON " << shapes[i] << " (" << docs[i].objsize() << " bytes):\t"
+                  << (micros * 1000 / N) << "ns/doc, "
+                  << (docs[i].objsize() * (unsigned long long) N / (micros + 1)) << "MB/s" << std::endl;
+        }
+    }
+
+    TEST(BSONScan, PerfUTF8) {
+        const string ascii(1024, 'a');
+        string mixed;
+        while (mixed.size() < 1024) {
+            mixed += "caf\xc3\xa9 na\xc3\xafve \xe2\x82\xac";
+        }
+        const int N = 100000;
+        const string *inputs[] = { &ascii, &mixed };
+        const char *names[] = { "ascii", "mixed" };
+        for (int k = 0; k < 2; k++) {
+            const string &s = *inputs[k];
+            Timer t;
+            for (int i = 0; i < N; i++) {
+                ASSERT_TRUE(bsonscan::isValidUTF8(s.data(), s.size()));
+            }
+            const unsigned long long micros = t.micros();
+            log() << "isValidUTF8 1KB " << names[k] << ":\t" << (micros * 1000 / N) << "ns" << std::endl;
+        }
+    }
+#endif
+
+} // namespace
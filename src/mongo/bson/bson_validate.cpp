@@ -18,6 +18,7 @@
 #include <deque>
 
 #include "mongo/bson/bson_validate.h"
+#include "mongo/bson/bson_scan.h"
 #include "mongo/bson/oid.h"
 
 namespace mongo {
@@ -43,10 +44,12 @@ namespace mongo {
             }
 
             Status readCString( StringData* out ) {
-                const void* x = memchr( _buffer + _position, 0, _maxLength - _position );
-                if ( !x )
+                if ( _position >= _maxLength )
                     return Status( ErrorCodes::InvalidBSON, "no end of c-string" );
-                uint64_t len = static_cast<uint64_t>( static_cast<const char*>(x) - ( _buffer + _position ) );
+                const long long x = bsonscan::cstringLength( _buffer + _position, _buffer + _maxLength );
+                if ( x < 0 )
+                    return Status( ErrorCodes::InvalidBSON, "no end of c-string" );
+                uint64_t len = static_cast<uint64_t>( x );
 
                 StringData data( _buffer + _position, len );
                 _position += len + 1;
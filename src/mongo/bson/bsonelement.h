@@ -447,6 +447,14 @@ namespace mongo {
             }
         }
 
+        struct FieldNameSizeTag {}; // For disambiguation with the constructor taking maxLen.
+
+        /** For callers that already found the end of the field name, fieldNameSize includes
+            the NUL terminator. */
+        BSONElement(const char *d, int fieldNameSize, FieldNameSizeTag) :
+            data(d), fieldNameSize_(fieldNameSize), totalSize(-1) {
+        }
+
         explicit BSONElement(const char *d) : data(d) {
             fieldNameSize_ = -1;
             totalSize = -1;
@@ -63,6 +63,12 @@ namespace mongo {
             _b.skip( 4 );
         }
 
+        /** @param arena the buffer comes from it while it can provide it, see arenaObj() */
+        BSONObjBuilder(BuilderArena *arena, int initsize=512) : _b(_buf), _buf(initsize + sizeof(unsigned), arena), _offset( sizeof(unsigned) ), _s( this ) , _tracker(0) , _doneCalled(false) {
+            _b.appendNum((unsigned)0); // ref-count
+            _b.skip(4);
+        }
+
         BSONObjBuilder( const BSONSizeTracker & tracker ) : _b(_buf) , _buf(tracker.getSize() + sizeof(unsigned) ), _offset( sizeof(unsigned) ), _s( this ) , _tracker( (BSONSizeTracker*)(&tracker) ) , _doneCalled(false) {
             _b.appendNum((unsigned)0); // ref-count
             _b.skip(4);
@@ -571,6 +577,16 @@ namespace mongo {
             return BSONObj(h);
         }
 
+        /** Like obj(), except that if the buffer came from an arena the object doesn't own it,
+            and is only valid as long as the arena keeps that memory.
+        */
+        BSONObj arenaObj() {
+            if ( _b.inArena() ) {
+                return done();
+            }
+            return obj();
+        }
+
         /** Fetch the object we have built.
             BSONObjBuilder still frees the object when the builder goes out of
             scope -- very important to keep in mind.  Use obj() if you
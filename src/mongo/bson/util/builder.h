@@ -63,36 +63,82 @@ namespace mongo {
     template <typename Allocator>
     class StringBuilderImpl;
 
+    /**
+     * Memory that builders can draw from instead of the heap.  The arena, not the builder, decides
+     * when the memory goes away, so a buffer drawn from one can't be decoupled.
+     */
+    class BuilderArena {
+    public:
+        /** @return sz bytes, or NULL if the arena can't provide them. */
+        virtual void* allocate(size_t sz) = 0;
+    protected:
+        ~BuilderArena() {}
+    };
+
     class TrivialAllocator { 
     public:
-        void* Malloc(size_t sz) { return malloc(sz); }
-        void* Realloc(void *p, size_t sz) { return realloc(p, sz); }
-        void Free(void *p) { free(p); }
+        /** @param arena if not NULL, buffers come from it while it can provide them */
+        explicit TrivialAllocator(BuilderArena *arena = NULL) : _arena(arena), _arenaBuf(NULL), _arenaSize(0) {}
+        void* Malloc(size_t sz) {
+            if ( _arena ) {
+                void *p = _arena->allocate(sz);
+                if ( p ) {
+                    _arenaBuf = p;
+                    _arenaSize = sz;
+                    return p;
+                }
+            }
+            return malloc(sz);
+        }
+        void* Realloc(void *p, size_t sz) {
+            if ( inArena(p) ) {
+                const size_t oldSize = _arenaSize;
+                void *d = Malloc(sz);
+                if ( d == 0 )
+                    msgasserted( 17056 , "out of memory TrivialAllocator::Realloc" );
+                memcpy(d, p, oldSize < sz ? oldSize : sz);
+                return d;
+            }
+            return realloc(p, sz);
+        }
+        void Free(void *p) {
+            if ( !inArena(p) )
+                free(p);
+        }
+        bool inArena(const void *p) const { return p != NULL && p == _arenaBuf; }
+    private:
+        BuilderArena *_arena;
+        void *_arenaBuf;
+        size_t _arenaSize;
     };
 
     class StackAllocator {
     public:
         enum { SZ = 512 };
+        /** @param overflow if not NULL, buffers that don't fit on the stack come from it */
+        explicit StackAllocator(BuilderArena *overflow = NULL) : _heap(overflow) {}
         void* Malloc(size_t sz) {
             if( sz <= SZ ) return buf;
-            return malloc(sz); 
+            return _heap.Malloc(sz); 
         }
         void* Realloc(void *p, size_t sz) { 
             if( p == buf ) {
                 if( sz <= SZ ) return buf;
-                void *d = malloc(sz);
+                void *d = _heap.Malloc(sz);
                 if ( d == 0 )
                     msgasserted( 15912 , "out of memory StackAllocator::Realloc" );
                 memcpy(d, p, SZ);
                 return d;
             }
-            return realloc(p, sz); 
+            return _heap.Realloc(p, sz); 
         }
         void Free(void *p) { 
             if( p != buf )
-                free(p); 
+                _heap.Free(p); 
         }
+        bool inArena(const void *p) const { return _heap.inArena(p); }
     private:
+        TrivialAllocator _heap;
         char buf[SZ];
     };
 
@@ -104,15 +150,11 @@ namespace mongo {
         Allocator al;
     public:
         _BufBuilder(int initsize = 512) : size(initsize) {
-            if ( size > 0 ) {
-                data = (char *) al.Malloc(size);
-                if( data == 0 )
-                    msgasserted(10000, "out of memory BufBuilder");
-            }
-            else {
-                data = 0;
-            }
-            l = 0;
+            init();
+        }
+        /** Draws the buffer from "arena" while it can provide it, see BuilderArena. */
+        _BufBuilder(int initsize, BuilderArena *arena) : al(arena), size(initsize) {
+            init();
         }
         ~_BufBuilder() { kill(); }
 
@@ -147,7 +189,13 @@ namespace mongo {
         const char* buf() const { return data; }
 
         /* assume ownership of the buffer - you must then free() it */
-        void decouple() { data = 0; }
+        void decouple() {
+            massert( 17057 , "can't decouple a buffer drawn from an arena" , !inArena() );
+            data = 0;
+        }
+
+        /** @return true if the buffer currently comes from a BuilderArena */
+        bool inArena() const { return al.inArena(data); }
 
         void appendUChar(unsigned char j) {
             *((unsigned char*)grow(sizeof(unsigned char))) = j;
@@ -212,6 +260,18 @@ namespace mongo {
         }
 
     private:
+        void init() {
+            if ( size > 0 ) {
+                data = (char *) al.Malloc(size);
+                if( data == 0 )
+                    msgasserted(10000, "out of memory BufBuilder");
+            }
+            else {
+                data = 0;
+            }
+            l = 0;
+        }
+
         /* "slow" portion of 'grow()'  */
         void NOINLINE_DECL grow_reallocate(int newLen) {
             int a = 64;
@@ -247,6 +307,8 @@ namespace mongo {
     class StackBufBuilder : public _BufBuilder<StackAllocator> { 
     public:
         StackBufBuilder() : _BufBuilder<StackAllocator>(StackAllocator::SZ) { }
+        /** Buffers that outgrow the stack come from "overflow" while it can provide them. */
+        explicit StackBufBuilder(BuilderArena *overflow) : _BufBuilder<StackAllocator>(StackAllocator::SZ, overflow) { }
         void decouple(); // not allowed. not implemented.
     };
 
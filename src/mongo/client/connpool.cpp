@@ -22,6 +22,7 @@
 #include "connpool.h"
 #include "syncclusterconnection.h"
 #include "../s/shard.h"
+#include "mongo/client/dbclient_multiplexed.h"
 #include "mongo/client/dbclient_rs.h"
 
 namespace mongo {
@@ -173,6 +174,7 @@ namespace mongo {
     DBConnectionPool::DBConnectionPool() 
         : _mutex("DBConnectionPool") , 
           _name( "dbconnectionpool" ) , 
+          _multiplexed( false ) , 
           _hooks( new list<DBConnectionHook*>() ) { 
     }
 
@@ -204,6 +206,19 @@ namespace mongo {
         return conn;
     }
 
+    DBClientBase* DBConnectionPool::_connect( const ConnectionString& cs , string& errmsg , double socketTimeout ) {
+        if ( _multiplexed && cs.type() == ConnectionString::MASTER ) {
+            DBClientMultiplexedConnection * c = new DBClientMultiplexedConnection( socketTimeout );
+            LOG(1) << "creating new multiplexed connection to:" << cs.getServers()[0] << endl;
+            if ( ! c->connect( cs.getServers()[0] , errmsg ) ) {
+                delete c;
+                return 0;
+            }
+            return c;
+        }
+        return cs.connect( errmsg, socketTimeout );
+    }
+
     DBClientBase* DBConnectionPool::get(const ConnectionString& url, double socketTimeout) {
         DBClientBase * c = _get( url.toString() , socketTimeout );
         if ( c ) {
@@ -218,7 +233,7 @@ namespace mongo {
         }
 
         string errmsg;
-        c = url.connect( errmsg, socketTimeout );
+        c = _connect( url, errmsg, socketTimeout );
         uassert( 13328 ,  _name + ": connect failed " + url.toString() + " : " + errmsg , c );
 
         return _finishCreate( url.toString() , socketTimeout , c );
@@ -241,7 +256,7 @@ namespace mongo {
         ConnectionString cs = ConnectionString::parse( host , errmsg );
         uassert( 13071 , (string)"invalid hostname [" + host + "]" + errmsg , cs.isValid() );
 
-        c = cs.connect( errmsg, socketTimeout );
+        c = _connect( cs, errmsg, socketTimeout );
         if ( ! c )
             throw SocketException( SocketException::CONNECT_ERROR , host , 11002 , str::stream() << _name << " error: " << errmsg );
         return _finishCreate( host , socketTimeout , c );
@@ -140,6 +140,12 @@ namespace mongo {
         /** right now just controls some asserts.  defaults to "dbconnectionpool" */
         void setName( const string& name ) { _name = name; }
 
+        /**
+         * If set, new connections to single servers are DBClientMultiplexedConnections, which
+         * share a few sockets per host (see DBClientMultiplexedConnection::setSocketsPerHost()).
+         */
+        void setMultiplexed( bool multiplexed ) { _multiplexed = multiplexed; }
+
         void onCreate( DBClientBase * conn );
         void onHandedOut( DBClientBase * conn );
         void onDestroy( DBClientBase * conn );
@@ -187,6 +193,8 @@ namespace mongo {
         DBClientBase* _get( const string& ident , double socketTimeout );
 
         DBClientBase* _finishCreate( const string& ident , double socketTimeout, DBClientBase* conn );
+
+        DBClientBase* _connect( const ConnectionString& cs , string& errmsg , double socketTimeout );
         
         struct PoolKey {
             PoolKey( const std::string& i , double t ) : ident( i ) , timeout( t ) {}
@@ -202,6 +210,7 @@ namespace mongo {
 
         mongo::mutex _mutex;
         string _name;
+        bool _multiplexed;
         
         PoolMap _pools;
 
@@ -0,0 +1,403 @@
+// dbclient_multiplexed.cpp
+
+/*    Copyright 2013 Tokutek Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/pch.h"
+
+#include "mongo/client/dbclient_multiplexed.h"
+
+#include <boost/thread/thread_time.hpp>
+
+#include "mongo/client/sasl_client_authenticate.h"
+#include "mongo/db/cmdline.h"
+#include "mongo/db/dbmessage.h"
+#include "mongo/db/namespacestring.h"
+#include "mongo/util/mongoutils/str.h"
+
+namespace mongo {
+
+    MultiplexedPort::MultiplexedPort(int logLevel) :
+        // No socket timeout, each call has its own.
+        _port(new MessagingPort(0, logLevel)),
+        _sendMutex("MultiplexedPort::send"),
+        _mutex("MultiplexedPort"),
+        _reading(false),
+        _failed(false),
+        _authMutex("MultiplexedPort::auth") {
+    }
+
+    bool MultiplexedPort::connect(const HostAndPort& server, string& errmsg) {
+        _remote = server.toString();
+        _addr.reset(new SockAddr(server.host().c_str(), server.port()));
+        if (server.host().empty() || _addr->getAddr() == "0.0.0.0" || !_port->connect(*_addr)) {
+            errmsg = mongoutils::str::stream() << "couldn't connect to server " << _remote;
+            _failed = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool MultiplexedPort::failed() const {
+        scoped_lock lk(_mutex);
+        return _failed;
+    }
+
+    void MultiplexedPort::throwFailed() const {
+        throw SocketException(SocketException::FAILED_STATE, _remote);
+    }
+
+    void MultiplexedPort::setFailed() {
+        _failed = true;
+        // Nothing more will be read, so no late replies either.
+        _abandoned.clear();
+        _replied.notify_all();
+    }
+
+    void MultiplexedPort::throwTimedOut(unsigned id) {
+        _waiting.erase(id);
+        // The reply may still come, it's dropped when it does.
+        _abandoned.insert(id);
+        throw SocketException(SocketException::RECV_TIMEOUT, _remote);
+    }
+
+    void MultiplexedPort::send(Message& toSend) {
+        SimpleMutex::scoped_lock lk(_sendMutex);
+        try {
+            toSend.send(*_port, "multiplexed");
+        }
+        catch (SocketException&) {
+            scoped_lock lk(_mutex);
+            setFailed();
+            throw;
+        }
+    }
+
+    void MultiplexedPort::say(Message& toSend) {
+        verify(!toSend.empty());
+        toSend.header()->id = nextMessageId();
+        toSend.header()->responseTo = -1;
+        send(toSend);
+    }
+
+    void MultiplexedPort::call(Message& toSend, Message& response, double timeoutSecs) {
+        verify(!toSend.empty());
+        // The id has to be registered before the request goes out, since another caller may
+        // read the reply as soon as it does.
+        const unsigned id = nextMessageId();
+        toSend.header()->id = id;
+        toSend.header()->responseTo = -1;
+
+        const bool hasDeadline = timeoutSecs > 0;
+        const boost::system_time deadline = boost::get_system_time() +
+                boost::posix_time::microseconds(static_cast<long long>(timeoutSecs * 1000000));
+
+        Waiter w;
+        {
+            scoped_lock lk(_mutex);
+            if (_failed) {
+                throwFailed();
+            }
+            _waiting[id] = &w;
+        }
+        try {
+            send(toSend);
+        }
+        catch (...) {
+            scoped_lock lk(_mutex);
+            _waiting.erase(id);
+            throw;
+        }
+
+        while (true) {
+            {
+                scoped_lock lk(_mutex);
+                while (!w.done && !_failed && _reading) {
+                    if (!hasDeadline) {
+                        _replied.wait(lk.boost());
+                    }
+                    else if (!_replied.timed_wait(lk.boost(), deadline) && !w.done) {
+                        // Only this call times out, the others keep waiting for theirs.
+                        throwTimedOut(id);
+                    }
+                }
+                if (w.done) {
+                    response = w.reply;
+                    return;
+                }
+                if (_failed) {
+                    _waiting.erase(id);
+                    throwFailed();
+                }
+                _reading = true;
+            }
+
+            // Read without the lock, so other callers can send their requests meanwhile.  A
+            // reply that has started arriving is read whole, so the socket stays in step with
+            // the message boundaries even if that takes past the deadline.
+            bool readable = true;
+            Message m;
+            bool ok = false;
+            try {
+                if (hasDeadline) {
+                    const long long micros = (deadline - boost::get_system_time()).total_microseconds();
+                    readable = micros > 0 && _port->psock->waitForReadable(micros / 1000000.0);
+                }
+                if (readable) {
+                    ok = _port->recv(m);
+                }
+            }
+            catch (SocketException& e) {
+                LOG(1) << "multiplexed connection to " << _remote << " failed: " << e.toString() << endl;
+            }
+
+            scoped_lock lk(_mutex);
+            _reading = false;
+            // Let someone else take over reading.
+            _replied.notify_all();
+            if (!readable) {
+                throwTimedOut(id);
+            }
+            if (!ok) {
+                setFailed();
+            }
+            else {
+                const unsigned responseTo = m.header()->responseTo;
+                map<unsigned, Waiter*>::iterator it = _waiting.find(responseTo);
+                if (it != _waiting.end()) {
+                    it->second->reply = m;
+                    it->second->done = true;
+                    _waiting.erase(it);
+                }
+                else if (_abandoned.erase(responseTo) > 0) {
+                    LOG(1) << "multiplexed connection to " << _remote << " dropping late reply to request "
+                           << responseTo << endl;
+                }
+                else {
+                    warning() << "multiplexed connection to " << _remote << " got a reply to unknown request "
+                              << responseTo << ", dropping it" << endl;
+                }
+            }
+        }
+    }
+
+    namespace {
+
+        struct HostPorts {
+            HostPorts() : next(0) {}
+            vector<boost::shared_ptr<MultiplexedPort> > ports;
+            unsigned next;
+        };
+
+        mongo::mutex portsMutex("multiplexedPorts");
+        map<string, HostPorts> portsByHost;
+        unsigned socketsPerHost = 0;
+
+        /**
+         * Picks one of server's shared sockets round-robin, connecting a new one if there aren't
+         * socketsPerHost yet, or if the one picked has failed.
+         */
+        boost::shared_ptr<MultiplexedPort> getPort(const HostAndPort& server, int logLevel,
+                                                   string& errmsg) {
+            const string key = server.toString();
+            size_t slot;
+            {
+                scoped_lock lk(portsMutex);
+                HostPorts& h = portsByHost[key];
+                if (h.ports.size() < socketsPerHost || h.ports.empty()) {
+                    slot = h.ports.size();
+                }
+                else {
+                    slot = h.next++ % h.ports.size();
+                    if (!h.ports[slot]->failed()) {
+                        return h.ports[slot];
+                    }
+                }
+            }
+
+            // Connect without the lock, this can take a while.
+            boost::shared_ptr<MultiplexedPort> port(new MultiplexedPort(logLevel));
+            if (!port->connect(server, errmsg)) {
+                return boost::shared_ptr<MultiplexedPort>();
+            }
+
+            scoped_lock lk(portsMutex);
+            HostPorts& h = portsByHost[key];
+            if (slot == h.ports.size()) {
+                h.ports.push_back(port);
+            }
+            else if (slot < h.ports.size() && h.ports[slot]->failed()) {
+                h.ports[slot] = port;
+            }
+            // Otherwise someone else filled the slot first, and port is only used by this
+            // connection.
+            return port;
+        }
+
+        /**
+         * @return true if toSend runs a command that can take long enough to hold up everything
+         *         pipelined behind it on a shared socket.
+         */
+        bool isLongCommand(Message& toSend) {
+            DbMessage dm(toSend);
+            QueryMessage qm(dm);
+            if (!NamespaceString::isCommand(qm.ns)) {
+                return false;
+            }
+            BSONObj cmd = qm.query;
+            if (cmd.hasField("$query")) {
+                cmd = cmd.getObjectField("$query");
+            }
+            else if (cmd.hasField("query") && cmd["query"].isABSONObj()) {
+                cmd = cmd.getObjectField("query");
+            }
+            static const char* const longCommands[] = {
+                "moveChunk", "splitChunk", "splitVector", "medianKey", "dataSize",
+                "mapreduce", "mapReduce", "mapreduce.shardedfinish", "aggregate",
+                "copydb", "clone", "cloneCollection", "compact", "reIndex", "repairDatabase",
+                "dropDatabase", "validate", "filemd5", "eval", "$eval", "group"
+            };
+            const StringData name = cmd.firstElementFieldName();
+            for (size_t i = 0; i < sizeof(longCommands) / sizeof(longCommands[0]); i++) {
+                if (name == longCommands[i]) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    } // namespace
+
+    void DBClientMultiplexedConnection::setSocketsPerHost( unsigned n ) {
+        scoped_lock lk(portsMutex);
+        socketsPerHost = n;
+    }
+
+    unsigned DBClientMultiplexedConnection::getSocketsPerHost() {
+        scoped_lock lk(portsMutex);
+        return socketsPerHost;
+    }
+
+    bool DBClientMultiplexedConnection::connect(const HostAndPort& server, string& errmsg) {
+#ifdef MONGO_SSL
+        if ( cmdLine.sslOnNormalPorts ) {
+            return DBClientConnection::connect( server, errmsg );
+        }
+#endif
+        if ( getSocketsPerHost() == 0 ) {
+            return DBClientConnection::connect( server, errmsg );
+        }
+        _server = server;
+        _serverString = _server.toString();
+        _shared = getPort( _server, _logLevel, errmsg );
+        if ( !_shared ) {
+            _failed = true;
+            return false;
+        }
+        return true;
+    }
+
+    void DBClientMultiplexedConnection::useOwnSocket() {
+        LOG(2) << "multiplexed connection to " << _serverString << " switching to its own socket" << endl;
+        string errmsg;
+        if ( !_connect( errmsg ) ) {
+            p.reset();
+            _failed = true;
+            throw SocketException( SocketException::CONNECT_ERROR , toString() , 11002 , errmsg );
+        }
+        _shared.reset();
+        for( map<string, BSONObj>::const_iterator i = authCache.begin(); i != authCache.end(); i++ ) {
+            DBClientConnection::_auth( i->second );
+        }
+    }
+
+    void DBClientMultiplexedConnection::_auth(const BSONObj& params) {
+        if ( isMultiplexed() ) {
+            scoped_lock lk( _shared->authMutex() );
+            const BSONObj& current = _shared->authParams();
+            if ( current.isEmpty() ) {
+                DBClientConnection::_auth( params );
+                _shared->setAuthParams( params );
+                return;
+            }
+            if ( current.woCompare( params ) == 0 ) {
+                authCache[params[saslCommandPrincipalSourceFieldName].str()] = params.getOwned();
+                return;
+            }
+        }
+        if ( isMultiplexed() ) {
+            useOwnSocket();
+        }
+        DBClientConnection::_auth( params );
+    }
+
+    bool DBClientMultiplexedConnection::call( Message &toSend, Message &response, bool assertOk , string * actualServer ) {
+        checkConnection();
+        if ( isMultiplexed() && toSend.operation() == dbQuery &&
+             ( ( toSend.header()->dataAsInt() & QueryOption_Exhaust ) || isLongCommand( toSend ) ) ) {
+            useOwnSocket();
+        }
+        if ( !isMultiplexed() ) {
+            return DBClientConnection::call( toSend, response, assertOk, actualServer );
+        }
+        try {
+            _shared->call( toSend, response, _so_timeout );
+        }
+        catch( SocketException & ) {
+            _failed = true;
+            throw;
+        }
+        return true;
+    }
+
+    void DBClientMultiplexedConnection::say( Message &toSend, bool isRetry , string * actualServer ) {
+        checkConnection();
+        if ( isMultiplexed() && toSend.operation() == dbKillCursors ) {
+            try {
+                _shared->say( toSend );
+            }
+            catch( SocketException & ) {
+                _failed = true;
+                throw;
+            }
+            return;
+        }
+        if ( isMultiplexed() ) {
+            useOwnSocket();
+        }
+        DBClientConnection::say( toSend, isRetry, actualServer );
+    }
+
+    void DBClientMultiplexedConnection::sayPiggyBack( Message &toSend ) {
+        if ( isMultiplexed() ) {
+            say( toSend );
+            return;
+        }
+        DBClientConnection::sayPiggyBack( toSend );
+    }
+
+    bool DBClientMultiplexedConnection::recv( Message &m ) {
+        uassert( 17061, "can't wait for unrequested replies on a multiplexed connection", !isMultiplexed() );
+        return DBClientConnection::recv( m );
+    }
+
+    uint64_t DBClientMultiplexedConnection::getSockCreationMicroSec() const {
+        if ( isMultiplexed() ) {
+            return _shared->getSockCreationMicroSec();
+        }
+        return DBClientConnection::getSockCreationMicroSec();
+    }
+
+} // namespace mongo
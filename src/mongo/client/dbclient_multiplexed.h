@@ -0,0 +1,164 @@
+/** @file dbclient_multiplexed.h */
+
+/*    Copyright 2013 Tokutek Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include <boost/thread/condition.hpp>
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/net/message_port.h"
+
+namespace mongo {
+
+    /**
+     * One socket to a server, shared by many DBClientMultiplexedConnections.  Requests from
+     * different threads are pipelined on it, each tagged with its own requestID, and replies are
+     * handed back to their requests by responseTo.  The server works through a connection's
+     * requests in order, so this trades some head-of-line blocking for far fewer sockets, and
+     * far fewer threads on the server.
+     *
+     * There's no reader thread: a caller waiting for its reply reads replies off the socket,
+     * handing out the ones that aren't its own, until its own arrives.  Meanwhile other callers
+     * wait to be handed theirs, or to take over reading.
+     *
+     * The socket itself has no timeout.  Each call has its own, and when it expires only that
+     * call gives up; its reply is dropped if it arrives later.
+     */
+    class MultiplexedPort : boost::noncopyable {
+    public:
+        explicit MultiplexedPort(int logLevel);
+
+        bool connect(const HostAndPort& server, string& errmsg);
+
+        /**
+         * Sends toSend and waits up to timeoutSecs for its reply, or forever if it's 0.
+         * @throw SocketException RECV_TIMEOUT if the reply doesn't come in time, which leaves
+         *        the port usable, or any other if the socket fails, after which it isn't.
+         */
+        void call(Message& toSend, Message& response, double timeoutSecs);
+
+        /** Sends a message that gets no reply. */
+        void say(Message& toSend);
+
+        bool failed() const;
+        uint64_t getSockCreationMicroSec() const { return _port->getSockCreationMicroSec(); }
+
+        /**
+         * The socket is only ever authenticated as one principal, so that connections sharing it
+         * can't pick up each other's privileges.  Hold authMutex() to authenticate it.
+         */
+        mongo::mutex& authMutex() { return _authMutex; }
+        const BSONObj& authParams() const { return _authParams; }
+        void setAuthParams(const BSONObj& params) { _authParams = params.getOwned(); }
+
+    private:
+        struct Waiter {
+            Waiter() : done(false) {}
+            bool done;
+            Message reply;
+        };
+
+        void send(Message& toSend);
+        void throwFailed() const;
+        // Marks the port unusable and wakes up everyone waiting on it.  Must hold _mutex.
+        void setFailed();
+        // Gives up waiting for request id.  Must hold _mutex.
+        void throwTimedOut(unsigned id);
+
+        scoped_ptr<MessagingPort> _port;
+        scoped_ptr<SockAddr> _addr;
+        string _remote;
+
+        // Held while writing a message, so messages aren't interleaved on the socket.
+        SimpleMutex _sendMutex;
+
+        // Protects everything below.
+        mutable mongo::mutex _mutex;
+        boost::condition _replied;
+        map<unsigned, Waiter*> _waiting; // by requestID
+        set<unsigned> _abandoned; // requestIDs that timed out, their replies are dropped when
+                                  // they come, or when the port fails
+        bool _reading;
+        bool _failed;
+
+        mongo::mutex _authMutex;
+        BSONObj _authParams;
+    };
+
+    /**
+     * A logical connection to a mongod that shares a MultiplexedPort with other connections to
+     * the same host, instead of having a socket of its own.
+     *
+     * Only requests that don't depend on the server's per-connection state can share a socket.
+     * When a connection sends one that does (a write, which may be followed by getLastError, or
+     * an exhaust query) or authenticates as a different principal than its socket, it opens a
+     * socket of its own and uses it from then on, like a DBClientConnection.  So do connections
+     * that reconnect after their shared socket failed, and ones that run a command that can take
+     * long (moveChunk, mapReduce...), which would hold up every request pipelined behind it.
+     */
+    class DBClientMultiplexedConnection : public DBClientConnection {
+    public:
+        using DBClientConnection::connect;
+
+        DBClientMultiplexedConnection(double so_timeout = 0) :
+            DBClientConnection(true, 0, so_timeout) {}
+
+        virtual bool connect(const HostAndPort& server, string& errmsg);
+
+        virtual void say( Message &toSend, bool isRetry = false , string * actualServer = 0 );
+        virtual bool recv( Message& m );
+        virtual bool call( Message &toSend, Message &response, bool assertOk = true , string * actualServer = 0 );
+
+        // Lazy queries read their reply with recv(), which needs a socket of our own.
+        virtual bool lazySupported() const { return !isMultiplexed(); }
+
+        virtual uint64_t getSockCreationMicroSec() const;
+
+        /**
+         * @return false once this connection has a socket of its own, which it gets from
+         *         useOwnSocket(), or from reconnecting.
+         */
+        bool isMultiplexed() const { return _shared && !p; }
+
+        /**
+         * Sets the number of sockets each host's multiplexed connections share.  0, the default,
+         * turns multiplexing off.
+         *
+         * The server answers a socket's requests one after the other, so any slow request that
+         * keeps sharing a socket (a query, count or getMore that runs long) holds up every
+         * request sent after it on that socket, until it finishes or its connection's timeout
+         * expires.  Only the commands known to run long get sockets of their own.
+         */
+        static void setSocketsPerHost( unsigned n );
+        static unsigned getSocketsPerHost();
+
+    protected:
+        virtual void _auth(const BSONObj& params);
+        virtual void sayPiggyBack( Message &toSend );
+
+    private:
+        // Stops sharing a socket: connects one of our own, and authenticates it like the shared
+        // one was.
+        void useOwnSocket();
+
+        boost::shared_ptr<MultiplexedPort> _shared;
+    };
+
+} // namespace mongo
@@ -20,7 +20,10 @@
 
 #include "mongo/client/dbclient_rs.h"
 
+#include <algorithm>
+#include <boost/thread/thread.hpp>
 #include <fstream>
+#include <limits>
 #include <memory>
 
 #include "mongo/base/init.h"
@@ -205,6 +208,8 @@ namespace mongo {
                             HostAndPort* lastHost /* in/out */,
                             bool* isPrimarySelected) {
         HostAndPort fallbackHost;
+        // a secondary that is falling behind, only used if nothing else matches
+        HostAndPort laggingHost;
 
         // Implicit: start from index 0 if lastHost doesn't exist anymore
         size_t nextNodeIndex = 0;
@@ -236,6 +241,14 @@ namespace mongo {
             }
 
             if (node.matchesTag(readPreferenceTag)) {
+                if (!node.ismaster && node.isFallingBehind()) {
+                    LOG(2) << "dbclient_rs not preferring " << node
+                           << ", replication lag has been growing (" << node.lagMillis
+                           << "ms, " << node.gtidLag << " GTIDs behind)" << endl;
+                    laggingHost = node.addr;
+                    continue;
+                }
+
                 // found an ok candidate; may not be local.
                 fallbackHost = node.addr;
                 *isPrimarySelected = node.ismaster;
@@ -250,6 +263,11 @@ namespace mongo {
             }
         }
 
+        if (fallbackHost.empty() && !laggingHost.empty()) {
+            fallbackHost = laggingHost;
+            *isPrimarySelected = false;
+        }
+
         if (!fallbackHost.empty()) {
             *lastHost = fallbackHost;
         }
@@ -387,6 +405,7 @@ namespace mongo {
     ReplicaSetMonitor::ReplicaSetMonitor( const string& name , const vector<HostAndPort>& servers )
         : _lock( "ReplicaSetMonitor instance" ),
           _checkConnectionLock( "ReplicaSetMonitor check connection lock" ),
+          _checkHostsLock( "ReplicaSetMonitor check hosts lock" ),
           _name( name ), _master(-1),
           _nextSlave(0), _failedChecks(0), _localThresholdMillis(cmdLine.defaultLocalThresholdMillis) {
 
@@ -668,6 +687,29 @@ namespace mongo {
         }
     }
 
+    namespace {
+        /**
+         * @return how many GTIDs the secondary's last GTID is behind the primary's, given as
+         *     replSetGetStatus reports them, or -1 if they weren't both handed out by the same
+         *     primary, which is when the distance between them means something.
+         */
+        long long _gtidDistance(const BSONElement& primaryGTID, const BSONElement& secondaryGTID) {
+            if (primaryGTID.type() != String || secondaryGTID.type() != String) {
+                return -1;
+            }
+            unsigned long long priPrimary, priSecondary, secPrimary, secSecondary;
+            if (sscanf(primaryGTID.valuestr(), "primary: %llu secondary: %llu",
+                       &priPrimary, &priSecondary) != 2 ||
+                sscanf(secondaryGTID.valuestr(), "primary: %llu secondary: %llu",
+                       &secPrimary, &secSecondary) != 2 ||
+                priPrimary != secPrimary) {
+                return -1;
+            }
+            return priSecondary > secSecondary ?
+                    static_cast<long long>(priSecondary - secSecondary) : 0;
+        }
+    }
+
     void ReplicaSetMonitor::_checkStatus( const string& hostAddr ) {
         BSONObj status;
 
@@ -697,11 +739,20 @@ namespace mongo {
             return;
         }
 
+        BSONObj primary;
+        BSONObj self;
         BSONObjIterator hi(status["members"].Obj());
         while (hi.more()) {
             BSONObj member = hi.next().Obj();
             string host = member["name"].String();
 
+            if (member["state"].numberInt() == 1) {
+                primary = member;
+            }
+            if (member["self"].trueValue()) {
+                self = member;
+            }
+
             int m = -1;
             if ((m = _find(host)) < 0) {
                 LOG(1) << "dbclient_rs _checkStatus couldn't _find(" << host << ')' << endl;
@@ -720,6 +771,24 @@ namespace mongo {
                 _nodes[m].ok = false;
             }
         }
+
+        // Each node reports its own lag, so that it's tracked once per check of that node, with
+        // its freshest view of its own progress.
+        if (!self.isEmpty() && !primary.isEmpty() && self["state"].numberInt() == 2 &&
+            self["optimeDate"].type() == Date && primary["optimeDate"].type() == Date) {
+            const long long lagMillis = std::max(0LL,
+                    static_cast<long long>(primary["optimeDate"].date().millis) -
+                    static_cast<long long>(self["optimeDate"].date().millis));
+            const long long gtidLag = _gtidDistance(primary["lastGTID"], self["lastGTID"]);
+
+            scoped_lock lk( _lock );
+            int m = _find_inlock(self["name"].String());
+            if (m >= 0) {
+                _nodes[m].recordLag(lagMillis, gtidLag);
+                LOG(2) << "dbclient_rs " << self["name"].String() << " is " << lagMillis
+                       << "ms, " << gtidLag << " GTIDs behind the primary" << endl;
+            }
+        }
     }
 
     NodeDiff ReplicaSetMonitor::_getHostDiff_inlock( const BSONObj& hostList ){
@@ -862,11 +931,36 @@ namespace mongo {
     }
     
 
+    /**
+     * Holds conn for a _checkConnection, waiting for any other check of it to finish first.
+     */
+    class ReplicaSetMonitor::CheckingConnection : boost::noncopyable {
+    public:
+        CheckingConnection( ReplicaSetMonitor* monitor, DBClientConnection* conn ) :
+            _monitor( monitor ), _conn( conn ) {
+            scoped_lock lk( _monitor->_checkConnectionLock );
+            while ( _monitor->_checkingConns.count( _conn ) ) {
+                _monitor->_checkConnectionDone.wait( lk.boost() );
+            }
+            _monitor->_checkingConns.insert( _conn );
+        }
+
+        ~CheckingConnection() {
+            scoped_lock lk( _monitor->_checkConnectionLock );
+            _monitor->_checkingConns.erase( _conn );
+            _monitor->_checkConnectionDone.notify_all();
+        }
+
+    private:
+        ReplicaSetMonitor* _monitor;
+        DBClientConnection* _conn;
+    };
+
     bool ReplicaSetMonitor::_checkConnection( DBClientConnection* conn,
             string& maybePrimary, bool verbose, int nodesOffset ) {
 
         verify( conn );
-        scoped_lock lk( _checkConnectionLock );
+        CheckingConnection checking( this, conn );
         bool isMaster = false;
         bool changed = false;
         bool errorOccured = false;
@@ -895,24 +989,24 @@ namespace mongo {
 
                 if ( nodesOffset >= 0 ) {
                     scoped_lock lk( _lock );
-                    _nodes[nodesOffset].ok = false;
+                    // Another checker may have changed _nodes while isMaster ran.
+                    if ( _checkConnMatch_inlock( conn, nodesOffset ) ) {
+                        _nodes[nodesOffset].ok = false;
+                    }
                 }
 
                 return false;
             }
-            int commandTime = t.millis();
+            long long commandMicros = t.micros();
 
             if ( nodesOffset >= 0 ) {
                 scoped_lock lk( _lock );
+                if ( !_checkConnMatch_inlock( conn, nodesOffset ) ) {
+                    return false;
+                }
                 Node& node = _nodes[nodesOffset];
 
-                if (node.pingTimeMillis == 0) {
-                    node.pingTimeMillis = commandTime;
-                }
-                else {
-                    // update ping time with smoothed moving averaged (1/4th the delta)
-                    node.pingTimeMillis += (commandTime - node.pingTimeMillis) / 4;
-                }
+                node.recordLatency(commandMicros);
 
                 node.hidden = o["hidden"].trueValue();
                 node.secondary = o["secondary"].trueValue();
@@ -939,7 +1033,11 @@ namespace mongo {
                 while( it.more() ) b.append( it.next() );
             }
             
-            _checkHosts( b.arr(), changed);
+            {
+                // Only one checker at a time changes the membership.
+                scoped_lock lk( _checkHostsLock );
+                _checkHosts( b.arr(), changed );
+            }
             _checkStatus( conn->getServerAddress() );
 
         }
@@ -959,15 +1057,65 @@ namespace mongo {
             }
         }
 
-        if ( changed && _hook )
+        if ( changed && _hook ) {
+            scoped_lock lk( _checkHostsLock );
             _hook( this );
+        }
 
         return isMaster;
     }
 
+    int ReplicaSetMonitor::_checkAllInParallel() {
+        vector<shared_ptr<DBClientConnection> > conns;
+        {
+            scoped_lock lk( _lock );
+            for ( unsigned i = 0; i < _nodes.size(); i++ ) {
+                conns.push_back( _getConnWithRefresh( _nodes[i] ) );
+            }
+        }
+
+        // _checkConnection records whether each node is the primary in _nodes, we only need
+        // somewhere for the primary each one names.
+        vector<string> maybePrimary( conns.size() );
+        boost::thread_group checkers;
+        for ( size_t i = 0; i < conns.size(); i++ ) {
+            if ( conns[i].get() == NULL ) continue;
+            try {
+                checkers.create_thread( boost::bind( &ReplicaSetMonitor::_checkConnection, this,
+                                                     conns[i].get(), boost::ref( maybePrimary[i] ),
+                                                     false, static_cast<int>( i ) ) );
+            }
+            catch ( boost::thread_resource_error& ) {
+                _checkConnection( conns[i].get(), maybePrimary[i], false, i );
+            }
+        }
+        checkers.join_all();
+
+        scoped_lock lk( _lock );
+        for ( size_t i = 0; i < conns.size(); i++ ) {
+            if ( conns[i].get() == NULL || !_checkConnMatch_inlock( conns[i].get(), i ) ) continue;
+            const Node& node = _nodes[i];
+            if ( node.ok && node.ismaster ) {
+                if ( static_cast<int>( i ) != _master ) {
+                    log() << "Primary for replica set " << _name
+                          << " changed to " << node.addr << endl;
+                }
+                _master = i;
+                return i;
+            }
+        }
+        return -1;
+    }
+
     void ReplicaSetMonitor::_check( bool checkAllSecondaries ) {
         LOG(1) <<  "_check : " << getServerAddress() << endl;
 
+        if ( checkAllSecondaries && _checkAllInParallel() >= 0 ) {
+            return;
+        }
+
+        // Either we only need a primary, or none was found, in which case look harder, one
+        // node at a time, following the hints the nodes give about who the primary is.
         int newMaster = -1;
         shared_ptr<DBClientConnection> nodeConn;
 
@@ -1174,6 +1322,20 @@ namespace mongo {
             builder.append("hidden", node.hidden);
             builder.append("secondary", node.secondary);
             builder.append("pingTimeMillis", node.pingTimeMillis);
+            if (!node.latencySamples.empty()) {
+                BSONObjBuilder latency(builder.subobjStart("latencyMicros"));
+                latency.append("avg", static_cast<long long>(node.latencyMicros));
+                latency.append("p50", node.latencyPercentile(50));
+                latency.append("p95", node.latencyPercentile(95));
+                latency.append("p99", node.latencyPercentile(99));
+                latency.append("samples", static_cast<int>(node.latencySamples.size()));
+                latency.done();
+            }
+            if (node.lagMillis >= 0) {
+                builder.append("lagMillis", node.lagMillis);
+                builder.append("gtidLag", node.gtidLag);
+                builder.append("fallingBehind", node.isFallingBehind());
+            }
 
             const BSONElement& tagElem = node.lastIsMaster["tags"];
             if (tagElem.ok() && tagElem.isABSONObj()) {
@@ -1469,6 +1631,54 @@ namespace mongo {
         return builder.obj();
     }
 
+    namespace {
+        // Weight of each new round trip in latencyMicros, like TCP's smoothed RTT.
+        const double latencyWeight = 1.0 / 8;
+        // How many recent round trips percentiles are taken over.
+        const size_t maxLatencySamples = 128;
+    }
+
+    void ReplicaSetMonitor::Node::recordLatency( long long micros ) {
+        if ( micros < 0 )
+            micros = 0;
+        if ( latencyMicros == 0 ) {
+            latencyMicros = micros;
+        }
+        else {
+            latencyMicros += ( micros - latencyMicros ) * latencyWeight;
+        }
+        pingTimeMillis = static_cast<int>( latencyMicros / 1000 );
+
+        const int sample = static_cast<int>( std::min( micros, static_cast<long long>( std::numeric_limits<int>::max() ) ) );
+        if ( latencySamples.size() < maxLatencySamples ) {
+            latencySamples.push_back( sample );
+        }
+        else {
+            latencySamples[nextLatencySample] = sample;
+        }
+        nextLatencySample = ( nextLatencySample + 1 ) % maxLatencySamples;
+    }
+
+    long long ReplicaSetMonitor::Node::latencyPercentile( double pct ) const {
+        if ( latencySamples.empty() )
+            return -1;
+        vector<int> sorted( latencySamples );
+        size_t i = static_cast<size_t>( pct / 100 * ( sorted.size() - 1 ) + 0.5 );
+        if ( i >= sorted.size() )
+            i = sorted.size() - 1;
+        std::nth_element( sorted.begin(), sorted.begin() + i, sorted.end() );
+        return sorted[i];
+    }
+
+    void ReplicaSetMonitor::Node::recordLag( long long millis, long long gtids ) {
+        // Prefer the GTID distance, it doesn't depend on how often the primary writes.
+        const bool rose = ( gtids >= 0 && gtidLag >= 0 ) ? gtids > gtidLag :
+                          ( lagMillis >= 0 && millis > lagMillis );
+        lagRises = rose ? lagRises + 1 : 0;
+        lagMillis = millis;
+        gtidLag = gtids;
+    }
+
     ReplicaSetMonitor::ConfigChangeHook ReplicaSetMonitor::_hook;
     int ReplicaSetMonitor::_maxFailedChecks = 30; // At 1 check every 10 seconds, 30 checks takes 5 minutes
 
@@ -22,6 +22,7 @@
 
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition.hpp>
 #include <set>
 #include <utility>
 
@@ -63,7 +64,12 @@ namespace mongo {
                 ismaster(false),
                 secondary( false ),
                 hidden( false ),
-                pingTimeMillis( 0 ) {
+                pingTimeMillis( 0 ),
+                latencyMicros( 0 ),
+                nextLatencySample( 0 ),
+                lagMillis( -1 ),
+                gtidLag( -1 ),
+                lagRises( 0 ) {
             }
 
             bool okForSecondaryQueries() const {
@@ -99,6 +105,36 @@ namespace mongo {
                 return pingTimeMillis < threshold;
             }
 
+            /**
+             * Folds the round trip of a health check isMaster into latencyMicros and the recent
+             * samples, and updates pingTimeMillis from latencyMicros.  Requests aren't counted,
+             * their time includes however long the server took to run them.
+             */
+            void recordLatency( long long micros );
+
+            /**
+             * @param pct  a percentile, 0 to 100
+             * @return the latency below which pct percent of the recent samples fall, or -1 if
+             *         there are none
+             */
+            long long latencyPercentile( double pct ) const;
+
+            /**
+             * Records this secondary's replication lag behind the primary, as of the last check.
+             * @param gtids  how many GTIDs behind the primary it is, or -1 if unknown (when the
+             *               primary has changed since the secondary's last GTID)
+             */
+            void recordLag( long long millis, long long gtids );
+
+            /**
+             * @return true if this node's replication lag has grown at each of the last few
+             *         checks, so reads from it are getting staler.  Such nodes are only selected
+             *         for secondary reads when no other node matches.
+             */
+            bool isFallingBehind() const {
+                return lagRises >= 2;
+            }
+
             /**
              * Checks whether this nodes is compatible with the given readPreference and
              * tag. Compatibility check is strict in the sense that secondary preferred
@@ -130,8 +166,21 @@ namespace mongo {
             bool secondary;
             bool hidden;
 
+            // smoothed round trip time of health checks and requests
             int pingTimeMillis;
 
+            // exponentially weighted moving average of the round trips, and a ring of the last
+            // few of them for percentiles
+            double latencyMicros;
+            std::vector<int> latencySamples;
+            size_t nextLatencySample;
+
+            // replication lag behind the primary, from the node's own replSetGetStatus, -1 if
+            // unknown, and how many checks in a row it has grown at
+            long long lagMillis;
+            long long gtidLag;
+            int lagRises;
+
         };
 
         static const double SOCKET_TIMEOUT_SECS;
@@ -144,7 +193,9 @@ namespace mongo {
          * @param tags the tags used for filtering nodes
          * @param localThresholdMillis the exclusive upper bound of ping time to be
          *     considered as a local node. Local nodes are favored over non-local
-         *     nodes if multiple nodes matches the other criteria.
+         *     nodes if multiple nodes matches the other criteria. Secondaries that are
+         *     falling behind (see Node::isFallingBehind) are only returned if no other node
+         *     matches.
          * @param lastHost the host used in the last successful request. This is used for
          *     selecting a different node as much as possible, by doing a simple round
          *     robin, starting from the node next to this lastHost. This will be overwritten
@@ -303,6 +354,14 @@ namespace mongo {
          */
         void _check( bool checkAllSecondaries );
 
+        /**
+         * Checks every node at once, each in its own thread, so that one slow or unreachable
+         * member doesn't hold up what we learn about the others.
+         *
+         * @return the index of the primary found, or -1 if there was none.
+         */
+        int _checkAllInParallel();
+
         /**
          * Use replSetGetStatus command to make sure hosts in host list are up
          * and readable.  Sets Node::ok appropriately.
@@ -374,14 +433,24 @@ namespace mongo {
         mutable mongo::mutex _lock;
 
         /**
-         * "Synchronizes" the _checkConnection method. Should ideally be one mutex per
-         * connection object being used. The purpose of this lock is to make sure that
-         * the reply from the connection the lock holder got is the actual response
-         * to what it sent.
+         * "Synchronizes" the _checkConnection method, one connection object at a time. The
+         * purpose of this is to make sure that the reply from the connection the checker got
+         * is the actual response to what it sent, while still letting different members be
+         * checked at the same time. _checkingConns holds the connections being checked.
          *
          * Deadlock WARNING: never acquire this while holding _lock
          */
+        class CheckingConnection;
         mutable mongo::mutex  _checkConnectionLock;
+        boost::condition _checkConnectionDone;
+        std::set<DBClientConnection*> _checkingConns;
+
+        /**
+         * Serializes _checkHosts and _hook between checkers running in parallel.
+         *
+         * Deadlock WARNING: never acquire this while holding _lock
+         */
+        mongo::mutex _checkHostsLock;
 
         string _name;
 
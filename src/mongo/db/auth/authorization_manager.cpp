@@ -173,6 +173,7 @@ namespace {
         clusterAdminRoleReadActions.addAction(ActionType::setParameter);
         clusterAdminRoleReadActions.addAction(ActionType::setShardVersion); // TODO: should this be internal?
         clusterAdminRoleReadActions.addAction(ActionType::serverStatus);
+        clusterAdminRoleReadActions.addAction(ActionType::showContendedRanges);
         clusterAdminRoleReadActions.addAction(ActionType::showLiveTransactions);
         clusterAdminRoleReadActions.addAction(ActionType::showPendingLockRequests);
         clusterAdminRoleReadActions.addAction(ActionType::splitVector);
@@ -43,6 +43,7 @@
 #include "mongo/db/introspect.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/kill_current_op.h"
+#include "mongo/db/ops/query.h"
 #include "mongo/db/repl/rs.h"
 #include "mongo/db/repl_block.h"
 #include "mongo/db/parsed_query.h"
@@ -65,25 +66,112 @@ namespace mongo {
         return false;
     }
 
-    CCById ClientCursor::clientCursorsById;
-    boost::recursive_mutex& ClientCursor::ccmutex( *(new boost::recursive_mutex()) );
-    long long ClientCursor::numberTimedOut = 0;
+    struct ClientCursor::Partition {
+        SimpleMutex mutex;
+        CCById cursors;
+        // Keeps neighboring partitions' locks off each other's cache lines.
+        char _pad[64];
+        Partition() : mutex("clientCursorPartition") {}
+    };
+
+    // Never deleted, like the mutex it replaced, so cursors destroyed during shutdown can still
+    // unregister.
+    ClientCursor::Partition *ClientCursor::partitions = new ClientCursor::Partition[ClientCursor::NumPartitions];
+    AtomicInt64 ClientCursor::numberTimedOut;
+
+    ClientCursor::Partition &ClientCursor::partitionFor(CursorId id) {
+        return partitions[id & (NumPartitions - 1)];
+    }
+
+    ClientCursor* ClientCursor::find_inlock(Partition &p, CursorId id, bool warn) {
+        CCById::const_iterator it = p.cursors.find(id);
+        if ( it == p.cursors.end() ) {
+            if ( warn )
+                OCCASIONALLY out() << "ClientCursor::find(): cursor not found in map " << id << " (ok after a drop)\n";
+            return 0;
+        }
+        return it->second;
+    }
+
+    ClientCursor* ClientCursor::find(CursorId id, bool warn) {
+        Partition &p = partitionFor(id);
+        SimpleMutex::scoped_lock lk(p.mutex);
+        ClientCursor *c = find_inlock(p, id, warn);
+        // if this asserts, your code was not thread safe - you either need to set no timeout
+        // for the cursor or keep a ClientCursor::Pointer in scope for it.
+        massert( 12521, "internal error: use of an unlocked ClientCursor", c == 0 || c->_pinValue );
+        return c;
+    }
+
+    ClientCursor::Pin::Pin( long long cursorid ) :
+        _cursorid( INVALID_CURSOR_ID ) {
+        Partition &p = partitionFor( cursorid );
+        SimpleMutex::scoped_lock lk( p.mutex );
+        ClientCursor *cursor = find_inlock( p, cursorid, true );
+        if ( cursor ) {
+            uassert( 12051, "clientcursor already in use? driver problem?",
+                    cursor->_pinValue < 100 );
+            cursor->_pinValue += 100;
+            _cursorid = cursorid;
+        }
+    }
+
+    void ClientCursor::Pin::release() {
+        if ( _cursorid == INVALID_CURSOR_ID ) {
+            return;
+        }
+        Partition &p = partitionFor( _cursorid );
+        SimpleMutex::scoped_lock lk( p.mutex );
+        ClientCursor *cursor = find_inlock( p, _cursorid, true );
+        _cursorid = INVALID_CURSOR_ID;
+        if ( cursor ) {
+            verify( cursor->_pinValue >= 100 );
+            cursor->_pinValue -= 100;
+        }
+    }
+
+    unsigned ClientCursor::numCursors() {
+        unsigned n = 0;
+        for ( int i = 0; i < NumPartitions; i++ ) {
+            SimpleMutex::scoped_lock lk(partitions[i].mutex);
+            n += partitions[i].cursors.size();
+        }
+        return n;
+    }
 
     /*static*/ void ClientCursor::assertNoCursors() {
-        recursive_scoped_lock lock(ccmutex);
-        if( clientCursorsById.size() ) {
-            log() << "ERROR clientcursors exist but should not at this point" << endl;
-            ClientCursor *cc = clientCursorsById.begin()->second;
-            log() << "first one: " << cc->_cursorid << ' ' << cc->_ns << endl;
-            clientCursorsById.clear();
-            verify(false);
+        for ( int i = 0; i < NumPartitions; i++ ) {
+            Partition &p = partitions[i];
+            SimpleMutex::scoped_lock lk(p.mutex);
+            if( p.cursors.size() ) {
+                log() << "ERROR clientcursors exist but should not at this point" << endl;
+                ClientCursor *cc = p.cursors.begin()->second;
+                log() << "first one: " << cc->_cursorid << ' ' << cc->_ns << endl;
+                p.cursors.clear();
+                verify(false);
+            }
+        }
+    }
+
+    void ClientCursor::deleteCursors(const vector<ClientCursor*> &cursors) {
+        for ( vector<ClientCursor*>::const_iterator it = cursors.begin(); it != cursors.end(); ++it ) {
+            delete *it;
         }
     }
 
     void ClientCursor::invalidateAllCursors() {
         verify(Lock::isW());
-        for( LockedIterator i; i.ok(); ) {
-            i.deleteAndAdvance();
+        for ( int i = 0; i < NumPartitions; i++ ) {
+            Partition &p = partitions[i];
+            vector<ClientCursor*> toDelete;
+            {
+                SimpleMutex::scoped_lock lk(p.mutex);
+                for ( CCById::const_iterator it = p.cursors.begin(); it != p.cursors.end(); ++it ) {
+                    toDelete.push_back(it->second);
+                }
+                p.cursors.clear();
+            }
+            deleteCursors(toDelete);
         }
     }
 
@@ -102,89 +190,111 @@ namespace mongo {
             verify(db);
             verify( ns.startsWith(db->name()) );
 
-            for( LockedIterator i; i.ok(); ) {
-                ClientCursor *cc = i.current();
-
-                bool shouldDelete = false;
-                if (cc->c()->shouldDestroyOnNSDeletion() && cc->_db == db) {
-                    if (isDB) {
-                        // already checked that db matched above
-                        dassert( StringData(cc->_ns).startsWith(ns) );
-                        shouldDelete = true;
-                    }
-                    else {
-                        if ( ns == cc->_ns )
-                            shouldDelete = true;
+            for ( int i = 0; i < NumPartitions; i++ ) {
+                Partition &p = partitions[i];
+                vector<ClientCursor*> toDelete;
+                {
+                    SimpleMutex::scoped_lock lk(p.mutex);
+                    for ( CCById::iterator it = p.cursors.begin(); it != p.cursors.end(); ) {
+                        ClientCursor *cc = it->second;
+
+                        bool shouldDelete = false;
+                        if (cc->c()->shouldDestroyOnNSDeletion() && cc->_db == db) {
+                            if (isDB) {
+                                // already checked that db matched above
+                                dassert( StringData(cc->_ns).startsWith(ns) );
+                                shouldDelete = true;
+                            }
+                            else {
+                                if ( ns == cc->_ns )
+                                    shouldDelete = true;
+                            }
+                        }
+
+                        if ( shouldDelete ) {
+                            toDelete.push_back(cc);
+                            p.cursors.erase(it++);
+                        }
+                        else {
+                            ++it;
+                        }
                     }
                 }
-
-                if ( shouldDelete ) {
-                    i.deleteAndAdvance();
-                }
-                else {
-                    i.advance();
-                }
+                deleteCursors(toDelete);
             }
         }
     }
 
-    /* note called outside of locks (other than ccmutex) so care must be exercised */
+    /* note called outside of locks (other than the cursor's partition lock) so care must be exercised */
     bool ClientCursor::shouldTimeout( unsigned millis ) {
         _idleAgeMillis += millis;
         return _idleAgeMillis > 600000 && _pinValue == 0;
     }
 
-    /* called every 4 seconds.  millis is amount of idle time passed since the last call -- could be zero */
+    /* called every 4 seconds.  millis is amount of idle time passed since the last call -- could be zero
+
+       The scan is done a partition at a time, so it only ever holds up getMores on 1/NumPartitions of
+       the cursors, and only for as long as it takes to age that partition's cursors.
+    */
     void ClientCursor::idleTimeReport(unsigned millis) {
+        bool someToTimeout[NumPartitions];
         bool foundSomeToTimeout = false;
+        unsigned sz = 0;
 
         // two passes so that we don't need to readlock unless we really do some timeouts
         // we assume here that incrementing _idleAgeMillis outside readlock is ok.
-        {
-            recursive_scoped_lock lock(ccmutex);
-            {
-                unsigned sz = clientCursorsById.size();
-                static time_t last;
-                if( sz >= 100000 ) { 
-                    if( time(0) - last > 300 ) {
-                        last = time(0);
-                        log() << "warning number of open cursors is very large: " << sz << endl;
-                    }
+        for ( int i = 0; i < NumPartitions; i++ ) {
+            Partition &p = partitions[i];
+            someToTimeout[i] = false;
+            SimpleMutex::scoped_lock lk(p.mutex);
+            sz += p.cursors.size();
+            for ( CCById::const_iterator it = p.cursors.begin(); it != p.cursors.end(); ++it ) {
+                if( it->second->shouldTimeout( millis ) ) {
+                    someToTimeout[i] = true;
                 }
             }
-            for ( CCById::iterator i = clientCursorsById.begin(); i != clientCursorsById.end();  ) {
-                CCById::iterator j = i;
-                i++;
-                if( j->second->shouldTimeout( millis ) ) {
-                    foundSomeToTimeout = true;
+            foundSomeToTimeout = foundSomeToTimeout || someToTimeout[i];
+        }
+
+        {
+            static time_t last;
+            if( sz >= 100000 ) { 
+                if( time(0) - last > 300 ) {
+                    last = time(0);
+                    log() << "warning number of open cursors is very large: " << sz << endl;
                 }
             }
         }
 
         if( foundSomeToTimeout ) {
             Lock::GlobalRead lk;
-            for( LockedIterator i; i.ok(); ) {
-                ClientCursor *cc = i.current();
-                if( cc->shouldTimeout(0) ) {
-                    numberTimedOut++;
-                    LOG(1) << "killing old cursor " << cc->_cursorid << ' ' << cc->_ns
-                           << " idle:" << cc->idleTime() << "ms\n";
-                    i.deleteAndAdvance();
+            for ( int i = 0; i < NumPartitions; i++ ) {
+                if ( !someToTimeout[i] ) {
+                    continue;
                 }
-                else {
-                    i.advance();
+                Partition &p = partitions[i];
+                vector<ClientCursor*> toDelete;
+                {
+                    SimpleMutex::scoped_lock lk(p.mutex);
+                    for ( CCById::iterator it = p.cursors.begin(); it != p.cursors.end(); ) {
+                        ClientCursor *cc = it->second;
+                        if( cc->shouldTimeout(0) ) {
+                            numberTimedOut.fetchAndAdd(1);
+                            LOG(1) << "killing old cursor " << cc->_cursorid << ' ' << cc->_ns
+                                   << " idle:" << cc->idleTime() << "ms\n";
+                            toDelete.push_back(cc);
+                            p.cursors.erase(it++);
+                        }
+                        else {
+                            ++it;
+                        }
+                    }
                 }
+                deleteCursors(toDelete);
             }
         }
     }
 
-    void ClientCursor::LockedIterator::deleteAndAdvance() {
-        ClientCursor *cc = current();
-        CursorId id = cc->cursorid();
-        delete cc;
-        _i = clientCursorsById.upper_bound( id );
-    }
-    
     ClientCursor::ClientCursor(int queryOptions, const shared_ptr<Cursor>& c, const string& ns,
                                BSONObj query, const bool inMultiStatementTxn ) :
         _ns(ns), _db( cc().database() ),
@@ -200,9 +310,15 @@ namespace mongo {
         verify( str::startsWith(_ns, _db->name()) );
         if( queryOptions & QueryOption_NoCursorTimeout )
             noTimeout();
-        recursive_scoped_lock lock(ccmutex);
-        _cursorid = allocCursorId_inlock();
-        clientCursorsById.insert( make_pair(_cursorid, this) );
+        while ( 1 ) {
+            const CursorId id = allocCursorId();
+            Partition &p = partitionFor(id);
+            SimpleMutex::scoped_lock lk(p.mutex);
+            if ( p.cursors.insert( make_pair(id, this) ).second ) {
+                _cursorid = id;
+                break;
+            }
+        }
 
         if (_partOfMultiStatementTxn) {
             transactions = cc().txnStack();
@@ -238,9 +354,14 @@ namespace mongo {
         }
 
         {
-            recursive_scoped_lock lock(ccmutex);
+            Partition &p = partitionFor(_cursorid);
+            SimpleMutex::scoped_lock lk(p.mutex);
 
-            clientCursorsById.erase(_cursorid);
+            // Cursors that were erased through the registry have already been unregistered.
+            CCById::iterator it = p.cursors.find(_cursorid);
+            if ( it != p.cursors.end() && it->second == this ) {
+                p.cursors.erase(it);
+            }
 
             // defensive:
             _cursorid = INVALID_CURSOR_ID;
@@ -328,24 +449,28 @@ namespace mongo {
         return usingKeyPattern.extractSingleKey( _c->current() );
     }
 
-    void ClientCursor::fillQueryResultFromObj( BufBuilder &b, const MatchDetails* details ) const {
+    void ClientCursor::fillQueryResultFromObj( ReplyBuilder &b, const MatchDetails* details ) const {
         const Projection::KeyOnly *keyFieldsOnly = c()->keyFieldsOnly();
         if ( keyFieldsOnly ) {
-            mongo::fillQueryResultFromObj( b, 0, keyFieldsOnly->hydrate( c()->currKey(), c()->currPK() ), details );
+            mongo::fillQueryResultFromObj( b.buf(), 0, keyFieldsOnly->hydrate( c()->currKey(), c()->currPK() ), details );
+        }
+        else if ( fields ) {
+            mongo::fillQueryResultFromObj( b.buf(), fields.get(), c()->current(), details );
         }
         else {
-            mongo::fillQueryResultFromObj( b, fields.get(), c()->current(), details );
+            b.appendObj( c()->current(), c()->currentPin() );
         }
     }
 
     namespace {
-        // so we don't have to do find() which is a little slow very often.
-        long long cursorGenTSLast = 0;
+        SimpleMutex cursorGenMutex("cursorGen");
         PseudoRandom* cursorGenRandom = NULL;
     }
 
-    long long ClientCursor::allocCursorId_inlock() {
-        // It is important that cursor IDs not be reused within a short period of time.
+    long long ClientCursor::allocCursorId() {
+        // It is important that cursor IDs not be reused within a short period of time.  The
+        // constructor retries if the id is already registered.
+        SimpleMutex::scoped_lock lk(cursorGenMutex);
 
         if ( ! cursorGenRandom ) {
             scoped_ptr<SecureRandom> sr( SecureRandom::create() );
@@ -356,21 +481,13 @@ namespace mongo {
 
         long long x;
 
-        while ( 1 ) {
+        do {
             x = ts << 32;
             x |= cursorGenRandom->nextInt32();
+        } while ( x == 0 );
 
-            if ( x == 0 )
-                continue;
-
-            if ( x < 0 )
-                x *= -1;
-
-            if ( ts != cursorGenTSLast || ClientCursor::find_inlock(x, false) == 0 )
-                break;
-        }
-
-        cursorGenTSLast = ts;
+        if ( x < 0 )
+            x *= -1;
 
         return x;
     }
@@ -397,19 +514,24 @@ namespace mongo {
     }
 
     void ClientCursor::appendStats( BSONObjBuilder& result ) {
-        recursive_scoped_lock lock(ccmutex);
-        result.appendNumber("totalOpen", clientCursorsById.size() );
-        result.appendNumber("clientCursors_size", (int) numCursors());
-        result.appendNumber("timedOut" , numberTimedOut);
+        size_t total = 0;
         unsigned pinned = 0;
         unsigned notimeout = 0;
-        for ( CCById::iterator i = clientCursorsById.begin(); i != clientCursorsById.end(); i++ ) {
-            unsigned p = i->second->_pinValue;
-            if( p >= 100 )
-                pinned++;
-            else if( p > 0 )
-                notimeout++;
+        for ( int j = 0; j < NumPartitions; j++ ) {
+            SimpleMutex::scoped_lock lk(partitions[j].mutex);
+            const CCById &cursors = partitions[j].cursors;
+            total += cursors.size();
+            for ( CCById::const_iterator i = cursors.begin(); i != cursors.end(); i++ ) {
+                unsigned p = i->second->_pinValue;
+                if( p >= 100 )
+                    pinned++;
+                else if( p > 0 )
+                    notimeout++;
+            }
         }
+        result.appendNumber("totalOpen", total );
+        result.appendNumber("clientCursors_size", (int) total);
+        result.appendNumber("timedOut" , numberTimedOut.load());
         if( pinned ) 
             result.append("pinned", pinned);
         if( notimeout )
@@ -465,39 +587,47 @@ namespace mongo {
     }
 
     void ClientCursor::find( const string& ns , set<CursorId>& all ) {
-        recursive_scoped_lock lock(ccmutex);
-
-        for ( CCById::iterator i=clientCursorsById.begin(); i!=clientCursorsById.end(); ++i ) {
-            if ( i->second->_ns == ns )
-                all.insert( i->first );
+        for ( int j = 0; j < NumPartitions; j++ ) {
+            SimpleMutex::scoped_lock lk(partitions[j].mutex);
+            const CCById &cursors = partitions[j].cursors;
+            for ( CCById::const_iterator i=cursors.begin(); i!=cursors.end(); ++i ) {
+                if ( i->second->_ns == ns )
+                    all.insert( i->first );
+            }
         }
     }
 
-    bool ClientCursor::_erase_inlock(ClientCursor* cursor) {
+    void ClientCursor::_unregister_inlock(Partition &p, ClientCursor* cursor) {
         // Must not have an active ClientCursor::Pin.
         massert( 16089,
                 str::stream() << "Cannot kill active cursor " << cursor->cursorid(),
                 cursor->_pinValue < 100 );
 
-        delete cursor;
-        return true;
+        p.cursors.erase(cursor->_cursorid);
     }
 
     bool ClientCursor::erase(CursorId id) {
-        recursive_scoped_lock lock(ccmutex);
-        ClientCursor* cursor = find_inlock(id);
-        if (!cursor) {
-            return false;
+        ClientCursor* cursor;
+        {
+            Partition &p = partitionFor(id);
+            SimpleMutex::scoped_lock lk(p.mutex);
+            cursor = find_inlock(p, id);
+            if (!cursor) {
+                return false;
+            }
+            _unregister_inlock(p, cursor);
         }
 
-        return _erase_inlock(cursor);
+        delete cursor;
+        return true;
     }
 
     bool ClientCursor::eraseIfAuthorized(CursorId id) {
         std::string ns;
+        Partition &p = partitionFor(id);
         {
-            recursive_scoped_lock lock(ccmutex);
-            ClientCursor* cursor = find_inlock(id);
+            SimpleMutex::scoped_lock lk(p.mutex);
+            ClientCursor* cursor = find_inlock(p, id);
             if (!cursor) {
                 return false;
             }
@@ -512,19 +642,24 @@ namespace mongo {
         // It is safe to lookup the cursor again after temporarily releasing the mutex because
         // of 2 invariants: that the cursor ID won't be re-used in a short period of time, and that
         // the namespace associated with a cursor cannot change.
-        recursive_scoped_lock lock(ccmutex);
-        ClientCursor* cursor = find_inlock(id);
-        if (!cursor) {
-            // Cursor was deleted in another thread since we found it earlier in this function.
-            return false;
-        }
-        if (cursor->ns() != ns) {
-            warning() << "Cursor namespace changed. Previous ns: " << ns << ", current ns: "
-                    << cursor->ns() << endl;
-            return false;
+        ClientCursor* cursor;
+        {
+            SimpleMutex::scoped_lock lk(p.mutex);
+            cursor = find_inlock(p, id);
+            if (!cursor) {
+                // Cursor was deleted in another thread since we found it earlier in this function.
+                return false;
+            }
+            if (cursor->ns() != ns) {
+                warning() << "Cursor namespace changed. Previous ns: " << ns << ", current ns: "
+                        << cursor->ns() << endl;
+                return false;
+            }
+            _unregister_inlock(p, cursor);
         }
 
-        return _erase_inlock(cursor);
+        delete cursor;
+        return true;
     }
 
     int ClientCursor::erase(int n, long long *ids) {
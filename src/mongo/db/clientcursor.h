@@ -27,13 +27,13 @@
 
 #include "mongo/pch.h"
 
-#include <boost/thread/recursive_mutex.hpp>
-
 #include "mongo/db/cursor.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/matcher.h"
 #include "mongo/db/projection.h"
 #include "mongo/db/keypattern.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/platform/unordered_map.h"
 #include "mongo/s/d_chunk_manager.h"
 #include "mongo/util/net/message.h"
 #include "mongo/util/net/listen.h"
@@ -42,17 +42,17 @@
 
 namespace mongo {
 
-    typedef boost::recursive_mutex::scoped_lock recursive_scoped_lock;
     typedef long long CursorId; /* passed to the client so it can send back on getMore */
     static const CursorId INVALID_CURSOR_ID = -1; // But see SERVER-5726.
     class Cursor; /* internal server cursor base class */
     class ClientCursor;
     class ParsedQuery;
+    class ReplyBuilder;
 
     /* todo: make this map be per connection.  this will prevent cursor hijacking security attacks perhaps.
      *       ERH: 9/2010 this may not work since some drivers send getMore over a different connection
     */
-    typedef map<CursorId, ClientCursor*> CCById;
+    typedef unordered_map<CursorId, ClientCursor*> CCById;
 
     extern BSONObj id_obj;
     
@@ -71,28 +71,8 @@ namespace mongo {
         */
         class Pin : boost::noncopyable {
         public:
-            Pin( long long cursorid ) :
-                _cursorid( INVALID_CURSOR_ID ) {
-                recursive_scoped_lock lock( ccmutex );
-                ClientCursor *cursor = ClientCursor::find_inlock( cursorid, true );
-                if ( cursor ) {
-                    uassert( 12051, "clientcursor already in use? driver problem?",
-                            cursor->_pinValue < 100 );
-                    cursor->_pinValue += 100;
-                    _cursorid = cursorid;
-                }
-            }
-            void release() {
-                if ( _cursorid == INVALID_CURSOR_ID ) {
-                    return;
-                }
-                ClientCursor *cursor = c();
-                _cursorid = INVALID_CURSOR_ID;
-                if ( cursor ) {
-                    verify( cursor->_pinValue >= 100 );
-                    cursor->_pinValue -= 100;
-                }
-            }
+            Pin( long long cursorid );
+            void release();
             ~Pin() { DESTRUCTOR_GUARD( release(); ) }
             ClientCursor *c() const { return ClientCursor::find( _cursorid ); }
         private:
@@ -140,26 +120,6 @@ namespace mongo {
             CursorId _id;
         };
 
-        /**
-         * Iterates through all ClientCursors, under its own ccmutex lock.
-         * Also supports deletion on the fly.
-         */
-        class LockedIterator : boost::noncopyable {
-        public:
-            LockedIterator() : _lock( ccmutex ), _i( clientCursorsById.begin() ) {}
-            bool ok() const { return _i != clientCursorsById.end(); }
-            ClientCursor *current() const { return _i->second; }
-            void advance() { ++_i; }
-            /**
-             * Delete 'current' and advance. Properly handles cascading deletions that may occur
-             * when one ClientCursor is directly deleted.
-             */
-            void deleteAndAdvance();
-        private:
-            recursive_scoped_lock _lock;
-            CCById::const_iterator _i;
-        };
-        
         ClientCursor(int queryOptions, const shared_ptr<Cursor>& c, const string& ns,
                      BSONObj query = BSONObj(), const bool inMultiStatementTxn = false );
 
@@ -228,7 +188,8 @@ namespace mongo {
          */
         BSONObj extractKey( const KeyPattern& usingKeyPattern ) const;
 
-        void fillQueryResultFromObj( BufBuilder &b, const MatchDetails* details = NULL ) const;
+        /** Adds the current document to b, by reference when it's unprojected and big enough. */
+        void fillQueryResultFromObj( ReplyBuilder &b, const MatchDetails* details = NULL ) const;
 
         bool currentIsDup() {
             return _c->getsetdup( _c->currPK() );
@@ -243,26 +204,8 @@ namespace mongo {
         void setChunkManager( ShardChunkManagerPtr manager ){ _chunkManager = manager; }
         ShardChunkManagerPtr getChunkManager(){ return _chunkManager; }
 
-    private:
-        static ClientCursor* find_inlock(CursorId id, bool warn = true) {
-            CCById::iterator it = clientCursorsById.find(id);
-            if ( it == clientCursorsById.end() ) {
-                if ( warn )
-                    OCCASIONALLY out() << "ClientCursor::find(): cursor not found in map " << id << " (ok after a drop)\n";
-                return 0;
-            }
-            return it->second;
-        }
-
     public:
-        static ClientCursor* find(CursorId id, bool warn = true) {
-            recursive_scoped_lock lock(ccmutex);
-            ClientCursor *c = find_inlock(id, warn);
-            // if this asserts, your code was not thread safe - you either need to set no timeout
-            // for the cursor or keep a ClientCursor::Pointer in scope for it.
-            massert( 12521, "internal error: use of an unlocked ClientCursor", c == 0 || c->_pinValue );
-            return c;
-        }
+        static ClientCursor* find(CursorId id, bool warn = true);
 
         /**
          * Deletes the cursor with the provided @param 'id' if one exists.
@@ -272,8 +215,7 @@ namespace mongo {
          */
         static bool erase(CursorId id);
         // Same as erase but checks to make sure this thread has read permission on the cursor's
-        // namespace.  This should be called when receiving killCursors from a client.  This should
-        // not be called when ccmutex is held.
+        // namespace.  This should be called when receiving killCursors from a client.
         static bool eraseIfAuthorized(CursorId id);
 
         /**
@@ -298,7 +240,7 @@ namespace mongo {
         static void idleTimeReport(unsigned millis);
 
         static void appendStats( BSONObjBuilder& result );
-        static unsigned numCursors() { return clientCursorsById.size(); }
+        static unsigned numCursors();
         static void find( const string& ns , set<CursorId>& all );
 
     public:
@@ -325,7 +267,14 @@ namespace mongo {
         // setting this prevents timeout of the cursor in question.
         void noTimeout() { _pinValue++; }
 
-        static bool _erase_inlock(ClientCursor* cursor);
+        struct Partition;
+
+        static Partition &partitionFor(CursorId id);
+        static ClientCursor* find_inlock(Partition &p, CursorId id, bool warn = true);
+        // Removes cursor from its partition, so it can be deleted after the partition's lock is
+        // released.
+        static void _unregister_inlock(Partition &p, ClientCursor* cursor);
+        static void deleteCursors(const vector<ClientCursor*> &cursors);
 
         CursorId _cursorid;
 
@@ -362,10 +311,16 @@ namespace mongo {
 
     private: // static members
 
-        static CCById clientCursorsById;
-        static long long numberTimedOut;
-        static boost::recursive_mutex& ccmutex;   // must use this for all statics above!
-        static CursorId allocCursorId_inlock();
+        /* Cursors are registered in one of NumPartitions partitions, picked by the low bits of
+           their ids (which are random), each with its own lock, so that getMores on different
+           cursors don't wait for each other.  A cursor's _pinValue and _idleAgeMillis are
+           protected by its partition's lock.  Cursors are never deleted with a partition lock
+           held, because deleting one can erase others (when it aborts their transaction).
+        */
+        static const int NumPartitions = 16;
+        static Partition *partitions;
+        static AtomicInt64 numberTimedOut;
+        static CursorId allocCursorId();
 
     };
 
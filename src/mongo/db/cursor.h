@@ -35,8 +35,8 @@ namespace mongo {
      * Query cursors, base class.  This is for our internal cursors.  "ClientCursor" is a separate
      * concept and is for the user's cursor.
      *
-     * WARNING concurrency: the vfunctions below are called back from within a
-     * ClientCursor::ccmutex.  Don't cause a deadlock, you've been warned.
+     * WARNING concurrency: the vfunctions below are called back from within a ClientCursor
+     * registry partition's lock.  Don't cause a deadlock, you've been warned.
      */
     class Cursor : boost::noncopyable {
     public:
@@ -132,6 +132,34 @@ namespace mongo {
         
         virtual void explainDetails( BSONObjBuilder& b ) const { return; }
 
+        /**
+         * @return a reference that keeps the memory current() returned for the current iterate
+         * valid and unchanged, after the cursor advances or is destroyed, for as long as it is
+         * held.  Lets a reply send the document from where it is instead of copying it.  Empty
+         * if the cursor can't guarantee that.
+         */
+        virtual boost::shared_ptr<void> currentPin() { return boost::shared_ptr<void>(); }
+
+        /**
+         * Hints that only these top-level fields of each document are needed, so a cursor that
+         * fetches documents along with its keys can keep just those.  An empty list means no
+         * fields are needed (the query is covered).  current() may then return a partial
+         * document, or look the whole document up again if none was kept.  Cursors that can't
+         * make use of the hint ignore it.
+         */
+        virtual void setFieldsToFetch( const vector<string> &fields ) { }
+
+        /**
+         * Sets a matcher that a cursor which fetches documents along with its keys checks each
+         * document against as it reads it, so documents that can't match aren't kept.  Their keys
+         * still are, so iteration is unchanged, and currentFilteredOut() is true for them.
+         * Cursors that can't make use of it ignore it.
+         */
+        virtual void setFetchFilter( const shared_ptr<CoveredIndexMatcher> &filter ) { }
+
+        /** @return true if the current document is known not to match matcher. */
+        virtual bool currentFilteredOut( const Matcher &matcher ) const { return false; }
+
         /// Should this cursor be destroyed when it's namespace is deleted
         virtual bool shouldDestroyOnNSDeletion() { return true; }
     };
@@ -156,6 +184,17 @@ namespace mongo {
         // Append a key and obj onto the buffer 
         void append(const storage::Key &sKey, const BSONObj &obj);
 
+        // Append a key and only the top-level fields of obj named in fields,
+        // marking the row as projected.
+        void appendProjected(const storage::Key &sKey, const BSONObj &obj,
+                             const vector<string> &fields);
+
+        // Append just a key, marking the row's obj as filtered out.
+        void appendFilteredOut(const storage::Key &sKey);
+
+        // true if the current row's obj was filtered out
+        bool currentFilteredOut() const;
+
         // moves the buffer to the next key/pk/obj
         // returns:
         //      true, the buffer has data, you may call current().
@@ -166,11 +205,23 @@ namespace mongo {
         // only reset it fields if there is something in the buffer.
         void empty();
 
+        // keeps the memory of the rows currently in the buffer valid while it's held.
+        // a pinned buffer is not reused, the next rows go in a new one.
+        boost::shared_ptr<void> pin() const { return _bufHolder; }
+
     private:
+        // Any combination is valid, including none: a pk index row whose
+        // query needs no fields of the document has neither a separate pk
+        // nor an obj.
         class HeaderBits {
         public:
             static const unsigned char hasPK = 1;
             static const unsigned char hasObj = 2;
+            // the obj holds only some of the document's fields
+            static const unsigned char isProjected = 4;
+            // there's no obj, because it didn't match the fetch filter
+            static const unsigned char filteredOut = 8;
+            static const unsigned char all = 15;
         };
 
         // store rows in a buffer that has a "preferred size". if we need to 
@@ -184,7 +235,13 @@ namespace mongo {
         size_t _size;
         size_t _current_offset;
         size_t _end_offset;
+        boost::shared_ptr<char> _bufHolder;
         char *_buf;
+
+        void allocate(size_t size);
+        // make sure there's room to append size more bytes
+        void reserve(size_t size);
+        void appendHeader(const storage::Key &sKey, unsigned char headerBits);
     };
 
     /**
@@ -232,7 +289,9 @@ namespace mongo {
         BSONObj currPK() const { return _currPK; }
         BSONObj currKey() const { return _currKey; }
         BSONObj current();
+        boost::shared_ptr<void> currentPin();
         BSONObj indexKeyPattern() const { return _idx.keyPattern(); }
+        const IndexDetails &index() const { return _idx; }
 
         string toString() const;
         BSONObj prettyIndexBounds() const;
@@ -247,6 +306,22 @@ namespace mongo {
         void setKeyFieldsOnly( const shared_ptr<Projection::KeyOnly> &keyFieldsOnly ) {
             _keyFieldsOnly = keyFieldsOnly;
         }
+        void setFieldsToFetch( const vector<string> &fields ) {
+            _fieldsToFetch = fields;
+            _projectFetched = true;
+        }
+        void setFetchFilter( const shared_ptr<CoveredIndexMatcher> &filter ) {
+            _fetchFilter = filter;
+        }
+        bool currentFilteredOut( const Matcher &matcher ) const {
+            if ( !_currFilteredOut ) {
+                return false;
+            }
+            // Later $or clauses match with a copy of the first clause's matcher.
+            const Matcher &filter = _fetchFilter->docMatcher();
+            return &matcher == &filter || matcher.getQuery()->binaryEqual( *filter.getQuery() );
+        }
+        void explainDetails( BSONObjBuilder &b ) const;
         
         long long nscanned() const { return _nscanned; }
 
@@ -299,9 +374,16 @@ namespace mongo {
             RowBuffer *buffer;
             int rows_fetched;
             int rows_to_fetch;
+            // if non-null, only these fields of each document are kept
+            const vector<string> *fields;
+            // if non-null, only documents matching this are kept
+            const Matcher *filter;
+            int rows_filtered;
             std::exception *ex;
-            cursor_getf_extra(RowBuffer *buf, int n_to_fetch) :
-                buffer(buf), rows_fetched(0), rows_to_fetch(n_to_fetch), ex(NULL) {
+            cursor_getf_extra(RowBuffer *buf, int n_to_fetch, const vector<string> *f,
+                              const Matcher *m) :
+                buffer(buf), rows_fetched(0), rows_to_fetch(n_to_fetch), fields(f),
+                filter(m), rows_filtered(0), ex(NULL) {
             }
         };
         static int cursor_getf(const DBT *key, const DBT *val, void *extra);
@@ -346,6 +428,12 @@ namespace mongo {
                                // _boundsMustMatch will be set to false accordingly.
         shared_ptr< CoveredIndexMatcher > _matcher;
         shared_ptr<Projection::KeyOnly> _keyFieldsOnly;
+        // Set by setFieldsToFetch(), the top-level fields kept from documents stored with the key.
+        vector<string> _fieldsToFetch;
+        bool _projectFetched;
+        // Set by setFetchFilter(), checked against documents stored with the key as they're read.
+        shared_ptr<CoveredIndexMatcher> _fetchFilter;
+        long long _nfilteredInCallback;
         long long _nscanned;
         long long _nscannedObjects;
 
@@ -371,6 +459,7 @@ namespace mongo {
         BSONObj _currKey;
         BSONObj _currPK;
         BSONObj _currObj;
+        bool _currFilteredOut;
         BufBuilder _currKeyBufBuilder;
 
         // Row buffer to store rows in using bulk fetch. Also track the iteration
@@ -379,6 +468,89 @@ namespace mongo {
         int _getf_iteration;
     };
 
+    /**
+     * A Cursor over the documents whose primary keys are found by each of several secondary
+     * index cursors, so only the surviving documents are fetched.
+     *
+     * If every input returns its primary keys in order, which is the case when each scans a
+     * single point of its index, the inputs are merged.  Otherwise all inputs but the last are
+     * read up front into a set of candidate primary keys, and the last input is then streamed
+     * and filtered against that set.
+     *
+     * If the candidates outgrow MaxCandidateBytes, the cursor stops intersecting and instead
+     * returns the documents of the input it was reading that match the whole query.
+     */
+    class IntersectionCursor : public Cursor {
+    public:
+        // Most candidate primary keys kept before falling back to a single input.
+        static const int MaxCandidateBytes = 32 * 1024 * 1024;
+        // Memory each candidate takes besides its primary key: the set's node and the
+        // BSONObj's holder.
+        static const int CandidateOverheadBytes = 64;
+
+        /**
+         * @param query  the whole query, which documents are checked against if the cursor
+         *               falls back to a single input.
+         */
+        static shared_ptr<IntersectionCursor> make( NamespaceDetails *d,
+                                                    const vector<shared_ptr<IndexCursor> > &inputs,
+                                                    bool pkOrdered, const BSONObj &query );
+
+        bool ok() { return _ok; }
+        BSONObj current();
+        bool advance();
+        bool supportGetMore() { return true; }
+        // Each primary key is returned at most once, unless the cursor fell back to a multikey
+        // input.
+        bool getsetdup(const BSONObj &pk) {
+            return _fallbackInput >= 0 && _inputs[_fallbackInput]->getsetdup( pk );
+        }
+        bool isMultiKey() const { return false; }
+        bool modifiedKeys() const { return true; }
+        BSONObj currPK() const { return _currPK; }
+        string toString() const;
+        BSONObj prettyIndexBounds() const;
+        long long nscanned() const;
+        void explainDetails( BSONObjBuilder &b ) const;
+
+        CoveredIndexMatcher *matcher() const { return _matcher.get(); }
+        void setMatcher( shared_ptr< CoveredIndexMatcher > matcher ) { _matcher = matcher; }
+        void setKeyFieldsOnly( const shared_ptr<Projection::KeyOnly> &keyFieldsOnly ) {
+            // Documents are always fetched.
+        }
+
+    private:
+        IntersectionCursor( NamespaceDetails *d, const vector<shared_ptr<IndexCursor> > &inputs,
+                            bool pkOrdered, const BSONObj &query );
+
+        /** Advance the inputs until they agree on a primary key. */
+        void mergeToNext();
+        /** Read all inputs but the last into the candidate set. */
+        void buildCandidates();
+        /** Advance the last input until it finds a candidate primary key. */
+        void probeToNext();
+        /**
+         * Return the candidates collected from _inputs[_fallbackInput] and then the rest of
+         * that input, skipping documents that don't match _query.
+         */
+        void fallbackToNext();
+
+        NamespaceDetails *const _d;
+        const vector<shared_ptr<IndexCursor> > _inputs;
+        const bool _pkOrdered;
+        const Ordering _pkOrdering;
+        const BSONObj _query;
+        bool _ok;
+        set<BSONObj, BSONObjCmp> _candidates;
+        int _fallbackInput; // -1 unless the candidates outgrew MaxCandidateBytes
+        bool _fallbackScanning; // the candidates are used up, and the input is being read
+        scoped_ptr<Matcher> _fallbackMatcher;
+        BSONObj _currPK;
+        BSONObj _currObj;
+        long long _nscannedObjects;
+        shared_ptr< CoveredIndexMatcher > _matcher;
+    };
+
     /**
      * Abstracts index scans by generating a the start and end key
      * based on the index's ordering and the desired direction.
@@ -408,7 +580,6 @@ namespace mongo {
         virtual bool isMultiKey() const { return false; }
         virtual bool modifiedKeys() const { return false; }
         virtual BSONObj prettyIndexBounds() const { return BSONArray(); }
-        virtual void explainDetails( BSONObjBuilder& b ) const { return; }
 
     private:
         BasicCursor( NamespaceDetails *d, int direction );
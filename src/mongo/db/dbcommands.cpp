@@ -56,6 +56,7 @@
 #include "mongo/db/stats/counters.h"
 #include "mongo/db/stats/timer_stats.h"
 #include "mongo/db/storage/env.h"
+#include "mongo/db/storage/lock_tree_stats.h"
 #include "mongo/db/oplog_helpers.h"
 #include "mongo/s/d_writeback.h"
 #include "mongo/s/stale_exception.h"  // for SendStaleConfigException
@@ -512,6 +513,37 @@ namespace mongo {
         }
     } cmdShowPendingLockRequests;
 
+    class CmdShowContendedRanges : public WebInformationCommand {
+    public:
+        CmdShowContendedRanges() : WebInformationCommand("showContendedRanges") {}
+
+        virtual void addRequiredPrivileges(const std::string& dbname,
+                                           const BSONObj& cmdObj,
+                                           std::vector<Privilege>* out) {
+            ActionSet actions;
+            actions.addAction(ActionType::showContendedRanges);
+            out->push_back(Privilege(AuthorizationManager::SERVER_RESOURCE_NAME, actions));
+        }
+        virtual void help( stringstream& help ) const {
+            help << "returns the document-level lock ranges that most often caused lock requests to time out,\n"
+                 << "among the most recently sampled conflicts\n"
+                 << "{ showContendedRanges : 1, limit : <n> } (default limit 20)";
+        }
+
+        bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl) {
+            int limit = 20;
+            if (cmdObj["limit"].isNumber()) {
+                limit = cmdObj["limit"].numberInt();
+            }
+            if (limit <= 0) {
+                errmsg = "limit must be positive";
+                return false;
+            }
+            storage::LockTreeStats::global.appendContendedRanges(result, limit);
+            return true;
+        }
+    } cmdShowContendedRanges;
+
     class CmdShowLiveTransactions : public WebInformationCommand {
     public:
         CmdShowLiveTransactions() : WebInformationCommand("showLiveTransactions") {}
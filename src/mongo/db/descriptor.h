@@ -39,7 +39,8 @@ namespace mongo {
                    const bool hashed = false,
                    const int hashSeed = 0,
                    const bool sparse = false,
-                   const bool clustering = false);
+                   const bool clustering = false,
+                   const int hashVersion = 0);
         // For interpretting a memory buffer as a descriptor.
         Descriptor(const char *data, const size_t size);
 
@@ -72,7 +73,7 @@ namespace mongo {
         //   [
         //     4 bytes: ordering,
         //     1 byte: version,
-        //     1 byte: hashed boolean,
+        //     1 byte: hashed, 0 if not hashed, otherwise 1 + the hash version (version 2+ only),
         //     1 byte: sparse boolean,
         //     1 byte: clustering boolean,
         //     4 bytes: hash seed integer,
@@ -86,14 +87,21 @@ namespace mongo {
                 // Version 0 is kind of a fake version.
                 VERSION_0 = 0,
                 VERSION_1 = 1,
-                NEXT_VERSION = 2
+                // Version 2 stores the hash version in the hashed byte. Only descriptors that
+                // need it (hash version > 0) are written at version 2, so older servers keep
+                // opening everything else and refuse to open what they would hash incorrectly.
+                VERSION_2 = 2,
+                NEXT_VERSION = 3
             };
-            static const int CURRENT_VERSION = (int) NEXT_VERSION - 1;
 
         public:
             Header(const Ordering &o, char h, char s, char c, int hs, uint32_t n)
-                : ordering(o), version((char) CURRENT_VERSION), hashed(h), sparse(s), clustering(c),
-                  hashSeed(hs), numFields(n) {
+                : ordering(o), version((char) (h > 1 ? VERSION_2 : VERSION_1)), hashed(h),
+                  sparse(s), clustering(c), hashSeed(hs), numFields(n) {
+            }
+
+            int hashVersion() const {
+                return hashed - 1;
             }
 
             Ordering ordering;
@@ -29,6 +29,7 @@ namespace mongo {
     _n(),
     _nscannedObjects(),
     _nscanned(),
+    _estimatedNscanned( -1 ),
     _scanAndOrder(),
     _indexOnly(),
     _picked(),
@@ -43,6 +44,10 @@ namespace mongo {
         noteCursorUpdate( cursor );
     }
     
+    void ExplainPlanInfo::noteEstimate( long long estimatedNscanned ) {
+        _estimatedNscanned = estimatedNscanned;
+    }
+
     void ExplainPlanInfo::noteIterate( bool match, bool loadedRecord, const Cursor &cursor ) {
         if ( match ) {
             ++_n;
@@ -71,6 +76,9 @@ namespace mongo {
         bob.appendNumber( "n", _n );
         bob.appendNumber( "nscannedObjects", _nscannedObjects );
         bob.appendNumber( "nscanned", _nscanned );
+        if ( _estimatedNscanned >= 0 ) {
+            bob.appendNumber( "estimatedNscanned", _estimatedNscanned );
+        }
         bob.append( "indexBounds", _indexBounds );
         return bob.obj();
     }
@@ -82,6 +90,9 @@ namespace mongo {
         bob.appendNumber( "n", clauseInfo.n() );
         bob.appendNumber( "nscannedObjects", clauseInfo.nscannedObjects() );
         bob.appendNumber( "nscanned", clauseInfo.nscanned() );
+        if ( _estimatedNscanned >= 0 ) {
+            bob.appendNumber( "estimatedNscanned", _estimatedNscanned );
+        }
         bob.appendNumber( "nscannedObjectsAllPlans", clauseInfo.nscannedObjectsAllPlans() );
         bob.appendNumber( "nscannedAllPlans", clauseInfo.nscannedAllPlans() );
         bob.append( "scanAndOrder", _scanAndOrder );
@@ -50,6 +50,8 @@ namespace mongo {
 
         /** Note information about the plan. */
         void notePlan( const Cursor &cursor, bool scanAndOrder, bool indexOnly );
+        /** Note the optimizer's estimate of nscanned for the plan, -1 if it had none. */
+        void noteEstimate( long long estimatedNscanned );
         /** Note an iteration of the plan. */
         void noteIterate( bool match, bool loadedRecord, const Cursor &cursor );
         /** Note that the plan finished execution. */
@@ -75,6 +77,7 @@ namespace mongo {
         long long _n;
         long long _nscannedObjects;
         long long _nscanned;
+        long long _estimatedNscanned;
         bool _scanAndOrder;
         bool _indexOnly;
         BSONObj _indexBounds;
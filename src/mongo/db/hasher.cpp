@@ -22,7 +22,11 @@
 */
 
 #include "mongo/db/hasher.h"
+
+#include "third_party/murmurhash3/MurmurHash3.h"
+
 #include "mongo/db/jsobj.h"
+#include "mongo/util/mongoutils/str.h"
 #include "mongo/util/startup_test.h"
 
 namespace mongo {
@@ -40,17 +44,53 @@ namespace mongo {
         md5_finish( &_md5State , out );
     }
 
+    namespace {
+
+        /* Collects the canonical byte stream of an element so it can be hashed in one
+         * MurmurHash3 call.  Small elements, which is nearly all of them, stay on the stack.
+         */
+        class MurmurHasher : private boost::noncopyable {
+        public:
+            void addData( const void * keyData , size_t numBytes ) {
+                _buf.appendBuf( keyData , numBytes );
+            }
+            long long int finish( HashSeed seed ) {
+                HashDigest d;
+                MurmurHash3_x64_128( _buf.buf() , _buf.len() , static_cast<uint32_t>( seed ) , d );
+                long long int out;
+                memcpy( &out , d , sizeof( out ) );
+                return out;
+            }
+        private:
+            StackBufBuilder _buf;
+        };
+
+    } // namespace
+
     long long int BSONElementHasher::hash64( const BSONElement& e , HashSeed seed ){
-        scoped_ptr<Hasher> h( HasherFactory::createHasher( seed ) );
-        recursiveHash( h.get() , e , false );
+        return hash64( e , seed , HASH_VERSION_MD5 );
+    }
+
+    long long int BSONElementHasher::hash64( const BSONElement& e , HashSeed seed ,
+                                             HashVersion version ){
+        if ( version == HASH_VERSION_MURMUR3 ) {
+            MurmurHasher h;
+            recursiveHash( &h , e , false );
+            return h.finish( seed );
+        }
+        massert( 17060 , mongoutils::str::stream() << "unknown hashVersion " << version ,
+                 version == HASH_VERSION_MD5 );
+        Hasher h( seed );
+        recursiveHash( &h , e , false );
         HashDigest d;
-        h->finish(d);
+        h.finish(d);
         //HashDigest is actually 16 bytes, but we just get 8 via truncation
         // NOTE: assumes little-endian
         return *reinterpret_cast< long long int * >( d );
     }
 
-    void BSONElementHasher::recursiveHash( Hasher* h ,
+    template< typename H >
+    void BSONElementHasher::recursiveHash( H* h ,
                                            const BSONElement& e ,
                                            bool includeFieldName ) {
 
@@ -98,6 +138,9 @@ namespace mongo {
             // Hard-coded check to ensure the hash function is consistent across platforms
             BSONObj o = BSON( "check" << 42 );
             verify( BSONElementHasher::hash64( o.firstElement(), 0 ) == -944302157085130861LL );
+            verify( BSONElementHasher::hash64( o.firstElement(), 0,
+                                               BSONElementHasher::HASH_VERSION_MURMUR3 ) ==
+                    8715208212397937794LL );
         }
     } hasherUnitTest;
 }
@@ -73,6 +73,22 @@ namespace mongo {
          */
         static const int DEFAULT_HASH_SEED = 0;
 
+        /* Hashed indexes record which function their keys were made with, in the index spec's
+         * "hashVersion" field and in the dictionary's descriptor.
+         *
+         * Version 0 is MD5 and is what hashed shard keys use.  Version 1 is MurmurHash3
+         * (x64, 128 bit), which needs no heap allocation and is several times faster on the
+         * short values indexes usually hold.  Both hash the same canonical byte stream, so they
+         * squash the same values together.
+         */
+        static const HashVersion HASH_VERSION_MD5 = 0;
+        static const HashVersion HASH_VERSION_MURMUR3 = 1;
+        static const HashVersion DEFAULT_HASH_VERSION = HASH_VERSION_MD5;
+
+        static bool isKnownVersion( HashVersion v ) {
+            return v == HASH_VERSION_MD5 || v == HASH_VERSION_MURMUR3;
+        }
+
         /* This computes a 64-bit hash of the value part of BSONElement "e",
          * preceded by the seed "seed".  Squashes element (and any sub-elements)
          * of the same canonical type, so hash({a:{b:4}}) will be the same
@@ -87,18 +103,22 @@ namespace mongo {
          */
         static long long int hash64( const BSONElement& e , HashSeed seed );
 
+        /* Same as above, with the hash function chosen by "version", which must be known. */
+        static long long int hash64( const BSONElement& e , HashSeed seed , HashVersion version );
+
     private:
         BSONElementHasher();
 
         /* This incrementally computes the hash of BSONElement "e"
-         * using hash function "h".  If "includeFieldName" is true,
+         * using hash function "h", anything with an addData() like Hasher's.  If "includeFieldName" is true,
          * then the name of the field is hashed in between the type of
          * the element and the element value.  The hash function "h"
          * is applied recursively to any sub-elements (arrays/sub-documents),
          * squashing elements of the same canonical type.
          * Used as a helper for hash64 above.
          */
-        static void recursiveHash( Hasher* h , const BSONElement& e , bool includeFieldName );
+        template< typename H >
+        static void recursiveHash( H* h , const BSONElement& e , bool includeFieldName );
 
     };
 
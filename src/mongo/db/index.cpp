@@ -41,7 +41,9 @@ namespace mongo {
      *
      * Optional arguments:
      *  "seed" : int (default = 0, a seed for the hash function)
-     *  "hashVersion : int (default = 0, determines which hash function to use)
+     *  "hashVersion : int (default = 0, determines which hash function to use:
+     *                     0 is MD5, 1 is MurmurHash3, which is faster but can't
+     *                     back a hashed shard key)
      *
      * Example use in the mongo shell:
      * > db.foo.ensureIndex({a : "hashed"}, {seed : 3, hashVersion : 0})
@@ -76,8 +78,9 @@ namespace mongo {
             uassert( 16242, "Currently hashed indexes cannot guarantee uniqueness. Use a regular index.",
                             !unique() );
 
-            // Create a descriptor with hashed = true and the appropriate hash seed.
-            _descriptor.reset(new Descriptor(_keyPattern, true, _seed, _sparse, _clustering));
+            // Create a descriptor with hashed = true and the appropriate hash seed and version.
+            _descriptor.reset(new Descriptor(_keyPattern, true, _seed, _sparse, _clustering,
+                                             _hashVersion));
 
         }
 
@@ -413,6 +416,29 @@ namespace mongo {
         }
     }
 
+    uint64_t IndexDetails::estimateKeysInRange(const storage::Key &leftKey, const storage::Key &rightKey) const {
+        DB_TXN *txn = cc().hasTxn() ? cc().txn().db_txn() : NULL;
+        uint64_t leftLess, leftEqual, leftGreater;
+        uint64_t rightLess, rightEqual, rightGreater;
+        int isExact;
+
+        DBT left = leftKey.dbt();
+        int r = db()->key_range64(db(), txn, &left, &leftLess, &leftEqual, &leftGreater, &isExact);
+        if (r != 0) {
+            storage::handle_ydb_error(r);
+        }
+        DBT right = rightKey.dbt();
+        r = db()->key_range64(db(), txn, &right, &rightLess, &rightEqual, &rightGreater, &isExact);
+        if (r != 0) {
+            storage::handle_ydb_error(r);
+        }
+
+        // Each endpoint is estimated independently, so the difference may come out negative
+        // for a narrow range.
+        const uint64_t rightEnd = rightLess + rightEqual;
+        return rightEnd > leftLess ? rightEnd - leftLess : 0;
+    }
+
     int IndexDetails::hot_opt_callback(void *extra, float progress) {
         int retval = 0;
         uint64_t iter = *(uint64_t *)extra;
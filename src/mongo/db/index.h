@@ -191,6 +191,13 @@ namespace mongo {
         uint32_t getPageSize() const;
         uint32_t getReadPageSize() const;
         void getStat64(DB_BTREE_STAT64* stats) const;
+
+        /**
+         * @return an estimate of the number of keys between leftKey and rightKey, inclusive,
+         * computed from the ydb's key_range64 estimates at each endpoint.  Does not read any
+         * leaf entries, so it is cheap enough to call while planning a query.
+         */
+        uint64_t estimateKeysInRange(const storage::Key &leftKey, const storage::Key &rightKey) const;
         void optimize(const storage::Key &leftSKey, const storage::Key &rightSKey,
                       const bool sendOptimizeMessage, uint64_t* loops_run);
         void acquireTableLock();
@@ -30,11 +30,17 @@ namespace mongo {
         _size(_BUF_SIZE_PREFERRED),
         _current_offset(0),
         _end_offset(0),
-        _buf(new char[_size]) {
+        _buf(NULL) {
+        allocate(_size);
     }
 
     RowBuffer::~RowBuffer() {
-        delete []_buf;
+    }
+
+    void RowBuffer::allocate(size_t size) {
+        _bufHolder.reset(new char[size], boost::checked_array_deleter<char>());
+        _buf = _bufHolder.get();
+        _size = size;
     }
 
     bool RowBuffer::ok() const {
@@ -55,7 +61,7 @@ namespace mongo {
 
         const char *buf = _buf + _current_offset;
         const char headerBits = *buf++;
-        dassert(headerBits >= 1 && headerBits <= 3);
+        dassert((headerBits & ~HeaderBits::all) == 0);
 
         storage::Key sk(buf, headerBits & HeaderBits::hasPK);
         sKey.set(buf, sk.size());
@@ -68,34 +74,37 @@ namespace mongo {
                 <= _end_offset);
     }
 
-    void RowBuffer::append(const storage::Key &sKey, const BSONObj &obj) {
-
-        size_t key_size = sKey.size();
-        size_t obj_size = obj.isEmpty() ? 0 : obj.objsize();
-        size_t size_needed = _end_offset + 1 + key_size + obj_size;
+    void RowBuffer::reserve(size_t size) {
+        size_t size_needed = _end_offset + size;
 
         // if we need more than we have, realloc.
         if (size_needed > _size) {
-            char *buf = new char[size_needed];
-            memcpy(buf, _buf, _size);
-            delete []_buf;
-            _buf = buf;
-            _size = size_needed;
+            boost::shared_ptr<char> old = _bufHolder;
+            allocate(size_needed);
+            memcpy(_buf, old.get(), _end_offset);
         }
+    }
 
+    void RowBuffer::appendHeader(const storage::Key &sKey, unsigned char headerBits) {
         // Determine what to put in the header byte.
         const bool hasPK = !sKey.pk().isEmpty();
-        const bool hasObj = obj_size > 0;
-        const unsigned char headerBits = (hasPK ? HeaderBits::hasPK : 0) | (hasObj ? HeaderBits::hasObj : 0);
-        dassert(headerBits >= 1 && headerBits <= 3);
+        headerBits |= hasPK ? HeaderBits::hasPK : 0;
+        dassert((headerBits & ~HeaderBits::all) == 0);
         memcpy(_buf + _end_offset, &headerBits, 1);
         _end_offset += 1;
 
-        // Append the new key/obj row to the buffer.
+        // Append the new key row to the buffer.
         // We'll know how to interpet it later because
         // the header bit says whether a pk/obj exists.
-        memcpy(_buf + _end_offset, sKey.buf(), key_size);
-        _end_offset += key_size;
+        memcpy(_buf + _end_offset, sKey.buf(), sKey.size());
+        _end_offset += sKey.size();
+    }
+
+    void RowBuffer::append(const storage::Key &sKey, const BSONObj &obj) {
+        size_t obj_size = obj.isEmpty() ? 0 : obj.objsize();
+        reserve(1 + sKey.size() + obj_size);
+
+        appendHeader(sKey, obj_size > 0 ? HeaderBits::hasObj : 0);
         if (obj_size > 0) {
             memcpy(_buf + _end_offset, obj.objdata(), obj_size);
             _end_offset += obj_size;
@@ -104,6 +113,56 @@ namespace mongo {
         verify(_end_offset <= _size);
     }
 
+    void RowBuffer::appendFilteredOut(const storage::Key &sKey) {
+        reserve(1 + sKey.size());
+        appendHeader(sKey, HeaderBits::filteredOut);
+        verify(_end_offset <= _size);
+    }
+
+    bool RowBuffer::currentFilteredOut() const {
+        dassert(ok());
+        return *(_buf + _current_offset) & HeaderBits::filteredOut;
+    }
+
+    static bool isFieldToFetch(const char *name, const vector<string> &fields) {
+        for (vector<string>::const_iterator it = fields.begin(); it != fields.end(); ++it) {
+            if (strcmp(name, it->c_str()) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void RowBuffer::appendProjected(const storage::Key &sKey, const BSONObj &obj,
+                                    const vector<string> &fields) {
+        // Size the projected obj first, so it can be written straight into the buffer.
+        int obj_size = 5;
+        for (BSONObjIterator it(obj); it.more(); ) {
+            const BSONElement e = it.next();
+            if (isFieldToFetch(e.fieldName(), fields)) {
+                obj_size += e.size();
+            }
+        }
+        reserve(1 + sKey.size() + obj_size);
+
+        appendHeader(sKey, HeaderBits::hasObj | HeaderBits::isProjected);
+        char *p = _buf + _end_offset;
+        memcpy(p, &obj_size, 4);
+        p += 4;
+        for (BSONObjIterator it(obj); it.more(); ) {
+            const BSONElement e = it.next();
+            if (isFieldToFetch(e.fieldName(), fields)) {
+                memcpy(p, e.rawdata(), e.size());
+                p += e.size();
+            }
+        }
+        *p++ = EOO;
+        _end_offset += obj_size;
+        dassert(p == _buf + _end_offset);
+
+        verify(_end_offset <= _size);
+    }
+
     // moves the internal position to the next key/pk/obj and returns them
     // returns:
     //      true, the buffer had more and key/pk/obj were set appropriately
@@ -115,7 +174,7 @@ namespace mongo {
 
         // the buffer has more, seek passed the current one.
         const char headerBits = *(_buf + _current_offset);
-        dassert(headerBits >= 1 && headerBits <= 3);
+        dassert((headerBits & ~HeaderBits::all) == 0);
         _current_offset += 1;
 
         storage::Key sKey(_buf + _current_offset, headerBits & HeaderBits::hasPK);
@@ -138,10 +197,9 @@ namespace mongo {
         if ( _end_offset > 0 ) {
             // If the row buffer got really big, bring it back down to size.
             // Otherwise it's okay if its within 2x preferred size.
-            if ( _size > _BUF_SIZE_PREFERRED * 2 ) {
-                delete []_buf;
-                _size = _BUF_SIZE_PREFERRED;
-                _buf = new char[_size];
+            // If a reply still references rows in it, leave it to the reply.
+            if ( _size > _BUF_SIZE_PREFERRED * 2 || !_bufHolder.unique() ) {
+                allocate(_BUF_SIZE_PREFERRED);
             }
             _current_offset = 0;
             _end_offset = 0;
@@ -181,12 +239,15 @@ namespace mongo {
         _direction(direction),
         _bounds(),
         _boundsMustMatch(true),
+        _projectFetched(false),
+        _nfilteredInCallback(0),
         _nscanned(0),
         _nscannedObjects(0),
         _prelock(!cc().opSettings().getJustOne() && numWanted == 0),
         _cursor(_idx, cursor_flags()),
         _tailable(false),
         _ok(false),
+        _currFilteredOut(false),
         _getf_iteration(0)
     {
         verify( _d != NULL );
@@ -207,12 +268,15 @@ namespace mongo {
         _direction(direction),
         _bounds(bounds),
         _boundsMustMatch(true),
+        _projectFetched(false),
+        _nfilteredInCallback(0),
         _nscanned(0),
         _nscannedObjects(0),
         _prelock(!cc().opSettings().getJustOne() && numWanted == 0),
         _cursor(_idx, cursor_flags()),
         _tailable(false),
         _ok(false),
+        _currFilteredOut(false),
         _getf_iteration(0)
     {
         verify( _d != NULL );
@@ -235,8 +299,23 @@ namespace mongo {
             if (key != NULL) {
                 RowBuffer *buffer = info->buffer;
                 storage::Key sKey(key);
-                buffer->append(sKey, val->size > 0 ?
-                        BSONObj(static_cast<const char *>(val->data)) : BSONObj());
+                if (val->size > 0 && info->filter != NULL &&
+                    !info->filter->matches(BSONObj(static_cast<const char *>(val->data)))) {
+                    // Can't match, so don't copy the document.
+                    buffer->appendFilteredOut(sKey);
+                    info->rows_filtered++;
+                } else if (val->size > 0 && info->fields != NULL) {
+                    // Keep only what the query needs of the document, if anything.
+                    if (info->fields->empty()) {
+                        buffer->append(sKey, BSONObj());
+                    } else {
+                        buffer->appendProjected(sKey, BSONObj(static_cast<const char *>(val->data)),
+                                                *info->fields);
+                    }
+                } else {
+                    buffer->append(sKey, val->size > 0 ?
+                            BSONObj(static_cast<const char *>(val->data)) : BSONObj());
+                }
 
                 // request more bulk fetching if we are allowed to fetch more rows
                 // and the row buffer is not too full.
@@ -472,6 +551,7 @@ namespace mongo {
     void IndexCursor::getCurrentFromBuffer() {
         storage::Key sKey;
         _buffer.current(sKey, _currObj);
+        _currFilteredOut = _buffer.currentFilteredOut();
 
         _currKeyBufBuilder.reset(512);
         _currKey = sKey.key(_currKeyBufBuilder);
@@ -493,7 +573,9 @@ namespace mongo {
 
         int r;
         const int rows_to_fetch = getf_fetch_count();
-        struct cursor_getf_extra extra(&_buffer, rows_to_fetch);
+        struct cursor_getf_extra extra(&_buffer, rows_to_fetch,
+                                       _projectFetched ? &_fieldsToFetch : NULL,
+                                       _fetchFilter ? &_fetchFilter->docMatcher() : NULL);
         DBC *cursor = _cursor.dbc();
         if ( forward() ) {
             r = cursor->c_getf_set_range(cursor, getf_flags(), &key_dbt, cursor_getf, &extra);
@@ -507,6 +589,7 @@ namespace mongo {
             extra.throwException();
             storage::handle_ydb_error(r);
         }
+        _nfilteredInCallback += extra.rows_filtered;
 
         _getf_iteration++;
         _ok = extra.rows_fetched > 0 ? true : false;
@@ -688,7 +771,9 @@ again:      while ( !allInclusive && ok() ) {
 
         int r;
         const int rows_to_fetch = getf_fetch_count();
-        struct cursor_getf_extra extra(&_buffer, rows_to_fetch);
+        struct cursor_getf_extra extra(&_buffer, rows_to_fetch,
+                                       _projectFetched ? &_fieldsToFetch : NULL,
+                                       _fetchFilter ? &_fetchFilter->docMatcher() : NULL);
         DBC *cursor = _cursor.dbc();
         if ( forward() ) {
             r = cursor->c_getf_next(cursor, getf_flags(), cursor_getf, &extra);
@@ -702,6 +787,7 @@ again:      while ( !allInclusive && ok() ) {
             extra.throwException();
             storage::handle_ydb_error(r);
         }
+        _nfilteredInCallback += extra.rows_filtered;
 
         _getf_iteration++;
         return extra.rows_fetched > 0 ? true : false;
@@ -792,6 +878,14 @@ again:      while ( !allInclusive && ok() ) {
         return _currObj;
     }
 
+    boost::shared_ptr<void> IndexCursor::currentPin() {
+        // Unless it was looked up by pk (and is owned), _currObj is in the row buffer.
+        if ( _currObj.isEmpty() || _currObj.isOwned() ) {
+            return boost::shared_ptr<void>();
+        }
+        return _buffer.pin();
+    }
+
     bool IndexCursor::currentMatches( MatchDetails *details ) {
          // If currKey() might not match the specified _bounds, check whether or not it does.
          if ( !_boundsMustMatch && _bounds && !_bounds->matchesKey( currKey() ) ) {
@@ -802,6 +896,20 @@ again:      while ( !allInclusive && ok() ) {
          return Cursor::currentMatches( details );
     }
 
+    void IndexCursor::explainDetails( BSONObjBuilder &b ) const {
+        if ( _fetchFilter ) {
+            b.appendNumber( "nfilteredInCallback", _nfilteredInCallback );
+        }
+        if ( _projectFetched ) {
+            BSONArrayBuilder fields( b.subarrayStart( "fieldsFetched" ) );
+            for ( vector<string>::const_iterator it = _fieldsToFetch.begin();
+                  it != _fieldsToFetch.end(); ++it ) {
+                fields.append( *it );
+            }
+            fields.doneFast();
+        }
+    }
+
     string IndexCursor::toString() const {
         string s = string("IndexCursor ") + _idx.indexName();
         if ( _direction < 0 ) {
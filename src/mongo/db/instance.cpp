@@ -657,6 +657,7 @@ namespace mongo {
         int pass = 0;
         bool exhaust = false;
         QueryResult* msgdata = 0;
+        Message reply; // may reference the cursor's memory, see ReplyBuilder
         GTID last;
         bool isOplog = false;
         while( 1 ) {
@@ -710,7 +711,8 @@ namespace mongo {
                                          curop,
                                          pass,
                                          exhaust,
-                                         &isCursorAuthorized);
+                                         &isCursorAuthorized,
+                                         reply);
             }
             catch ( AssertionException& e ) {
                 if ( isCursorAuthorized ) {
@@ -792,13 +794,15 @@ namespace mongo {
                 return ok;
             }
 
+            reply.reset();
             msgdata = emptyMoreResult(cursorid);
+            reply.setData(msgdata, true);
         }
 
         Message *resp = new Message();
-        resp->setData(msgdata, true);
+        *resp = reply;
         curop.debug().responseLength = resp->header()->dataLen();
-        curop.debug().nreturned = msgdata->nReturned;
+        curop.debug().nreturned = ((QueryResult *) resp->header())->nReturned;
 
         dbresponse.response = resp;
         dbresponse.responseTo = m.header()->id;
@@ -0,0 +1,278 @@
+// intersectioncursor.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+#include "mongo/db/curop.h"
+#include "mongo/db/cursor.h"
+#include "mongo/db/namespace_details.h"
+
+namespace mongo {
+
+    shared_ptr<IntersectionCursor> IntersectionCursor::make( NamespaceDetails *d,
+                                                             const vector<shared_ptr<IndexCursor> > &inputs,
+                                                             bool pkOrdered, const BSONObj &query ) {
+        return shared_ptr<IntersectionCursor>( new IntersectionCursor( d, inputs, pkOrdered, query ) );
+    }
+
+    IntersectionCursor::IntersectionCursor( NamespaceDetails *d,
+                                            const vector<shared_ptr<IndexCursor> > &inputs,
+                                            bool pkOrdered, const BSONObj &query ) :
+        _d(d),
+        _inputs(inputs),
+        _pkOrdered(pkOrdered),
+        _pkOrdering(Ordering::make(d->pkPattern())),
+        _query(query.getOwned()),
+        _ok(true),
+        _fallbackInput(-1),
+        _fallbackScanning(false),
+        _nscannedObjects(0) {
+        verify( _inputs.size() >= 2 );
+        if ( _pkOrdered ) {
+            mergeToNext();
+        } else {
+            buildCandidates();
+            if ( _fallbackInput >= 0 ) {
+                fallbackToNext();
+            } else {
+                probeToNext();
+            }
+        }
+    }
+
+    void IntersectionCursor::mergeToNext() {
+        _currObj = BSONObj();
+        while ( true ) {
+            BSONObj maxPK;
+            for ( vector<shared_ptr<IndexCursor> >::const_iterator it = _inputs.begin();
+                  it != _inputs.end(); ++it ) {
+                IndexCursor &c = **it;
+                // An input may stop on a key outside its bounds, see
+                // IndexCursor::currentMatches().  The matcher doesn't check the predicates the
+                // inputs' bounds answer, so those keys must be skipped here.
+                while ( c.ok() && !c.currentMatches() ) {
+                    c.advance();
+                }
+                if ( !c.ok() ) {
+                    _ok = false;
+                    return;
+                }
+                const BSONObj pk = c.currPK();
+                if ( maxPK.isEmpty() || pk.woCompare( maxPK, _pkOrdering ) > 0 ) {
+                    maxPK = pk;
+                }
+            }
+            maxPK = maxPK.getOwned();
+
+            bool agree = true;
+            for ( vector<shared_ptr<IndexCursor> >::const_iterator it = _inputs.begin();
+                  it != _inputs.end(); ++it ) {
+                IndexCursor &c = **it;
+                while ( c.ok() && ( c.currPK().woCompare( maxPK, _pkOrdering ) < 0 ||
+                                    !c.currentMatches() ) ) {
+                    c.advance();
+                }
+                if ( !c.ok() ) {
+                    _ok = false;
+                    return;
+                }
+                if ( c.currPK().woCompare( maxPK, _pkOrdering ) != 0 ) {
+                    agree = false;
+                }
+            }
+            if ( agree ) {
+                _currPK = maxPK;
+                return;
+            }
+        }
+    }
+
+    void IntersectionCursor::buildCandidates() {
+        for ( size_t i = 0; i < _inputs.size() - 1; ++i ) {
+            set<BSONObj, BSONObjCmp> next;
+            long long bytes = 0;
+            for ( IndexCursor &c = *_inputs[i]; c.ok(); c.advance() ) {
+                killCurrentOp.checkForInterrupt();
+                // An input may stop on a key outside its bounds, see IndexCursor::currentMatches().
+                if ( !c.currentMatches() ) {
+                    continue;
+                }
+                const BSONObj pk = c.currPK();
+                if ( i > 0 && _candidates.count( pk ) == 0 ) {
+                    continue;
+                }
+                if ( next.insert( pk.getOwned() ).second ) {
+                    bytes += pk.objsize() + CandidateOverheadBytes;
+                    if ( bytes > MaxCandidateBytes ) {
+                        // Every document matching the query is either already in next or
+                        // further along this input.
+                        LOG(1) << toString() << ": too many candidate primary keys, "
+                               << "falling back to " << c.toString() << endl;
+                        c.advance();
+                        _candidates.swap( next );
+                        _fallbackInput = static_cast<int>( i );
+                        _fallbackMatcher.reset( new Matcher( _query ) );
+                        return;
+                    }
+                }
+            }
+            _candidates.swap( next );
+            if ( _candidates.empty() ) {
+                break;
+            }
+        }
+    }
+
+    void IntersectionCursor::probeToNext() {
+        _currObj = BSONObj();
+        IndexCursor &c = *_inputs.back();
+        for ( ; c.ok(); c.advance() ) {
+            if ( !c.currentMatches() ) {
+                continue;
+            }
+            // Erasing the candidate also skips the duplicates a multikey input may return.
+            const BSONObj pk = c.currPK();
+            if ( _candidates.erase( pk ) > 0 ) {
+                _currPK = pk.getOwned();
+                return;
+            }
+            if ( _candidates.empty() ) {
+                break;
+            }
+        }
+        _ok = false;
+    }
+
+    void IntersectionCursor::fallbackToNext() {
+        _currObj = BSONObj();
+        while ( !_fallbackScanning && !_candidates.empty() ) {
+            killCurrentOp.checkForInterrupt();
+            const BSONObj pk = *_candidates.begin();
+            _candidates.erase( _candidates.begin() );
+            _nscannedObjects++;
+            BSONObj obj;
+            // The document may have been deleted under a snapshot or read uncommitted cursor.
+            if ( _d->findByPK( pk, obj ) && _fallbackMatcher->matches( obj ) ) {
+                _currPK = pk;
+                _currObj = obj;
+                return;
+            }
+        }
+        _fallbackScanning = true;
+
+        IndexCursor &c = *_inputs[_fallbackInput];
+        for ( ; c.ok(); c.advance() ) {
+            killCurrentOp.checkForInterrupt();
+            if ( !c.currentMatches() ) {
+                continue;
+            }
+            _nscannedObjects++;
+            const BSONObj obj = c.current();
+            if ( _fallbackMatcher->matches( obj ) ) {
+                _currPK = c.currPK().getOwned();
+                _currObj = obj.getOwned();
+                return;
+            }
+        }
+        _ok = false;
+    }
+
+    bool IntersectionCursor::advance() {
+        killCurrentOp.checkForInterrupt();
+        if ( !_ok ) {
+            return false;
+        }
+        if ( _fallbackInput >= 0 ) {
+            if ( _fallbackScanning ) {
+                _inputs[_fallbackInput]->advance();
+            }
+            fallbackToNext();
+        }
+        else if ( _pkOrdered ) {
+            for ( vector<shared_ptr<IndexCursor> >::const_iterator it = _inputs.begin();
+                  it != _inputs.end(); ++it ) {
+                (*it)->advance();
+            }
+            mergeToNext();
+        } else {
+            _inputs.back()->advance();
+            probeToNext();
+        }
+        return _ok;
+    }
+
+    BSONObj IntersectionCursor::current() {
+        if ( _currObj.isEmpty() ) {
+            _nscannedObjects++;
+            bool found = _d->findByPK( _currPK, _currObj );
+            if ( !found ) {
+                // Same as IndexCursor::current(), the document may have been deleted under a
+                // snapshot or read uncommitted cursor, so we may try the next one exactly once.
+                advance();
+                if ( ok() ) {
+                    found = _d->findByPK( _currPK, _currObj );
+                    uassert( 17035, str::stream()
+                                << toString() << ": could not find associated document with pk "
+                                << _currPK, found );
+                }
+            }
+        }
+        return _currObj;
+    }
+
+    long long IntersectionCursor::nscanned() const {
+        long long n = 0;
+        for ( vector<shared_ptr<IndexCursor> >::const_iterator it = _inputs.begin();
+              it != _inputs.end(); ++it ) {
+            n += (*it)->nscanned();
+        }
+        return n;
+    }
+
+    string IntersectionCursor::toString() const {
+        string s = "IntersectionCursor";
+        for ( vector<shared_ptr<IndexCursor> >::const_iterator it = _inputs.begin();
+              it != _inputs.end(); ++it ) {
+            s += " " + (*it)->index().indexName();
+        }
+        return s;
+    }
+
+    BSONObj IntersectionCursor::prettyIndexBounds() const {
+        BSONObjBuilder b;
+        for ( vector<shared_ptr<IndexCursor> >::const_iterator it = _inputs.begin();
+              it != _inputs.end(); ++it ) {
+            b.append( (*it)->index().indexName(), (*it)->prettyIndexBounds() );
+        }
+        return b.obj();
+    }
+
+    void IntersectionCursor::explainDetails( BSONObjBuilder &b ) const {
+        b.append( "intersectionMerged", _pkOrdered );
+        if ( _fallbackInput >= 0 ) {
+            b.append( "intersectionFallback", _inputs[_fallbackInput]->index().indexName() );
+        }
+        BSONArrayBuilder inputs( b.subarrayStart( "intersectionInputs" ) );
+        for ( vector<shared_ptr<IndexCursor> >::const_iterator it = _inputs.begin();
+              it != _inputs.end(); ++it ) {
+            inputs.append( BSON( "cursor" << (*it)->toString() <<
+                                 "nscanned" << (*it)->nscanned() ) );
+        }
+        inputs.doneFast();
+    }
+
+} // namespace mongo
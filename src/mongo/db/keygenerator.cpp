@@ -18,8 +18,10 @@
 */
 
 #include "mongo/pch.h"
+#include "mongo/bson/bson_scan.h"
 #include "mongo/db/hasher.h"
 #include "mongo/db/keygenerator.h"
+#include "mongo/db/operation_arena.h"
 #include "mongo/db/storage/assert_ids.h"
 #include "mongo/util/stringutils.h"
 #include "mongo/util/mongoutils/str.h"
@@ -29,13 +31,15 @@ namespace mongo {
 
     /* Takes a BSONElement, seed and hashVersion, and outputs the
      * 64-bit hash used for this index
-     * E.g. if the element is {a : 3} this outputs v1-hash(3)
+     * E.g. if the element is {a : 3} this outputs v-hash(3)
      * */
     long long int HashKeyGenerator::makeSingleKey(const BSONElement &e,
                                                   const HashSeed &seed,
                                                   const HashVersion &v) {
-        massert( 16245, "Only HashVersion 0 has been defined", v == 0 );
-        return BSONElementHasher::hash64( e , seed );
+        uassert( 16245, mongoutils::str::stream() << "unknown hashVersion " << v
+                                      << ", only 0 (MD5) and 1 (MurmurHash3) are defined",
+                 BSONElementHasher::isKnownVersion( v ) );
+        return BSONElementHasher::hash64( e , seed , v );
     }
 
     void HashKeyGenerator::getKeys(const BSONObj &obj, BSONObjSet &keys) {
@@ -45,12 +49,10 @@ namespace mongo {
                  "Error: hashed indexes do not currently support array values",
                  fieldVal.type() != Array );
 
-        if (!fieldVal.eoo()) {
-            BSONObj key = BSON("" << makeSingleKey(fieldVal, _seed, _hashVersion));
-            keys.insert(key);
-        } else if (!_sparse) {
-            BSONObj key = BSON("" << makeSingleKey(nullElt, _seed, _hashVersion));
-            keys.insert(key);
+        if (!fieldVal.eoo() || !_sparse) {
+            BSONObjBuilder b(OperationArena::current(), 32);
+            b.append("", makeSingleKey(fieldVal.eoo() ? nullElt : fieldVal, _seed, _hashVersion));
+            keys.insert(b.arenaObj());
         }
     }
 
@@ -64,11 +66,11 @@ namespace mongo {
         vector<BSONElement> fixed( fieldNames.size() );
         _getKeys( fieldNames , fixed , obj, sparse, keys );
         if ( keys.empty() && ! sparse ) {
-            BSONObjBuilder nullKey(128);
+            BSONObjBuilder nullKey(OperationArena::current(), 128);
             for (size_t i = 0; i < fieldNames.size(); i++) {
                 nullKey.appendNull("");
             }
-            keys.insert( nullKey.obj() );
+            keys.insert( nullKey.arenaObj() );
         }
     }
         
@@ -166,11 +168,11 @@ namespace mongo {
             if ( sparse && numNotFound == (int) fieldNames.size() ) {
                 return;
             }            
-            BSONObjBuilder b(128);
+            BSONObjBuilder b(OperationArena::current(), 128);
             for( vector< BSONElement >::iterator i = fixed.begin(); i != fixed.end(); ++i ) {
                 b.appendAs( *i, "" );
             }
-            keys.insert( b.obj() );
+            keys.insert( b.arenaObj() );
         }
         else if ( arrElt.embeddedObject().firstElement().eoo() ) {
             // Empty array, so set matching fields to undefined.
@@ -186,4 +188,115 @@ namespace mongo {
         }
     }
 
+    KeyGenerationPlan::Values::Values(const KeyGenerationPlan &plan) : _elts(_inline) {
+        if (plan._fields.size() > InlineFields) {
+            _more.resize(plan._fields.size());
+            _elts = &_more[0];
+        }
+    }
+
+    int KeyGenerationPlan::slotFor(const StringData &name) {
+        for (size_t i = 0; i < _fields.size(); i++) {
+            if (name == _fields[i]) {
+                return i;
+            }
+        }
+        _fields.push_back(name.toString());
+        return _fields.size() - 1;
+    }
+
+    void KeyGenerationPlan::addIndex(const BSONObj &keyPattern, const bool sparse, const bool standard) {
+        Index idx;
+        idx.simple = standard;
+        idx.sparse = sparse;
+        for (BSONObjIterator it(keyPattern); it.more(); ) {
+            const char *field = it.next().fieldName();
+            const char *dot = strchr(field, '.');
+            if (dot != NULL) {
+                idx.simple = false;
+            }
+            idx.slots.push_back(slotFor(dot != NULL ? StringData(field, dot - field) : StringData(field)));
+        }
+        _indexes.push_back(idx);
+    }
+
+    void KeyGenerationPlan::extract(const BSONObj &obj, Values &values) const {
+        const size_t n = _fields.size();
+        for (size_t i = 0; i < n; i++) {
+            values._elts[i] = BSONElement();
+        }
+        size_t found = 0;
+        const char *p = obj.objdata() + 4;
+        const char *end = obj.objdata() + obj.objsize();
+        while (found < n && *p != EOO) {
+            const long long nameLen = bsonscan::cstringLength(p + 1, end);
+            massert(17059, "Invalid field name", nameLen >= 0);
+            BSONElement e(p, static_cast<int>(nameLen) + 1, BSONElement::FieldNameSizeTag());
+            for (size_t i = 0; i < n; i++) {
+                const string &f = _fields[i];
+                if (f.size() == static_cast<size_t>(nameLen) && memcmp(f.data(), p + 1, nameLen) == 0) {
+                    // Like getField(), the first of duplicate fields wins.
+                    if (values._elts[i].eoo()) {
+                        values._elts[i] = e;
+                        found++;
+                    }
+                    break;
+                }
+            }
+            p += e.size();
+        }
+    }
+
+    bool KeyGenerationPlan::getKeys(const int i, const Values &values, BSONObjSet &keys) const {
+        // An index being built may not be in the plan yet.
+        if (i >= (int) _indexes.size() || !_indexes[i].simple) {
+            return false;
+        }
+        const Index &idx = _indexes[i];
+        int numNotFound = 0;
+        for (vector<int>::const_iterator it = idx.slots.begin(); it != idx.slots.end(); ++it) {
+            const BSONElement &e = values._elts[*it];
+            if (e.eoo()) {
+                numNotFound++;
+            } else if (e.type() == Array) {
+                // Arrays expand to several keys, that's KeyGenerator's job.
+                return false;
+            }
+        }
+        // Same as the single key case of KeyGenerator::_getKeys().
+        if (idx.sparse && numNotFound == (int) idx.slots.size()) {
+            return true;
+        }
+        BSONObjBuilder b(OperationArena::current(), 128);
+        for (vector<int>::const_iterator it = idx.slots.begin(); it != idx.slots.end(); ++it) {
+            const BSONElement &e = values._elts[*it];
+            if (e.eoo()) {
+                b.appendNull("");
+            } else {
+                b.appendAs(e, "");
+            }
+        }
+        keys.insert(b.arenaObj());
+        return true;
+    }
+
+    bool KeyGenerationPlan::sameKeys(const int i, const Values &a, const Values &b) const {
+        if (i >= (int) _indexes.size()) {
+            return false;
+        }
+        const Index &idx = _indexes[i];
+        for (vector<int>::const_iterator it = idx.slots.begin(); it != idx.slots.end(); ++it) {
+            const BSONElement &x = a._elts[*it];
+            const BSONElement &y = b._elts[*it];
+            if (x.eoo() != y.eoo()) {
+                return false;
+            }
+            // The names are the same, so this compares the types and values.
+            if (!x.eoo() && (x.size() != y.size() || memcmp(x.rawdata(), y.rawdata(), x.size()) != 0)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
 } // namespace mongo
@@ -95,4 +95,63 @@ namespace mongo {
         const bool _sparse;
     };
 
+    // Generates keys for all of a collection's standard indexes with one pass over the document.
+    //
+    // The plan collects the top level fields that every index's key pattern starts from, and
+    // extract() finds all of them in a single walk over the document's elements.  An index whose
+    // fields are all top level gets its key straight from those values, unless one of them is an
+    // array.  Otherwise (dotted fields, array values, hashed indexes) getKeys() returns false and
+    // the caller uses the index's own generator, see IndexDetails::getKeysFromObject().
+    //
+    // Comparing the values extracted from two versions of a document also tells an update which
+    // indexes' keys can't have changed, see sameKeys().
+    class KeyGenerationPlan : boost::noncopyable {
+    public:
+        // The values extract() found in one document.  Kept apart from the plan, which is
+        // shared by all the threads writing to the collection.
+        class Values : boost::noncopyable {
+        public:
+            explicit Values(const KeyGenerationPlan &plan);
+        private:
+            enum { InlineFields = 16 };
+            BSONElement _inline[InlineFields];
+            vector<BSONElement> _more;
+            BSONElement *_elts;
+            friend class KeyGenerationPlan;
+        };
+
+        KeyGenerationPlan() { }
+
+        // Adds the next index of the collection.
+        // @param standard false if the index generates its keys some other way (e.g. hashed)
+        void addIndex(const BSONObj &keyPattern, const bool sparse, const bool standard);
+
+        // Finds the values of the plan's top level fields in obj.
+        void extract(const BSONObj &obj, Values &values) const;
+
+        // Generates the keys for index i from values.
+        // @return false if the plan can't generate this index's keys for this document.
+        bool getKeys(const int i, const Values &values, BSONObjSet &keys) const;
+
+        // @return true if index i has the same keys for the two documents a and b were extracted
+        //         from, because the top level fields its key pattern reads are byte for byte
+        //         the same.  False means the keys may differ.
+        bool sameKeys(const int i, const Values &a, const Values &b) const;
+
+    private:
+        struct Index {
+            bool simple; // standard, and all fields are top level
+            bool sparse;
+            // Into _fields, the top level field each key pattern field starts from.
+            vector<int> slots;
+        };
+
+        int slotFor(const StringData &name);
+
+        // The distinct top level fields of the key patterns.  There are few of them, so
+        // extract() matches element names against them in order.
+        vector<string> _fields;
+        vector<Index> _indexes;
+    };
+
 } // namespace mongo
@@ -28,6 +28,7 @@
 #include "mongo/db/client.h"
 #include "mongo/db/namespacestring.h"
 #include "mongo/db/auth/authorization_manager.h"
+#include "mongo/db/server_parameters.h"
 
 namespace {
     inline pcrecpp::RE_Options flags2options(const char* flags) {
@@ -55,6 +56,9 @@ namespace mongo {
 
     extern BSONObj staticNull;
 
+    // Whether matchers check the basics they compiled in one pass over the document.
+    MONGO_EXPORT_SERVER_PARAMETER(compiledMatcher, bool, true);
+
     class Where : boost::noncopyable {
     public:
 
@@ -576,6 +580,7 @@ namespace mongo {
         while ( i.more() ) {
             parseMatchExpressionElement( i.next(), nested );
         }
+        compileBasics();
     }
 
     Matcher::Matcher( const Matcher &docMatcher, const BSONObj &key ) :
@@ -934,6 +939,174 @@ namespace mongo {
         return -1;
     }
 
+    bool Matcher::matchesBasic( const ElementMatcher &bm, const BSONObj &jsobj, MatchDetails *details ) const {
+        const BSONElement& m = bm._toMatch;
+        // -1=mismatch. 0=missing element. 1=match
+        int cmp = matchesDotted(m.fieldName(), m, jsobj, bm._compareOp, bm , false , details );
+        if ( cmp == 0 && bm._compareOp == BSONObj::opEXISTS ) {
+            // If missing, match cmp is opposite of $exists spec.
+            cmp = -retExistsFound(bm);
+        }
+        if ( bm._isNot )
+            cmp = -cmp;
+        if ( cmp < 0 )
+            return false;
+        if ( cmp == 0 ) {
+            /* missing is ok iff we were looking for null */
+            if ( m.type() == jstNULL || m.type() == Undefined ||
+                ( ( bm._compareOp == BSONObj::opIN || bm._compareOp == BSONObj::NIN ) && bm._myset->count( staticNull.firstElement() ) > 0 ) ) {
+                if ( bm.negativeCompareOp() ^ bm._isNot ) {
+                    return false;
+                }
+            }
+            else {
+                if ( !bm._isNot ) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void Matcher::compileBasics() {
+        _isCompiled.assign( _basics.size(), false );
+        // matchesCompiled() tracks the basics it has seen in a 64 bit mask.
+        for ( unsigned i = 0; i < _basics.size() && _compiled.size() < 64; i++ ) {
+            const ElementMatcher &bm = _basics[i];
+            const BSONElement &m = bm._toMatch;
+            if ( bm._isNot || strchr( m.fieldName(), '.' ) != NULL ) {
+                continue;
+            }
+            CompiledBasic cb;
+            cb.fieldName = m.fieldName();
+            cb.op = bm._compareOp;
+            cb.canonicalType = m.canonicalType();
+            cb.integer = 0;
+            cb.basic = i;
+            switch ( bm._compareOp ) {
+            case BSONObj::Equality:
+            case BSONObj::LT:
+            case BSONObj::LTE:
+            case BSONObj::GT:
+            case BSONObj::GTE:
+                switch ( m.type() ) {
+                case NumberInt:
+                case NumberLong:
+                    cb.kind = CompiledBasic::INTEGER;
+                    cb.integer = m.numberLong();
+                    break;
+                case String:
+                    cb.kind = CompiledBasic::STRING;
+                    break;
+                case NumberDouble:
+                case Bool:
+                case Date:
+                case jstOID:
+                    cb.kind = CompiledBasic::GENERIC;
+                    break;
+                default:
+                    // null matches missing fields, and objects, arrays and the rest are rare
+                    // enough to leave to matchesDotted().
+                    continue;
+                }
+                break;
+            case BSONObj::opIN:
+                if ( bm._myregex.get() ) {
+                    continue;
+                }
+                cb.kind = CompiledBasic::IN;
+                break;
+            default:
+                continue;
+            }
+            _compiled.push_back( cb );
+            _isCompiled[i] = true;
+        }
+    }
+
+    inline bool Matcher::compiledBasicMatches( const CompiledBasic &cb, const BSONElement &e ) const {
+        int c;
+        switch ( cb.kind ) {
+        case CompiledBasic::IN:
+            return _basics[cb.basic]._myset->count( e ) > 0;
+        case CompiledBasic::INTEGER:
+            if ( e.type() == NumberInt || e.type() == NumberLong ) {
+                const long long l = e.type() == NumberInt ? e._numberInt() : e._numberLong();
+                c = l < cb.integer ? -1 : ( l == cb.integer ? 0 : 1 );
+                break;
+            }
+            if ( e.canonicalType() != cb.canonicalType ) {
+                return false;
+            }
+            c = compareElementValues( e, _basics[cb.basic]._toMatch );
+            break;
+        case CompiledBasic::STRING: {
+            if ( e.type() != String && e.type() != Symbol ) {
+                return false;
+            }
+            const BSONElement &m = _basics[cb.basic]._toMatch;
+            const int lsz = e.valuestrsize();
+            const int rsz = m.valuestrsize();
+            c = memcmp( e.valuestr(), m.valuestr(), std::min( lsz, rsz ) );
+            if ( c == 0 ) {
+                c = lsz - rsz;
+            }
+            break;
+        }
+        default:
+            if ( e.canonicalType() != cb.canonicalType ) {
+                return false;
+            }
+            c = compareElementValues( e, _basics[cb.basic]._toMatch );
+            break;
+        }
+        if ( cb.op == BSONObj::Equality ) {
+            return c == 0;
+        }
+        // Same as valuesMatch().
+        if ( c < -1 ) c = -1;
+        if ( c > 1 ) c = 1;
+        return cb.op & ( 1 << ( c + 1 ) );
+    }
+
+    bool Matcher::matchesCompiled( const BSONObj &jsobj, MatchDetails *details ) const {
+        const unsigned n = _compiled.size();
+        unsigned long long seen = 0;
+        unsigned nseen = 0;
+        BSONObjIterator it( jsobj );
+        while ( nseen < n && it.more() ) {
+            const BSONElement e = it.next();
+            const char *fieldName = e.fieldName();
+            for ( unsigned i = 0; i < n; i++ ) {
+                const CompiledBasic &cb = _compiled[i];
+                // Only the first field with a given name counts, like getField().
+                if ( ( seen & ( 1ULL << i ) ) || cb.fieldName[0] != fieldName[0] ||
+                     strcmp( cb.fieldName, fieldName ) != 0 ) {
+                    continue;
+                }
+                seen |= 1ULL << i;
+                nseen++;
+                if ( e.type() == Array ) {
+                    // Arrays can match by any of their elements.
+                    if ( !matchesBasic( _basics[cb.basic], jsobj, details ) ) {
+                        return false;
+                    }
+                }
+                else if ( !compiledBasicMatches( cb, e ) ) {
+                    return false;
+                }
+            }
+        }
+        // Missing fields can still match, e.g. { a : { $in : [ null, 1 ] } }.
+        for ( unsigned i = 0; nseen < n && i < n; i++ ) {
+            if ( !( seen & ( 1ULL << i ) ) &&
+                 !matchesBasic( _basics[_compiled[i].basic], jsobj, details ) ) {
+                return false;
+            }
+        }
+        return true;
+    }
+
     extern int dump;
 
     /* See if an object matches the query.
@@ -947,36 +1120,21 @@ namespace mongo {
 
         LOG(5) << "Matcher::matches() " << jsobj.toString() << endl;
 
-        /* assuming there is usually only one thing to match.  if more this
-           could be slow sometimes. */
+        // The compiled basics are checked in whatever order the document's fields come in, so
+        // leave them alone if the caller wants to know which array element matched.
+        const bool useCompiled = !_compiled.empty() && compiledMatcher &&
+                                 !( details && details->needRecord() );
+        if ( useCompiled && !matchesCompiled( jsobj, details ) ) {
+            return false;
+        }
 
         // check normal non-regex cases:
         for ( unsigned i = 0; i < _basics.size(); i++ ) {
-            const ElementMatcher& bm = _basics[i];
-            const BSONElement& m = bm._toMatch;
-            // -1=mismatch. 0=missing element. 1=match
-            int cmp = matchesDotted(m.fieldName(), m, jsobj, bm._compareOp, bm , false , details );
-            if ( cmp == 0 && bm._compareOp == BSONObj::opEXISTS ) {
-                // If missing, match cmp is opposite of $exists spec.
-                cmp = -retExistsFound(bm);
+            if ( useCompiled && _isCompiled[i] ) {
+                continue;
             }
-            if ( bm._isNot )
-                cmp = -cmp;
-            if ( cmp < 0 )
+            if ( !matchesBasic( _basics[i], jsobj, details ) ) {
                 return false;
-            if ( cmp == 0 ) {
-                /* missing is ok iff we were looking for null */
-                if ( m.type() == jstNULL || m.type() == Undefined ||
-                    ( ( bm._compareOp == BSONObj::opIN || bm._compareOp == BSONObj::NIN ) && bm._myset->count( staticNull.firstElement() ) > 0 ) ) {
-                    if ( bm.negativeCompareOp() ^ bm._isNot ) {
-                        return false;
-                    }
-                }
-                else {
-                    if ( !bm._isNot ) {
-                        return false;
-                    }
-                }
             }
         }
 
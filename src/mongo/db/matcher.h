@@ -318,6 +318,9 @@ namespace mongo {
 
         const BSONObj *getQuery() const { return &_jsobj; };
 
+        /** @return true if this Matcher itself, not counting nested ones, has a $where clause. */
+        bool hasWhere() const { return _where != NULL; }
+
     private:
         /**
          * Generate a matcher for the provided index key format using the
@@ -337,6 +340,38 @@ namespace mongo {
 
         int valuesMatch(const BSONElement& l, const BSONElement& r, int op, const ElementMatcher& bm) const;
 
+        /** @return true if jsobj satisfies bm. */
+        bool matchesBasic( const ElementMatcher &bm, const BSONObj &jsobj, MatchDetails *details ) const;
+
+        /**
+         * A basic on a top level field, compiled so that all of them can be checked in one pass
+         * over a document's fields, with a comparison picked ahead of time for the type of the
+         * value it compares against.
+         */
+        struct CompiledBasic {
+            enum Kind {
+                INTEGER,    // NumberInt or NumberLong value
+                STRING,     // String value
+                GENERIC,    // any other scalar value
+                IN          // $in without regexes
+            };
+            const char *fieldName;
+            int op;
+            Kind kind;
+            int canonicalType;
+            long long integer;  // the value, if kind is INTEGER
+            unsigned basic;     // index in _basics
+        };
+
+        /** Compiles the basics that can be, called once the query is parsed. */
+        void compileBasics();
+
+        /** @return true if e, a top level non array field, satisfies cb. */
+        bool compiledBasicMatches( const CompiledBasic &cb, const BSONElement &e ) const;
+
+        /** @return true if jsobj satisfies all the compiled basics. */
+        bool matchesCompiled( const BSONObj &jsobj, MatchDetails *details ) const;
+
         bool parseClause( const BSONElement &e );
         void parseExtractedClause( const BSONElement &e, list< shared_ptr< Matcher > > &matchers );
 
@@ -347,6 +382,8 @@ namespace mongo {
         BSONObj _jsobj;                  // the query pattern.  e.g., { name: "joe" }
         BSONObj _constrainIndexKey;
         vector<ElementMatcher> _basics;
+        vector<CompiledBasic> _compiled;
+        vector<bool> _isCompiled;         // by index in _basics
         bool _haveSize;
         bool _all;
         bool _hasArray;
@@ -374,6 +411,8 @@ namespace mongo {
          */
         bool matchesCurrent( Cursor * cursor , MatchDetails * details = 0 ) const;
         bool needRecord() const { return _needRecord; }
+        /** @return true if the cursor can check documents against docMatcher() as it reads them. */
+        bool canFilterWhileFetching() const;
 
         const Matcher &docMatcher() const { return *_docMatcher; }
 
@@ -53,7 +53,32 @@ namespace mongo {
             !_orDedupConstraints.empty();
     }
 
+    namespace {
+
+        class WhereDetector : public MatcherVisitor {
+        public:
+            WhereDetector() : _foundWhere() {}
+            bool hasFoundWhere() const { return _foundWhere; }
+            void visitMatcher( const Matcher& matcher ) { _foundWhere |= matcher.hasWhere(); }
+        private:
+            bool _foundWhere;
+        };
+
+    } // namespace
+
+    bool CoveredIndexMatcher::canFilterWhileFetching() const {
+        // $where would run javascript from inside the ydb callback.
+        WhereDetector detector;
+        _docMatcher->visit( detector );
+        return !detector.hasFoundWhere();
+    }
+
     bool CoveredIndexMatcher::matchesCurrent( Cursor * cursor , MatchDetails * details ) const {
+        if ( cursor->currentFilteredOut( *_docMatcher ) ) {
+            // Already known not to match, the document wasn't even kept.
+            return false;
+        }
+
         const bool keyUsable = !cursor->indexKeyPattern().isEmpty() && !cursor->isMultiKey();
         const BSONObj key = cursor->currKey();
         dassert( key.isValid() );
@@ -25,16 +25,19 @@
 
 #include <boost/filesystem/operations.hpp>
 
+#include "mongo/base/counter.h"
 #include "mongo/base/init.h"
 #include "mongo/base/units.h"
 #include "mongo/db/auth/action_type.h"
 #include "mongo/db/auth/authorization_manager.h"
+#include "mongo/db/commands/server_status.h"
 #include "mongo/db/cursor.h"
 #include "mongo/db/database.h"
 #include "mongo/db/databaseholder.h"
 #include "mongo/db/json.h"
 #include "mongo/db/namespacestring.h"
 #include "mongo/db/namespace_details.h"
+#include "mongo/db/operation_arena.h"
 #include "mongo/db/query_optimizer.h"
 #include "mongo/db/oplog.h"
 #include "mongo/db/relock.h"
@@ -1051,14 +1054,24 @@ namespace mongo {
 
     void NamespaceDetails::computeIndexKeys() {
         _indexedPaths.clear();
+        _keyPlan.reset(new KeyGenerationPlan());
 
         for (int i = 0; i < nIndexesBeingBuilt(); i++) {
-            const BSONObj &key = _indexes[i]->keyPattern();
+            const IndexDetails &idx = *_indexes[i];
+            const BSONObj &key = idx.keyPattern();
             BSONObjIterator o( key );
             while ( o.more() ) {
                 const BSONElement e = o.next();
                 _indexedPaths.addPath( e.fieldName() );
             }
+            _keyPlan->addIndex(key, idx.sparse(), !idx.special());
+        }
+    }
+
+    void NamespaceDetails::getIndexKeys(const int idxNum, const BSONObj &obj,
+                                        const KeyGenerationPlan::Values &values, BSONObjSet &keys) const {
+        if (!_keyPlan->getKeys(idxNum, values, keys)) {
+            _indexes[idxNum]->getKeysFromObject(obj, keys);
         }
     }
 
@@ -1148,6 +1161,8 @@ namespace mongo {
     }
 
     void NamespaceDetails::insertIntoIndexes(const BSONObj &pk, const BSONObj &obj, uint64_t flags) {
+        // The generated keys are dead once the ydb has copied them.
+        OperationArena::Scope arenaScope;
         dassert(!pk.isEmpty());
         dassert(!obj.isEmpty());
 
@@ -1165,6 +1180,9 @@ namespace mongo {
         DBT src_key = storage::dbt_make(sPK.buf(), sPK.size());
         DBT src_val = storage::dbt_make(obj.objdata(), obj.objsize());
 
+        KeyGenerationPlan::Values values(*_keyPlan);
+        _keyPlan->extract(obj, values);
+
         for (int i = 0; i < n; i++) {
             const bool isPK = i == 0;
             const bool prelocked = flags & NamespaceDetails::NO_LOCKTREE;
@@ -1185,7 +1203,7 @@ namespace mongo {
 
             if (!isPK) {
                 BSONObjSet idxKeys;
-                idx.getKeysFromObject(obj, idxKeys);
+                getIndexKeys(i, obj, values, idxKeys);
                 if (idx.unique() && doUniqueChecks) {
                     for (BSONObjSet::const_iterator o = idxKeys.begin(); o != idxKeys.end(); ++o) {
                         idx.uniqueCheck(*o, &pk);
@@ -1231,6 +1249,7 @@ namespace mongo {
     }
 
     void NamespaceDetails::deleteFromIndexes(const BSONObj &pk, const BSONObj &obj, uint64_t flags) {
+        OperationArena::Scope arenaScope;
         dassert(!pk.isEmpty());
         dassert(!obj.isEmpty());
 
@@ -1243,6 +1262,9 @@ namespace mongo {
         DBT src_key = storage::dbt_make(sPK.buf(), sPK.size());
         DBT src_val = storage::dbt_make(obj.objdata(), obj.objsize());
 
+        KeyGenerationPlan::Values values(*_keyPlan);
+        _keyPlan->extract(obj, values);
+
         for (int i = 0; i < n; i++) {
             const bool isPK = i == 0;
             const bool prelocked = flags & NamespaceDetails::NO_LOCKTREE;
@@ -1252,7 +1274,7 @@ namespace mongo {
 
             if (!isPK) {
                 BSONObjSet idxKeys;
-                idx.getKeysFromObject(obj, idxKeys);
+                getIndexKeys(i, obj, values, idxKeys);
 
                 if (idxKeys.size() > 1) {
                     verify(isMultikey(i));
@@ -1309,6 +1331,14 @@ namespace mongo {
         deleteFromIndexes(pk, obj, flags);
     }
 
+    // Secondary indexes an update did and didn't have to write, see updateObject().
+    static Counter64 updateIndexesWritten;
+    static Counter64 updateIndexesSkipped;
+    static ServerStatusMetricField<Counter64> displayUpdateIndexesWritten("index.update.written",
+                                                                          &updateIndexesWritten);
+    static ServerStatusMetricField<Counter64> displayUpdateIndexesSkipped("index.update.skipped",
+                                                                          &updateIndexesSkipped);
+
     void NamespaceDetails::updateObject(const BSONObj &pk, const BSONObj &oldObj, BSONObj &newObj, uint64_t flags) {
         TOKULOG(4) << "NamespaceDetails::updateObject pk "
             << pk << ", old " << oldObj << ", new " << newObj << endl;
@@ -1321,6 +1351,8 @@ namespace mongo {
             uassertStatusOK(AuthorizationManager::checkValidPrivilegeDocument(nsToDatabaseSubstring(_ns), newObj));
         }
 
+        OperationArena::Scope arenaScope;
+
         const int n = nIndexesBeingBuilt();
         DB *dbs[n];
         storage::DBTArrays keyArrays(n * 2);
@@ -1332,6 +1364,11 @@ namespace mongo {
         DBT new_src_val = storage::dbt_make(newObj.objdata(), newObj.objsize());
         DBT old_src_val = storage::dbt_make(oldObj.objdata(), oldObj.objsize());
 
+        KeyGenerationPlan::Values oldValues(*_keyPlan);
+        KeyGenerationPlan::Values newValues(*_keyPlan);
+        _keyPlan->extract(oldObj, oldValues);
+        _keyPlan->extract(newObj, newValues);
+
         // Generate keys for each index, prepare data structures for del multiple.
         // We will end up abandoning del multiple if there are any multikey indexes.
         for (int i = 0; i < n; i++) {
@@ -1355,11 +1392,25 @@ namespace mongo {
             //   we need to update the clustering document.
             const bool keysMayHaveChanged = !(flags & NamespaceDetails::KEYS_UNAFFECTED_HINT);
             if (!isPK && (keysMayHaveChanged || idx.clustering())) {
+                // The hint covers the whole collection, the key plan can tell per index.
+                const bool sameKeys = !keysMayHaveChanged ||
+                                      _keyPlan->sameKeys(i, oldValues, newValues);
+                if (sameKeys && !idx.clustering()) {
+                    // Leaving the key arrays empty means no messages for this index.
+                    updateIndexesSkipped.increment();
+                    continue;
+                }
+                updateIndexesWritten.increment();
                 BSONObjSet oldIdxKeys;
                 BSONObjSet newIdxKeys;
-                idx.getKeysFromObject(oldObj, oldIdxKeys);
-                idx.getKeysFromObject(newObj, newIdxKeys);
-                if (idx.unique() && doUniqueChecks && keysMayHaveChanged) {
+                getIndexKeys(i, newObj, newValues, newIdxKeys);
+                if (sameKeys) {
+                    // A clustering index still needs the new document, under the same keys.
+                    oldIdxKeys = newIdxKeys;
+                } else {
+                    getIndexKeys(i, oldObj, oldValues, oldIdxKeys);
+                }
+                if (idx.unique() && doUniqueChecks && !sameKeys) {
                     // Only perform the unique check for those keys that actually changed.
                     for (BSONObjSet::iterator o = newIdxKeys.begin(); o != newIdxKeys.end(); ++o) {
                         const BSONObj &k = *o;
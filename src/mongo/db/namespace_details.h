@@ -28,6 +28,7 @@
 #include "mongo/db/index.h"
 #include "mongo/db/index_set.h"
 #include "mongo/db/jsobj.h"
+#include "mongo/db/keygenerator.h"
 #include "mongo/db/queryoptimizercursor.h"
 #include "mongo/db/query_plan_selection_policy.h"
 #include "mongo/db/querypattern.h"
@@ -489,6 +490,15 @@ namespace mongo {
     protected:
         void dropIndex(const int idxNum);
 
+        // Generates the keys of the idxNum'th index for obj, whose fields _keyPlan has extracted
+        // into values.
+        void getIndexKeys(const int idxNum, const BSONObj &obj,
+                          const KeyGenerationPlan::Values &values, BSONObjSet &keys) const;
+
+        // Generates the keys of all the committed indexes with one pass over each document.
+        // Rebuilt by computeIndexKeys() whenever the set of indexes changes.
+        scoped_ptr<KeyGenerationPlan> _keyPlan;
+
     private:
         IndexPathSet _indexedPaths;
         void resetTransient();
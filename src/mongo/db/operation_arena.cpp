@@ -0,0 +1,146 @@
+// @file operation_arena.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/operation_arena.h"
+
+#include "mongo/db/commands/server_status.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/util/concurrency/partitioned_counter.h"
+
+namespace mongo {
+
+    TSP_DEFINE(OperationArena, operationArena);
+
+    namespace {
+
+        PartitionedCounter<unsigned long long> arenaAllocations;
+        PartitionedCounter<unsigned long long> arenaBytes;
+        PartitionedCounter<unsigned long long> arenaHeapFallbacks;
+        PartitionedCounter<unsigned long long> arenaChunks;
+
+    } // namespace
+
+    OperationArena::OperationArena() :
+        _chunk(0), _offset(0), _depth(0),
+        _allocations(0), _bytes(0), _heapFallbacks(0), _chunksAllocated(0) {
+    }
+
+    OperationArena::~OperationArena() {
+        for (vector<char *>::iterator it = _chunks.begin(); it != _chunks.end(); ++it) {
+            free(*it);
+        }
+    }
+
+    OperationArena *OperationArena::current() {
+        OperationArena *arena = operationArena.get();
+        return (arena != NULL && arena->_depth > 0) ? arena : NULL;
+    }
+
+    void* OperationArena::allocate(size_t sz) {
+        dassert(_depth > 0);
+        sz = (sz + 7) & ~size_t(7);
+        if (sz > MaxAllocationSize) {
+            _heapFallbacks++;
+            return NULL;
+        }
+        if (_chunks.empty() || _offset + sz > ChunkSize) {
+            // The tail of the current chunk is wasted until the enclosing Scope rewinds past it.
+            const size_t next = _chunks.empty() ? 0 : _chunk + 1;
+            if (next == _chunks.size()) {
+                char *chunk = next < MaxChunks ? static_cast<char *>(malloc(ChunkSize)) : NULL;
+                if (chunk == NULL) {
+                    _heapFallbacks++;
+                    return NULL;
+                }
+                _chunks.push_back(chunk);
+                _chunksAllocated++;
+            }
+            _chunk = next;
+            _offset = 0;
+        }
+        void *p = _chunks[_chunk] + _offset;
+        _offset += sz;
+        _allocations++;
+        _bytes += sz;
+        return p;
+    }
+
+    void OperationArena::rewind(size_t chunk, size_t offset) {
+        _chunk = chunk;
+        _offset = offset;
+        if (_depth == 0 && _chunks.size() > 1) {
+            // Keep one chunk for the next operation, most of them never need a second.
+            for (size_t i = 1; i < _chunks.size(); i++) {
+                free(_chunks[i]);
+            }
+            _chunks.resize(1);
+        }
+    }
+
+    void OperationArena::foldStats() {
+        if (_allocations > 0) {
+            arenaAllocations.inc(_allocations);
+            arenaBytes.inc(_bytes);
+        }
+        if (_heapFallbacks > 0) {
+            arenaHeapFallbacks.inc(_heapFallbacks);
+        }
+        if (_chunksAllocated > 0) {
+            arenaChunks.inc(_chunksAllocated);
+        }
+        _allocations = _bytes = _heapFallbacks = _chunksAllocated = 0;
+    }
+
+    OperationArena::Scope::Scope() :
+        _arena(*operationArena.getMake()),
+        _chunk(_arena._chunk),
+        _offset(_arena._offset) {
+        _arena._depth++;
+    }
+
+    OperationArena::Scope::~Scope() {
+        _arena._depth--;
+        dassert(_arena._depth >= 0);
+        _arena.rewind(_chunk, _offset);
+        if (_arena._depth == 0) {
+            _arena.foldStats();
+        }
+    }
+
+    void OperationArena::appendStats(BSONObjBuilder &b) {
+        b.append("allocations", (long long) arenaAllocations.get());
+        b.append("bytes", (long long) arenaBytes.get());
+        b.append("heapFallbacks", (long long) arenaHeapFallbacks.get());
+        b.append("chunksAllocated", (long long) arenaChunks.get());
+    }
+
+    class OperationArenaServerStats : public ServerStatusSection {
+    public:
+        OperationArenaServerStats() : ServerStatusSection("operationArena") {}
+        virtual bool includeByDefault() const { return true; }
+
+        BSONObj generateSection(const BSONElement &configElement) const {
+            BSONObjBuilder b;
+            OperationArena::appendStats(b);
+            return b.obj();
+        }
+    } operationArenaServerStats;
+
+} // namespace mongo
@@ -0,0 +1,94 @@
+// @file operation_arena.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include <vector>
+
+#include "mongo/bson/util/builder.h"
+#include "mongo/util/concurrency/threadlocal.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * A per-thread bump allocator for the short-lived buffers of one operation, like the index
+     * keys generated for a document and their storage::Key encodings.  Builders draw from it by
+     * being constructed with OperationArena::current() (see BuilderArena).
+     *
+     * Memory is only handed out inside a Scope and all of it is released when the Scope ends, so
+     * nothing drawn from the arena may outlive the innermost Scope active when it was drawn.
+     * Requests that are too big, or that would grow the arena past MaxChunks, return NULL and the
+     * builder falls back to the heap.
+     */
+    class OperationArena : public BuilderArena, boost::noncopyable {
+    public:
+        OperationArena();
+        ~OperationArena();
+
+        /** @return the calling thread's arena if it is inside a Scope, otherwise NULL. */
+        static OperationArena *current();
+
+        virtual void* allocate(size_t sz);
+
+        /**
+         * Makes the calling thread's arena current for the Scope's lifetime, and releases what was
+         * drawn from it inside the Scope when it ends.  The index maintenance functions in
+         * NamespaceDetails and storage::generate_keys() open one per document, so a bulk
+         * operation reuses the same memory.  Scopes nest, and the outermost one also returns the
+         * arena's extra chunks to the heap.
+         */
+        class Scope : boost::noncopyable {
+        public:
+            Scope();
+            ~Scope();
+        private:
+            OperationArena &_arena;
+            const size_t _chunk;
+            const size_t _offset;
+        };
+
+        /** Appends the allocation counters of all threads' arenas, for serverStatus. */
+        static void appendStats(BSONObjBuilder &b);
+
+    private:
+        static const size_t ChunkSize = 32 * 1024;
+        static const size_t MaxAllocationSize = 8 * 1024;
+        static const size_t MaxChunks = 32;
+
+        void rewind(size_t chunk, size_t offset);
+        void foldStats();
+
+        std::vector<char *> _chunks;
+        size_t _chunk;
+        size_t _offset;
+        int _depth;
+
+        // Counted since the outermost Scope started, and folded into the global counters at its end.
+        unsigned long long _allocations;
+        unsigned long long _bytes;
+        unsigned long long _heapFallbacks;
+        unsigned long long _chunksAllocated;
+    };
+
+    TSP_DECLARE(OperationArena, operationArena);
+
+} // namespace mongo
@@ -21,15 +21,18 @@
 
 #include "mongo/db/ops/query.h"
 
+#include "mongo/base/counter.h"
 #include "mongo/bson/util/builder.h"
 #include "mongo/db/clientcursor.h"
 #include "mongo/db/commands.h"
+#include "mongo/db/commands/server_status.h"
 #include "mongo/db/parsed_query.h"
 #include "mongo/db/query_plan_summary.h"
 #include "mongo/db/query_optimizer.h"
 #include "mongo/db/query_optimizer_internal.h"
 #include "mongo/db/replutil.h"
 #include "mongo/db/scanandorder.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/s/d_logic.h"
 #include "mongo/s/stale_exception.h"  // for SendStaleConfigException
 #include "mongo/server.h"
@@ -41,6 +44,75 @@ namespace mongo {
     */
     const int32_t MaxBytesToReturnToClientAtOnce = 4 * 1024 * 1024;
 
+    // Documents at least this big are sent from the cursor's memory instead of being copied into
+    // the reply, when they can be.  Smaller ones are cheaper to copy than to reference.  0 turns
+    // this off.
+    MONGO_EXPORT_SERVER_PARAMETER(zeroCopyReplyMinObjSize, int, 1024);
+
+    static Counter64 zeroCopyDocuments;
+    static ServerStatusMetricField<Counter64> displayZeroCopyDocuments( "query.zeroCopy.documents",
+                                                                         &zeroCopyDocuments );
+    static Counter64 zeroCopyBytes;
+    static ServerStatusMetricField<Counter64> displayZeroCopyBytes( "query.zeroCopy.bytes",
+                                                                     &zeroCopyBytes );
+
+    ReplyBuilder::ReplyBuilder( int initialSize ) :
+        _buf( initialSize ),
+        _pinnedBytes( 0 ) {
+        reset();
+    }
+
+    void ReplyBuilder::reset() {
+        _buf.reset();
+        _buf.skip( sizeof( QueryResult ) );
+        _pinned.clear();
+        _pinnedBytes = 0;
+    }
+
+    void ReplyBuilder::appendObj( const BSONObj &obj, const boost::shared_ptr<void> &pin ) {
+        const int size = obj.objsize();
+        const int minSize = zeroCopyReplyMinObjSize;
+        if ( minSize > 0 && size >= minSize ) {
+            // An owned object keeps its own memory valid.
+            boost::shared_ptr<void> objPin = obj.isOwned() ?
+                    boost::shared_ptr<void>( new BSONObj( obj ) ) : pin;
+            if ( objPin ) {
+                PinnedObj p = { _buf.len(), obj.objdata(), size, objPin };
+                _pinned.push_back( p );
+                _pinnedBytes += size;
+                zeroCopyDocuments.increment();
+                zeroCopyBytes.increment( size );
+                return;
+            }
+        }
+        _buf.appendBuf( obj.objdata(), size );
+    }
+
+    void ReplyBuilder::handoff( Message &result ) {
+        verify( result.empty() );
+        if ( _pinned.empty() ) {
+            result.appendData( _buf.buf(), _buf.len() );
+            _buf.decouple();
+            return;
+        }
+
+        // The copied parts of the reply all live in _buf's memory, which they share.
+        const int bufLen = _buf.len();
+        boost::shared_ptr<void> bufPin( _buf.buf(), free );
+        char *buf = _buf.buf();
+        _buf.decouple();
+
+        int offset = 0;
+        for ( vector<PinnedObj>::const_iterator i = _pinned.begin(); i != _pinned.end(); ++i ) {
+            result.appendPinnedData( buf + offset, i->offset - offset, bufPin );
+            result.appendPinnedData( i->data, i->size, i->pin );
+            offset = i->offset;
+        }
+        result.appendPinnedData( buf + offset, bufLen - offset, bufPin );
+        _pinned.clear();
+        _pinnedBytes = 0;
+    }
+
     bool runCommands(const char *ns, BSONObj& jsobj, CurOp& curop, BufBuilder &b, BSONObjBuilder& anObjBuilder, bool fromRepl, int queryOptions) {
         try {
             return _runCommands(ns, jsobj, b, anObjBuilder, fromRepl, queryOptions);
@@ -89,15 +161,15 @@ namespace mongo {
                                 CurOp& curop,
                                 int pass,
                                 bool& exhaust,
-                                bool* isCursorAuthorized ) {
+                                bool* isCursorAuthorized,
+                                Message &result ) {
         exhaust = false;
         ClientCursor::Pin p(cursorid);
         ClientCursor *client_cursor = p.c();
 
         int bufSize = 512 + sizeof( QueryResult ) + MaxBytesToReturnToClientAtOnce;
 
-        BufBuilder b( bufSize );
-        b.skip(sizeof(QueryResult));
+        ReplyBuilder b( bufSize );
         int resultFlags = ResultFlag_AwaitCapable;
         int start = 0;
         int n = 0;
@@ -222,16 +294,16 @@ namespace mongo {
             }
         }
 
-        QueryResult *qr = (QueryResult *) b.buf();
-        qr->len = b.len();
+        QueryResult *qr = (QueryResult *) b.buf().buf();
         qr->setOperation(opReply);
         qr->_resultFlags() = resultFlags;
         qr->cursorId = cursorid;
         qr->startingFrom = start;
         qr->nReturned = n;
-        b.decouple();
+        // qr->len is set by appendData()
+        b.handoff(result);
 
-        return qr;
+        return (QueryResult *) result.header();
     }
 
     ResultDetails::ResultDetails() :
@@ -319,7 +391,7 @@ namespace mongo {
 
     ResponseBuildStrategy::ResponseBuildStrategy( const ParsedQuery &parsedQuery,
                                                   const shared_ptr<Cursor> &cursor,
-                                                  BufBuilder &buf ) :
+                                                  ReplyBuilder &buf ) :
     _parsedQuery( parsedQuery ),
     _cursor( cursor ),
     _queryOptimizerCursor( dynamic_pointer_cast<QueryOptimizerCursor>( _cursor ) ),
@@ -328,11 +400,11 @@ namespace mongo {
 
     void ResponseBuildStrategy::resetBuf() {
         _buf.reset();
-        _buf.skip( sizeof( QueryResult ) );
     }
 
     BSONObj ResponseBuildStrategy::current( bool allowCovered,
-                                            ResultDetails* resultDetails ) const {
+                                            ResultDetails* resultDetails,
+                                            boost::shared_ptr<void>* pin ) const {
         if ( _parsedQuery.returnKey() ) {
             BSONObjBuilder bob;
             bob.appendKeys( _cursor->indexKeyPattern(), _cursor->currKey() );
@@ -347,12 +419,15 @@ namespace mongo {
         resultDetails->loadedRecord = true;
         BSONObj ret = _cursor->current();
         verify( ret.isValid() );
+        if ( pin ) {
+            *pin = _cursor->currentPin();
+        }
         return ret;
     }
 
     OrderedBuildStrategy::OrderedBuildStrategy( const ParsedQuery &parsedQuery,
                                                const shared_ptr<Cursor> &cursor,
-                                               BufBuilder &buf ) :
+                                               ReplyBuilder &buf ) :
     ResponseBuildStrategy( parsedQuery, cursor, buf ),
     _skip( _parsedQuery.getSkip() ),
     _bufferedMatches() {
@@ -367,11 +442,17 @@ namespace mongo {
             --_skip;
             return false;
         }
-        BSONObj currentDocument = current( true, resultDetails );
+        boost::shared_ptr<void> pin;
+        BSONObj currentDocument = current( true, resultDetails, &pin );
         // Explain does not obey soft limits, so matches should not be buffered.
         if ( !_parsedQuery.isExplain() ) {
-            fillQueryResultFromObj( _buf, _parsedQuery.getFields(),
-                                    currentDocument, &resultDetails->matchDetails );
+            if ( _parsedQuery.getFields() ) {
+                fillQueryResultFromObj( _buf.buf(), _parsedQuery.getFields(),
+                                        currentDocument, &resultDetails->matchDetails );
+            }
+            else {
+                _buf.appendObj( currentDocument, pin );
+            }
             ++_bufferedMatches;
         }
         resultDetails->match = true;
@@ -381,7 +462,7 @@ namespace mongo {
 
     ReorderBuildStrategy* ReorderBuildStrategy::make( const ParsedQuery& parsedQuery,
                                                       const shared_ptr<Cursor>& cursor,
-                                                      BufBuilder& buf,
+                                                      ReplyBuilder& buf,
                                                       const QueryPlanSummary& queryPlan ) {
         auto_ptr<ReorderBuildStrategy> ret( new ReorderBuildStrategy( parsedQuery, cursor, buf ) );
         ret->init( queryPlan );
@@ -390,7 +471,7 @@ namespace mongo {
 
     ReorderBuildStrategy::ReorderBuildStrategy( const ParsedQuery &parsedQuery,
                                                const shared_ptr<Cursor> &cursor,
-                                               BufBuilder &buf ) :
+                                               ReplyBuilder &buf ) :
     ResponseBuildStrategy( parsedQuery, cursor, buf ),
     _bufferedMatches() {
     }
@@ -415,7 +496,7 @@ namespace mongo {
     int ReorderBuildStrategy::rewriteMatches() {
         cc().curop()->debug().scanAndOrder = true;
         int ret = 0;
-        _scanAndOrder->fill( _buf, &_parsedQuery, ret );
+        _scanAndOrder->fill( _buf.buf(), &_parsedQuery, ret );
         _bufferedMatches = ret;
         return ret;
     }
@@ -441,7 +522,7 @@ namespace mongo {
 
     HybridBuildStrategy* HybridBuildStrategy::make( const ParsedQuery& parsedQuery,
                                                     const shared_ptr<QueryOptimizerCursor>& cursor,
-                                                    BufBuilder& buf ) {
+                                                    ReplyBuilder& buf ) {
         auto_ptr<HybridBuildStrategy> ret( new HybridBuildStrategy( parsedQuery, cursor, buf ) );
         ret->init();
         return ret.release();
@@ -449,7 +530,7 @@ namespace mongo {
 
     HybridBuildStrategy::HybridBuildStrategy( const ParsedQuery &parsedQuery,
                                              const shared_ptr<QueryOptimizerCursor> &cursor,
-                                             BufBuilder &buf ) :
+                                             ReplyBuilder &buf ) :
     ResponseBuildStrategy( parsedQuery, cursor, buf ),
     _orderedBuild( _parsedQuery, _cursor, _buf ),
     _reorderedMatches() {
@@ -575,15 +656,11 @@ namespace mongo {
                 explainInfo->reviseN( rewriteCount );
             }
             _builder->resetBuf();
-            fillQueryResultFromObj( _buf, 0, explainInfo->bson() );
-            result.appendData( _buf.buf(), _buf.len() );
-            _buf.decouple();
+            fillQueryResultFromObj( _buf.buf(), 0, explainInfo->bson() );
+            _buf.handoff( result );
             return 1;
         }
-        if ( _buf.len() > 0 ) {
-            result.appendData( _buf.buf(), _buf.len() );
-            _buf.decouple();
-        }
+        _buf.handoff( result );
         return _builder->bufferedMatches();
     }
 
@@ -651,9 +728,12 @@ namespace mongo {
         if ( !_chunkManager ) {
             return true;
         }
-        // TODO: should make this covered at some point
-        resultDetails->loadedRecord = true;
-        if ( _chunkManager->belongsToMe( _cursor->current() ) ) {
+        bool loadedRecord;
+        const bool belongs = _chunkManager->belongsToMe( _cursor.get() , &loadedRecord );
+        if ( loadedRecord ) {
+            resultDetails->loadedRecord = true;
+        }
+        if ( belongs ) {
             return true;
         }
         resultDetails->chunkSkip = true;
@@ -35,11 +35,53 @@ namespace mongo {
     struct QueryPlanSummary;
 
     extern const int32_t MaxBytesToReturnToClientAtOnce;
-    
+
+    /**
+     * Builds the documents of a reply to a query or getMore, after room for its QueryResult
+     * header.  Documents sent as they are, which are big enough and whose memory can be pinned
+     * (see Cursor::currentPin), are not copied but referenced where they are, and the reply is
+     * sent as a scatter/gather list.  Everything else, like documents a projection transforms,
+     * is copied into buf().
+     */
+    class ReplyBuilder : boost::noncopyable {
+    public:
+        explicit ReplyBuilder( int initialSize );
+
+        /** Empties the reply, leaving room for the header. */
+        void reset();
+
+        /** The buffer copied documents go in, which starts with the header. */
+        BufBuilder &buf() { return _buf; }
+
+        /**
+         * Adds obj to the reply as it is.
+         * @param pin keeps obj's memory valid, if it isn't owned.  If empty, obj is copied.
+         */
+        void appendObj( const BSONObj &obj, const boost::shared_ptr<void> &pin );
+
+        /** @return the size of the reply so far, including the header. */
+        int len() const { return _buf.len() + _pinnedBytes; }
+
+        /** Moves the reply into the empty result.  The builder can't be used afterwards. */
+        void handoff( Message &result );
+
+    private:
+        struct PinnedObj {
+            int offset; // where in _buf it goes
+            const char *data;
+            int size;
+            boost::shared_ptr<void> pin;
+        };
+        BufBuilder _buf;
+        vector<PinnedObj> _pinned;
+        int _pinnedBytes;
+    };
+
     /**
      * Return a batch of results from a client OP_GET_MORE request.
      * 'cursorid' - The id of the cursor producing results.
      * 'isCursorAuthorized' - Set to true after a cursor with id 'cursorid' is authorized for use.
+     * 'result' - Gets the reply, which the return value is the header of.
      */
     QueryResult* processGetMore(const char* ns,
                                 int ntoreturn,
@@ -47,7 +89,8 @@ namespace mongo {
                                 CurOp& op,
                                 int pass,
                                 bool& exhaust,
-                                bool* isCursorAuthorized);
+                                bool* isCursorAuthorized,
+                                Message &result);
 
     string runQuery(Message& m, QueryMessage& q, CurOp& curop, Message &result);
 
@@ -137,7 +180,7 @@ namespace mongo {
         shared_ptr<QueryOptimizerCursor> _cursor;
     };
 
-    /** Interface for building a query response in a supplied BufBuilder. */
+    /** Interface for building a query response in a supplied ReplyBuilder. */
     class ResponseBuildStrategy {
     public:
         /**
@@ -145,7 +188,7 @@ namespace mongo {
          * results must be sorted or read with a covered index.
          */
         ResponseBuildStrategy( const ParsedQuery &parsedQuery, const shared_ptr<Cursor> &cursor,
-                              BufBuilder &buf );
+                              ReplyBuilder &buf );
         virtual ~ResponseBuildStrategy() {}
         /**
          * Handle the current iterate of the supplied cursor as a (possibly duplicate) match.
@@ -173,19 +216,22 @@ namespace mongo {
          * Return the document for the current iterate.  Implements the $returnKey option.
          * @param allowCovered enable covered index support.
          * @param resultDetails details of how the result is loaded.
+         * @param pin if not NULL, set to the cursor's pin on the document if it is the cursor's
+         *     own current() document.
          */
-        BSONObj current( bool allowCovered, ResultDetails* resultDetails ) const;
+        BSONObj current( bool allowCovered, ResultDetails* resultDetails,
+                         boost::shared_ptr<void>* pin = NULL ) const;
         const ParsedQuery &_parsedQuery;
         shared_ptr<Cursor> _cursor;
         shared_ptr<QueryOptimizerCursor> _queryOptimizerCursor;
-        BufBuilder &_buf;
+        ReplyBuilder &_buf;
     };
 
     /** Build strategy for a cursor returning in order results. */
     class OrderedBuildStrategy : public ResponseBuildStrategy {
     public:
         OrderedBuildStrategy( const ParsedQuery &parsedQuery, const shared_ptr<Cursor> &cursor,
-                             BufBuilder &buf );
+                             ReplyBuilder &buf );
         virtual bool handleMatch( ResultDetails* resultDetails );
         virtual int bufferedMatches() const { return _bufferedMatches; }
     private:
@@ -200,7 +246,7 @@ namespace mongo {
     public:
         static ReorderBuildStrategy* make( const ParsedQuery& parsedQuery,
                                            const shared_ptr<Cursor>& cursor,
-                                           BufBuilder& buf,
+                                           ReplyBuilder& buf,
                                            const QueryPlanSummary& queryPlan );
         virtual bool handleMatch( ResultDetails* resultDetails );
         /** Handle a match without performing deduping. */
@@ -210,7 +256,7 @@ namespace mongo {
     private:
         ReorderBuildStrategy( const ParsedQuery& parsedQuery,
                               const shared_ptr<Cursor>& cursor,
-                              BufBuilder& buf );
+                              ReplyBuilder& buf );
         void init( const QueryPlanSummary& queryPlan );
         ScanAndOrder *newScanAndOrder( const QueryPlanSummary &queryPlan ) const;
         shared_ptr<ScanAndOrder> _scanAndOrder;
@@ -237,11 +283,11 @@ namespace mongo {
     public:
         static HybridBuildStrategy* make( const ParsedQuery& parsedQuery,
                                           const shared_ptr<QueryOptimizerCursor>& cursor,
-                                          BufBuilder& buf );
+                                          ReplyBuilder& buf );
     private:
         HybridBuildStrategy( const ParsedQuery &parsedQuery,
                             const shared_ptr<QueryOptimizerCursor> &cursor,
-                            BufBuilder &buf );
+                            ReplyBuilder &buf );
         void init();
         virtual bool handleMatch( ResultDetails* resultDetails );
         virtual int rewriteMatches();
@@ -309,7 +355,7 @@ namespace mongo {
         const ParsedQuery &_parsedQuery;
         shared_ptr<Cursor> _cursor;
         shared_ptr<QueryOptimizerCursor> _queryOptimizerCursor;
-        BufBuilder _buf;
+        ReplyBuilder _buf;
         ShardChunkManagerPtr _chunkManager;
         shared_ptr<ExplainRecordingStrategy> _explain;
         shared_ptr<ResponseBuildStrategy> _builder;
@@ -344,6 +344,21 @@ namespace mongo {
         uasserted( 16354, "Positional operator does not match the query specifier." );
     }
 
+    bool Projection::getTopLevelFields( set<string> &fields ) const {
+        if ( _include || _source.isEmpty() ) {
+            // Everything not excluded is returned.
+            return false;
+        }
+        BSONObjIterator i( _source );
+        while ( i.more() ) {
+            fields.insert( mongoutils::str::before( i.next().fieldName(), '.' ) );
+        }
+        if ( _includeID ) {
+            fields.insert( "_id" );
+        }
+        return true;
+    }
+
     Projection::KeyOnly *Projection::checkKey( const BSONObj &keyPattern,
                                                const BSONObj &pkPattern ) const {
         if ( _include ) {
@@ -109,6 +109,12 @@ namespace mongo {
 
         bool includeID() const { return _includeID; }
 
+        /**
+         * Adds the top-level fields transform() reads to fields.
+         * @return false if it may read fields it doesn't name, as an exclusion does.
+         */
+        bool getTopLevelFields( set<string> &fields ) const;
+
         /**
          *  get the type of array operator for the projection
          *  @return     ARRAY_OP_NORMAL if no array projection modifier,
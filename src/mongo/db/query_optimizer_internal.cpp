@@ -27,6 +27,7 @@
 #include "mongo/db/parsed_query.h"
 #include "mongo/db/query_plan_selection_policy.h"
 #include "mongo/db/queryutil.h"
+#include "mongo/db/server_parameters.h"
 
 //#define DEBUGQO(x) cout << x << endl;
 #define DEBUGQO(x)
@@ -263,6 +264,7 @@ namespace mongo {
         _explainPlanInfo->notePlan( *_c,
                                     queryPlan().scanAndOrderRequired(),
                                     queryPlan().keyFieldsOnly() );
+        _explainPlanInfo->noteEstimate( queryPlan().estimatedNscanned() );
         return _explainPlanInfo;
     }
 
@@ -328,6 +330,71 @@ namespace mongo {
         }
     }
 
+    namespace {
+
+        // When one candidate plan's estimated cost is lower than every other's by this factor,
+        // it is run alone instead of racing the candidates.  0 disables cost based selection.
+        double queryPlanCostRatio = 10.0;
+
+        ExportedServerParameter<double> QueryPlanCostRatioSetting( ServerParameterSet::getGlobal(),
+                                                                   "queryPlanCostRatio",
+                                                                   &queryPlanCostRatio,
+                                                                   true,
+                                                                   true );
+
+        const long long MinCostedNscanned = 1000;
+
+        // Each document found through a secondary, non clustering index costs a point query
+        // into the primary key, which is much more expensive than reading the next key.
+        const double FetchCostFactor = 10.0;
+
+        // An intersection plan is not raced (its nscanned is always higher than its inputs', it
+        // saves fetches instead), so it only runs when it is estimated to be this much cheaper
+        // than every other plan.
+        const double IntersectionCostRatio = 2.0;
+
+        const size_t MaxIntersectedPlans = 3;
+
+        bool queryPlanIntersection = true;
+
+        ExportedServerParameter<bool> QueryPlanIntersectionSetting( ServerParameterSet::getGlobal(),
+                                                                    "queryPlanIntersection",
+                                                                    &queryPlanIntersection,
+                                                                    true,
+                                                                    true );
+
+        /** @return the relative cost of running 'plan', or -1 if it cannot be estimated. */
+        double estimatedCost( const QueryPlan& plan ) {
+            const long long nscanned = plan.estimatedNscanned();
+            if ( nscanned < 0 ) {
+                return -1;
+            }
+            const vector<shared_ptr<QueryPlan> >& intersected = plan.intersectedPlans();
+            if ( !intersected.empty() ) {
+                // Assume the intersected predicates are independent.
+                DB_BTREE_STAT64 st;
+                plan.nsd()->getPKIndex().getStat64( &st );
+                double fetched = st.bt_nkeys;
+                for ( vector<shared_ptr<QueryPlan> >::const_iterator i = intersected.begin();
+                      i != intersected.end(); ++i ) {
+                    fetched *= st.bt_nkeys > 0 ? (double) (*i)->estimatedNscanned() / st.bt_nkeys : 0;
+                }
+                return nscanned + fetched * FetchCostFactor;
+            }
+            const IndexDetails* idx = plan.index();
+            if ( idx != NULL && !plan.nsd()->isPKIndex( *idx ) && !idx->clustering() &&
+                 !plan.keyFieldsOnly() ) {
+                return nscanned * FetchCostFactor;
+            }
+            return nscanned;
+        }
+
+        bool fewerEstimatedKeys( const shared_ptr<QueryPlan>& a, const shared_ptr<QueryPlan>& b ) {
+            return a->estimatedNscanned() < b->estimatedNscanned();
+        }
+
+    } // namespace
+
     QueryPlanGenerator::QueryPlanGenerator( QueryPlanSet& qps,
                                             auto_ptr<FieldRangeSetPair> originalFrsp,
                                             const shared_ptr<const ParsedQuery>& parsedQuery,
@@ -412,14 +479,134 @@ namespace mongo {
             return;
         }
 
+        plans.push_back( newPlan( d, -1 ) );
+
+        shared_ptr<QueryPlan> cheapestPlan = chooseByEstimatedCost( plans );
+        if ( cheapestPlan ) {
+            _qps.setCostedPlan( cheapestPlan );
+            return;
+        }
+
+        shared_ptr<QueryPlan> intersectionPlan = newIntersectionPlan( d, plans );
+        if ( intersectionPlan ) {
+            _qps.setSinglePlan( intersectionPlan );
+            return;
+        }
+
         for( vector<shared_ptr<QueryPlan> >::const_iterator i = plans.begin(); i != plans.end();
             ++i ) {
             _qps.addCandidatePlan( *i );
         }        
-        
-        _qps.addCandidatePlan( newPlan( d, -1 ) );
+    }
+
+    shared_ptr<QueryPlan> QueryPlanGenerator::chooseByEstimatedCost
+            ( const vector<shared_ptr<QueryPlan> >& plans ) const {
+        // A cached plan that is being supplemented has already been shown to do poorly, so the
+        // alternatives are raced against it.
+        if ( queryPlanCostRatio <= 0 || _qps.nPlans() > 0 || plans.size() < 2 ) {
+            return shared_ptr<QueryPlan>();
+        }
+
+        vector<double> costs;
+        for( vector<shared_ptr<QueryPlan> >::const_iterator i = plans.begin(); i != plans.end();
+            ++i ) {
+            const QueryPlan& plan = **i;
+            // An in order plan may stop long before its estimate when there is a limit, which
+            // only a race can tell.
+            if ( !_qps.order().isEmpty() &&
+                 plan.scanAndOrderRequired() != plans.front()->scanAndOrderRequired() ) {
+                return shared_ptr<QueryPlan>();
+            }
+            const double cost = estimatedCost( plan );
+            if ( cost < 0 ) {
+                return shared_ptr<QueryPlan>();
+            }
+            costs.push_back( cost );
+        }
+
+        size_t best = 0;
+        for( size_t i = 1; i < costs.size(); ++i ) {
+            if ( costs[ i ] < costs[ best ] ) {
+                best = i;
+            }
+        }
+        double secondCost = -1;
+        for( size_t i = 0; i < costs.size(); ++i ) {
+            if ( i != best && ( secondCost < 0 || costs[ i ] < secondCost ) ) {
+                secondCost = costs[ i ];
+            }
+        }
+
+        // Racing costs about as much as the winner's scan times the number of plans, so it is
+        // only worth avoiding when the winner is expected to scan a lot.
+        if ( plans[ best ]->estimatedNscanned() < MinCostedNscanned ||
+             secondCost < costs[ best ] * queryPlanCostRatio ) {
+            return shared_ptr<QueryPlan>();
+        }
+        return plans[ best ];
     }
     
+    shared_ptr<QueryPlan> QueryPlanGenerator::newIntersectionPlan
+            ( NamespaceDetails* d, const vector<shared_ptr<QueryPlan> >& plans ) const {
+        // $or clauses dedup against earlier clauses' index bounds, which an intersection does
+        // not have.
+        if ( !queryPlanIntersection || queryPlanCostRatio <= 0 || _qps.nPlans() > 0 ||
+             _originalFrsp.get() || d->isCapped() ) {
+            return shared_ptr<QueryPlan>();
+        }
+
+        double cheapestCost = -1;
+        long long cheapestNscanned = 0;
+        vector<shared_ptr<QueryPlan> > inputs;
+        set<string> leadingFields;
+        for( vector<shared_ptr<QueryPlan> >::const_iterator i = plans.begin(); i != plans.end();
+            ++i ) {
+            const QueryPlan& plan = **i;
+            const double cost = estimatedCost( plan );
+            if ( cost < 0 ) {
+                return shared_ptr<QueryPlan>();
+            }
+            if ( cheapestCost < 0 || cost < cheapestCost ) {
+                cheapestCost = cost;
+                cheapestNscanned = plan.estimatedNscanned();
+            }
+
+            if ( plan.willScanTable() ) {
+                continue;
+            }
+            // Clustering indexes already hold the documents, and two indexes with the same
+            // leading field would mostly scan the same keys.
+            const IndexDetails& idx = *plan.index();
+            if ( d->isPKIndex( idx ) || idx.clustering() ||
+                 !leadingFields.insert( idx.keyPattern().firstElementFieldName() ).second ) {
+                continue;
+            }
+            inputs.push_back( *i );
+        }
+        if ( inputs.size() < 2 || cheapestNscanned < MinCostedNscanned ) {
+            return shared_ptr<QueryPlan>();
+        }
+
+        // The most selective inputs narrow the candidates soonest, and the least selective one
+        // is streamed rather than collected.
+        std::sort( inputs.begin(), inputs.end(), fewerEstimatedKeys );
+        if ( inputs.size() > MaxIntersectedPlans ) {
+            inputs.resize( MaxIntersectedPlans );
+        }
+        // Unless its inputs can be merged, the intersection keeps all of the most selective
+        // input's primary keys in memory.  It falls back to scanning that input alone if they
+        // don't fit, so don't choose it when they aren't expected to.
+        if ( inputs.front()->estimatedNscanned() * IntersectionCursor::CandidateOverheadBytes >
+             IntersectionCursor::MaxCandidateBytes ) {
+            return shared_ptr<QueryPlan>();
+        }
+        shared_ptr<QueryPlan> intersection( QueryPlan::makeIntersection( inputs ) );
+        if ( estimatedCost( *intersection ) * IntersectionCostRatio > cheapestCost ) {
+            return shared_ptr<QueryPlan>();
+        }
+        return intersection;
+    }
+
     bool QueryPlanGenerator::addShortCircuitPlan( NamespaceDetails* d ) {
         return
             // The collection is missing.
@@ -665,6 +852,7 @@ namespace mongo {
         _frsp( frsp ),
         _mayRecordPlan(),
         _usingCachedPlan(),
+        _usingCostedPlan(),
         _order( order.getOwned() ),
         _oldNScanned( 0 ),
         _allowSpecial( allowSpecial ) {
@@ -681,6 +869,7 @@ namespace mongo {
         DEBUGQO( "QueryPlanSet::init " << ns << "\t" << _originalQuery );
         _plans.clear();
         _usingCachedPlan = false;
+        _usingCostedPlan = false;
 
         _generator.addInitialPlans();
     }
@@ -700,6 +889,13 @@ namespace mongo {
         pushPlan( plan );
     }
 
+    void QueryPlanSet::setCostedPlan( const QueryPlanPtr& plan ) {
+        verify( nPlans() == 0 );
+        _usingCostedPlan = true;
+        pushPlan( plan );
+        _mayRecordPlan = true;
+    }
+
     void QueryPlanSet::addCandidatePlan( const QueryPlanPtr& plan ) {
         // If _plans is nonempty, the new plan may be supplementing a recorded plan at the first
         // position of _plans.  It must not duplicate the first plan.
@@ -1156,7 +1352,8 @@ namespace mongo {
     const QueryPlan *MultiPlanScanner::singlePlan() const {
         if ( _or ||
              _currentQps->nPlans() != 1 ||
-             _currentQps->hasPossiblyExcludedPlans() ) {
+             _currentQps->hasPossiblyExcludedPlans() ||
+             _currentQps->usingCostedPlan() ) {
             return 0;
         }
         return _currentQps->firstPlan().get();
@@ -1254,6 +1451,7 @@ namespace mongo {
                 _explainPlanInfo->notePlan( *_c,
                                             _queryPlan->scanAndOrderRequired(),
                                            _queryPlan->keyFieldsOnly() );
+                _explainPlanInfo->noteEstimate( _queryPlan->estimatedNscanned() );
                 shared_ptr<ExplainClauseInfo> clauseInfo( new ExplainClauseInfo() );
                 clauseInfo->addPlanInfo( _explainPlanInfo );
                 _mps->addClauseInfo( clauseInfo );
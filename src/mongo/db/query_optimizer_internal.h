@@ -145,6 +145,9 @@ namespace mongo {
         BSONObj currPK() const { return _c ? _c->currPK() : BSONObj(); }
         BSONObj currKey() const { return _c ? _c->currKey() : BSONObj(); }
         BSONObj current() const { return _c ? _c->current() : BSONObj(); }
+        boost::shared_ptr<void> currentPin() const {
+            return _c ? _c->currentPin() : boost::shared_ptr<void>();
+        }
         bool currentMatches( MatchDetails* details );
         
         /**
@@ -306,6 +309,20 @@ namespace mongo {
 
         bool addCachedPlan( NamespaceDetails* d );
 
+        /**
+         * @return the plan among 'plans' whose estimated cost is lower than all others by at
+         * least queryPlanCostRatio, or an empty pointer if the plans should be raced instead.
+         */
+        shared_ptr<QueryPlan> chooseByEstimatedCost
+                ( const vector<shared_ptr<QueryPlan> >& plans ) const;
+
+        /**
+         * @return a plan intersecting the secondary index plans among 'plans' if it is estimated
+         * to be much cheaper than any of 'plans', otherwise an empty pointer.
+         */
+        shared_ptr<QueryPlan> newIntersectionPlan
+                ( NamespaceDetails* d, const vector<shared_ptr<QueryPlan> >& plans ) const;
+
         shared_ptr<QueryPlan> newPlan( NamespaceDetails* d,
                                        int idxNo,
                                        const BSONObj& min = BSONObj(),
@@ -361,6 +378,7 @@ namespace mongo {
         
         /** @return true if a plan is selected based on previous success of this plan. */
         bool usingCachedPlan() const { return _usingCachedPlan; }
+        bool usingCostedPlan() const { return _usingCostedPlan; }
 
         /** @return true if some candidate plans may have been excluded due to plan caching. */
         bool hasPossiblyExcludedPlans() const;
@@ -395,6 +413,12 @@ namespace mongo {
         /** Configure a query plan from the plan cache. */
         void setCachedPlan( const QueryPlanPtr& plan, const CachedQueryPlan& cachedPlan );
 
+        /**
+         * Configure a single query plan chosen by estimated cost.  It is run like a raced plan,
+         * so it is recorded only once it has run, with the nscanned it actually took.
+         */
+        void setCostedPlan( const QueryPlanPtr& plan );
+
         /** Add a candidate query plan, potentially one of many. */
         void addCandidatePlan( const QueryPlanPtr& plan );
 
@@ -438,6 +462,7 @@ namespace mongo {
         PlanVector _plans;
         bool _mayRecordPlan;
         bool _usingCachedPlan;
+        bool _usingCostedPlan;
         CandidatePlanCharacter _cachedPlanCharacter;
         BSONObj _order;
         long long _oldNScanned;
@@ -678,6 +703,7 @@ namespace mongo {
 
         virtual bool ok() { return _c->ok(); }
         virtual BSONObj current() { return _c->current(); }
+        virtual boost::shared_ptr<void> currentPin() { return _c->currentPin(); }
         virtual BSONObj currPK() const { return _c->currPK(); }
         virtual bool advance();
 
@@ -21,6 +21,8 @@
 #include "mongo/db/parsed_query.h"
 #include "mongo/db/query_plan_summary.h"
 #include "mongo/db/queryutil.h"
+#include "mongo/db/storage/key.h"
+#include "mongo/s/d_logic.h"
 #include "mongo/server.h"
 
 namespace mongo {
@@ -60,6 +62,11 @@ namespace mongo {
         return ret.release();
     }
     
+    QueryPlan* QueryPlan::makeIntersection( const vector<shared_ptr<QueryPlan> >& intersected ) {
+        verify( intersected.size() >= 2 );
+        return new QueryPlan( intersected );
+    }
+
     QueryPlan::QueryPlan( NamespaceDetails* d,
                           int idxNo,
                           const FieldRangeSetPair& frsp,
@@ -81,9 +88,33 @@ namespace mongo {
         _endKeyInclusive(),
         _utility( Helpful ),
         _special( special ),
-        _startOrEndSpec() {
+        _startOrEndSpec(),
+        _estimated(),
+        _estimatedNscanned( -1 ) {
     }
     
+    QueryPlan::QueryPlan( const vector<shared_ptr<QueryPlan> >& intersected ) :
+        _d( intersected.front()->_d ),
+        _idxNo( intersected.front()->_idxNo ),
+        _frs( intersected.front()->_frs ),
+        _frsMulti( intersected.front()->_frsMulti ),
+        _originalQuery( intersected.front()->_originalQuery ),
+        _order( intersected.front()->_order ),
+        _parsedQuery( intersected.front()->_parsedQuery ),
+        _index( intersected.front()->_index ),
+        // Documents come back in primary key order, or in the order of the last intersected
+        // index.
+        _scanAndOrderRequired( !_order.isEmpty() ),
+        _matcherNecessary( true ),
+        _direction( 0 ),
+        _endKeyInclusive(),
+        _utility( Helpful ),
+        _startOrEndSpec(),
+        _intersected( intersected ),
+        _estimated(),
+        _estimatedNscanned( -1 ) {
+    }
+
     void QueryPlan::init( const FieldRangeSetPair* originalFrsp,
                           const BSONObj& startKey,
                           const BSONObj& endKey ) {
@@ -253,37 +284,142 @@ doneCheckOrder:
             return shared_ptr<Cursor>( new DummyCursor() );
         }
 
+        if ( !_intersected.empty() ) {
+            // Primary keys are in order within a single point of a secondary index.
+            bool pkOrdered = true;
+            vector<shared_ptr<IndexCursor> > inputs;
+            for ( vector<shared_ptr<QueryPlan> >::const_iterator i = _intersected.begin();
+                  i != _intersected.end(); ++i ) {
+                const QueryPlan& plan = **i;
+                pkOrdered = pkOrdered && plan._direction >= 0 && plan._frv->size() == 1 &&
+                        plan._frv->containsOnlyPointIntervals();
+                inputs.push_back( IndexCursor::make( _d, *plan._index, plan._frv, 0,
+                                                     plan._direction >= 0 ? 1 : -1 ) );
+            }
+            return IntersectionCursor::make( _d, inputs, pkOrdered, _originalQuery );
+        }
+
+        shared_ptr<Cursor> c;
         if ( willScanTable() ) {
             checkTableScanAllowed();
             const int direction = _order.getField("$natural").number() >= 0 ? 1 : -1;
             NamespaceDetails *d = nsdetails( _frs.ns() );
-            return shared_ptr<Cursor>( BasicCursor::make( d, direction ) );
+            c = BasicCursor::make( d, direction );
         }
-
-        if ( _startOrEndSpec ) {
+        else if ( _startOrEndSpec ) {
             // we are sure to spec _endKeyInclusive
-            return shared_ptr<Cursor>( IndexCursor::make( _d,
-                                                          *_index,
-                                                          _startKey,
-                                                          _endKey,
-                                                          _endKeyInclusive,
-                                                          _direction >= 0 ? 1 : -1 ) );
-        }
-
-        if ( _index->special() ) {
-            return shared_ptr<Cursor>( IndexCursor::make( _d,
-                                                          *_index,
-                                                          _frv->startKey(),
-                                                          _frv->endKey(),
-                                                          true,
-                                                          _direction >= 0 ? 1 : -1 ) );
-        }
-
-        return shared_ptr<Cursor>( IndexCursor::make( _d,
-                                                      *_index,
-                                                      _frv,
-                                                      independentRangesSingleIntervalLimit(),
-                                                      _direction >= 0 ? 1 : -1 ) );
+            c = IndexCursor::make( _d,
+                                   *_index,
+                                   _startKey,
+                                   _endKey,
+                                   _endKeyInclusive,
+                                   _direction >= 0 ? 1 : -1 );
+        }
+        else if ( _index->special() ) {
+            c = IndexCursor::make( _d,
+                                   *_index,
+                                   _frv->startKey(),
+                                   _frv->endKey(),
+                                   true,
+                                   _direction >= 0 ? 1 : -1 );
+        }
+        else {
+            c = IndexCursor::make( _d,
+                                   *_index,
+                                   _frv,
+                                   independentRangesSingleIntervalLimit(),
+                                   _direction >= 0 ? 1 : -1 );
+        }
+
+        vector<string> fields;
+        const bool project = fieldsToFetch( fields );
+        if ( project ) {
+            c->setFieldsToFetch( fields );
+        }
+        // A covered plan keeps no documents, so there's nothing to filter.
+        if ( !( project && fields.empty() ) && _matcherNecessary &&
+             matcher()->canFilterWhileFetching() ) {
+            c->setFetchFilter( matcher() );
+        }
+        return c;
+    }
+
+    namespace {
+
+        /**
+         * Adds the top-level fields query looks at to fields.
+         * @return false if it may look at any field, as $where does.
+         */
+        bool getQueryTopLevelFields( const BSONObj &query, set<string> &fields ) {
+            BSONObjIterator i( query );
+            while ( i.more() ) {
+                const BSONElement e = i.next();
+                const char *name = e.fieldName();
+                if ( name[0] != '$' ) {
+                    fields.insert( mongoutils::str::before( name, '.' ) );
+                }
+                else if ( mongoutils::str::equals( name, "$and" ) || mongoutils::str::equals( name, "$or" ) ||
+                          mongoutils::str::equals( name, "$nor" ) ) {
+                    if ( e.type() != Array ) {
+                        return false;
+                    }
+                    BSONObjIterator j( e.embeddedObject() );
+                    while ( j.more() ) {
+                        const BSONElement clause = j.next();
+                        if ( clause.type() != Object ||
+                             !getQueryTopLevelFields( clause.embeddedObject(), fields ) ) {
+                            return false;
+                        }
+                    }
+                }
+                else if ( !mongoutils::str::equals( name, "$atomic" ) && !mongoutils::str::equals( name, "$isolated" ) ) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    } // namespace
+
+    bool QueryPlan::fieldsToFetch( vector<string> &fields ) const {
+        if ( !_parsedQuery || !_parsedQuery->getFields() ) {
+            return false;
+        }
+
+        if ( _keyFieldsOnly && !_scanAndOrderRequired && !matcher()->needRecord() ) {
+            // Covered, the documents aren't needed at all.
+            fields.clear();
+            return true;
+        }
+
+        // Keep what the projection returns, and what the matcher and the sort read.
+        set<string> needed;
+        if ( !_parsedQuery->getFields()->getTopLevelFields( needed ) ||
+             !getQueryTopLevelFields( _parsedQuery->getFilter(), needed ) ) {
+            return false;
+        }
+        BSONObjIterator i( _parsedQuery->getOrder() );
+        while ( i.more() ) {
+            needed.insert( mongoutils::str::before( i.next().fieldName(), '.' ) );
+        }
+        needed.insert( "_id" );
+        BSONObjIterator j( _d->pkPattern() );
+        while ( j.more() ) {
+            needed.insert( mongoutils::str::before( j.next().fieldName(), '.' ) );
+        }
+        if ( shardingState.needShardChunkManager( ns() ) ) {
+            // Orphans are filtered out by their shard key.
+            ShardChunkManagerPtr manager = shardingState.getShardChunkManager( ns() );
+            if ( !manager ) {
+                return false;
+            }
+            BSONObjIterator k( manager->getKey() );
+            while ( k.more() ) {
+                needed.insert( mongoutils::str::before( k.next().fieldName(), '.' ) );
+            }
+        }
+        fields.assign( needed.begin(), needed.end() );
+        return true;
     }
 
     shared_ptr<Cursor> QueryPlan::newReverseCursor() const {
@@ -300,6 +436,14 @@ doneCheckOrder:
     BSONObj QueryPlan::indexKey() const {
         if ( !_index )
             return BSON( "$natural" << 1 );
+        if ( !_intersected.empty() ) {
+            BSONArrayBuilder keys;
+            for ( vector<shared_ptr<QueryPlan> >::const_iterator i = _intersected.begin();
+                  i != _intersected.end(); ++i ) {
+                keys.append( (*i)->indexKey() );
+            }
+            return BSON( "$intersect" << keys.arr() );
+        }
         return _index->keyPattern();
     }
 
@@ -314,6 +458,10 @@ doneCheckOrder:
         if ( _utility == Impossible ) {
             return;
         }
+        // The plan cache records a single index.
+        if ( !_intersected.empty() ) {
+            return;
+        }
 
         NamespaceDetails *d = nsdetails(ns());
         if (d != NULL) {
@@ -324,6 +472,106 @@ doneCheckOrder:
         }
     }
     
+    namespace {
+        // Bounds with more intervals than this are estimated using the outermost intervals of
+        // the trailing fields, each estimate costs two tree descents.
+        const int MaxEstimatedIntervals = 64;
+    }
+
+    long long QueryPlan::estimatedNscanned() const {
+        if ( !_estimated ) {
+            _estimatedNscanned = estimateNscanned();
+            _estimated = true;
+        }
+        return _estimatedNscanned;
+    }
+
+    long long QueryPlan::estimateNscanned() const {
+        if ( _utility == Impossible ) {
+            return 0;
+        }
+        if ( willScanTable() ) {
+            DB_BTREE_STAT64 st;
+            _d->getPKIndex().getStat64( &st );
+            return st.bt_nkeys;
+        }
+        if ( !_intersected.empty() ) {
+            long long total = 0;
+            for ( vector<shared_ptr<QueryPlan> >::const_iterator i = _intersected.begin();
+                  i != _intersected.end(); ++i ) {
+                const long long n = (*i)->estimatedNscanned();
+                if ( n < 0 ) {
+                    return -1;
+                }
+                total += n;
+            }
+            return total;
+        }
+        if ( !_special.empty() || !_frv ) {
+            return -1;
+        }
+        if ( _startOrEndSpec ) {
+            return estimateKeysBetween( _startKey, _endKey );
+        }
+
+        // Expand the cartesian product of the fields' intervals as far as it stays small, the
+        // remaining fields are bounded by their outermost intervals.
+        const vector<FieldRange>& ranges = _frv->ranges();
+        int expandedFields = 0;
+        long long combinations = 1;
+        while ( expandedFields < (int) ranges.size() ) {
+            combinations *= ranges[ expandedFields ].intervals().size();
+            if ( combinations > MaxEstimatedIntervals ) {
+                break;
+            }
+            ++expandedFields;
+        }
+        vector<const FieldInterval*> combo;
+        combo.reserve( expandedFields );
+        return estimateFrvKeys( combo, expandedFields );
+    }
+
+    long long QueryPlan::estimateFrvKeys( vector<const FieldInterval*>& combo,
+                                          int expandedFields ) const {
+        const vector<FieldRange>& ranges = _frv->ranges();
+        if ( (int) combo.size() < expandedFields ) {
+            long long total = 0;
+            const vector<FieldInterval>& intervals = ranges[ combo.size() ].intervals();
+            for ( vector<FieldInterval>::const_iterator i = intervals.begin();
+                  i != intervals.end(); ++i ) {
+                combo.push_back( &*i );
+                total += estimateFrvKeys( combo, expandedFields );
+                combo.pop_back();
+            }
+            return total;
+        }
+
+        BSONObjBuilder startKey;
+        BSONObjBuilder endKey;
+        for ( int i = 0; i < (int) ranges.size(); ++i ) {
+            if ( i < expandedFields ) {
+                startKey.appendAs( combo[ i ]->_lower._bound, "" );
+                endKey.appendAs( combo[ i ]->_upper._bound, "" );
+            }
+            else {
+                startKey.appendAs( ranges[ i ].intervals().front()._lower._bound, "" );
+                endKey.appendAs( ranges[ i ].intervals().back()._upper._bound, "" );
+            }
+        }
+        return estimateKeysBetween( startKey.done(), endKey.done() );
+    }
+
+    long long QueryPlan::estimateKeysBetween( const BSONObj& startKey,
+                                              const BSONObj& endKey ) const {
+        // Like IndexCursor::_prelockRange(), the bounds are in traversal order and secondary
+        // keys are padded with the smallest and largest possible primary key.
+        const bool isSecondary = !_d->isPKIndex( *_index );
+        const bool forward = _direction >= 0;
+        storage::Key leftKey( forward ? startKey : endKey, isSecondary ? &minKey : NULL );
+        storage::Key rightKey( forward ? endKey : startKey, isSecondary ? &maxKey : NULL );
+        return _index->estimateKeysInRange( leftKey, rightKey );
+    }
+
     void QueryPlan::checkTableScanAllowed() const {
         if ( likely( !cmdLine.noTableScan ) )
             return;
@@ -466,14 +714,64 @@ doneCheckOrder:
     
     shared_ptr<CoveredIndexMatcher> QueryPlan::matcher() const {
         if ( !_matcher ) {
-            _matcher.reset( new CoveredIndexMatcher( originalQuery(), indexKey() ) );
+            if ( !_intersected.empty() ) {
+                // There is no single index key to match against.
+                _matcher.reset( new CoveredIndexMatcher( residualQuery(), BSONObj() ) );
+            }
+            else {
+                _matcher.reset( new CoveredIndexMatcher( originalQuery(), indexKey() ) );
+            }
         }
         return _matcher;
     }
-    
+
+    BSONObj QueryPlan::residualQuery() const {
+        BSONObjBuilder b;
+        BSONObjIterator i( _originalQuery );
+        while( i.more() ) {
+            const BSONElement e = i.next();
+            bool answered = false;
+            switch( e.type() ) {
+                // Values that may match documents without the field, arrays, or more than the
+                // index bounds say.
+                case Object:
+                case Array:
+                case RegEx:
+                case jstNULL:
+                case Undefined:
+                case MinKey:
+                case MaxKey:
+                    break;
+                default:
+                    for ( vector<shared_ptr<QueryPlan> >::const_iterator p = _intersected.begin();
+                          p != _intersected.end(); ++p ) {
+                        const BSONElement keyField = (*p)->indexKey().firstElement();
+                        if ( !(*p)->isMultiKey() && keyField.isNumber() &&
+                             str::equals( keyField.fieldName(), e.fieldName() ) ) {
+                            answered = true;
+                            break;
+                        }
+                    }
+            }
+            if ( !answered ) {
+                b.append( e );
+            }
+        }
+        return b.obj();
+    }
+
     bool QueryPlan::isMultiKey() const {
         if ( _idxNo < 0 )
             return false;
+        if ( !_intersected.empty() ) {
+            for ( vector<shared_ptr<QueryPlan> >::const_iterator i = _intersected.begin();
+                  i != _intersected.end(); ++i ) {
+                if ( (*i)->isMultiKey() ) {
+                    return true;
+                }
+            }
+            return false;
+        }
         return _d->isMultikey( _idxNo );
     }
 
@@ -24,6 +24,7 @@
 namespace mongo {
 
     class Cursor;
+    struct FieldInterval;
     class FieldRangeSet;
     class FieldRangeSetPair;
     class IndexDetails;
@@ -54,6 +55,12 @@ namespace mongo {
                                 const BSONObj& endKey = BSONObj(),
                                 const std::string& special = "" );
 
+        /**
+         * @return a plan that runs the plans 'intersected', which must be over distinct secondary
+         * indexes of one collection, and returns only the documents found by all of them.
+         */
+        static QueryPlan* makeIntersection( const vector<shared_ptr<QueryPlan> >& intersected );
+
         /** Categorical classification of a QueryPlan's utility. */
         enum Utility {
             Impossible, // Cannot produce any matches, so the query must have an empty result set.
@@ -108,6 +115,9 @@ namespace mongo {
 
         int idxNo() const { return _idxNo; }
 
+        /** @return the plans intersected by this plan, empty unless made by makeIntersection(). */
+        const vector<shared_ptr<QueryPlan> >& intersectedPlans() const { return _intersected; }
+
         const char* ns() const;
 
         NamespaceDetails* nsd() const { return _d; }
@@ -127,6 +137,13 @@ namespace mongo {
         
         QueryPlanSummary summary() const;
 
+        /**
+         * @return an estimate of the number of keys this plan will scan, derived from the ydb's
+         * key range estimates over the plan's index bounds, or -1 if none can be made (for
+         * example for special indexes).  Computed on first use.
+         */
+        long long estimatedNscanned() const;
+
         // The following member functions are for testing, or public for testing.
         
         shared_ptr<FieldRangeVector> frv() const { return _frv; }
@@ -143,6 +160,7 @@ namespace mongo {
                    const BSONObj& order,
                    const shared_ptr<const ParsedQuery>& parsedQuery,
                    const std::string& special );
+        QueryPlan( const vector<shared_ptr<QueryPlan> >& intersected );
         void init( const FieldRangeSetPair* originalFrsp,
                    const BSONObj& startKey,
                    const BSONObj& endKey );
@@ -154,6 +172,21 @@ namespace mongo {
         /** @return true when the plan's query may contains an $exists:false predicate. */
         bool hasPossibleExistsFalsePredicate() const;
 
+        /**
+         * @return the query without the equality predicates that an intersected plan's index
+         * answers exactly, which need not be matched again against the document.
+         */
+        BSONObj residualQuery() const;
+
+        long long estimateNscanned() const;
+        /**
+         * @return true and the top-level fields of each document this plan's query needs, or
+         * none if it's covered, false if it may need any of them.
+         */
+        bool fieldsToFetch( vector<string> &fields ) const;
+        long long estimateKeysBetween( const BSONObj& startKey, const BSONObj& endKey ) const;
+        long long estimateFrvKeys( vector<const FieldInterval*>& combo, int expandedFields ) const;
+
         NamespaceDetails* _d;
         int _idxNo;
         const FieldRangeSet& _frs;
@@ -175,6 +208,9 @@ namespace mongo {
         bool _startOrEndSpec;
         shared_ptr<Projection::KeyOnly> _keyFieldsOnly;
         mutable shared_ptr<CoveredIndexMatcher> _matcher; // Lazy initialization.
+        vector<shared_ptr<QueryPlan> > _intersected;
+        mutable bool _estimated;
+        mutable long long _estimatedNscanned; // Lazy initialization.
     };
 
     std::ostream &operator<< ( std::ostream& out, const QueryPlan::Utility& utility );
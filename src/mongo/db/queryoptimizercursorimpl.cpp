@@ -54,6 +54,14 @@ namespace mongo {
         assertOk();
         return _currRunner->current();
     }
+
+    boost::shared_ptr<void> QueryOptimizerCursorImpl::currentPin() {
+        if ( _takeover ) {
+            return _takeover->currentPin();
+        }
+        assertOk();
+        return _currRunner->currentPin();
+    }
         
     BSONObj QueryOptimizerCursorImpl::currPK() const {
         return _takeover ? _takeover->currPK() : _currPK();
@@ -101,6 +101,8 @@ namespace mongo {
         virtual bool ok();
         
         virtual BSONObj current();
+
+        virtual boost::shared_ptr<void> currentPin();
         
         virtual BSONObj currPK() const;
 
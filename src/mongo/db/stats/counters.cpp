@@ -24,7 +24,6 @@ namespace mongo {
     OpCounters::OpCounters() {}
 
     void OpCounters::gotOp( int op , bool isCommand ) {
-        RARELY _checkWrap();
         switch ( op ) {
         case dbInsert: /*gotInsert();*/ break; // need to handle multi-insert
         case dbQuery:
@@ -45,35 +44,14 @@ namespace mongo {
         }
     }
 
-    void OpCounters::_checkWrap() {
-        const unsigned MAX = 1 << 30;
-        
-        bool wrap =
-            _insert.get() > MAX ||
-            _query.get() > MAX ||
-            _update.get() > MAX ||
-            _delete.get() > MAX ||
-            _getmore.get() > MAX ||
-            _command.get() > MAX;
-        
-        if ( wrap ) {
-            _insert.zero();
-            _query.zero();
-            _update.zero();
-            _delete.zero();
-            _getmore.zero();
-            _command.zero();
-        }
-    }
-
     BSONObj OpCounters::getObj() const {
         BSONObjBuilder b;
-        b.append( "insert" , _insert.get() );
-        b.append( "query" , _query.get() );
-        b.append( "update" , _update.get() );
-        b.append( "delete" , _delete.get() );
-        b.append( "getmore" , _getmore.get() );
-        b.append( "command" , _command.get() );
+        b.appendNumber( "insert" , (long long) _insert.get() );
+        b.appendNumber( "query" , (long long) _query.get() );
+        b.appendNumber( "update" , (long long) _update.get() );
+        b.appendNumber( "delete" , (long long) _delete.get() );
+        b.appendNumber( "getmore" , (long long) _getmore.get() );
+        b.appendNumber( "command" , (long long) _command.get() );
         return b.obj();
     }
 
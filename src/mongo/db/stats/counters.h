@@ -23,49 +23,48 @@
 #include "mongo/db/jsobj.h"
 #include "mongo/util/net/message.h"
 #include "mongo/util/processinfo.h"
+#include "mongo/util/concurrency/partitioned_counter.h"
 #include "mongo/util/concurrency/spin_lock.h"
 
 namespace mongo {
 
     /**
      * for storing operation counters
-     * note: not thread safe.  ok with that for speed
+     * each counter is partitioned per thread, so counting an op doesn't touch memory shared
+     * with other threads
      */
     class OpCounters {
     public:
+        typedef PartitionedCounter<unsigned long long> Counter;
 
         OpCounters();
-        void incInsertInWriteLock(int n) { _insert.x += n; }
-        void gotInsert() { _insert++; }
-        void gotQuery() { _query++; }
-        void gotUpdate() { _update++; }
-        void gotDelete() { _delete++; }
-        void gotGetMore() { _getmore++; }
-        void gotCommand() { _command++; }
+        void incInsertInWriteLock(int n) { _insert += n; }
+        void gotInsert() { ++_insert; }
+        void gotQuery() { ++_query; }
+        void gotUpdate() { ++_update; }
+        void gotDelete() { ++_delete; }
+        void gotGetMore() { ++_getmore; }
+        void gotCommand() { ++_command; }
 
         void gotOp( int op , bool isCommand );
 
         BSONObj getObj() const;
         
         // thse are used by snmp, and other things, do not remove
-        const AtomicUInt * getInsert() const { return &_insert; }
-        const AtomicUInt * getQuery() const { return &_query; }
-        const AtomicUInt * getUpdate() const { return &_update; }
-        const AtomicUInt * getDelete() const { return &_delete; }
-        const AtomicUInt * getGetMore() const { return &_getmore; }
-        const AtomicUInt * getCommand() const { return &_command; }
+        const Counter * getInsert() const { return &_insert; }
+        const Counter * getQuery() const { return &_query; }
+        const Counter * getUpdate() const { return &_update; }
+        const Counter * getDelete() const { return &_delete; }
+        const Counter * getGetMore() const { return &_getmore; }
+        const Counter * getCommand() const { return &_command; }
 
     private:
-        void _checkWrap();
-        
-        // todo: there will be a lot of cache line contention on these.  need to do something 
-        //       else eventually.
-        AtomicUInt _insert;
-        AtomicUInt _query;
-        AtomicUInt _update;
-        AtomicUInt _delete;
-        AtomicUInt _getmore;
-        AtomicUInt _command;
+        Counter _insert;
+        Counter _query;
+        Counter _update;
+        Counter _delete;
+        Counter _getmore;
+        Counter _command;
     };
 
     extern OpCounters globalOpCounters;
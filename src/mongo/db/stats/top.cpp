@@ -26,6 +26,7 @@
 #include "mongo/db/auth/privilege.h"
 #include "mongo/util/net/message.h"
 #include "mongo/db/commands.h"
+#include "mongo/util/concurrency/threadlocal.h"
 
 namespace mongo {
 
@@ -35,6 +36,43 @@ namespace mongo {
         count = (newer.count >= older.count) ? (newer.count - older.count) : newer.count;
     }
 
+    Top::LatencyHistogram::LatencyHistogram() {
+        memset( buckets , 0 , sizeof(buckets) );
+    }
+
+    Top::LatencyHistogram::LatencyHistogram( const LatencyHistogram& older , const LatencyHistogram& newer ) {
+        for ( int i = 0; i < NumBuckets; i++ ) {
+            buckets[i] = (newer.buckets[i] >= older.buckets[i]) ? (newer.buckets[i] - older.buckets[i]) : newer.buckets[i];
+        }
+    }
+
+    void Top::LatencyHistogram::inc( long long micros ) {
+        int i = 0;
+        for ( long long bound = 4; i < NumBuckets - 1 && micros >= bound; bound <<= 2 ) {
+            i++;
+        }
+        buckets[i]++;
+    }
+
+    void Top::LatencyHistogram::add( const LatencyHistogram& other ) {
+        for ( int i = 0; i < NumBuckets; i++ ) {
+            buckets[i] += other.buckets[i];
+        }
+    }
+
+    void Top::LatencyHistogram::append( BSONObjBuilder& b ) const {
+        // keyed by the exclusive upper bound of each bucket, in micros
+        long long bound = 4;
+        for ( int i = 0; i < NumBuckets; i++, bound <<= 2 ) {
+            if ( buckets[i] == 0 )
+                continue;
+            if ( i == NumBuckets - 1 )
+                b.appendNumber( "inf" , buckets[i] );
+            else
+                b.appendNumber( BSONObjBuilder::numStr( bound ) , buckets[i] );
+        }
+    }
+
     Top::CollectionData::CollectionData( const CollectionData& older , const CollectionData& newer )
         : total( older.total , newer.total ) ,
           readLock( older.readLock , newer.readLock ) ,
@@ -44,25 +82,70 @@ namespace mongo {
           insert( older.insert , newer.insert ) ,
           update( older.update , newer.update ) ,
           remove( older.remove , newer.remove ),
-          commands( older.commands , newer.commands ) {
+          commands( older.commands , newer.commands ),
+          lockConflicts( older.lockConflicts , newer.lockConflicts ) {
 
     }
 
+    void Top::CollectionData::add( const CollectionData& other ) {
+        total.add( other.total );
+        readLock.add( other.readLock );
+        writeLock.add( other.writeLock );
+        queries.add( other.queries );
+        getmore.add( other.getmore );
+        insert.add( other.insert );
+        update.add( other.update );
+        remove.add( other.remove );
+        commands.add( other.commands );
+        lockConflicts.add( other.lockConflicts );
+    }
+
+    namespace {
+        // which of Top's partitions this thread records into, plus one (0 means unassigned)
+        struct TopPartitionIndex {
+            TopPartitionIndex() : i(0) {}
+            unsigned i;
+        };
+    }
+
+    TSP_DECLARE(TopPartitionIndex, topPartitionIndex);
+    TSP_DEFINE(TopPartitionIndex, topPartitionIndex);
+
+    Top::Partition& Top::_myPartition() {
+        TopPartitionIndex *idx = topPartitionIndex.getMake();
+        if ( idx->i == 0 ) {
+            // round robin, so that the threads alive at the same time spread out evenly
+            idx->i = (_nextPartition++ % NumPartitions) + 1;
+        }
+        return _partitions[idx->i - 1];
+    }
+
     void Top::record( const StringData& ns , int op , int lockType , long long micros , bool command ) {
         if ( ns[0] == '?' )
             return;
 
         //cout << "record: " << ns << "\t" << op << "\t" << command << endl;
-        SimpleMutex::scoped_lock lk(_lock);
+        Partition& p = _myPartition();
+        SimpleMutex::scoped_lock lk(p.lock);
 
-        if ( ( command || op == dbQuery ) && ns == _lastDropped ) {
-            _lastDropped = "";
+        if ( ( command || op == dbQuery ) && ns == p.lastDropped ) {
+            p.lastDropped = "";
             return;
         }
 
-        CollectionData& coll = _usage[ns];
+        CollectionData& coll = p.usage[ns];
         _record( coll , op , lockType , micros , command );
-        _record( _global , op , lockType , micros , command );
+        _record( p.global , op , lockType , micros , command );
+    }
+
+    void Top::recordLockConflict( const StringData& ns ) {
+        if ( ns.empty() || ns[0] == '?' )
+            return;
+
+        Partition& p = _myPartition();
+        SimpleMutex::scoped_lock lk(p.lock);
+        p.usage[ns].lockConflicts.inc( 0 );
+        p.global.lockConflicts.inc( 0 );
     }
 
     void Top::_record( CollectionData& c , int op , int lockType , long long micros , bool command ) {
@@ -109,19 +192,40 @@ namespace mongo {
 
     void Top::collectionDropped( const StringData& ns ) {
         //cout << "collectionDropped: " << ns << endl;
-        SimpleMutex::scoped_lock lk(_lock);
-        _usage.erase(ns);
-        _lastDropped = ns.toString();
+        for ( int i = 0; i < NumPartitions; i++ ) {
+            SimpleMutex::scoped_lock lk( _partitions[i].lock );
+            _partitions[i].usage.erase(ns);
+        }
+        // The drop itself gets recorded by this thread once it finishes, into its own partition.
+        Partition& p = _myPartition();
+        SimpleMutex::scoped_lock lk( p.lock );
+        p.lastDropped = ns.toString();
     }
 
     void Top::cloneMap(Top::UsageMap& out) const {
-        SimpleMutex::scoped_lock lk(_lock);
-        out = _usage;
+        out = UsageMap();
+        for ( int i = 0; i < NumPartitions; i++ ) {
+            SimpleMutex::scoped_lock lk( _partitions[i].lock );
+            const UsageMap& usage = _partitions[i].usage;
+            for ( UsageMap::const_iterator it = usage.begin(); it != usage.end(); ++it ) {
+                out[it->first].add( it->second );
+            }
+        }
+    }
+
+    Top::CollectionData Top::getGlobalData() const {
+        CollectionData global;
+        for ( int i = 0; i < NumPartitions; i++ ) {
+            SimpleMutex::scoped_lock lk( _partitions[i].lock );
+            global.add( _partitions[i].global );
+        }
+        return global;
     }
 
     void Top::append( BSONObjBuilder& b ) {
-        SimpleMutex::scoped_lock lk( _lock );
-        _appendToUsageMap( b , _usage );
+        UsageMap usage;
+        cloneMap( usage );
+        _appendToUsageMap( b , usage );
     }
 
     void Top::_appendToUsageMap( BSONObjBuilder& b , const UsageMap& map ) const {
@@ -150,6 +254,9 @@ namespace mongo {
             _appendStatsEntry( b , "update" , coll.update );
             _appendStatsEntry( b , "remove" , coll.remove );
             _appendStatsEntry( b , "commands" , coll.commands );
+            BSONObjBuilder lockConflicts( b.subobjStart( "lockConflicts" ) );
+            lockConflicts.appendNumber( "count" , coll.lockConflicts.count );
+            lockConflicts.done();
 
             bb.done();
         }
@@ -162,6 +269,16 @@ namespace mongo {
         bb.done();
     }
 
+    void Top::_appendStatsEntry( BSONObjBuilder& b , const char * statsName , const OpUsageData& map ) const {
+        BSONObjBuilder bb( b.subobjStart( statsName ) );
+        bb.appendNumber( "time" , map.time );
+        bb.appendNumber( "count" , map.count );
+        BSONObjBuilder lb( bb.subobjStart( "latency" ) );
+        map.latency.append( lb );
+        lb.done();
+        bb.done();
+    }
+
     class TopCmd : public WebInformationCommand {
     public:
         TopCmd() : WebInformationCommand("top") {}
@@ -19,17 +19,24 @@
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include "mongo/bson/util/atomic_int.h"
+#include "mongo/util/concurrency/mutex.h"
 #include "mongo/util/string_map.h"
 
 namespace mongo {
 
     /**
      * tracks usage by collection
+     *
+     * Usage is accumulated in a fixed number of partitions, each with its own lock and its own
+     * map, and each thread always records into the same partition.  This keeps record(), which
+     * is called at the end of every operation, from serializing all threads on one mutex.  The
+     * partitions are only combined when someone reads the data.
      */
     class Top {
 
     public:
-        Top() : _lock("Top") { }
+        Top() : _nextPartition(0) { }
 
         struct UsageData {
             UsageData() : time(0) , count(0) {}
@@ -41,6 +48,46 @@ namespace mongo {
                 count++;
                 time += micros;
             }
+
+            void add( const UsageData& other ) {
+                count += other.count;
+                time += other.time;
+            }
+        };
+
+        /**
+         * counts of operations by latency, bucket i holds operations that took less than
+         * 4^(i+1) micros, the last bucket holds everything slower
+         */
+        struct LatencyHistogram {
+            static const int NumBuckets = 12;
+
+            LatencyHistogram();
+            LatencyHistogram( const LatencyHistogram& older , const LatencyHistogram& newer );
+
+            void inc( long long micros );
+            void add( const LatencyHistogram& other );
+            void append( BSONObjBuilder& b ) const;
+
+            long long buckets[NumBuckets];
+        };
+
+        struct OpUsageData : public UsageData {
+            OpUsageData() {}
+            OpUsageData( const OpUsageData& older , const OpUsageData& newer )
+                : UsageData( older , newer ) , latency( older.latency , newer.latency ) {}
+
+            LatencyHistogram latency;
+
+            void inc( long long micros ) {
+                UsageData::inc( micros );
+                latency.inc( micros );
+            }
+
+            void add( const OpUsageData& other ) {
+                UsageData::add( other );
+                latency.add( other.latency );
+            }
         };
 
         struct CollectionData {
@@ -50,40 +97,59 @@ namespace mongo {
             CollectionData() {}
             CollectionData( const CollectionData& older , const CollectionData& newer );
 
+            void add( const CollectionData& other );
+
             UsageData total;
 
             UsageData readLock;
             UsageData writeLock;
 
-            UsageData queries;
-            UsageData getmore;
-            UsageData insert;
-            UsageData update;
-            UsageData remove;
-            UsageData commands;
+            OpUsageData queries;
+            OpUsageData getmore;
+            OpUsageData insert;
+            OpUsageData update;
+            OpUsageData remove;
+            OpUsageData commands;
+
+            // row lock requests not granted, only counted since the ydb doesn't report how
+            // long they waited
+            UsageData lockConflicts;
         };
 
         typedef StringMap<CollectionData> UsageMap;
 
     public:
         void record( const StringData& ns , int op , int lockType , long long micros , bool command );
+        void recordLockConflict( const StringData& ns );
         void append( BSONObjBuilder& b );
         void cloneMap(UsageMap& out) const;
-        CollectionData getGlobalData() const { return _global; }
+        CollectionData getGlobalData() const;
         void collectionDropped( const StringData& ns );
 
     public: // static stuff
         static Top global;
 
     private:
+        static const int NumPartitions = 16;
+
+        struct Partition {
+            Partition() : lock("Top") {}
+            mutable SimpleMutex lock;
+            CollectionData global;
+            UsageMap usage;
+            string lastDropped;
+            char _pad[64]; // keep neighboring partitions' locks off the same cache line
+        };
+
+        Partition& _myPartition();
+
         void _appendToUsageMap( BSONObjBuilder& b , const UsageMap& map ) const;
         void _appendStatsEntry( BSONObjBuilder& b , const char * statsName , const UsageData& map ) const;
+        void _appendStatsEntry( BSONObjBuilder& b , const char * statsName , const OpUsageData& map ) const;
         void _record( CollectionData& c , int op , int lockType , long long micros , bool command );
 
-        mutable SimpleMutex _lock;
-        CollectionData _global;
-        UsageMap _usage;
-        string _lastDropped;
+        AtomicUInt _nextPartition;
+        Partition _partitions[NumPartitions];
     };
 
 } // namespace mongo
@@ -37,10 +37,13 @@
 #include "mongo/db/cmdline.h"
 #include "mongo/db/commands/server_status.h"
 #include "mongo/db/descriptor.h"
+#include "mongo/db/operation_arena.h"
 #include "mongo/db/storage/assert_ids.h"
 #include "mongo/db/storage/dbt.h"
 #include "mongo/db/storage/exception.h"
 #include "mongo/db/storage/key.h"
+#include "mongo/db/storage/lock_tree_stats.h"
+#include "mongo/db/stats/top.h"
 #include "mongo/util/assert_util.h"
 #include "mongo/util/log.h"
 
@@ -102,6 +105,8 @@ namespace mongo {
                 return 0;
             }
             try {
+                // Indexers and loaders call us once per document, dbt_array_push() copies the keys.
+                OperationArena::Scope arenaScope;
                 const DBT *desc = &dest_db->cmp_descriptor->dbt;
                 Descriptor descriptor(reinterpret_cast<const char *>(desc->data), desc->size);
 
@@ -676,15 +681,21 @@ namespace mongo {
         static void lock_not_granted_callback(DB *db, uint64_t requesting_txnid,
                                               const DBT *left_key, const DBT *right_key,
                                               uint64_t blocking_txnid) {
-            CurOp *op = cc().curop();
+            BSONArrayBuilder bounds;
+            pretty_bounds(db, left_key, right_key, bounds);
+            const BSONArray boundsArr = bounds.arr();
+
+            LockTreeStats::global.recordConflict(get_index_name(db), boundsArr);
+
+            CurOp *op = haveClient() ? cc().curop() : NULL;
             if (op != NULL) {
+                Top::global.recordLockConflict(op->getNS());
+
                 BSONObjBuilder info;
                 info.append("index", get_index_name(db));
                 info.appendNumber("requestingTxnid", requesting_txnid);
                 info.appendNumber("blockingTxnid", blocking_txnid);
-                BSONArrayBuilder bounds(info.subarrayStart("bounds"));
-                pretty_bounds(db, left_key, right_key, bounds);
-                bounds.done();
+                info.append("bounds", boundsArr);
                 op->debug().lockNotGrantedInfo = info.obj();
             }
         }
@@ -730,6 +741,63 @@ namespace mongo {
             status.appendArray("requests", e.array.done());
         }
 
+        void get_lock_tree_status(BSONObjBuilder &status) {
+            LockTreeStats::global.append(status);
+
+            // Summarize the requests that are waiting right now, per dictionary, so that
+            // contention shows up before the requests time out.
+            struct iterate_waiting_requests : public ExceptionSaver {
+                typedef map<string, vector<uint64_t> > WaitMap;
+                iterate_waiting_requests() : now(curTimeMillis64()) { }
+                static int callback(DB *db, uint64_t requesting_txnid,
+                                    const DBT *left_key, const DBT *right_key,
+                                    uint64_t blocking_txnid, uint64_t start_time,
+                                    void *extra) {
+                    iterate_waiting_requests *info = reinterpret_cast<iterate_waiting_requests *>(extra);
+                    try {
+                        vector<uint64_t> &buckets = info->waits[get_index_name(db)];
+                        buckets.resize(LockTreeStats::NumBuckets);
+                        const uint64_t waitedMillis = info->now > start_time ? info->now - start_time : 0;
+                        buckets[LockTreeStats::bucketFor(waitedMillis * 1000)]++;
+                        return 0;
+                    } catch (const std::exception &ex) {
+                        info->saveException(ex);
+                    }
+                    return -1;
+                }
+                const unsigned long long now;
+                WaitMap waits;
+            } e;
+            const int r = env->iterate_pending_lock_requests(env, iterate_waiting_requests::callback, &e);
+            if (r != 0) {
+                e.throwException();
+                handle_ydb_error(r);
+            }
+            BSONObjBuilder waiting(status.subobjStart("waiting"));
+            for (iterate_waiting_requests::WaitMap::const_iterator it = e.waits.begin(); it != e.waits.end(); ++it) {
+                BSONObjBuilder h(waiting.subobjStart(it->first));
+                LockTreeStats::appendHistogram(h, &it->second[0]);
+                h.doneFast();
+            }
+            waiting.doneFast();
+        }
+
+        class LockTreeSSS : public ServerStatusSection {
+          public:
+            LockTreeSSS() : ServerStatusSection("lockTree") {}
+            virtual bool includeByDefault() const { return true; }
+
+            BSONObj generateSection(const BSONElement &configElement) const {
+                if (cmdLine.isMongos()) {
+                    return BSONObj();
+                }
+
+                BSONObjBuilder result;
+                get_lock_tree_status(result);
+                return result.obj();
+            }
+        } lockTreeSSS;
+
         void get_live_transaction_status(BSONObjBuilder &status) {
             struct iterate_transactions : public ExceptionSaver {
                 iterate_transactions() { }
@@ -39,6 +39,7 @@ namespace mongo {
         void get_status(BSONObjBuilder &status);
         void get_pending_lock_request_status(BSONObjBuilder &status);
         void get_live_transaction_status(BSONObjBuilder &status);
+        void get_lock_tree_status(BSONObjBuilder &status);
         void log_flush();
         void checkpoint();
 
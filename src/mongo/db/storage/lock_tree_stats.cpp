@@ -0,0 +1,170 @@
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/storage/lock_tree_stats.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace mongo {
+
+    namespace storage {
+
+        LockTreeStats LockTreeStats::global;
+
+        static uint64_t hashName(const char *name) {
+            // FNV-1a, never returns 0 since 0 marks an empty slot
+            uint64_t h = 14695981039346656037ULL;
+            for (const char *p = name; *p != '\0'; ++p) {
+                h ^= (unsigned char) *p;
+                h *= 1099511628211ULL;
+            }
+            return h == 0 ? 1 : h;
+        }
+
+        int LockTreeStats::bucketFor(uint64_t micros) {
+            uint64_t millis = micros / 1000;
+            int b = 0;
+            while (millis > 0 && b < NumBuckets - 1) {
+                millis >>= 1;
+                ++b;
+            }
+            return b;
+        }
+
+        void LockTreeStats::appendHistogram(BSONObjBuilder &b, const uint64_t *buckets) {
+            for (int i = 0; i < NumBuckets; ++i) {
+                if (buckets[i] == 0) {
+                    continue;
+                }
+                // Bucket i holds waits shorter than 2^i ms.
+                if (i == NumBuckets - 1) {
+                    b.appendNumber("inf", (long long) buckets[i]);
+                } else {
+                    b.appendNumber(BSONObjBuilder::numStr(1 << i) + "ms", (long long) buckets[i]);
+                }
+            }
+        }
+
+        LockTreeStats::Slot *LockTreeStats::findSlot(const char *dname) {
+            const uint64_t h = hashName(dname);
+            for (int probe = 0; probe < NumSlots; ++probe) {
+                Slot &s = _slots[(h + probe) % NumSlots];
+                uint64_t cur = s.hash.load();
+                if (cur == 0) {
+                    cur = s.hash.compareAndSwap(0, h);
+                    if (cur == 0) {
+                        // We own the slot, publish the name.
+                        strncpy(s.name, dname, MaxNameLen - 1);
+                        s.name[MaxNameLen - 1] = '\0';
+                        s.ready.store(1);
+                        return &s;
+                    }
+                }
+                if (cur != h) {
+                    continue;
+                }
+                while (s.ready.load() == 0) {
+                    // Another thread claimed it and is copying the name in, very briefly.
+                }
+                if (strncmp(s.name, dname, MaxNameLen - 1) == 0) {
+                    return &s;
+                }
+            }
+            return &_overflow;
+        }
+
+        void LockTreeStats::recordConflict(const char *dname, const BSONObj &bounds) {
+            Slot *s = findSlot(dname);
+            s->conflicts.fetchAndAdd(1);
+
+            RangeSample &rs = _samples[_nextSample.fetchAndAdd(1) % NumRangeSamples];
+            BSONObj sample = BSON("index" << dname << "bounds" << bounds);
+            scoped_spinlock lk(rs.lock);
+            rs.sample = sample;
+        }
+
+        void LockTreeStats::append(BSONObjBuilder &b) const {
+            uint64_t totalConflicts = 0;
+            BSONObjBuilder dictionaries(b.subobjStart("dictionaries"));
+            for (int i = 0; i <= NumSlots; ++i) {
+                const Slot &s = (i < NumSlots ? _slots[i] : _overflow);
+                if (i < NumSlots && s.ready.load() == 0) {
+                    continue;
+                }
+                const uint64_t conflicts = s.conflicts.load();
+                if (conflicts == 0) {
+                    continue;
+                }
+                totalConflicts += conflicts;
+
+                BSONObjBuilder d(dictionaries.subobjStart(i < NumSlots ? s.name : "$other"));
+                d.appendNumber("conflicts", (long long) conflicts);
+                d.doneFast();
+            }
+            dictionaries.doneFast();
+            b.appendNumber("conflicts", (long long) totalConflicts);
+        }
+
+        static bool moreContended(const pair<int, BSONObj> &a, const pair<int, BSONObj> &b) {
+            return a.first > b.first;
+        }
+
+        void LockTreeStats::appendContendedRanges(BSONObjBuilder &b, int limit) const {
+            // Group identical (index, bounds) samples and count them.
+            map<BSONObj, int, BSONObjCmp> counts;
+            int sampled = 0;
+            for (int i = 0; i < NumRangeSamples; ++i) {
+                BSONObj sample;
+                {
+                    scoped_spinlock lk(_samples[i].lock);
+                    sample = _samples[i].sample;
+                }
+                if (!sample.isEmpty()) {
+                    counts[sample]++;
+                    sampled++;
+                }
+            }
+
+            vector<pair<int, BSONObj> > sorted;
+            sorted.reserve(counts.size());
+            for (map<BSONObj, int, BSONObjCmp>::const_iterator it = counts.begin(); it != counts.end(); ++it) {
+                sorted.push_back(make_pair(it->second, it->first));
+            }
+            std::stable_sort(sorted.begin(), sorted.end(), moreContended);
+
+            b.append("sampled", sampled);
+            BSONArrayBuilder ranges(b.subarrayStart("ranges"));
+            for (size_t i = 0; i < sorted.size() && (int) i < limit; ++i) {
+                if (ranges.len() + sorted[i].second.objsize() > BSONObjMaxUserSize - 1024) {
+                    // We're running out of space, better stop here.
+                    ranges.append("too many results to return");
+                    break;
+                }
+                BSONObjBuilder r(ranges.subobjStart());
+                r.appendElements(sorted[i].second);
+                r.append("conflicts", sorted[i].first);
+                r.doneFast();
+            }
+            ranges.doneFast();
+        }
+
+    } // namespace storage
+
+} // namespace mongo
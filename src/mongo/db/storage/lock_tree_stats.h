@@ -0,0 +1,103 @@
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include "mongo/bson/bsonobj.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/concurrency/spin_lock.h"
+
+namespace mongo {
+
+    namespace storage {
+
+        /**
+         * LockTreeStats aggregates row lock conflicts reported by the ydb lock tree, per
+         * dictionary, so that contention can be attributed to a collection or index instead of
+         * only being visible as a point-in-time dump of pending requests.
+         *
+         * Recording a conflict never takes a lock: dictionaries are assigned a slot in a fixed
+         * size, open-addressed table by compare-and-swap on the hash of their name, and all
+         * counters are atomic.  Once the table is full, further dictionaries are accounted to a
+         * shared overflow slot.  In addition, the key range of each conflict is kept in a fixed
+         * size ring so the most contended ranges can be reported.  Each ring entry has its own
+         * spinlock, so writers only contend if they land on the same entry.
+         *
+         * Statistics are cumulative since startup.  Dropped dictionaries keep their slot.
+         */
+        class LockTreeStats : boost::noncopyable {
+          public:
+            // Wait time histogram buckets, for requests that are waiting right now, are powers
+            // of two of milliseconds, the last bucket collects everything beyond
+            // 2^(NumBuckets-2) ms.
+            static const int NumBuckets = 20;
+            static const int NumSlots = 1024;
+            static const int NumRangeSamples = 1024;
+            static const size_t MaxNameLen = 128;
+
+            LockTreeStats() {}
+
+            /**
+             * Record that a lock request on dname was not granted.  bounds is the pretty-printed
+             * range [left, right] that was requested.  The ydb doesn't say how long the request
+             * waited, so only conflicts are counted.
+             */
+            void recordConflict(const char *dname, const BSONObj &bounds);
+
+            /** Appends per-dictionary conflict counts to b. */
+            void append(BSONObjBuilder &b) const;
+
+            /**
+             * Appends the `limit' most frequently conflicting ranges among the sampled ones, most
+             * contended first, as an array named "ranges".
+             */
+            void appendContendedRanges(BSONObjBuilder &b, int limit) const;
+
+            /** @return the histogram bucket for a wait of `micros' microseconds. */
+            static int bucketFor(uint64_t micros);
+
+            /** Appends the histogram in `buckets' to b, skipping empty buckets. */
+            static void appendHistogram(BSONObjBuilder &b, const uint64_t *buckets);
+
+            static LockTreeStats global;
+
+          private:
+            struct Slot {
+                AtomicWord<uint64_t> hash;
+                AtomicWord<uint32_t> ready;
+                char name[MaxNameLen];
+                AtomicWord<uint64_t> conflicts;
+            };
+
+            struct RangeSample {
+                mutable SpinLock lock;
+                BSONObj sample;
+            };
+
+            Slot *findSlot(const char *dname);
+
+            Slot _slots[NumSlots];
+            Slot _overflow;
+            AtomicWord<uint64_t> _nextSample;
+            RangeSample _samples[NumRangeSamples];
+        };
+
+    } // namespace storage
+
+} // namespace mongo
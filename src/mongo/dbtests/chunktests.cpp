@@ -19,7 +19,9 @@
 #include "pch.h"
 
 #include "../s/chunk.h"
+#include "mongo/db/hasher.h"
 #include "mongo/db/json.h"
+#include "mongo/util/timer.h"
 
 #include "dbtests.h"
 
@@ -50,6 +52,7 @@ namespace mongo {
             }
             
             chunkRanges.reloadAll( chunkMap );
+            _buildRoutingIndex();
         }
     };
     
@@ -236,6 +239,63 @@ namespace ChunkTests {
             }
         };
 
+        /* Routing throughput for a hashed shard key over the chunks shardCollection pre-splits,
+         * by hash version: hash the document's key, then find its chunk.  mongos routes with
+         * MD5 only, MurmurHash3 is here to show what a hashVersion 1 shard key would cost.
+         */
+        class HashedRoutingThroughput {
+        public:
+            void run() {
+                const int numChunks = 1024;
+                const long long intervalSize = ( numeric_limits<long long>::max() / numChunks ) * 2;
+                vector<BSONObj> splitPoints;
+                splitPoints.push_back( BSON( "a" << 0LL ) );
+                for ( long long current = intervalSize; splitPoints.size() < static_cast<size_t>( numChunks - 1 );
+                      current += intervalSize ) {
+                    splitPoints.push_back( BSON( "a" << current ) );
+                    splitPoints.push_back( BSON( "a" << -current ) );
+                }
+                sort( splitPoints.begin(), splitPoints.end(), BSONObjCmp() );
+
+                ChunkManager chunkManager;
+                chunkManager.setShardKey( BSON( "a" << "hashed" ) );
+                chunkManager.setSingleChunkForShards( splitPoints );
+                ASSERT_EQUALS( numChunks, chunkManager.numChunks() );
+
+                const int N = 100000;
+                vector<BSONObj> docs;
+                docs.reserve( N );
+                for ( int i = 0; i < N; i++ ) {
+                    docs.push_back( BSONObjBuilder().genOID().obj() );
+                }
+
+                // MD5 keys route to the chunk mongos picks for the document.
+                for ( int i = 0; i < 1000; i++ ) {
+                    const long long h = BSONElementHasher::hash64( docs[i].firstElement(), 0 );
+                    ASSERT( chunkManager.findIntersectingChunk( BSON( "a" << h ) ) ==
+                            chunkManager.findChunkForDoc( BSON( "a" << docs[i].firstElement() ) ) );
+                }
+
+                unsigned long long micros[2];
+                for ( HashVersion v = 0; v < 2; v++ ) {
+                    vector<ChunkPtr> routed( N );
+                    Timer t;
+                    for ( int i = 0; i < N; i++ ) {
+                        const long long h = BSONElementHasher::hash64( docs[i].firstElement(), 0, v );
+                        routed[i] = chunkManager.findIntersectingChunk( BSON( "a" << h ) );
+                    }
+                    micros[v] = t.micros() + 1;
+
+                    // Either hash spreads about 100 keys per chunk over all of them.
+                    set<ChunkPtr> hit( routed.begin(), routed.end() );
+                    ASSERT_EQUALS( static_cast<size_t>( numChunks ), hit.size() );
+                }
+                log() << "hashed shard key routing over " << numChunks << " chunks:\tMD5 "
+                      << ( N * 1000000ULL / micros[0] ) << "/s\tMurmurHash3 "
+                      << ( N * 1000000ULL / micros[1] ) << "/s" << endl;
+            }
+        };
+
     } // namespace ChunkManagerTests
     
     class All : public Suite {
@@ -264,6 +324,7 @@ namespace ChunkTests {
             add<ChunkManagerTests::InequalityThenUnsatisfiable>();
             add<ChunkManagerTests::OrEqualityUnsatisfiableInequality>();
             add<ChunkManagerTests::InMultiShard>();
+            add<ChunkManagerTests::HashedRoutingThroughput>();
         }
     } myall;
     
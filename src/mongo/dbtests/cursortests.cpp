@@ -20,6 +20,9 @@
 
 #include "mongo/pch.h"
 
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
 #include "mongo/db/cursor.h"
 #include "mongo/db/clientcursor.h"
 #include "mongo/db/instance.h"
@@ -27,6 +30,7 @@
 #include "mongo/db/queryutil.h"
 #include "mongo/db/query_optimizer.h"
 #include "mongo/dbtests/dbtests.h"
+#include "mongo/util/timer.h"
 
 namespace CursorTests {
 
@@ -642,6 +646,61 @@ namespace CursorTests {
             
         } // namespace Pin
 
+        /**
+         * Times threads pinning and releasing their own cursors, the way concurrent getMores do,
+         * to measure contention in the ClientCursor registry.
+         */
+        class PinContention {
+        public:
+            void run() {
+                Client::Transaction transaction(DB_SERIALIZABLE);
+                {
+                    Client::WriteContext ctx( ns() );
+                    vector<boost::shared_ptr<ClientCursor::Holder> > holders;
+                    for ( int i = 0; i < nThreads; i++ ) {
+                        boost::shared_ptr<Cursor> cursor( BasicCursor::make( nsdetails(ns()) ) );
+                        holders.push_back( boost::shared_ptr<ClientCursor::Holder>
+                                ( new ClientCursor::Holder( new ClientCursor( 0, cursor, ns() ) ) ) );
+                        _ids[i] = holders.back()->get()->cursorid();
+                        _found[i] = 0;
+                    }
+
+                    Timer t;
+                    boost::thread_group threads;
+                    for ( int i = 0; i < nThreads; i++ ) {
+                        threads.create_thread( boost::bind( &PinContention::pinLoop, this, i ) );
+                    }
+                    threads.join_all();
+                    const unsigned long long micros = t.micros();
+
+                    for ( int i = 0; i < nThreads; i++ ) {
+                        ASSERT_EQUALS( (int) N, _found[i] );
+                    }
+                    log() << "ClientCursor registry: " << (int) nThreads << " threads, "
+                          << ( (unsigned long long) nThreads * N * 1000000 / ( micros + 1 ) )
+                          << " pins/sec" << endl;
+                }
+                transaction.commit();
+            }
+        private:
+            enum { nThreads = 16 };
+#if defined(_DEBUG)
+            enum { N = 10000 };
+#else
+            enum { N = 200000 };
+#endif
+            void pinLoop( int i ) {
+                for ( int j = 0; j < N; j++ ) {
+                    ClientCursor::Pin pin( _ids[i] );
+                    if ( pin.c() ) {
+                        _found[i]++;
+                    }
+                }
+            }
+            CursorId _ids[nThreads];
+            int _found[nThreads];
+        };
+
     } // namespace ClientCursor
     
     class All : public Suite {
@@ -666,6 +725,7 @@ namespace CursorTests {
             add<ClientCursor::Pin::PinCursor>();
             add<ClientCursor::Pin::PinTwice>();
             add<ClientCursor::Pin::CursorDeleted>();
+            add<ClientCursor::PinContention>();
         }
     } myall;
 } // namespace CursorTests
@@ -18,6 +18,7 @@
 
 #include "pch.h"
 
+#include "mongo/db/cursor.h"
 #include "mongo/dbtests/dbtests.h"
 #include "mongo/s/chunk_version.h"
 #include "mongo/s/d_chunk_manager.h"
@@ -120,6 +121,89 @@ namespace {
         }
     };
 
+    // An index cursor positioned on one entry, that counts how often its document is loaded.
+    class OneKeyCursor : public Cursor {
+    public:
+        OneKeyCursor( const BSONObj& keyPattern , const BSONObj& key , const BSONObj& doc ) :
+            _keyPattern( keyPattern ) , _key( key ) , _doc( doc ) , loads( 0 ) {}
+        bool ok() { return true; }
+        BSONObj current() { loads++; return _doc; }
+        bool advance() { return false; }
+        BSONObj currKey() const { return _key; }
+        BSONObj indexKeyPattern() const { return _keyPattern; }
+        bool supportGetMore() { return false; }
+        bool getsetdup( const BSONObj& pk ) { return false; }
+        bool isMultiKey() const { return false; }
+        bool modifiedKeys() const { return false; }
+        long long nscanned() const { return 1; }
+    private:
+        BSONObj _keyPattern;
+        BSONObj _key;
+        BSONObj _doc;
+    public:
+        int loads;
+    };
+
+    class CoveredCursorTests {
+    public:
+        void run() {
+            BSONObj collection = BSON(CollectionType::ns("x.y") <<
+                                      CollectionType::dropped(false) <<
+                                      CollectionType::keyPattern(BSON("a" << 1 << "b" << 1)) <<
+                                      CollectionType::unique(false));
+
+            // [min->{a:10,b:0}) , <gap> , [{a:20,b:0}->max)
+            BSONArray chunks = BSON_ARRAY(BSON(ChunkType::name("x.y-a_MinKey") <<
+                                               ChunkType::ns("x.y") <<
+                                               ChunkType::min(BSON("a" << MINKEY << "b" << MINKEY)) <<
+                                               ChunkType::max(BSON("a" << 10 << "b" << 0))) <<
+
+                                          BSON(ChunkType::name("x.y-a_20") <<
+                                               ChunkType::ns("x.y") <<
+                                               ChunkType::min(BSON("a" << 20 << "b" << 0)) <<
+                                               ChunkType::max(BSON("a" << MAXKEY << "b" << MAXKEY))));
+
+            ShardChunkManager s ( collection , chunks );
+            bool loaded;
+
+            // The index has the shard key fields, in another order and with others between.
+            {
+                OneKeyCursor c( BSON( "b" << -1 << "c" << 1 << "a" << 1 ) , BSON( "" << 0 << "" << 7 << "" << 5 ) ,
+                                BSON( "a" << 5 << "b" << 0 << "c" << 7 ) );
+                ASSERT( s.belongsToMe( &c , &loaded ) );
+                ASSERT( ! loaded );
+                ASSERT_EQUALS( 0 , c.loads );
+            }
+            {
+                OneKeyCursor c( BSON( "b" << -1 << "c" << 1 << "a" << 1 ) , BSON( "" << 0 << "" << 7 << "" << 15 ) ,
+                                BSON( "a" << 15 << "b" << 0 << "c" << 7 ) );
+                ASSERT( ! s.belongsToMe( &c , &loaded ) );
+                ASSERT( ! loaded );
+                ASSERT_EQUALS( 0 , c.loads );
+            }
+            // The index is missing a shard key field.
+            {
+                OneKeyCursor c( BSON( "a" << 1 ) , BSON( "" << 25 ) , BSON( "a" << 25 << "b" << 3 ) );
+                ASSERT( s.belongsToMe( &c , &loaded ) );
+                ASSERT( loaded );
+                ASSERT_EQUALS( 1 , c.loads );
+            }
+            // A hashed index's keys aren't the field's values.
+            {
+                OneKeyCursor c( BSON( "a" << "hashed" << "b" << 1 ) , BSON( "" << 12345LL << "" << 0 ) ,
+                                BSON( "a" << 25 << "b" << 0 ) );
+                ASSERT( s.belongsToMe( &c , &loaded ) );
+                ASSERT( loaded );
+            }
+            // Not an index cursor.
+            {
+                OneKeyCursor c( BSONObj() , BSONObj() , BSON( "a" << 15 << "b" << 0 ) );
+                ASSERT( ! s.belongsToMe( &c , &loaded ) );
+                ASSERT( loaded );
+            }
+        }
+    };
+
     class GetNextTests {
     public:
         void run() {
@@ -462,6 +546,7 @@ namespace {
             add< BasicTests >();
             add< BasicCompoundTests >();
             add< RangeTests >();
+            add< CoveredCursorTests >();
             add< GetNextTests >();
             add< DeletedTests >();
             add< ClonePlusTests >();
@@ -21,6 +21,7 @@
 #include "mongo/db/hasher.h"
 #include "mongo/db/json.h"
 #include "mongo/dbtests/dbtests.h"
+#include "mongo/util/timer.h"
 
 namespace JsobjHashingTests {
 
@@ -156,6 +157,76 @@ namespace JsobjHashingTests {
         }
     };
 
+    /* The canonical stream is shared by both hash versions, so MurmurHash3 must squash the
+     * same values MD5 does and keep apart the ones it keeps apart.
+     */
+    class MurmurHashingTest {
+    public:
+        void run() {
+            const HashVersion v = BSONElementHasher::HASH_VERSION_MURMUR3;
+            const int seed = 0;
+
+            BSONObj i = BSON("a" << 3);
+            BSONObj l = BSON("a" << 3LL);
+            BSONObj d = BSON("a" << 3.1);
+            ASSERT_EQUALS( BSONElementHasher::hash64( i.firstElement() , seed , v ) ,
+                           BSONElementHasher::hash64( l.firstElement() , seed , v ) );
+            ASSERT_EQUALS( BSONElementHasher::hash64( i.firstElement() , seed , v ) ,
+                           BSONElementHasher::hash64( d.firstElement() , seed , v ) );
+
+            BSONObj four = BSON("a" << 4);
+            ASSERT_NOT_EQUALS( BSONElementHasher::hash64( i.firstElement() , seed , v ) ,
+                               BSONElementHasher::hash64( four.firstElement() , seed , v ) );
+            ASSERT_NOT_EQUALS( BSONElementHasher::hash64( i.firstElement() , seed , v ) ,
+                               BSONElementHasher::hash64( i.firstElement() , 1 , v ) );
+
+            // Different versions are different functions.
+            ASSERT_NOT_EQUALS( BSONElementHasher::hash64( i.firstElement() , seed , v ) ,
+                               BSONElementHasher::hash64( i.firstElement() , seed ) );
+
+            // Field names of embedded objects are part of the hash, and values too large for the
+            // stack buffer are hashed whole.
+            BSONObj o1 = BSON("a" << BSON("b" << 1));
+            BSONObj o2 = BSON("a" << BSON("c" << 1));
+            ASSERT_NOT_EQUALS( BSONElementHasher::hash64( o1.firstElement() , seed , v ) ,
+                               BSONElementHasher::hash64( o2.firstElement() , seed , v ) );
+            string big( 2048 , 'x' );
+            BSONObj s1 = BSON("a" << big);
+            big[2000] = 'y';
+            BSONObj s2 = BSON("a" << big);
+            ASSERT_NOT_EQUALS( BSONElementHasher::hash64( s1.firstElement() , seed , v ) ,
+                               BSONElementHasher::hash64( s2.firstElement() , seed , v ) );
+        }
+    };
+
+    /* Hashes per second for the values hashed shard keys and hashed indexes usually hold,
+     * by version.  Hashing is on the routing path of every operation on a hashed shard key.
+     */
+    class HashThroughput {
+    public:
+        void run() {
+            const BSONObj values[] = { BSONObjBuilder().genOID().obj(),
+                                       BSON("a" << 12345678LL),
+                                       BSON("a" << "user_1234567@example.com") };
+            const char *names[] = { "ObjectId", "long", "string" };
+            const int N = 200000;
+            for (size_t k = 0; k < sizeof(values) / sizeof(values[0]); k++) {
+                unsigned long long micros[2];
+                for (HashVersion v = 0; v < 2; v++) {
+                    long long sum = 0;
+                    Timer t;
+                    for (int i = 0; i < N; i++) {
+                        sum += BSONElementHasher::hash64( values[k].firstElement() , i & 1 , v );
+                    }
+                    micros[v] = t.micros() + 1;
+                    ASSERT_NOT_EQUALS( 0 , sum );
+                }
+                log() << "hash64 " << names[k] << ":\tMD5 " << (N * 1000000ULL / micros[0])
+                      << "/s\tMurmurHash3 " << (N * 1000000ULL / micros[1]) << "/s" << endl;
+            }
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "jsobjhashing" ) {
@@ -163,6 +234,8 @@ namespace JsobjHashingTests {
 
         void setupTests() {
             add< BSONElementHashingTest >();
+            add< MurmurHashingTest >();
+            add< HashThroughput >();
         }
     } myall;
 
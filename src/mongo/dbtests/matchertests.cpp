@@ -29,6 +29,10 @@
 #include "mongo/dbtests/dbtests.h"
 #include "mongo/util/timer.h"
 
+namespace mongo {
+    extern bool compiledMatcher;
+} // namespace mongo
+
 namespace MatcherTests {
 
     class CollectionBase {
@@ -276,6 +280,36 @@ namespace MatcherTests {
         
     } // namespace Covered
     
+    /** Basics compiled for one pass matching give the same answers as matchesDotted(). */
+    class CompiledBasics {
+    public:
+        ~CompiledBasics() {
+            compiledMatcher = true;
+        }
+        void run() {
+            const char *queries[] = {
+                "{a:5}", "{a:{$gt:4,$lte:6}}", "{a:5.5}", "{a:'x'}", "{a:{$lt:'xy'}}",
+                "{a:true}", "{a:{$in:[1,'x',null]}}", "{a:{$in:[[5]]}}", "{a:5,b:{$gte:2}}",
+                "{a:null}", "{a:{$ne:5}}", "{a:{$not:{$gt:5}}}", "{'b.c':2,a:{$gte:5}}"
+            };
+            const char *docs[] = {
+                "{}", "{a:5}", "{a:5.0}", "{a:NumberLong(5)}", "{a:6,b:1}", "{a:5,b:2}",
+                "{a:5.5}", "{a:'x'}", "{a:'xyz'}", "{a:true}", "{a:null}", "{a:[4,5]}",
+                "{a:[[5]]}", "{a:{b:5}}", "{a:'x',a:5}", "{b:{c:2},a:7}", "{a:1,b:[2,3]}"
+            };
+            for ( size_t i = 0; i < sizeof( queries ) / sizeof( queries[0] ); i++ ) {
+                Matcher m( fromjson( queries[i] ) );
+                for ( size_t j = 0; j < sizeof( docs ) / sizeof( docs[0] ); j++ ) {
+                    BSONObj doc = fromjson( docs[j] );
+                    compiledMatcher = false;
+                    const bool expected = m.matches( doc );
+                    compiledMatcher = true;
+                    ASSERT_EQUALS( expected, m.matches( doc ) );
+                }
+            }
+        }
+    };
+
     class TimingBase {
     public:
         long time( const BSONObj& patt , const BSONObj& obj ) {
@@ -418,6 +452,7 @@ namespace MatcherTests {
             add<Covered::ElemMatchKeyUnindexed>();
             add<Covered::ElemMatchKeyIndexed>();
             add<Covered::ElemMatchKeyIndexedSingleKey>();
+            add<CompiledBasics>();
             add<AllTiming>();
             add<Visit>();
             add<WithinBox>();
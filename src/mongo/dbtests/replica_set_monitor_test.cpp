@@ -315,6 +315,50 @@ namespace mongo_test {
         ASSERT(!node.isCompatible(mongo::ReadPreference_Nearest, &tags));
     }
 
+    TEST(ReplSetMonitorNode, LatencyAverage) {
+        ReplicaSetMonitor::Node node(HostAndPort("dummy", 3), NULL);
+        ASSERT_EQUALS(-1, node.latencyPercentile(50));
+
+        node.recordLatency(8000);
+        ASSERT_EQUALS(8, node.pingTimeMillis);
+
+        // Each new round trip moves the average an eighth of the way to it.
+        node.recordLatency(16000);
+        ASSERT_EQUALS(9, node.pingTimeMillis);
+        ASSERT_EQUALS(9000, static_cast<long long>(node.latencyMicros));
+    }
+
+    TEST(ReplSetMonitorNode, LatencyPercentiles) {
+        ReplicaSetMonitor::Node node(HostAndPort("dummy", 3), NULL);
+        for (int i = 1; i <= 100; i++) {
+            node.recordLatency(i * 1000);
+        }
+        ASSERT_EQUALS(1000, node.latencyPercentile(0));
+        ASSERT_EQUALS(51000, node.latencyPercentile(50));
+        ASSERT_EQUALS(100000, node.latencyPercentile(100));
+
+        // Only the most recent round trips count.
+        for (int i = 0; i < 1000; i++) {
+            node.recordLatency(500);
+        }
+        ASSERT_EQUALS(500, node.latencyPercentile(99));
+    }
+
+    TEST(ReplSetMonitorNode, LagRising) {
+        ReplicaSetMonitor::Node node(HostAndPort("dummy", 3), NULL);
+        node.recordLag(10, 1);
+        node.recordLag(20, 2);
+        ASSERT(!node.isFallingBehind());
+        node.recordLag(30, 3);
+        ASSERT(node.isFallingBehind());
+
+        // After a new primary the GTID distance is unknown, so the lag in time is compared.
+        node.recordLag(40, -1);
+        ASSERT(node.isFallingBehind());
+        node.recordLag(5, -1);
+        ASSERT(!node.isFallingBehind());
+    }
+
     class NodeSetFixtures {
     public:
         static vector<ReplicaSetMonitor::Node> getThreeMemberWithTags();
@@ -850,6 +894,66 @@ namespace mongo_test {
         ASSERT_EQUALS("b", host.host());
     }
 
+    TEST(ReplSetMonitorReadPref, SecOnlyAvoidsFallingBehind) {
+        vector<ReplicaSetMonitor::Node> nodes =
+                NodeSetFixtures::getThreeMemberWithTags();
+        TagSet tags(TagSetFixtures::getDefaultSet());
+        HostAndPort lastHost = nodes[1].addr;
+
+        nodes[2].recordLag(100, 10);
+        nodes[2].recordLag(200, 20);
+        nodes[2].recordLag(300, 30);
+        ASSERT(nodes[2].isFallingBehind());
+
+        bool isPrimarySelected = false;
+        HostAndPort host = ReplicaSetMonitor::selectNode(nodes,
+            mongo::ReadPreference_SecondaryOnly, &tags, 3, &lastHost,
+            &isPrimarySelected);
+
+        ASSERT(!isPrimarySelected);
+        ASSERT_EQUALS("a", host.host());
+        ASSERT_EQUALS("a", lastHost.host());
+    }
+
+    TEST(ReplSetMonitorReadPref, SecOnlyFallingBehindOnlyMatch) {
+        vector<ReplicaSetMonitor::Node> nodes =
+                NodeSetFixtures::getThreeMemberWithTags();
+        TagSet tags(TagSetFixtures::getP2Tag());
+        HostAndPort lastHost = nodes[2].addr;
+
+        nodes[2].recordLag(100, 10);
+        nodes[2].recordLag(200, 20);
+        nodes[2].recordLag(300, 30);
+
+        bool isPrimarySelected = false;
+        HostAndPort host = ReplicaSetMonitor::selectNode(nodes,
+            mongo::ReadPreference_SecondaryOnly, &tags, 3, &lastHost,
+            &isPrimarySelected);
+
+        ASSERT(!isPrimarySelected);
+        ASSERT_EQUALS("c", host.host());
+    }
+
+    TEST(ReplSetMonitorReadPref, SecOnlyLagCaughtUp) {
+        vector<ReplicaSetMonitor::Node> nodes =
+                NodeSetFixtures::getThreeMemberWithTags();
+        TagSet tags(TagSetFixtures::getDefaultSet());
+        HostAndPort lastHost = nodes[1].addr;
+
+        nodes[2].recordLag(100, 10);
+        nodes[2].recordLag(200, 20);
+        nodes[2].recordLag(300, 30);
+        nodes[2].recordLag(0, 0);
+        ASSERT(!nodes[2].isFallingBehind());
+
+        bool isPrimarySelected = false;
+        HostAndPort host = ReplicaSetMonitor::selectNode(nodes,
+            mongo::ReadPreference_SecondaryOnly, &tags, 3, &lastHost,
+            &isPrimarySelected);
+
+        ASSERT_EQUALS("c", host.host());
+    }
+
     class MultiTags: public mongo::unittest::Test {
     public:
         vector<ReplicaSetMonitor::Node> getNodes() const {
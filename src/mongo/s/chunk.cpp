@@ -671,6 +671,7 @@ namespace mongo {
                     const_cast<set<Shard>&>(_shards).swap(shards);
                     const_cast<ShardVersionMap&>(_shardVersions).swap(shardVersions);
                     const_cast<ChunkRangeManager&>(_chunkRanges).reloadAll(_chunkMap);
+                    _buildRoutingIndex();
 
                     // Once we load data, clear reference to old manager
                     _oldManager.reset();
@@ -1044,11 +1045,34 @@ namespace mongo {
         _version = ChunkVersion( 0, version.epoch() );
     }
 
+    void ChunkManager::_buildRoutingIndex() {
+        vector<BSONObj> maxes;
+        vector<ChunkPtr> chunks;
+        maxes.reserve( _chunkMap.size() );
+        chunks.reserve( _chunkMap.size() );
+        for ( ChunkMap::const_iterator it = _chunkMap.begin(); it != _chunkMap.end(); ++it ) {
+            maxes.push_back( it->first );
+            chunks.push_back( it->second );
+        }
+        const_cast<ChunkRoutingIndex&>(_routingIndex).reset( maxes );
+        const_cast<vector<ChunkPtr>&>(_routingChunks).swap( chunks );
+        if ( _routingIndex.empty() && !_chunkMap.empty() ) {
+            LOG(1) << "no routing index for " << _ns << ", shard key bounds can't be encoded" << endl;
+        }
+    }
+
     ChunkPtr ChunkManager::findIntersectingChunk( const BSONObj& point ) const {
         {
             BSONObj foo;
             ChunkPtr c;
-            {
+            const int i = _routingIndex.find( point );
+            if ( i >= 0 ) {
+                if ( static_cast<size_t>( i ) < _routingChunks.size() ) {
+                    c = _routingChunks[i];
+                    foo = c->getMax();
+                }
+            }
+            else {
                 ChunkMap::const_iterator it = _chunkMap.upper_bound( point );
                 if (it != _chunkMap.end()) {
                     foo = it->first;
@@ -0,0 +1,278 @@
+// @file chunk_routing_index.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/s/chunk_routing_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "mongo/util/log.h"
+
+namespace mongo {
+
+    namespace {
+
+        // Doubles are only encoded if they are integers this small, so that comparing them to a
+        // long long as doubles (which is what compareElementValues() does) gives the same answer
+        // as comparing them exactly.
+        const double maxExactDouble = 9007199254740992.0; // 2^53
+
+        template<typename Builder>
+        void appendBigEndian(Builder &b, unsigned long long v) {
+            char buf[8];
+            for (int i = 7; i >= 0; i--) {
+                buf[i] = static_cast<char>(v & 0xff);
+                v >>= 8;
+            }
+            b.appendBuf(buf, sizeof(buf));
+        }
+
+        // Flipping the sign bit makes signed values sort as unsigned big-endian bytes.
+        template<typename Builder>
+        void appendSigned(Builder &b, long long v) {
+            appendBigEndian(b, static_cast<unsigned long long>(v) ^ (1ULL << 63));
+        }
+
+    } // namespace
+
+    ChunkRoutingIndex::ChunkRoutingIndex() : _n(0), _numeric(false), _numericBase(0) {}
+
+    bool ChunkRoutingIndex::exactLong(const BSONElement &e, long long &out) {
+        switch (e.type()) {
+        case NumberInt:
+            out = e._numberInt();
+            return true;
+        case NumberLong:
+            out = e._numberLong();
+            return true;
+        case NumberDouble: {
+            const double d = e._numberDouble();
+            if (d > -maxExactDouble && d < maxExactDouble && d == static_cast<double>(static_cast<long long>(d))) {
+                out = static_cast<long long>(d);
+                return true;
+            }
+            return false;
+        }
+        default:
+            return false;
+        }
+    }
+
+    template<typename Builder>
+    bool ChunkRoutingIndex::encodeElement(const BSONElement &e, Builder &b) {
+        switch (e.type()) {
+        case MinKey:
+        case MaxKey:
+        case jstNULL:
+        case NumberInt:
+        case NumberLong:
+        case NumberDouble:
+        case String:
+        case jstOID:
+        case Bool:
+        case Date:
+            break;
+        default:
+            return false;
+        }
+        // canonicalType() is -1 for MinKey and 127 for MaxKey.
+        b.appendChar(static_cast<char>(e.canonicalType() + 1));
+        switch (e.type()) {
+        case NumberInt:
+        case NumberLong:
+        case NumberDouble: {
+            long long v;
+            if (!exactLong(e, v)) {
+                return false;
+            }
+            appendSigned(b, v);
+            break;
+        }
+        case String: {
+            // compareElementValues() compares the bytes and then the lengths, which is what
+            // memcmp() does with a terminating NUL as long as there are no others.
+            const int len = e.valuestrsize() - 1;
+            if (memchr(e.valuestr(), '\0', len) != NULL) {
+                return false;
+            }
+            b.appendBuf(e.valuestr(), len + 1);
+            break;
+        }
+        case jstOID:
+            b.appendBuf(e.value(), 12);
+            break;
+        case Bool:
+            b.appendChar(e.boolean() ? 1 : 0);
+            break;
+        case Date:
+            appendSigned(b, static_cast<long long>(e.date().millis));
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    template<typename Builder>
+    bool ChunkRoutingIndex::encode(const BSONObj &o, Builder &b) const {
+        size_t i = 0;
+        for (BSONObjIterator it(o); it.more(); ++i) {
+            const BSONElement e = it.next();
+            if (i >= _fieldNames.size() || _fieldNames[i] != e.fieldName()) {
+                return false;
+            }
+            if (!encodeElement(e, b)) {
+                return false;
+            }
+        }
+        return i == _fieldNames.size();
+    }
+
+    void ChunkRoutingIndex::reset(const std::vector<BSONObj> &keys) {
+        _n = 0;
+        _fieldNames.clear();
+        _numeric = false;
+        _splits.clear();
+        _numericBase = 0;
+        _keys.clear();
+        _offsets.clear();
+        if (keys.empty() || keys.size() > static_cast<size_t>(std::numeric_limits<int>::max())) {
+            return;
+        }
+
+        std::vector<std::string> fieldNames;
+        for (BSONObjIterator it(keys.back()); it.more(); ) {
+            fieldNames.push_back(it.next().fieldName());
+        }
+        _fieldNames.swap(fieldNames);
+
+        if (_fieldNames.size() == 1) {
+            std::vector<long long> splits;
+            splits.reserve(keys.size());
+            size_t begin = 0;
+            size_t end = keys.size();
+            if (keys.front().firstElement().type() == MinKey) {
+                begin++;
+            }
+            if (end > begin && keys.back().firstElement().type() == MaxKey) {
+                end--;
+            }
+            bool ok = true;
+            for (size_t i = 0; ok && i < keys.size(); i++) {
+                const BSONElement e = keys[i].firstElement();
+                ok = keys[i].nFields() == 1 && _fieldNames[0] == e.fieldName();
+                long long v;
+                if (ok && i >= begin && i < end) {
+                    ok = exactLong(e, v) && (splits.empty() || splits.back() < v);
+                    if (ok) {
+                        splits.push_back(v);
+                    }
+                }
+            }
+            if (ok) {
+                _numeric = true;
+                _splits.swap(splits);
+                _numericBase = static_cast<int>(begin);
+                _n = keys.size();
+                return;
+            }
+        }
+
+        BufBuilder b;
+        std::vector<unsigned> offsets;
+        offsets.reserve(keys.size() + 1);
+        for (size_t i = 0; i < keys.size(); i++) {
+            offsets.push_back(b.len());
+            if (!encode(keys[i], b)) {
+                return;
+            }
+            if (i > 0) {
+                const char *prev = b.buf() + offsets[i - 1];
+                const int prevLen = offsets[i] - offsets[i - 1];
+                const int len = b.len() - offsets[i];
+                const int c = memcmp(prev, b.buf() + offsets[i], std::min(prevLen, len));
+                if (c > 0 || (c == 0 && prevLen >= len)) {
+                    warning() << "shard key bounds " << keys[i - 1] << " and " << keys[i]
+                              << " don't sort the same encoded, not building routing index" << endl;
+                    return;
+                }
+            }
+        }
+        offsets.push_back(b.len());
+        _keys.assign(b.buf(), b.len());
+        _offsets.swap(offsets);
+        _n = keys.size();
+    }
+
+    int ChunkRoutingIndex::findLong(long long key) const {
+        // Branch-free upper_bound: the answer is always in [lo, lo + len], and the comparison
+        // just picks between two values for lo, so it compiles to a conditional move.
+        const long long *a = _splits.empty() ? NULL : &_splits[0];
+        size_t lo = 0;
+        size_t len = _splits.size();
+        if (len == 0) {
+            return 0;
+        }
+        while (len > 1) {
+            const size_t half = len / 2;
+            lo = (a[lo + half] <= key) ? lo + half : lo;
+            len -= half;
+        }
+        return static_cast<int>(lo + (a[lo] <= key));
+    }
+
+    int ChunkRoutingIndex::findEncoded(const char *key, int keyLen) const {
+        const char *keys = _keys.data();
+        const unsigned *offsets = &_offsets[0];
+        size_t lo = 0;
+        size_t len = _n;
+        while (len > 1) {
+            const size_t half = len / 2;
+            const size_t mid = lo + half;
+            const int midLen = offsets[mid + 1] - offsets[mid];
+            const int c = memcmp(keys + offsets[mid], key, std::min(midLen, keyLen));
+            const bool le = c < 0 || (c == 0 && midLen <= keyLen);
+            lo = le ? mid : lo;
+            len -= half;
+        }
+        const int loLen = offsets[lo + 1] - offsets[lo];
+        const int c = memcmp(keys + offsets[lo], key, std::min(loLen, keyLen));
+        return static_cast<int>(lo + (c < 0 || (c == 0 && loLen <= keyLen)));
+    }
+
+    int ChunkRoutingIndex::find(const BSONObj &point) const {
+        if (_n == 0) {
+            return -1;
+        }
+        if (_numeric) {
+            const BSONElement e = point.firstElement();
+            long long v;
+            if (point.nFields() != 1 || _fieldNames[0] != e.fieldName() || !exactLong(e, v)) {
+                return -1;
+            }
+            return _numericBase + findLong(v);
+        }
+        StackBufBuilder b;
+        if (!encode(point, b)) {
+            return -1;
+        }
+        return findEncoded(b.buf(), b.len());
+    }
+
+} // namespace mongo
@@ -0,0 +1,104 @@
+// @file chunk_routing_index.h
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/bson/util/builder.h"
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+    /**
+     * An immutable index over a sorted set of shard key bounds, for routing.  ChunkManager
+     * builds one over its chunks' max keys each time it loads its chunk map, and
+     * findIntersectingChunk() asks it before walking the map.  ShardChunkManager builds one over
+     * the min keys of the ranges a shard owns, for orphan filtering.
+     *
+     * The keys are kept in one of two flat, sorted arrays, searched with a branch-free binary
+     * search:
+     *
+     *  - If the shard key has a single field and every key is an integral number, as with
+     *    hashed shard keys, they are kept as an array of long longs.  A leading MinKey and a
+     *    trailing MaxKey are allowed, numbers are always between them.
+     *  - Otherwise each key is encoded into bytes that sort with memcmp() the way the keys
+     *    sort with woCompare(), and the encodings are packed into one buffer.
+     *
+     * Only the types shard keys are usually made of can be encoded: MinKey, MaxKey, null,
+     * numbers that are exact as long longs, strings without embedded NULs, ObjectIds, bools and
+     * dates.  If a key can't be encoded the index is left empty, and if a point can't be
+     * find() says so, and the caller falls back to its map.
+     */
+    class ChunkRoutingIndex {
+        MONGO_DISALLOW_COPYING(ChunkRoutingIndex);
+    public:
+        ChunkRoutingIndex();
+
+        /**
+         * Rebuilds the index.
+         * @param keys in shard key order, all with the same field names.
+         */
+        void reset(const std::vector<BSONObj> &keys);
+
+        /**
+         * @return the number of keys less than or equal to point, which is the index of the
+         *         first key greater than it, or -1 if the index can't answer.  Over chunk max
+         *         keys that's the chunk containing point.
+         */
+        int find(const BSONObj &point) const;
+
+        bool empty() const { return _n == 0; }
+
+    private:
+        // Appends the memcmp-comparable encoding of o to b.
+        // @return false if o can't be encoded, or doesn't have the shard key's field names.
+        template<typename Builder>
+        bool encode(const BSONObj &o, Builder &b) const;
+
+        // Encodes a single element's value, without its field name.
+        template<typename Builder>
+        static bool encodeElement(const BSONElement &e, Builder &b);
+
+        // Sets out to e's value if e is a number that's exact as a long long.
+        static bool exactLong(const BSONElement &e, long long &out);
+
+        int findEncoded(const char *key, int len) const;
+        int findLong(long long key) const;
+
+        // The number of keys, or 0 if the index is empty.
+        size_t _n;
+
+        // The shard key's field names, which woCompare() also compares.
+        std::vector<std::string> _fieldNames;
+
+        // For single field keys that are all numbers: the numbers, and whether they come after
+        // a MinKey, which is less than or equal to every number.
+        bool _numeric;
+        std::vector<long long> _splits;
+        int _numericBase;
+
+        // Otherwise: the n encoded keys, packed, with _offsets[i] the start of the i'th and
+        // _offsets[n] the end.
+        std::string _keys;
+        std::vector<unsigned> _offsets;
+    };
+
+} // namespace mongo
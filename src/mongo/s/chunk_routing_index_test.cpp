@@ -0,0 +1,300 @@
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <map>
+#include <vector>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/random.h"
+#include "mongo/s/chunk_routing_index.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/log.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/timer.h"
+
+namespace {
+
+    using namespace mongo;
+    using std::map;
+    using std::vector;
+
+    typedef map<BSONObj, int, BSONObjCmp> RoutingMap;
+
+    // The chunk maxes ChunkManager would have for these split points, as a map like ChunkMap
+    // and as the vector ChunkRoutingIndex is built from.
+    void makeChunks(vector<BSONObj> splits, const BSONObj &maxKey,
+                    RoutingMap &chunkMap, vector<BSONObj> &maxes) {
+        splits.push_back(maxKey);
+        for (size_t i = 0; i < splits.size(); i++) {
+            chunkMap[splits[i]] = 0;
+        }
+        int i = 0;
+        for (RoutingMap::iterator it = chunkMap.begin(); it != chunkMap.end(); ++it, ++i) {
+            it->second = i;
+            maxes.push_back(it->first);
+        }
+    }
+
+    int mapFind(const RoutingMap &chunkMap, const BSONObj &point) {
+        RoutingMap::const_iterator it = chunkMap.upper_bound(point);
+        return it == chunkMap.end() ? static_cast<int>(chunkMap.size()) : it->second;
+    }
+
+    void assertSameAsMap(const RoutingMap &chunkMap, const ChunkRoutingIndex &index,
+                         const BSONObj &point) {
+        const int i = index.find(point);
+        if (i >= 0) {
+            ASSERT_EQUALS(mapFind(chunkMap, point), i);
+        }
+    }
+
+    BSONObj maxKeyFor(const char *field) {
+        BSONObjBuilder b;
+        b.appendMaxKey(field);
+        return b.obj();
+    }
+
+    TEST(ChunkRoutingIndex, HashedKeys) {
+        PseudoRandom r(1);
+        vector<BSONObj> splits;
+        for (int i = 0; i < 1000; i++) {
+            splits.push_back(BSON("a" << static_cast<long long>(r.nextInt64())));
+        }
+        RoutingMap chunkMap;
+        vector<BSONObj> maxes;
+        makeChunks(splits, maxKeyFor("a"), chunkMap, maxes);
+        ChunkRoutingIndex index;
+        index.reset(maxes);
+        ASSERT_FALSE(index.empty());
+
+        for (int i = 0; i < 10000; i++) {
+            const BSONObj point = BSON("a" << static_cast<long long>(r.nextInt64()));
+            ASSERT_NOT_EQUALS(-1, index.find(point));
+            assertSameAsMap(chunkMap, index, point);
+        }
+        // The split points themselves belong to the chunk they start.
+        for (size_t i = 0; i + 1 < maxes.size(); i++) {
+            ASSERT_EQUALS(static_cast<int>(i) + 1, index.find(maxes[i]));
+        }
+        // Mixed numeric types.
+        assertSameAsMap(chunkMap, index, BSON("a" << 3));
+        assertSameAsMap(chunkMap, index, BSON("a" << -7.0));
+        // Not answerable: other types, non-integral doubles, other field names.
+        ASSERT_EQUALS(-1, index.find(BSON("a" << 3.5)));
+        ASSERT_EQUALS(-1, index.find(BSON("a" << "x")));
+        ASSERT_EQUALS(-1, index.find(BSON("b" << 3)));
+        ASSERT_EQUALS(-1, index.find(BSON("a" << 3 << "b" << 4)));
+    }
+
+    TEST(ChunkRoutingIndex, SingleChunk) {
+        RoutingMap chunkMap;
+        vector<BSONObj> maxes;
+        makeChunks(vector<BSONObj>(), maxKeyFor("a"), chunkMap, maxes);
+        ChunkRoutingIndex index;
+        index.reset(maxes);
+        ASSERT_EQUALS(0, index.find(BSON("a" << 5)));
+        assertSameAsMap(chunkMap, index, BSON("a" << "x"));
+        assertSameAsMap(chunkMap, index, maxes[0]);
+    }
+
+    // Range min keys, as ShardChunkManager indexes them, start with MinKey.
+    TEST(ChunkRoutingIndex, LeadingMinKey) {
+        BSONObjBuilder minKey;
+        minKey.appendMinKey("a");
+        vector<BSONObj> mins;
+        mins.push_back(minKey.obj());
+        mins.push_back(BSON("a" << 10));
+        mins.push_back(BSON("a" << 20LL));
+        ChunkRoutingIndex index;
+        index.reset(mins);
+        ASSERT_FALSE(index.empty());
+        ASSERT_EQUALS(1, index.find(BSON("a" << 5)));
+        ASSERT_EQUALS(1, index.find(BSON("a" << -100LL)));
+        ASSERT_EQUALS(2, index.find(BSON("a" << 10)));
+        ASSERT_EQUALS(2, index.find(BSON("a" << 19.0)));
+        ASSERT_EQUALS(3, index.find(BSON("a" << 20)));
+        ASSERT_EQUALS(3, index.find(BSON("a" << 1000)));
+    }
+
+    TEST(ChunkRoutingIndex, CompoundKeys) {
+        PseudoRandom r(2);
+        vector<BSONObj> splits;
+        for (int i = 0; i < 500; i++) {
+            const string s = mongoutils::str::stream() << "user" << r.nextInt32(100);
+            splits.push_back(BSON("a" << s << "b" << r.nextInt32(1000)));
+        }
+        BSONObjBuilder maxKey;
+        maxKey.appendMaxKey("a");
+        maxKey.appendMaxKey("b");
+        RoutingMap chunkMap;
+        vector<BSONObj> maxes;
+        makeChunks(splits, maxKey.obj(), chunkMap, maxes);
+        ChunkRoutingIndex index;
+        index.reset(maxes);
+        ASSERT_FALSE(index.empty());
+
+        for (int i = 0; i < 10000; i++) {
+            const string s = mongoutils::str::stream() << "user" << r.nextInt32(120);
+            BSONObj point;
+            switch (r.nextInt32(4)) {
+            case 0: point = BSON("a" << s << "b" << r.nextInt32(1000)); break;
+            case 1: point = BSON("a" << s << "b" << static_cast<long long>(r.nextInt32(1000))); break;
+            case 2: point = BSON("a" << s.substr(0, 5) << "b" << r.nextInt32(10)); break;
+            default: point = BSON("a" << s << "b" << BSONNULL); break;
+            }
+            ASSERT_NOT_EQUALS(-1, index.find(point));
+            assertSameAsMap(chunkMap, index, point);
+        }
+        for (size_t i = 0; i < maxes.size(); i++) {
+            ASSERT_EQUALS(static_cast<int>(i) + 1, index.find(maxes[i]));
+        }
+    }
+
+    TEST(ChunkRoutingIndex, MixedTypes) {
+        vector<BSONObj> splits;
+        splits.push_back(BSON("a" << BSONNULL));
+        splits.push_back(BSON("a" << -5));
+        splits.push_back(BSON("a" << 10.0));
+        splits.push_back(BSON("a" << ""));
+        splits.push_back(BSON("a" << "m"));
+        splits.push_back(BSON("a" << "mm"));
+        splits.push_back(BSON("a" << OID("51b0000000000000000000aa")));
+        splits.push_back(BSON("a" << true));
+        splits.push_back(BSON("a" << Date_t(1000)));
+        RoutingMap chunkMap;
+        vector<BSONObj> maxes;
+        makeChunks(splits, maxKeyFor("a"), chunkMap, maxes);
+        ChunkRoutingIndex index;
+        index.reset(maxes);
+        ASSERT_FALSE(index.empty());
+
+        BSONObjBuilder minKey;
+        minKey.appendMinKey("a");
+        const BSONObj points[] = {
+            minKey.obj(), BSON("a" << BSONNULL), BSON("a" << -6), BSON("a" << -5LL), BSON("a" << 0),
+            BSON("a" << 10), BSON("a" << (1LL << 40)), BSON("a" << ""), BSON("a" << "a"),
+            BSON("a" << "m"), BSON("a" << "ma"), BSON("a" << "mm"), BSON("a" << "z"),
+            BSON("a" << OID("51b000000000000000000000")), BSON("a" << OID("51b0000000000000000000ab")),
+            BSON("a" << false), BSON("a" << true), BSON("a" << Date_t(0)), BSON("a" << Date_t(5000)),
+            maxKeyFor("a")
+        };
+        for (size_t i = 0; i < sizeof(points) / sizeof(points[0]); i++) {
+            ASSERT_NOT_EQUALS(-1, index.find(points[i]));
+            assertSameAsMap(chunkMap, index, points[i]);
+        }
+        ASSERT_EQUALS(static_cast<int>(maxes.size()), index.find(maxKeyFor("a")));
+    }
+
+    TEST(ChunkRoutingIndex, UnencodableBounds) {
+        vector<BSONObj> splits;
+        splits.push_back(BSON("a" << 1));
+        splits.push_back(BSON("a" << BSON("b" << 1)));
+        RoutingMap chunkMap;
+        vector<BSONObj> maxes;
+        makeChunks(splits, maxKeyFor("a"), chunkMap, maxes);
+        ChunkRoutingIndex index;
+        index.reset(maxes);
+        ASSERT_TRUE(index.empty());
+        ASSERT_EQUALS(-1, index.find(BSON("a" << 1)));
+    }
+
+#if !defined(_DEBUG)
+    TEST(ChunkRoutingIndex, PerfHashedRouting) {
+        const int nChunks[] = { 1000, 100000 };
+        for (size_t k = 0; k < sizeof(nChunks) / sizeof(nChunks[0]); k++) {
+            PseudoRandom r(3);
+            vector<BSONObj> splits;
+            for (int i = 0; i < nChunks[k] - 1; i++) {
+                splits.push_back(BSON("a" << static_cast<long long>(r.nextInt64())));
+            }
+            RoutingMap chunkMap;
+            vector<BSONObj> maxes;
+            makeChunks(splits, maxKeyFor("a"), chunkMap, maxes);
+            ChunkRoutingIndex index;
+            index.reset(maxes);
+
+            vector<BSONObj> points;
+            for (int i = 0; i < 1000; i++) {
+                points.push_back(BSON("a" << static_cast<long long>(r.nextInt64())));
+            }
+            const int N = 1000;
+            long long sum = 0;
+            Timer mapTimer;
+            for (int j = 0; j < N; j++) {
+                for (size_t i = 0; i < points.size(); i++) {
+                    sum += mapFind(chunkMap, points[i]);
+                }
+            }
+            const unsigned long long mapMicros = mapTimer.micros();
+            Timer indexTimer;
+            for (int j = 0; j < N; j++) {
+                for (size_t i = 0; i < points.size(); i++) {
+                    sum -= index.find(points[i]);
+                }
+            }
+            const unsigned long long indexMicros = indexTimer.micros();
+            ASSERT_EQUALS(0, sum);
+            log() << "routing " << nChunks[k] << " hashed chunks:\tChunkMap "
+                  << (mapMicros * 1000 / (N * points.size())) << "ns\tChunkRoutingIndex "
+                  << (indexMicros * 1000 / (N * points.size())) << "ns" << std::endl;
+        }
+    }
+
+    TEST(ChunkRoutingIndex, PerfCompoundRouting) {
+        PseudoRandom r(4);
+        vector<BSONObj> splits;
+        for (int i = 0; i < 100000; i++) {
+            const string s = mongoutils::str::stream() << "customer" << r.nextInt32(1000000);
+            splits.push_back(BSON("a" << s << "b" << r.nextInt32(1000)));
+        }
+        BSONObjBuilder maxKey;
+        maxKey.appendMaxKey("a");
+        maxKey.appendMaxKey("b");
+        RoutingMap chunkMap;
+        vector<BSONObj> maxes;
+        makeChunks(splits, maxKey.obj(), chunkMap, maxes);
+        ChunkRoutingIndex index;
+        index.reset(maxes);
+
+        vector<BSONObj> points;
+        for (int i = 0; i < 1000; i++) {
+            const string s = mongoutils::str::stream() << "customer" << r.nextInt32(1000000);
+            points.push_back(BSON("a" << s << "b" << r.nextInt32(1000)));
+        }
+        const int N = 200;
+        long long sum = 0;
+        Timer mapTimer;
+        for (int j = 0; j < N; j++) {
+            for (size_t i = 0; i < points.size(); i++) {
+                sum += mapFind(chunkMap, points[i]);
+            }
+        }
+        const unsigned long long mapMicros = mapTimer.micros();
+        Timer indexTimer;
+        for (int j = 0; j < N; j++) {
+            for (size_t i = 0; i < points.size(); i++) {
+                sum -= index.find(points[i]);
+            }
+        }
+        const unsigned long long indexMicros = indexTimer.micros();
+        ASSERT_EQUALS(0, sum);
+        log() << "routing " << maxes.size() << " compound chunks:\tChunkMap "
+              << (mapMicros * 1000 / (N * points.size())) << "ns\tChunkRoutingIndex "
+              << (indexMicros * 1000 / (N * points.size())) << "ns" << std::endl;
+    }
+#endif
+
+} // namespace
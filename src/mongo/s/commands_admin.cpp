@@ -524,6 +524,16 @@ namespace mongo {
                     BSONObj idx = allQueryResult->next();
                     allIndexes.append( idx );
                     BSONObj currentKey = idx["key"].embeddedObject();
+                    // Hashed shard keys are routed with hashVersion 0, an index hashed with
+                    // another function orders its keys differently from the chunks.
+                    if ( idx["hashVersion"].numberInt() != 0 && proposedKey.isPrefixOf( currentKey ) ) {
+                        errmsg = str::stream() << "can't shard collection " << ns << " on "
+                                               << proposedKey << ", index " << currentKey
+                                               << " uses hashVersion " << idx["hashVersion"]
+                                               << " and hashed shard keys require hashVersion 0";
+                        conn->done();
+                        return false;
+                    }
                     // Check 2.i. and 2.ii.
                     if ( ! idx["sparse"].trueValue() && proposedKey.isPrefixOf( currentKey ) ) {
                         BSONElement ce = cmdObj["clustering"];
@@ -945,6 +945,11 @@ namespace mongo {
             ShowPendingLockRequestsCmd() : NotAllowedOnShardedClusterCmd("showPendingLockRequests") {}
         } showPendingLockRequestsCmd;
 
+        class ShowContendedRangesCmd : public NotAllowedOnShardedClusterCmd  {
+        public:
+            ShowContendedRangesCmd() : NotAllowedOnShardedClusterCmd("showContendedRanges") {}
+        } showContendedRangesCmd;
+
         class GroupCmd : public NotAllowedOnShardedCollectionCmd  {
         public:
             GroupCmd() : NotAllowedOnShardedCollectionCmd("group") {}
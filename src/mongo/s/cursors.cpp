@@ -98,6 +98,34 @@ namespace mongo {
         return hasMore;
     }
 
+    void ShardedClientCursor::sendAllBatchesAndReply( Request& r ) {
+        MSGID responseTo = r.m().header()->id;
+        int ntoreturn = _ntoreturn;
+        do {
+            BufBuilder buffer( INIT_REPLY_BUFFER_SIZE );
+            buffer.skip( sizeof( QueryResult ) );
+            int docCount = 0;
+            const int startFrom = _totalSent;
+            bool hasMore = sendNextBatch( r, ntoreturn, buffer, docCount );
+
+            QueryResult *qr = (QueryResult *) buffer.buf();
+            qr->_resultFlags() = 0;
+            qr->len = buffer.len();
+            qr->setOperation( opReply );
+            qr->cursorId = hasMore ? getId() : 0;
+            qr->startingFrom = startFrom;
+            qr->nReturned = docCount;
+            buffer.decouple();
+
+            Message resp( qr, true );
+            r.p()->reply( r.m(), resp, responseTo );
+            responseTo = resp.header()->id;
+
+            // Like mongod, only the first batch is sized by the client.
+            ntoreturn = 0;
+        } while ( ! _done );
+    }
+
     bool ShardedClientCursor::sendNextBatch( Request& r , int ntoreturn ,
             BufBuilder& buffer, int& docCount ) {
         uassert( 10191 ,  "cursor already done" , ! _done );
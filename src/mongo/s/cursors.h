@@ -50,6 +50,14 @@ namespace mongo {
          */
         bool sendNextBatchAndReply( Request& r );
 
+        /**
+         * For exhaust queries: sends every batch that's left, each one a reply to the one before
+         * it like mongod does, so the client never has to ask for them with getMores.  Sending
+         * blocks while the client isn't reading, so we only get as far ahead of it as the socket
+         * buffers allow.
+         */
+        void sendAllBatchesAndReply( Request& r );
+
         /**
          * Sends queries to the shards and gather the result for this batch.
          *
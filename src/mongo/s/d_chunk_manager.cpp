@@ -24,7 +24,9 @@
 #include "mongo/client/connpool.h"
 #include "mongo/client/dbclientmockcursor.h"
 #include "mongo/db/clientcursor.h"
+#include "mongo/db/cursor.h"
 #include "mongo/db/instance.h"
+#include "mongo/db/operation_arena.h"
 #include "mongo/s/chunk_diff.h"
 #include "mongo/s/type_chunk.h"
 #include "mongo/s/type_collection.h"
@@ -230,14 +232,17 @@ namespace mongo {
                 continue;
             }
 
-            _rangesMap.insert( make_pair( min , max ) );
+            _rangeMins.push_back( min );
+            _rangeMaxes.push_back( max );
 
             min = currMin;
             max = currMax;
         }
         verify( ! min.isEmpty() );
 
-        _rangesMap.insert( make_pair( min , max ) );
+        _rangeMins.push_back( min );
+        _rangeMaxes.push_back( max );
+        _rangeIndex.reset( _rangeMins );
     }
 
     static bool contains( const BSONObj& min , const BSONObj& max , const BSONObj& point ) {
@@ -246,15 +251,87 @@ namespace mongo {
     
     bool ShardChunkManager::belongsToMe( ClientCursor* cc ) const {
         verify( cc );
-        if ( _rangesMap.size() == 0 )
+        return belongsToMe( cc->c() , NULL );
+    }
+
+    /**
+     * Builds the shard key from an index key, if the index has every shard key field with a
+     * plain (not hashed, geo, etc.) key.
+     */
+    static bool shardKeyFromIndexKey( const BSONObj& shardKeyPattern , const BSONObj& indexPattern ,
+                                      const BSONObj& indexKey , BSONObjBuilder& b ) {
+        // Shard keys have few fields, so find each one's position with a scan.
+        int positions[32];
+        int n = 0;
+        for ( BSONObjIterator s( shardKeyPattern ); s.more(); n++ ) {
+            const BSONElement sk = s.next();
+            if ( n == 32 || ! sk.isNumber() ) {
+                return false;
+            }
+            positions[n] = -1;
+            int pos = 0;
+            for ( BSONObjIterator i( indexPattern ); i.more(); pos++ ) {
+                const BSONElement ik = i.next();
+                if ( str::equals( ik.fieldName() , sk.fieldName() ) ) {
+                    if ( ! ik.isNumber() ) {
+                        return false;
+                    }
+                    positions[n] = pos;
+                    break;
+                }
+            }
+            if ( positions[n] < 0 ) {
+                return false;
+            }
+        }
+
+        BSONElement values[32];
+        int pos = 0;
+        for ( BSONObjIterator k( indexKey ); k.more(); pos++ ) {
+            const BSONElement e = k.next();
+            for ( int j = 0; j < n; j++ ) {
+                if ( positions[j] == pos ) {
+                    values[j] = e;
+                }
+            }
+        }
+        BSONObjIterator s( shardKeyPattern );
+        for ( int j = 0; j < n; j++ ) {
+            if ( values[j].eoo() ) {
+                return false;
+            }
+            b.appendAs( values[j] , s.next().fieldName() );
+        }
+        return true;
+    }
+
+    bool ShardChunkManager::belongsToMe( Cursor* c , bool* loadedRecord ) const {
+        verify( c );
+        if ( loadedRecord ) {
+            *loadedRecord = false;
+        }
+        if ( _rangeMins.empty() )
             return false;
-        
+
+        const BSONObj indexPattern = c->indexKeyPattern();
+        if ( ! indexPattern.isEmpty() ) {
+            // The key only lives until we've looked it up.
+            OperationArena::Scope scope;
+            BSONObjBuilder b( OperationArena::current() , 64 );
+            if ( shardKeyFromIndexKey( _key , indexPattern , c->currKey() , b ) ) {
+                return _belongsToMe( b.arenaObj() );
+            }
+        }
+
+        if ( loadedRecord ) {
+            *loadedRecord = true;
+        }
         KeyPattern pat( _key );
-        return _belongsToMe( cc->extractKey( pat ) );
+        return _belongsToMe( pat.extractSingleKey( c->current() ) );
     }
 
     bool ShardChunkManager::belongsToMe( const BSONObj& doc ) const {
-        if ( _rangesMap.size() == 0 )
+        if ( _rangeMins.empty() )
             return false;
 
         KeyPattern pat( _key );
@@ -262,22 +339,17 @@ namespace mongo {
     }
 
     bool ShardChunkManager::_belongsToMe( const BSONObj& point ) const {
-        RangeMap::const_iterator it = _rangesMap.upper_bound( point );
-        if ( it != _rangesMap.begin() )
-            it--;
-
-        bool good = contains( it->first , it->second , point );
-
-#if 0
-        if ( ! good ) {
-            log() << "bad: " << x << " " << it->first << " " << x.woCompare( it->first ) << " " << x.woCompare( it->second ) << endl;
-            for ( RangeMap::const_iterator i=_rangesMap.begin(); i!=_rangesMap.end(); ++i ) {
-                log() << "\t" << i->first << "\t" << i->second << "\t" << endl;
-            }
+        int i = _rangeIndex.find( point );
+        if ( i < 0 ) {
+            i = std::upper_bound( _rangeMins.begin() , _rangeMins.end() , point , BSONObjCmp() )
+                    - _rangeMins.begin();
         }
-#endif
+        // the last range starting at or before point, if point is before them all use the
+        // first, which won't contain it
+        if ( i > 0 )
+            i--;
 
-        return good;
+        return contains( _rangeMins[i] , _rangeMaxes[i] , point );
     }
 
     bool ShardChunkManager::getNextChunk( const BSONObj& lookupKey, BSONObj* foundMin , BSONObj* foundMax ) const {
@@ -445,11 +517,11 @@ namespace mongo {
         StringBuilder ss;
         ss << " ShardChunkManager version: " << _version.toString() << " key: " << _key;
         bool first = true;
-        for ( RangeMap::const_iterator i=_rangesMap.begin(); i!=_rangesMap.end(); ++i ) {
+        for ( size_t i = 0; i < _rangeMins.size(); i++ ) {
             if ( first ) first = false;
             else ss << " , ";
 
-            ss << i->first << " -> " << i->second;
+            ss << _rangeMins[i] << " -> " << _rangeMaxes[i];
         }
         return ss.str();
     }
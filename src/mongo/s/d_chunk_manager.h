@@ -22,11 +22,13 @@
 #include "mongo/pch.h"
 
 #include "mongo/db/jsobj.h"
+#include "mongo/s/chunk_routing_index.h"
 #include "mongo/s/chunk_version.h"
 
 namespace mongo {
 
     class ClientCursor;
+    class Cursor;
     class DBClientCursorInterface;
 
     class ShardChunkManager;
@@ -116,6 +118,17 @@ namespace mongo {
          * @return true if shards hold the object
          */
         bool belongsToMe( ClientCursor* cc ) const;
+
+        /**
+         * Checks whether the document currently pointed to by this cursor belongs to this shard.
+         * The shard key is taken from the cursor's current index key if the index has all of
+         * its fields (and isn't hashed or otherwise special), so the document is only loaded
+         * when it has to be.
+         *
+         * @param loadedRecord if not NULL, set to whether the document was loaded
+         * @return true if shards hold the object
+         */
+        bool belongsToMe( Cursor* c , bool* loadedRecord ) const;
         
         /**
          * Given a chunk's min key (or empty doc), gets the boundary of the chunk following that one (the first).
@@ -154,9 +167,12 @@ namespace mongo {
         typedef map< BSONObj, BSONObj , BSONObjCmp > RangeMap;
         RangeMap _chunksMap;
 
-        // a map from a min key into a range or continguous chunks
+        // the ranges of continguous chunks, sorted, as parallel arrays of min and max keys
         // redundant but we expect high chunk continguity, expecially in small installations
-        RangeMap _rangesMap;
+        vector<BSONObj> _rangeMins;
+        vector<BSONObj> _rangeMaxes;
+        // finds the range a point may be in without comparing BSON, see ChunkRoutingIndex
+        ChunkRoutingIndex _rangeIndex;
 
         /** constructors helpers */
         void _fillCollectionKey( const BSONObj& collectionDoc );
@@ -26,6 +26,8 @@
 #include "../util/net/message.h"
 #include "../util/startup_test.h"
 #include "../client/connpool.h"
+#include "mongo/client/dbclient_multiplexed.h"
+#include "mongo/db/server_parameters.h"
 #include "../util/net/message_server.h"
 #include "../util/stringutils.h"
 #include "../util/version.h"
@@ -80,6 +82,11 @@ namespace mongo {
     static bool noHttpInterface = false;
     static vector<string> configdbs;
 
+    // The number of sockets mongos's unversioned connections to each shard server share, or 0 to
+    // give each connection its own.  A slow request holds up the ones sent after it on the same
+    // socket, see DBClientMultiplexedConnection::setSocketsPerHost.
+    MONGO_EXPORT_STARTUP_SERVER_PARAMETER(multiplexedSocketsPerShard, int, 0);
+
     bool inShutdown() {
         return dbexitCalled;
     }
@@ -280,6 +287,11 @@ static bool runMongosServer( bool doUpgrade ) {
 
     pool.addHook( new ShardingConnectionHook( false ) );
     pool.setName( "mongos connectionpool" );
+    if ( multiplexedSocketsPerShard > 0 ) {
+        // Versioned shard connections keep sharding state on their sockets, so only these share.
+        DBClientMultiplexedConnection::setSocketsPerHost( multiplexedSocketsPerShard );
+        pool.setMultiplexed( true );
+    }
 
     shardConnectionPool.addHook( new ShardingConnectionHook( true ) );
     shardConnectionPool.setName( "mongos shardconnection connectionpool" );
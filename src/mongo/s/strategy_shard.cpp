@@ -64,7 +64,11 @@ namespace mongo {
             if ( q.ntoreturn == 1 && strstr(q.ns, ".$cmd") )
                 throw UserException( 8010 , "something is wrong, shouldn't see a command here" );
 
-            QuerySpec qSpec( (string)q.ns, q.query, q.fields, q.ntoskip, q.ntoreturn, q.queryOptions );
+            // mongos streams exhaust queries to the client itself, and gets the results from the
+            // shards with ordinary getMores.
+            const bool exhaust = q.queryOptions & QueryOption_Exhaust;
+            QuerySpec qSpec( (string)q.ns, q.query, q.fields, q.ntoskip, q.ntoreturn,
+                             q.queryOptions & ~QueryOption_Exhaust );
 
             if ( _isSystemIndexes( q.ns ) && q.query["ns"].type() == String && r.getConfig()->isSharded( q.query["ns"].String() ) ) {
                 // if you are querying on system.indexes, we need to make sure we go to a shard that actually has chunks
@@ -115,6 +119,12 @@ namespace mongo {
             if( cursor->isSharded() ){
                 ShardedClientCursorPtr cc (new ShardedClientCursor( q , cursor ));
 
+                if ( exhaust ) {
+                    // The client won't send getMores, so there's no need to cache the cursor.
+                    cc->sendAllBatchesAndReply( r );
+                    return;
+                }
+
                 BufBuilder buffer( ShardedClientCursor::INIT_REPLY_BUFFER_SIZE );
                 int docCount = 0;
                 const int startFrom = cc->getTotalSent();
@@ -143,7 +153,61 @@ namespace mongo {
 
                 // We don't want to kill the cursor remotely if there's still data left
                 shardCursor->decouple();
+
+                if ( exhaust ) {
+                    Message* first = shardCursor->getMessage();
+                    _exhaustSingle( r, shardCursor->originalHost(), first->header()->getCursor(),
+                                    first->header()->id );
+                }
+            }
+        }
+
+        /**
+         * Streams the rest of an unsharded exhaust query from the shard holding its cursor: we
+         * send the getMores, and pass each reply on to the client as soon as it arrives.
+         *
+         * @param lastReplyId the id of the reply the client got last
+         */
+        void _exhaustSingle( Request& r, const string& host, long long id, MSGID lastReplyId ) {
+            if ( id == 0 ) {
+                return;
+            }
+
+            scoped_ptr<ScopedDbConnection> conn(
+                    ScopedDbConnection::getScopedDbConnection( host ) );
+            try {
+                bool hasMore = true;
+                while ( hasMore ) {
+                    BufBuilder b;
+                    b.appendNum( (int) 0 ); // reserved
+                    b.appendStr( r.getns() );
+                    b.appendNum( (int) 0 ); // ntoreturn
+                    b.appendNum( id );
+                    Message toSend;
+                    toSend.setData( dbGetMore, b.buf(), b.len() );
+
+                    Message response;
+                    uassert( 17062, "mongos: exhaust: error calling db",
+                             conn->get()->callRead( toSend, response ) );
+                    hasMore = response.singleData()->getCursor() != 0;
+
+                    r.p()->reply( r.m(), response, lastReplyId );
+                    lastReplyId = response.header()->id;
+                }
+            }
+            catch ( DBException& ) {
+                // The client or the shard went away, don't leave the shard's cursor behind.
+                cursorCache.removeRef( id );
+                try {
+                    conn->get()->killCursor( id );
+                    conn->done();
+                }
+                catch ( DBException& ) {
+                }
+                throw;
             }
+            cursorCache.removeRef( id );
+            conn->done();
         }
 
         virtual void commandOp( const string& db, const BSONObj& command, int options,
@@ -57,6 +57,65 @@ namespace {
 
 namespace mongo {
 
+    BenchRunLatencyHistogram::BenchRunLatencyHistogram() {
+        reset();
+    }
+
+    void BenchRunLatencyHistogram::reset() {
+        memset(_counts, 0, sizeof(_counts));
+    }
+
+    void BenchRunLatencyHistogram::updateFrom(const BenchRunLatencyHistogram &other) {
+        for (int i = 0; i < NumBuckets; ++i)
+            _counts[i] += other._counts[i];
+    }
+
+    void BenchRunLatencyHistogram::subtract(const BenchRunLatencyHistogram &other) {
+        for (int i = 0; i < NumBuckets; ++i) {
+            dassert(_counts[i] >= other._counts[i]);
+            _counts[i] -= other._counts[i];
+        }
+    }
+
+    unsigned long long BenchRunLatencyHistogram::percentile(double p) const {
+        unsigned long long total = 0;
+        for (int i = 0; i < NumBuckets; ++i)
+            total += _counts[i];
+        if (total == 0)
+            return 0;
+
+        unsigned long long rank = static_cast<unsigned long long>(ceil(p * total));
+        rank = std::max(rank, 1ULL);
+        unsigned long long seen = 0;
+        for (int i = 0; i < NumBuckets; ++i) {
+            seen += _counts[i];
+            if (seen >= rank)
+                return bucketUpperBound(i);
+        }
+        return bucketUpperBound(NumBuckets - 1);
+    }
+
+    int BenchRunLatencyHistogram::bucketFor(unsigned long long micros) {
+        if (micros < static_cast<unsigned long long>(SubBuckets))
+            return static_cast<int>(micros);
+        int msb = SubBucketBits;
+        while (msb < MaxBits && (micros >> (msb + 1)) != 0)
+            ++msb;
+        if (msb >= MaxBits)
+            return NumBuckets - 1;
+        // The top SubBucketBits + 1 bits pick the bucket within [2^msb, 2^(msb + 1)).
+        const int shift = msb - SubBucketBits;
+        return (shift + 1) * SubBuckets + static_cast<int>(micros >> shift) - SubBuckets;
+    }
+
+    unsigned long long BenchRunLatencyHistogram::bucketUpperBound(int bucket) {
+        if (bucket < SubBuckets)
+            return bucket;
+        const int shift = bucket / SubBuckets - 1;
+        const unsigned long long sub = bucket % SubBuckets + SubBuckets;
+        return ((sub + 1) << shift) - 1;
+    }
+
     BenchRunEventCounter::BenchRunEventCounter() {
         reset();
     }
@@ -66,11 +125,22 @@ namespace mongo {
     void BenchRunEventCounter::reset() {
         _numEvents = 0;
         _totalTimeMicros = 0;
+        _maxTimeMicros = 0;
+        _histogram.reset();
     }
 
     void BenchRunEventCounter::updateFrom(const BenchRunEventCounter &other) {
         _numEvents += other._numEvents;
         _totalTimeMicros += other._totalTimeMicros;
+        _maxTimeMicros = std::max(_maxTimeMicros, other._maxTimeMicros);
+        _histogram.updateFrom(other._histogram);
+    }
+
+    void BenchRunEventCounter::subtract(const BenchRunEventCounter &other) {
+        _numEvents -= other._numEvents;
+        _totalTimeMicros -= other._totalTimeMicros;
+        _histogram.subtract(other._histogram);
+        _maxTimeMicros = std::min(_maxTimeMicros, _histogram.percentile(1.0));
     }
 
     BenchRunStats::BenchRunStats() {
@@ -88,6 +158,7 @@ namespace mongo {
         insertCounter.reset();
         deleteCounter.reset();
         queryCounter.reset();
+        commandCounter.reset();
 
         trappedErrors.clear();
     }
@@ -102,11 +173,23 @@ namespace mongo {
         insertCounter.updateFrom(other.insertCounter);
         deleteCounter.updateFrom(other.deleteCounter);
         queryCounter.updateFrom(other.queryCounter);
+        commandCounter.updateFrom(other.commandCounter);
 
         for (size_t i = 0; i < other.trappedErrors.size(); ++i)
             trappedErrors.push_back(other.trappedErrors[i]);
     }
 
+    void BenchRunStats::subtractCounters(const BenchRunStats &other) {
+        errCount -= other.errCount;
+
+        findOneCounter.subtract(other.findOneCounter);
+        updateCounter.subtract(other.updateCounter);
+        insertCounter.subtract(other.insertCounter);
+        deleteCounter.subtract(other.deleteCounter);
+        queryCounter.subtract(other.queryCounter);
+        commandCounter.subtract(other.commandCounter);
+    }
+
     BenchRunConfig::BenchRunConfig() {
         initializeToDefaults();
     }
@@ -132,6 +215,9 @@ namespace mongo {
 
         throwGLE = false;
         breakOnTrap = true;
+
+        opsPerSecond = 0;
+        intervalSeconds = 0;
     }
 
     BenchRunConfig *BenchRunConfig::createFromBson( const BSONObj &args ) {
@@ -166,6 +252,10 @@ namespace mongo {
             this->throwGLE = args["throwGLE"].trueValue();
         if ( ! args["breakOnTrap"].eoo() )
             this->breakOnTrap = args["breakOnTrap"].trueValue();
+        if ( args["opsPerSecond"].isNumber() )
+            this->opsPerSecond = args["opsPerSecond"].number();
+        if ( args["intervalSeconds"].isNumber() )
+            this->intervalSeconds = args["intervalSeconds"].number();
 
         uassert(16164, "loopCommands config not supported", args["loopCommands"].eoo());
 
@@ -205,11 +295,13 @@ namespace mongo {
         return connection;
     }
 
-    BenchRunState::BenchRunState( unsigned numWorkers )
+    BenchRunState::BenchRunState( unsigned numWorkers, double intervalSeconds )
         : _mutex(),
           _numUnstartedWorkers( numWorkers ),
           _numActiveWorkers( 0 ),
-          _isShuttingDown( 0 ) {
+          _isShuttingDown( 0 ),
+          _intervalMicros( intervalSeconds > 0 ? static_cast<unsigned long long>(intervalSeconds * 1000000) : 0 ),
+          _firstOpenInterval( 0 ) {
     }
 
     BenchRunState::~BenchRunState() {
@@ -268,6 +360,60 @@ namespace mongo {
         }
     }
 
+    void BenchRunState::recordInterval(const BenchRunStats &events, unsigned long long index) {
+        boost::mutex::scoped_lock lk(_intervalMutex);
+        index = std::max(index, _firstOpenInterval);
+        boost::shared_ptr<BenchRunStats> &interval = _openIntervals[index];
+        if (!interval)
+            interval.reset(new BenchRunStats());
+        interval->updateFrom(events);
+
+        // Workers flush an interval when they start their first operation past its end, so only
+        // an operation slower than a whole interval can still add to the previous one.
+        const unsigned long long current = elapsedMicros() / _intervalMicros;
+        if (current >= 2)
+            closeIntervalsBefore(current - 1);
+    }
+
+    static void appendIntervalCounter(BSONObjBuilder &b, const char *name,
+                                      const BenchRunEventCounter &counter, double seconds) {
+        if (counter.getNumEvents() == 0)
+            return;
+        BSONObjBuilder c(b.subobjStart(name));
+        c.append("ops", static_cast<long long>(counter.getNumEvents()));
+        c.append("opsPerSec", counter.getNumEvents() / seconds);
+        c.append("p50", static_cast<long long>(counter.getPercentileTimeMicros(0.5)));
+        c.append("p99", static_cast<long long>(counter.getPercentileTimeMicros(0.99)));
+        c.append("max", static_cast<long long>(counter.getMaxTimeMicros()));
+        c.done();
+    }
+
+    void BenchRunState::closeIntervalsBefore(unsigned long long index) {
+        const double seconds = _intervalMicros / 1000000.0;
+        while (!_openIntervals.empty() && _openIntervals.begin()->first < index) {
+            const BenchRunStats &stats = *_openIntervals.begin()->second;
+            BSONObjBuilder b;
+            b.append("t", _openIntervals.begin()->first * seconds);
+            appendIntervalCounter(b, "findOne", stats.findOneCounter, seconds);
+            appendIntervalCounter(b, "insert", stats.insertCounter, seconds);
+            appendIntervalCounter(b, "delete", stats.deleteCounter, seconds);
+            appendIntervalCounter(b, "update", stats.updateCounter, seconds);
+            appendIntervalCounter(b, "query", stats.queryCounter, seconds);
+            appendIntervalCounter(b, "command", stats.commandCounter, seconds);
+            b.append("errCount", static_cast<long long>(stats.errCount));
+            _closedIntervals.push_back(b.obj());
+            _openIntervals.erase(_openIntervals.begin());
+        }
+        _firstOpenInterval = std::max(_firstOpenInterval, index);
+    }
+
+    std::vector<BSONObj> BenchRunState::finishIntervals() {
+        assertFinished();
+        boost::mutex::scoped_lock lk(_intervalMutex);
+        closeIntervalsBefore(std::numeric_limits<unsigned long long>::max());
+        return _closedIntervals;
+    }
+
     BSONObj benchStart( const BSONObj& , void* );
     BSONObj benchFinish( const BSONObj& , void* );
 
@@ -297,7 +443,8 @@ namespace mongo {
     }
 
     BenchRunWorker::BenchRunWorker(const BenchRunConfig *config, BenchRunState *brState)
-        : _config(config), _brState(brState) {
+        : _config(config), _brState(brState), _startMicros(0), _numOpsStarted(0),
+          _currentInterval(0) {
     }
 
     BenchRunWorker::~BenchRunWorker() {}
@@ -310,6 +457,42 @@ namespace mongo {
         return _brState->shouldWorkerFinish();
     }
 
+    unsigned long long BenchRunWorker::waitForNextOp() {
+        if (_config->opsPerSecond <= 0)
+            return 0;
+
+        // Each worker takes an equal share of the target rate.
+        const double opIntervalMicros = 1000000.0 * _config->parallel / _config->opsPerSecond;
+        const unsigned long long scheduledMicros =
+                _startMicros + static_cast<unsigned long long>(_numOpsStarted++ * opIntervalMicros);
+        unsigned long long now = _brState->elapsedMicros();
+        while (now < scheduledMicros) {
+            if (shouldStop())
+                return 0;
+            sleepmicros(std::min(scheduledMicros - now, 100000ULL));
+            now = _brState->elapsedMicros();
+        }
+        return now - scheduledMicros;
+    }
+
+    void BenchRunWorker::flushInterval(bool final) {
+        const unsigned long long intervalMicros = _brState->intervalMicros();
+        if (intervalMicros == 0)
+            return;
+        const unsigned long long index = _brState->elapsedMicros() / intervalMicros;
+        if (!final && index == _currentInterval)
+            return;
+
+        BenchRunStats events;
+        events.updateFrom(_stats);
+        events.subtractCounters(_flushedStats);
+        _brState->recordInterval(events, _currentInterval);
+
+        _flushedStats.reset();
+        _flushedStats.updateFrom(_stats);
+        _currentInterval = index;
+    }
+
     void doNothing(const BSONObj&) { }
 
     void BenchRunWorker::generateLoadOnConnection( DBClientBase* conn ) {
@@ -319,12 +502,21 @@ namespace mongo {
 
         BsonTemplateEvaluator bsonTemplateEvaluator;
 
+        _startMicros = _brState->elapsedMicros();
+        if ( _brState->intervalMicros() > 0 )
+            _currentInterval = _startMicros / _brState->intervalMicros();
+
         while ( !shouldStop() ) {
             BSONObjIterator i( _config->ops );
             while ( i.more() ) {
 
                 if ( shouldStop() ) break;
 
+                flushInterval( false );
+                // Time spent waiting for a late operation's turn is part of its latency.
+                const unsigned long long startDelayMicros = waitForNextOp();
+                if ( shouldStop() ) break;
+
                 BSONElement e = i.next();
 
                 string ns = e["ns"].String();
@@ -373,7 +565,7 @@ namespace mongo {
 
                         BSONObj result;
                         {
-                            BenchRunEventTrace _bret(&_stats.findOneCounter);
+                            BenchRunEventTrace _bret(&_stats.findOneCounter, startDelayMicros);
                             result = conn->findOne( ns , fixQuery( e["query"].Obj(),
                                                                    bsonTemplateEvaluator ) );
                         }
@@ -395,8 +587,11 @@ namespace mongo {
                     else if ( op == "command" ) {
 
                         BSONObj result;
-                        conn->runCommand( ns, fixQuery( e["command"].Obj(), bsonTemplateEvaluator ),
-                                          result, e["options"].numberInt() );
+                        {
+                            BenchRunEventTrace _bret(&_stats.commandCounter, startDelayMicros);
+                            conn->runCommand( ns, fixQuery( e["command"].Obj(), bsonTemplateEvaluator ),
+                                              result, e["options"].numberInt() );
+                        }
 
                         if( check ){
                             int err = scope->invoke( scopeFunc , 0 , &result,  1000 * 60 , false );
@@ -428,12 +623,12 @@ namespace mongo {
 
                         // use special query function for exhaust query option
                         if (options & QueryOption_Exhaust) {
-                            BenchRunEventTrace _bret(&_stats.queryCounter);
+                            BenchRunEventTrace _bret(&_stats.queryCounter, startDelayMicros);
                             boost::function<void (const BSONObj&)> castedDoNothing(doNothing);
                             count =  conn->query(castedDoNothing, ns, fixedQuery, &filter, options);
                         }
                         else {
-                            BenchRunEventTrace _bret(&_stats.queryCounter);
+                            BenchRunEventTrace _bret(&_stats.queryCounter, startDelayMicros);
                             cursor = conn->query(ns, fixedQuery, limit, skip, &filter, options,
                                                  batchSize);
                             count = cursor->itcount();
@@ -469,7 +664,7 @@ namespace mongo {
                         bool safe = e["safe"].trueValue();
 
                         {
-                            BenchRunEventTrace _bret(&_stats.updateCounter);
+                            BenchRunEventTrace _bret(&_stats.updateCounter, startDelayMicros);
                             conn->update( ns, fixQuery( query, bsonTemplateEvaluator ), update,
                                           upsert , multi );
                             if (safe)
@@ -499,7 +694,7 @@ namespace mongo {
                         bool safe = e["safe"].trueValue();
                         BSONObj result;
                         {
-                            BenchRunEventTrace _bret(&_stats.insertCounter);
+                            BenchRunEventTrace _bret(&_stats.insertCounter, startDelayMicros);
                             conn->insert( ns, fixQuery( e["doc"].Obj(), bsonTemplateEvaluator ) );
                             if (safe)
                                 result = conn->getLastErrorDetailed();
@@ -532,7 +727,7 @@ namespace mongo {
                         BSONObj result;
 
                         {
-                            BenchRunEventTrace _bret(&_stats.deleteCounter);
+                            BenchRunEventTrace _bret(&_stats.deleteCounter, startDelayMicros);
                             conn->remove( ns, fixQuery( query, bsonTemplateEvaluator ), ! multi );
                             if (safe)
                                 result = conn->getLastErrorDetailed();
@@ -653,10 +848,11 @@ namespace mongo {
         catch( ... ){
             error() << "Unknown exception not handled in benchRun thread." << endl;
         }
+        flushInterval( true );
     }
 
     BenchRunner::BenchRunner( BenchRunConfig *config )
-        : _brState(config->parallel),
+        : _brState(config->parallel, config->intervalSeconds),
           _config(config) {
 
         _oid.init();
@@ -754,6 +950,12 @@ namespace mongo {
         }
     }
 
+    std::vector<BSONObj> BenchRunner::finishIntervals() {
+        if ( _brState.intervalMicros() == 0 )
+            return std::vector<BSONObj>();
+        return _brState.finishIntervals();
+    }
+
      static void appendAverageMicrosIfAvailable(
              BSONObjBuilder &buf, const std::string &name, const BenchRunEventCounter &counter) {
 
@@ -762,6 +964,17 @@ namespace mongo {
                         static_cast<double>(counter.getTotalTimeMicros()) / counter.getNumEvents());
      }
 
+     static void appendLatencyPercentilesIfAvailable(
+             BSONObjBuilder &buf, const std::string &name, const BenchRunEventCounter &counter) {
+
+         if (counter.getNumEvents() > 0)
+             buf.append(name,
+                        BSON("p50" << static_cast<long long>(counter.getPercentileTimeMicros(0.5)) <<
+                             "p99" << static_cast<long long>(counter.getPercentileTimeMicros(0.99)) <<
+                             "p999" << static_cast<long long>(counter.getPercentileTimeMicros(0.999)) <<
+                             "max" << static_cast<long long>(counter.getMaxTimeMicros())));
+     }
+
      BSONObj BenchRunner::finish( BenchRunner* runner ) {
 
          runner->stop();
@@ -788,6 +1001,15 @@ namespace mongo {
          appendAverageMicrosIfAvailable(buf, "deleteLatencyAverageMicros", stats.deleteCounter);
          appendAverageMicrosIfAvailable(buf, "updateLatencyAverageMicros", stats.updateCounter);
          appendAverageMicrosIfAvailable(buf, "queryLatencyAverageMicros", stats.queryCounter);
+         appendAverageMicrosIfAvailable(buf, "commandLatencyAverageMicros", stats.commandCounter);
+         appendLatencyPercentilesIfAvailable(buf, "findOneLatencyMicros", stats.findOneCounter);
+         appendLatencyPercentilesIfAvailable(buf, "insertLatencyMicros", stats.insertCounter);
+         appendLatencyPercentilesIfAvailable(buf, "deleteLatencyMicros", stats.deleteCounter);
+         appendLatencyPercentilesIfAvailable(buf, "updateLatencyMicros", stats.updateCounter);
+         appendLatencyPercentilesIfAvailable(buf, "queryLatencyMicros", stats.queryCounter);
+         appendLatencyPercentilesIfAvailable(buf, "commandLatencyMicros", stats.commandCounter);
+         if ( runner->_config->intervalSeconds > 0 )
+             buf.append( "intervals", runner->finishIntervals() );
 
          {
              BSONObjIterator i( after );
@@ -16,7 +16,9 @@
 
 #pragma once
 
+#include <map>
 #include <string>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/condition.hpp>
@@ -110,11 +112,68 @@ namespace mongo {
         bool throwGLE;
         bool breakOnTrap;
 
+        /**
+         * Target rate for the whole activity, in operations per second, or 0 to run every worker
+         * as fast as it can.
+         *
+         * With a target rate each worker schedules its operations on a fixed timeline, and an
+         * operation that starts late because the previous ones took too long counts the delay
+         * as part of its latency.
+         */
+        double opsPerSecond;
+
+        /**
+         * Length of the intervals for which throughput and latency are reported separately, in
+         * seconds, or 0 to only report totals for the whole activity.
+         */
+        double intervalSeconds;
+
     private:
         /// Initialize a config object to its default values.
         void initializeToDefaults();
     };
 
+    /**
+     * A histogram of latencies in microseconds with log-linear buckets: each power of two range
+     * is split into SubBuckets equal buckets, so values read back from it are within 1/SubBuckets
+     * of the true ones.  Values of 2^MaxBits microseconds and more share the last bucket.
+     *
+     * Not thread safe.
+     */
+    class BenchRunLatencyHistogram {
+    public:
+        BenchRunLatencyHistogram();
+
+        void reset();
+
+        void record(unsigned long long micros) {
+            ++_counts[bucketFor(micros)];
+        }
+
+        /// Adds the values recorded in "other" into this.
+        void updateFrom( const BenchRunLatencyHistogram &other );
+
+        /// Removes the values recorded in "other", which must all have been recorded in this.
+        void subtract( const BenchRunLatencyHistogram &other );
+
+        /**
+         * Get the smallest bucket bound that at least the fraction "p" of the recorded values are
+         * at or below, or 0 if nothing was recorded.
+         */
+        unsigned long long percentile(double p) const;
+
+    private:
+        static const int SubBucketBits = 4;
+        static const int SubBuckets = 1 << SubBucketBits;
+        static const int MaxBits = 36;
+        static const int NumBuckets = (MaxBits - SubBucketBits + 1) * SubBuckets;
+
+        static int bucketFor(unsigned long long micros);
+        static unsigned long long bucketUpperBound(int bucket);
+
+        unsigned long long _counts[NumBuckets];
+    };
+
     /**
      * An event counter for events that have an associated duration.
      *
@@ -136,12 +195,22 @@ namespace mongo {
          */
         void updateFrom( const BenchRunEventCounter &other );
 
+        /**
+         * Conceptually the equivalent of "-=".  Removes the events in "other", which must be an
+         * earlier state of this counter.  The maximum becomes the histogram's bound for the
+         * slowest remaining event.
+         */
+        void subtract( const BenchRunEventCounter &other );
+
         /**
          * Count one instance of the event, which took "timeMicros" microseconds.
          */
         void countOne(unsigned long long timeMicros) {
             ++_numEvents;
             _totalTimeMicros += timeMicros;
+            _histogram.record(timeMicros);
+            if (timeMicros > _maxTimeMicros)
+                _maxTimeMicros = timeMicros;
         }
 
         /**
@@ -154,9 +223,24 @@ namespace mongo {
          */
         unsigned long long getNumEvents() const { return _numEvents; }
 
+        /**
+         * Get the duration at or below which the fraction "p" of the observed events fall, in
+         * microseconds.
+         */
+        unsigned long long getPercentileTimeMicros(double p) const {
+            return std::min(_histogram.percentile(p), _maxTimeMicros);
+        }
+
+        /**
+         * Get the duration of the slowest observed event, in microseconds.
+         */
+        unsigned long long getMaxTimeMicros() const { return _maxTimeMicros; }
+
     private:
         unsigned long long _numEvents;
         unsigned long long _totalTimeMicros;
+        unsigned long long _maxTimeMicros;
+        BenchRunLatencyHistogram _histogram;
     };
 
     /**
@@ -178,6 +262,15 @@ namespace mongo {
             initialize(eventCounter, eventCounter, false);
         }
 
+        /**
+         * Trace an event that started "startDelayMicros" after it was scheduled to.  The delay
+         * counts as part of the event's duration.
+         */
+        BenchRunEventTrace(BenchRunEventCounter *eventCounter, unsigned long long startDelayMicros) {
+            initialize(eventCounter, eventCounter, false);
+            _startDelayMicros = startDelayMicros;
+        }
+
         BenchRunEventTrace(BenchRunEventCounter *successCounter,
                            BenchRunEventCounter *failCounter,
                            bool defaultToFailure=true) {
@@ -185,7 +278,7 @@ namespace mongo {
         }
 
         ~BenchRunEventTrace() {
-            (_succeeded ? _successCounter : _failCounter)->countOne(_timer.micros());
+            (_succeeded ? _successCounter : _failCounter)->countOne(_startDelayMicros + _timer.micros());
         }
 
         void succeed() { _succeeded = true; }
@@ -198,9 +291,11 @@ namespace mongo {
             _successCounter = successCounter;
             _failCounter = failCounter;
             _succeeded = !defaultToFailure;
+            _startDelayMicros = 0;
         }
 
         Timer _timer;
+        unsigned long long _startDelayMicros;
         BenchRunEventCounter *_successCounter;
         BenchRunEventCounter *_failCounter;
         bool _succeeded;
@@ -218,6 +313,9 @@ namespace mongo {
 
         void updateFrom( const BenchRunStats &other );
 
+        /// Removes the events counted in "other", an earlier state of this, from the counters.
+        void subtractCounters( const BenchRunStats &other );
+
         bool error;
         unsigned long long errCount;
 
@@ -226,6 +324,7 @@ namespace mongo {
         BenchRunEventCounter insertCounter;
         BenchRunEventCounter deleteCounter;
         BenchRunEventCounter queryCounter;
+        BenchRunEventCounter commandCounter;
 
         std::map<std::string, long long> opcounters;
         std::vector<BSONObj> trappedErrors;
@@ -240,7 +339,7 @@ namespace mongo {
     public:
         enum State { BRS_STARTING_UP, BRS_RUNNING, BRS_FINISHED };
 
-        explicit BenchRunState(unsigned numWorkers);
+        BenchRunState(unsigned numWorkers, double intervalSeconds);
         ~BenchRunState();
 
         //
@@ -263,6 +362,12 @@ namespace mongo {
         /// Check that the current state is BRS_FINISHED.
         void assertFinished();
 
+        /**
+         * Close the last interval and get a summary of each interval's events, in order.  Only
+         * call once the state is BRS_FINISHED.
+         */
+        std::vector<BSONObj> finishIntervals();
+
         //
         // Functions called by the worker threads, through instances of BenchRunWorker.
         //
@@ -285,12 +390,37 @@ namespace mongo {
          */
         void onWorkerFinished();
 
+        /// Microseconds since the activity was created.
+        unsigned long long elapsedMicros() const { return _timer.micros(); }
+
+        /// Length of the reporting intervals in microseconds, 0 if there are none.
+        unsigned long long intervalMicros() const { return _intervalMicros; }
+
+        /**
+         * Add events a worker counted into interval number "index".  Intervals that every worker
+         * should have moved past get closed, and events arriving for a closed interval are
+         * counted in the oldest open one.
+         */
+        void recordInterval(const BenchRunStats &events, unsigned long long index);
+
     private:
+        void closeIntervalsBefore(unsigned long long index);
+
         boost::mutex _mutex;
         boost::condition _stateChangeCondition;
         unsigned _numUnstartedWorkers;
         unsigned _numActiveWorkers;
         AtomicUInt _isShuttingDown;
+
+        const Timer _timer;
+        const unsigned long long _intervalMicros;
+
+        // Protected by _intervalMutex.  Intervals still receiving events, by index, and the
+        // summaries of the closed ones.
+        boost::mutex _intervalMutex;
+        std::map<unsigned long long, boost::shared_ptr<BenchRunStats> > _openIntervals;
+        unsigned long long _firstOpenInterval;
+        std::vector<BSONObj> _closedIntervals;
     };
 
     /**
@@ -332,9 +462,27 @@ namespace mongo {
         /// Predicate, used to decide whether or not it's time to terminate the worker.
         bool shouldStop() const;
 
+        /**
+         * With a target rate, wait until the next operation is due.
+         * @return how late the operation is starting, in microseconds.
+         */
+        unsigned long long waitForNextOp();
+
+        /**
+         * Once the current interval is over, or when "final" is set, pass the events counted
+         * since the last call to the BenchRunState.
+         */
+        void flushInterval(bool final);
+
         const BenchRunConfig *_config;
         BenchRunState *_brState;
         BenchRunStats _stats;
+
+        // Pacing and interval reporting state, in microseconds since the BenchRunState was created.
+        unsigned long long _startMicros;
+        unsigned long long _numOpsStarted;
+        unsigned long long _currentInterval;
+        BenchRunStats _flushedStats;
     };
 
     /**
@@ -391,6 +539,12 @@ namespace mongo {
          */
         void populateStats(BenchRunStats *stats);
 
+        /**
+         * Get the summaries of the reporting intervals of a completed activity, empty if it was
+         * not configured with intervalSeconds.  Only call once, after stop() returns.
+         */
+        std::vector<BSONObj> finishIntervals();
+
         OID oid() const { return _oid; }
 
         const BenchRunConfig &config() const { return *_config; } // TODO: Remove this function.
@@ -67,7 +67,11 @@ namespace mongo {
        BSONObj subObj = in.embeddedObject();
        const char* opOrNot = subObj.firstElementFieldName();
        if (opOrNot[0] != '#') {
-           out.append(in);
+           BSONObjBuilder subBuilder(out.subobjStart(in.fieldName()));
+           Status st = evaluate(subObj, subBuilder);
+           if (st != StatusSuccess)
+               return st;
+           subBuilder.done();
            return StatusSuccess;
        }
        const char* op = opOrNot+1;
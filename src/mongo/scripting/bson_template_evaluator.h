@@ -25,6 +25,9 @@
  * Where possible, the templates can also be combined together and evaluated. For eg.
  * { key : { #CONCAT: [{ #RAND_INT: [10, 20] }, " ", "world"] } }
  *
+ * Templates may appear at any depth inside plain sub-objects, which allows query operators:
+ * { key : { $gte : { #RAND_INT: [10, 20] } } }
+ *
  * This library DOES NOT support combining or nesting the templates in an arbitrary fashion.
  * eg. { key : { #RAND_INT: [{ #RAND_INT: [10, 15] }, 20] } } is not supported.
  *
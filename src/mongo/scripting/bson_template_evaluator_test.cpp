@@ -354,5 +354,30 @@ namespace mongo {
             // so total string length should 1 + 13 + 5 = 19
             ASSERT_EQUALS(obj2.firstElement().str().length(), 19U);
         }
+
+        TEST(BSONTemplateEvaluatorTest, NESTED_OBJECTS) {
+
+            BsonTemplateEvaluator *t = new BsonTemplateEvaluator();
+            BSONObj randIntObj = BSON( "#RAND_INT" << BSON_ARRAY( 0 << 5 ) );
+
+            // Test success when an operator is inside a query operator's object
+            BSONObjBuilder builder1;
+            ASSERT_EQUALS( BsonTemplateEvaluator::StatusSuccess,
+                           t->evaluate(BSON("a" << BSON("$gte" << randIntObj) <<
+                                            "b" << BSON("c" << 1)), builder1) );
+            BSONObj obj1 = builder1.obj();
+            ASSERT_EQUALS(obj1.nFields(), 2);
+            BSONObj gte = obj1["a"].Obj();
+            ASSERT_EQUALS(gte.nFields(), 1);
+            ASSERT_GREATER_THAN_OR_EQUALS(gte["$gte"].numberInt(), 0);
+            ASSERT_LESS_THAN(gte["$gte"].numberInt(), 5);
+            ASSERT_EQUALS(obj1["b"].Obj().equal(BSON("c" << 1)), true);
+
+            // Test failure of an operator at depth
+            BSONObjBuilder builder2;
+            BSONObj badObj = BSON( "#RAND_INT" << BSON_ARRAY( 5 << 0 ) );
+            ASSERT_EQUALS( BsonTemplateEvaluator::StatusOpEvaluationError,
+                           t->evaluate(BSON("a" << BSON("b" << badObj)), builder2) );
+        }
     } // end anonymous namespace
 } // end namespace mongo
@@ -942,6 +942,14 @@ DB.prototype.showPendingLockRequests = function(){
     return this.runCommand('showPendingLockRequests');
 }
 
+DB.prototype.showContendedRanges = function(limit){
+    var cmd = { showContendedRanges : 1 };
+    if (limit) {
+        cmd.limit = limit;
+    }
+    return this.runCommand(cmd);
+}
+
 DB.prototype.serverBuildInfo = function(){
     return this._adminCommand( "buildinfo" );
 }
@@ -26,6 +26,8 @@
 
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/thread.hpp>
 
 #include "mongo/tools/tool.h"
 
@@ -45,50 +47,253 @@ static string fmtOpTime(const OpTime &t) {
     return ss.str();
 }
 
+/**
+ * Replays the inserts, updates and deletes for some of the namespaces in the oplog, on its own
+ * connection and thread.  Consecutive inserts into a namespace are sent in one message, and each
+ * message is checked with getLastError before the next one is sent.
+ */
+class OplogApplier : boost::noncopyable {
+    struct Op {
+        char op;
+        string ns;
+        BSONObj o;
+        BSONObj o2;
+        bool b;
+    };
+
+    scoped_ptr<mongo::DBClientBase> _conn;
+    vector<Op> _ops;
+    size_t _bytes;
+    string _error;
+
+    /**
+     * Checks the last op sent.  Inserts are allowed to fail with duplicate keys if dupKeyOk:
+     * replay may start before the dump it is applied to was taken, or resume partway into a
+     * batch that was applied before.
+     * @return false if it failed otherwise.
+     */
+    bool checkLastError(bool dupKeyOk) {
+        BSONObj res = _conn->getLastErrorDetailed();
+        if (res["err"].isNull() || (dupKeyOk && res["code"].numberInt() == ASSERT_ID_DUPKEY)) {
+            return true;
+        }
+        _error = res.toString();
+        return false;
+    }
+
+    /**
+     * Inserts docs into ns.  An insert message is applied as one transaction, so if one of the
+     * docs is already there none of them get inserted, and they are inserted again one at a time.
+     * @return false if an insert failed other than with a duplicate key.
+     */
+    bool insert(const string &ns, const vector<BSONObj> &docs) {
+        _conn->insert(ns, docs);
+        BSONObj res = _conn->getLastErrorDetailed();
+        if (res["err"].isNull()) {
+            return true;
+        }
+        if (res["code"].numberInt() != ASSERT_ID_DUPKEY) {
+            _error = res.toString();
+            return false;
+        }
+        if (docs.size() == 1) {
+            return true;
+        }
+        LOG(1) << "duplicate key inserting " << docs.size() << " documents into " << ns
+               << ", inserting them one at a time" << endl;
+        for (vector<BSONObj>::const_iterator it = docs.begin(); it != docs.end(); ++it) {
+            _conn->insert(ns, *it);
+            if (!checkLastError(true)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void apply() {
+        // seems like enough room for headers/metadata
+        static const size_t MAX_INSERT_SIZE = BSONObjMaxUserSize - (4<<10);
+        vector<BSONObj> inserts;
+        size_t insertSize = 0;
+        for (vector<Op>::const_iterator it = _ops.begin(); it != _ops.end(); ++it) {
+            // Consecutive inserts into the same namespace go in one message.
+            if (!inserts.empty() && (it->op != 'i' || it->ns != (it - 1)->ns ||
+                                     insertSize + it->o.objsize() > MAX_INSERT_SIZE)) {
+                if (!insert((it - 1)->ns, inserts)) {
+                    return;
+                }
+                inserts.clear();
+                insertSize = 0;
+            }
+            if (it->op == 'i') {
+                inserts.push_back(it->o);
+                insertSize += it->o.objsize();
+            }
+            else if (it->op == 'u') {
+                _conn->update(it->ns, it->o2, it->o, it->b, false);
+                if (!checkLastError(false)) {
+                    return;
+                }
+            }
+            else {
+                dassert(it->op == 'd');
+                _conn->remove(it->ns, it->o, it->b);
+                if (!checkLastError(false)) {
+                    return;
+                }
+            }
+        }
+        if (!inserts.empty()) {
+            insert(_ops.back().ns, inserts);
+        }
+    }
+
+  public:
+    explicit OplogApplier(mongo::DBClientBase *conn) : _conn(conn), _bytes(0) {}
+
+    void push(char op, const string &ns, const BSONObj &o, const BSONObj &o2, bool b) {
+        Op entry;
+        entry.op = op;
+        entry.ns = ns;
+        entry.o = o.getOwned();
+        entry.o2 = o2.getOwned();
+        entry.b = b;
+        _ops.push_back(entry);
+        _bytes += o.objsize() + o2.objsize();
+    }
+
+    size_t bytes() const { return _bytes; }
+    size_t size() const { return _ops.size(); }
+
+    /** Applies and clears the ops pushed so far.  Runs on its own thread. */
+    void run() {
+        try {
+            if (!_ops.empty()) {
+                apply();
+            }
+        }
+        catch (DBException &e) {
+            _error = e.toString();
+        }
+        _ops.clear();
+        _bytes = 0;
+    }
+
+    /** @return the error from the last run(), if any, and forget it. */
+    string takeError() {
+        string err;
+        err.swap(_error);
+        return err;
+    }
+};
+
 class VanillaOplogPlayer : boost::noncopyable {
     mongo::DBClientBase &_conn;
     string _host;
     OpTime _maxOpTimeSynced;
     OpTime _thisTime;
-    vector<BSONObj> _insertBuf;
-    string _insertNs;
-    size_t _insertSize;
-    OpTime _insertMaxTime;
+
+    // Ops are spread over the appliers by namespace, so each namespace's ops are replayed in
+    // order.  While one batch is being applied the next one is read from the source.
+    vector<shared_ptr<OplogApplier> > _appliers;
+    size_t _bufferedOps;
+    size_t _bufferedBytes;
+    OpTime _bufferedMaxTime;
+    scoped_ptr<boost::thread_group> _inFlight;
+    OpTime _inFlightMaxTime;
+    size_t _inFlightOps;
+    unsigned long long _opsApplied;
 
     volatile bool &_running;
     bool &_logAtExit;
 
-    void pushInsert(const StringData &ns, const BSONObj &o) {
-        uassert(16863, "cannot append an earlier optime", _thisTime > _insertMaxTime);
-        // semes like enough room for headers/metadata
-        static const size_t MAX_SIZE = BSONObjMaxUserSize - (4<<10);
-        if (ns != _insertNs || _insertSize + o.objsize() > MAX_SIZE) {
-            flushInserts();
-            _insertNs = ns.toString();
-        }
-        _insertBuf.push_back(o.getOwned());
-        _insertSize += o.objsize();
-        _insertMaxTime = _thisTime;
+    void pushOp(char op, const string &ns, const BSONObj &o, const BSONObj &o2, bool b) {
+        uassert(16863, "cannot append an earlier optime", _thisTime > _bufferedMaxTime);
+        OplogApplier &applier = *_appliers[boost::hash<string>()(ns) % _appliers.size()];
+        applier.push(op, ns, o, o2, b);
+        _bufferedOps++;
+        _bufferedBytes += o.objsize() + o2.objsize();
+        _bufferedMaxTime = _thisTime;
+    }
+
+    /** Waits for the batch being applied, if any. */
+    bool waitForInFlight() {
+        if (!_inFlight) {
+            return true;
+        }
+        _inFlight->join_all();
+        _inFlight.reset();
+
+        bool ok = true;
+        for (vector<shared_ptr<OplogApplier> >::const_iterator it = _appliers.begin(); it != _appliers.end(); ++it) {
+            string err = (*it)->takeError();
+            if (!err.empty()) {
+                log() << "replay of operations failed: " << err << endl;
+                ok = false;
+            }
+        }
+        if (!ok) {
+            // Other appliers may have gotten further, but the only position we know is safe to
+            // resume from is the end of the last complete batch.
+            return false;
+        }
+        verify(_maxOpTimeSynced < _inFlightMaxTime);
+        _maxOpTimeSynced = _inFlightMaxTime;
+        _opsApplied += _inFlightOps;
+        return true;
     }
 
   public:
     VanillaOplogPlayer(mongo::DBClientBase &conn, const string &host, const OpTime &maxOpTimeSynced,
+                       const vector<mongo::DBClientBase *> &applierConns,
                        volatile bool &running, bool &logAtExit)
             : _conn(conn), _host(host), _maxOpTimeSynced(maxOpTimeSynced),
-              _running(running), _logAtExit(logAtExit) {}
-
-    void flushInserts() {
-        if (!_insertBuf.empty()) {
-            _conn.insert(_insertNs, _insertBuf);
-            verify(_maxOpTimeSynced < _insertMaxTime);
-            _maxOpTimeSynced = _insertMaxTime;
-        }
-        _insertBuf.clear();
-        _insertSize = 0;
-        _insertNs = "";
-        _insertMaxTime = OpTime();
+              _bufferedOps(0), _bufferedBytes(0), _inFlightOps(0), _opsApplied(0),
+              _running(running), _logAtExit(logAtExit) {
+        verify(!applierConns.empty());
+        for (vector<mongo::DBClientBase *>::const_iterator it = applierConns.begin(); it != applierConns.end(); ++it) {
+            _appliers.push_back(shared_ptr<OplogApplier>(new OplogApplier(*it)));
+        }
+    }
+
+    ~VanillaOplogPlayer() {
+        if (_inFlight) {
+            _inFlight->join_all();
+        }
+    }
+
+    /**
+     * Waits for the previous batch to be applied, then starts applying the ops buffered since.
+     * @return false if the previous batch failed.
+     */
+    bool flush() {
+        if (!waitForInFlight()) {
+            return false;
+        }
+        if (_bufferedOps == 0) {
+            return true;
+        }
+        _inFlight.reset(new boost::thread_group);
+        for (vector<shared_ptr<OplogApplier> >::const_iterator it = _appliers.begin(); it != _appliers.end(); ++it) {
+            if ((*it)->size() > 0) {
+                _inFlight->create_thread(boost::bind(&OplogApplier::run, it->get()));
+            }
+        }
+        _inFlightMaxTime = _bufferedMaxTime;
+        _inFlightOps = _bufferedOps;
+        _bufferedOps = 0;
+        _bufferedBytes = 0;
+        _bufferedMaxTime = OpTime();
+        return true;
+    }
+
+    /** Applies everything buffered and waits for it. */
+    bool sync() {
+        return flush() && waitForInFlight();
     }
 
+    unsigned long long opsApplied() const { return _opsApplied; }
+
     const OpTime &maxOpTimeSynced() const { return _maxOpTimeSynced; }
     const OpTime &thisTime() const { return _thisTime; }
     string maxOpTimeSyncedStr() const { return fmtOpTime(_maxOpTimeSynced); }
@@ -135,10 +340,6 @@ class VanillaOplogPlayer : boost::noncopyable {
             return false;
         }
 
-        if (op != "i" && !_insertBuf.empty()) {
-            flushInserts();
-        }
-
         BSONElement &nsElt = fields[2];
         if (!nsElt.ok()) {
             log() << "oplog format error: " << obj << " missing 'ns' field." << endl;
@@ -165,6 +366,10 @@ class VanillaOplogPlayer : boost::noncopyable {
                 log() << "oplog format error: invalid namespace '" << ns << "' for command in op " << obj << "." << endl;
                 return false;
             }
+            // Commands can affect any namespace, so everything before them must be applied first.
+            if (!sync()) {
+                return false;
+            }
             BSONObj info;
             bool ok = _conn.runCommand(dbname.toString(), o, info);
             if (!ok) {
@@ -187,8 +392,10 @@ class VanillaOplogPlayer : boost::noncopyable {
             string nsstr = ns.toString();
             if (op == "i") {
                 if (collname == "system.indexes") {
-                    // Can't ensure multiple indexes in the same batch.
-                    flushInserts();
+                    // Index builds are applied on their own, after everything before them.
+                    if (!sync()) {
+                        return false;
+                    }
 
                     // For now, we need to strip out any background fields from
                     // ensureIndex.  Once we do hot indexing we can do something more
@@ -227,12 +434,16 @@ class VanillaOplogPlayer : boost::noncopyable {
                             _logAtExit = false;
                             return true;
                         }
+                        _maxOpTimeSynced = _thisTime;
+                        _thisTime = OpTime();
+                        return true;
                     }
+                    _conn.insert(nsstr, o);
+                }
+                else {
+                    pushOp('i', nsstr, o, BSONObj(), false);
+                    return maybeFlush();
                 }
-                pushInsert(nsstr, o);
-                // Don't call GLE or update _maxOpTimeSynced yet.
-                _thisTime = OpTime();
-                return true;
             }
             else if (op == "u") {
                 BSONElement o2Elt = obj["o2"];
@@ -243,12 +454,14 @@ class VanillaOplogPlayer : boost::noncopyable {
                 BSONElement &bElt = fields[4];
                 bool upsert = bElt.booleanSafe();
                 BSONObj o2 = o2Elt.Obj();
-                _conn.update(nsstr, o2, o, upsert, false);
+                pushOp('u', nsstr, o, o2, upsert);
+                return maybeFlush();
             }
             else if (op == "d") {
                 BSONElement &bElt = fields[4];
                 bool justOne = bElt.booleanSafe();
-                _conn.remove(nsstr, o, justOne);
+                pushOp('d', nsstr, o, BSONObj(), justOne);
+                return maybeFlush();
             }
             string err = _conn.getLastError(dbname.toString(), false, false);
             if (!err.empty()) {
@@ -262,6 +475,17 @@ class VanillaOplogPlayer : boost::noncopyable {
         _thisTime = OpTime();
         return true;
     }
+
+  private:
+    bool maybeFlush() {
+        // Don't call GLE or update _maxOpTimeSynced yet.
+        _thisTime = OpTime();
+        static const size_t MAX_BUFFERED_BYTES = 16 << 20;
+        if (_bufferedBytes >= MAX_BUFFERED_BYTES) {
+            return flush();
+        }
+        return true;
+    }
 };
 
 class OplogTool : public Tool {
@@ -271,6 +495,7 @@ class OplogTool : public Tool {
     scoped_ptr<ScopedDbConnection> _rconn;
     string _oplogns;
     mutable Timer _reportingTimer;
+    mutable unsigned long long _opsAppliedAtReport;
 
 public:
     void logPosition() const {
@@ -300,13 +525,14 @@ public:
     }
     static volatile bool running;
 
-    OplogTool() : Tool("2toku"), _logAtExit(true), _player(), _reportingTimer() {
+    OplogTool() : Tool("2toku"), _logAtExit(true), _player(), _reportingTimer(), _opsAppliedAtReport(0) {
         addFieldOptions();
         add_options()
         ("ts" , po::value<string>() , "max OpTime already applied (secs:inc)" )
         ("from", po::value<string>() , "host to pull from" )
         ("oplogns", po::value<string>()->default_value( "local.oplog.rs" ) , "ns to pull from" )
         ("reportingPeriod", po::value<int>()->default_value(10) , "seconds between progress reports" )
+        ("numApplyThreads", po::value<int>()->default_value(4) , "number of connections to replay operations on, spread by namespace" )
         ;
     }
 
@@ -317,6 +543,11 @@ public:
     void report() const {
         const OpTime &maxOpTimeSynced = _player->maxOpTimeSynced();
         LOG(0) << "synced up to " << fmtOpTime(maxOpTimeSynced);
+        const long long millis = _reportingTimer.millis();
+        if (millis > 0) {
+            LOG(0) << " (" << (_player->opsApplied() - _opsAppliedAtReport) * 1000 / millis << " ops/s)";
+        }
+        _opsAppliedAtReport = _player->opsApplied();
         if (!_rconn) {
             LOG(0) << endl;
             return;
@@ -395,7 +626,17 @@ public:
             }
             maxOpTimeSynced = OpTime(secs, i);
 
-            _player.reset(new VanillaOplogPlayer(conn(), _host, maxOpTimeSynced, running, _logAtExit));
+            const int numApplyThreads = getParam("numApplyThreads", 4);
+            if (numApplyThreads < 1) {
+                warning() << "--numApplyThreads must be at least 1" << endl;
+                return -1;
+            }
+            vector<DBClientBase *> applierConns;
+            for (int n = 0; n < numApplyThreads; n++) {
+                applierConns.push_back(newConnection());
+            }
+
+            _player.reset(new VanillaOplogPlayer(conn(), _host, maxOpTimeSynced, applierConns, running, _logAtExit));
         }
 
         const int reportingPeriod = getParam("reportingPeriod", 10);
@@ -457,7 +698,13 @@ public:
                             return -1;
                         }
                     }
-                    _player->flushInserts();
+                    // Start applying this batch while we get the next one.
+                    if (!_player->flush()) {
+                        logPosition();
+                        _rconn->done();
+                        _rconn.reset();
+                        return -1;
+                    }
 
                     if (_reportingTimer.seconds() >= reportingPeriod) {
                         report();
@@ -481,6 +728,12 @@ public:
         }
 
         if (_logAtExit) {
+            if (!_player->sync()) {
+                logPosition();
+                _rconn->done();
+                _rconn.reset();
+                return -1;
+            }
             logPosition();
 
             _rconn->done();
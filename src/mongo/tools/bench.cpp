@@ -0,0 +1,385 @@
+// bench.cpp
+
+/**
+*    Copyright (C) 2013 Tokutek Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mongo/pch.h"
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include <boost/program_options.hpp>
+
+#include "mongo/tools/tool.h"
+
+#include "mongo/base/initializer.h"
+#include "mongo/db/json.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/db/namespacestring.h"
+#include "mongo/scripting/bench.h"
+#include "mongo/scripting/bson_template_evaluator.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/timer.h"
+
+using namespace mongo;
+
+namespace po = boost::program_options;
+
+/**
+ * Runs workload suites described in JSON files with the same workers as the shell's benchRun(),
+ * and prints one result document per suite as a line of JSON.  A suite looks like:
+ *
+ * { name : "...", description : "...", requiresSharding : false,
+ *   setup : [ <step>, ... ],
+ *   workloads : [ { name : "...", parallel : 8, seconds : 30, ops : [ <benchRun op>, ... ] }, ... ],
+ *   teardown : [ <step>, ... ] }
+ *
+ * A workload takes any benchRun() option, e.g. opsPerSecond or intervalSeconds.  The steps are:
+ *
+ * { command : { ... }, db : "..." }                  runs a command, failing unless ignoreErrors
+ * { ensureIndex : "<ns>", key : { ... }, options : { ... } }
+ * { load : "<ns>", count : N, doc : <template> }     inserts N documents with _id 0 to N-1,
+ *                                                    built from a benchRun document template
+ *
+ * Any step that fails stops the run, so there are no results from a half set up suite.  In
+ * strings anywhere in a suite, a leading "$db" stands for the --db database (mongobench by
+ * default), e.g. { op : "find", ns : "$db.coll" } or { enableSharding : "$db" }.
+ */
+class BenchTool : public Tool {
+    static const size_t LoadBatchSize = 1000;
+
+    // Latest results of the baseline run, by "suite.workload.op".
+    map<string, BSONObj> _baseline;
+    double _tolerance;
+    bool _regressed;
+
+public:
+    BenchTool() : Tool("bench", REMOTE_SERVER, "mongobench", "", false), _tolerance(0.1), _regressed(false) {
+        add_options()
+        ("out", po::value<string>(), "append each suite's result document to this file, one JSON document per line")
+        ("baseline", po::value<string>(), "compare against the results of an earlier run, as written by --out")
+        ("tolerance", po::value<double>()->default_value(10.0), "percentage by which throughput may drop or p99 latency may rise before --baseline reports a regression")
+        ;
+        add_hidden_options()
+        ("suite", po::value<vector<string> >(), "workload suite files")
+        ;
+        addPositionArg("suite", -1);
+    }
+
+    virtual void printExtraHelp(ostream &out) {
+        out << "Run benchmark workload suites against a server.\n" << endl;
+        out << "usage: " << _name << " [options] suite.json..." << endl;
+    }
+
+    virtual void printExtraHelpAfter(ostream &out) {
+        out << "\nResults go to stdout, one JSON document per suite.  The exit code is 1 if any\n"
+               "operation regressed from the --baseline run." << endl;
+    }
+
+    int run() {
+        if (!hasParam("suite")) {
+            printHelp(cerr);
+            return -1;
+        }
+        const vector<string> suites = _params["suite"].as<vector<string> >();
+
+        _tolerance = _params["tolerance"].as<double>() / 100;
+        if (hasParam("baseline")) {
+            loadBaseline(getParam("baseline"));
+        }
+
+        auto_ptr<ofstream> out;
+        if (hasParam("out")) {
+            out.reset(new ofstream(getParam("out").c_str(), ios_base::out | ios_base::app));
+            uassert(17047, str::stream() << "couldn't open " << getParam("out"), out->good());
+        }
+
+        for (vector<string>::const_iterator it = suites.begin(); it != suites.end(); ++it) {
+            BSONObj result = runSuite(withDatabase(readJSONFile(*it)));
+            if (result.isEmpty()) {
+                continue;
+            }
+            const string line = result.jsonString();
+            cout << line << endl;
+            if (out.get() != NULL) {
+                *out << line << endl;
+            }
+            compareToBaseline(result);
+        }
+        return _regressed ? 1 : 0;
+    }
+
+private:
+    static BSONObj readJSONFile(const string &path) {
+        ifstream in(path.c_str());
+        uassert(17048, str::stream() << "couldn't open " << path, in.good());
+        stringstream ss;
+        ss << in.rdbuf();
+        return fromjson(ss.str());
+    }
+
+    /** @return obj with a leading "$db" in its strings replaced by the --db database. */
+    BSONObj withDatabase(const BSONObj &obj) const {
+        BSONObjBuilder b;
+        BSONForEach(e, obj) {
+            if (e.type() == String && (e.String() == "$db" || str::startsWith(e.String(), "$db."))) {
+                b.append(e.fieldName(), _db + e.String().substr(3));
+            }
+            else if (e.type() == Object) {
+                b.append(e.fieldName(), withDatabase(e.Obj()));
+            }
+            else if (e.type() == Array) {
+                b.appendArray(e.fieldName(), withDatabase(e.Obj()));
+            }
+            else {
+                b.append(e);
+            }
+        }
+        return b.obj();
+    }
+
+    BSONObj runSuite(const BSONObj &suite) {
+        const string name = suite["name"].String();
+        if (suite["requiresSharding"].trueValue() && !isMongos()) {
+            cerr << "skipping suite " << name << ", it needs to run against a mongos" << endl;
+            return BSONObj();
+        }
+        uassert(17049, str::stream() << "suite " << name << " has no workloads",
+                suite["workloads"].type() == Array && !suite["workloads"].Obj().isEmpty());
+
+        cerr << "running suite " << name << endl;
+        runSteps(suite["setup"]);
+
+        BSONObjBuilder b;
+        b.append("suite", name);
+        b.appendDate("date", jsTime());
+        b.append("host", _host);
+        BSONObj buildInfo;
+        conn().simpleCommand("admin", &buildInfo, "buildinfo");
+        b.append("version", buildInfo["version"].str());
+        b.append("gitVersion", buildInfo["gitVersion"].str());
+        b.append("tokumxVersion", buildInfo["tokumxVersion"].str());
+        {
+            BSONArrayBuilder workloads(b.subarrayStart("workloads"));
+            BSONForEach(w, suite["workloads"].Obj()) {
+                workloads.append(runWorkload(w.Obj()));
+            }
+            workloads.done();
+        }
+
+        runSteps(suite["teardown"]);
+        return b.obj();
+    }
+
+    void runSteps(const BSONElement &steps) {
+        if (steps.eoo()) {
+            return;
+        }
+        BSONForEach(e, steps.Obj()) {
+            BSONObj step = e.Obj();
+            if (step.hasField("command")) {
+                const string db = step.hasField("db") ? step["db"].String() : _db;
+                BSONObj res;
+                bool ok = conn().runCommand(db, step["command"].Obj(), res);
+                uassert(17050, str::stream() << "setup command " << step << " failed: " << res,
+                        ok || step["ignoreErrors"].trueValue());
+            }
+            else if (step.hasField("ensureIndex")) {
+                const string ns = step["ensureIndex"].String();
+                BSONObj key = step["key"].Obj();
+                BSONObjBuilder spec;
+                spec.append("ns", ns);
+                spec.append("key", key);
+                spec.append("name", conn().genIndexName(key));
+                if (step.hasField("options")) {
+                    spec.appendElements(step["options"].Obj());
+                }
+                conn().insert(nsToDatabase(ns) + ".system.indexes", spec.done());
+                checkLastError(step);
+                uassert(17063, str::stream() << "setup step " << step << " didn't create the index",
+                        conn().count(nsToDatabase(ns) + ".system.indexes",
+                                     BSON("ns" << ns << "key" << key)) == 1);
+            }
+            else if (step.hasField("load")) {
+                load(step);
+            }
+            else {
+                uasserted(17051, str::stream() << "unknown suite step " << step);
+            }
+        }
+    }
+
+    void load(const BSONObj &step) {
+        const string ns = step["load"].String();
+        const long long count = step["count"].numberLong();
+        BSONObj doc = step["doc"].eoo() ? BSONObj() : step["doc"].Obj();
+
+        BsonTemplateEvaluator evaluator;
+        vector<BSONObj> batch;
+        Timer t;
+        for (long long i = 0; i < count; i++) {
+            BSONObjBuilder b;
+            b.append("_id", i);
+            uassert(17052, str::stream() << "couldn't evaluate document template " << doc,
+                    evaluator.evaluate(doc, b) == BsonTemplateEvaluator::StatusSuccess);
+            batch.push_back(b.obj());
+            if (batch.size() == LoadBatchSize || i == count - 1) {
+                conn().insert(ns, batch);
+                checkLastError(step);
+                batch.clear();
+            }
+        }
+        const unsigned long long loaded =
+                conn().count(ns, BSON("_id" << BSON("$gte" << 0LL << "$lt" << count)));
+        uassert(17064, str::stream() << "setup step " << step << " loaded " << loaded << " documents",
+                loaded == static_cast<unsigned long long>(count));
+        cerr << "loaded " << count << " documents into " << ns << " in " << t.seconds() << "s" << endl;
+    }
+
+    void checkLastError(const BSONObj &step) {
+        string err = conn().getLastError();
+        uassert(17053, str::stream() << "setup step " << step << " failed: " << err, err.empty());
+    }
+
+    BSONObj runWorkload(const BSONObj &workload) {
+        const string name = workload["name"].String();
+
+        BSONObjBuilder configBuilder;
+        BSONForEach(e, workload) {
+            if (!str::equals(e.fieldName(), "name")) {
+                configBuilder.append(e);
+            }
+        }
+        configBuilder.append("host", _host);
+        if (!_username.empty()) {
+            configBuilder.append("username", _username);
+            configBuilder.append("password", _password);
+        }
+        BenchRunConfig *config = BenchRunConfig::createFromBson(configBuilder.done());
+        const double seconds = config->seconds;
+
+        cerr << "  " << name << ": " << config->parallel << " threads for " << seconds << "s" << endl;
+        BenchRunner runner(config);
+        runner.start();
+        sleepmillis(static_cast<long long>(seconds * 1000));
+        runner.stop();
+
+        BenchRunStats stats;
+        runner.populateStats(&stats);
+        uassert(17054, str::stream() << "workload " << name << " failed, check the log for the cause",
+                !stats.error);
+
+        BSONObjBuilder b;
+        b.append("name", name);
+        b.append("parallel", config->parallel);
+        b.append("seconds", seconds);
+        if (config->opsPerSecond > 0) {
+            b.append("opsPerSecond", config->opsPerSecond);
+        }
+        b.append("errCount", static_cast<long long>(stats.errCount));
+        {
+            BSONObjBuilder ops(b.subobjStart("ops"));
+            appendCounter(ops, "findOne", stats.findOneCounter, seconds);
+            appendCounter(ops, "insert", stats.insertCounter, seconds);
+            appendCounter(ops, "update", stats.updateCounter, seconds);
+            appendCounter(ops, "delete", stats.deleteCounter, seconds);
+            appendCounter(ops, "query", stats.queryCounter, seconds);
+            appendCounter(ops, "command", stats.commandCounter, seconds);
+            ops.done();
+        }
+        if (config->intervalSeconds > 0) {
+            b.append("intervals", runner.finishIntervals());
+        }
+        return b.obj();
+    }
+
+    static void appendCounter(BSONObjBuilder &b, const char *name,
+                              const BenchRunEventCounter &counter, double seconds) {
+        if (counter.getNumEvents() == 0) {
+            return;
+        }
+        BSONObjBuilder c(b.subobjStart(name));
+        c.append("ops", static_cast<long long>(counter.getNumEvents()));
+        c.append("opsPerSec", counter.getNumEvents() / seconds);
+        c.append("avgMicros", static_cast<double>(counter.getTotalTimeMicros()) / counter.getNumEvents());
+        c.append("p50", static_cast<long long>(counter.getPercentileTimeMicros(0.5)));
+        c.append("p99", static_cast<long long>(counter.getPercentileTimeMicros(0.99)));
+        c.append("p999", static_cast<long long>(counter.getPercentileTimeMicros(0.999)));
+        c.append("max", static_cast<long long>(counter.getMaxTimeMicros()));
+        c.done();
+    }
+
+    static string resultKey(const string &suite, const string &workload, const string &op) {
+        return suite + "." + workload + "." + op;
+    }
+
+    void loadBaseline(const string &path) {
+        ifstream in(path.c_str());
+        uassert(17055, str::stream() << "couldn't open " << path, in.good());
+        string line;
+        while (getline(in, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            BSONObj result = fromjson(line);
+            const string suite = result["suite"].String();
+            BSONForEach(w, result["workloads"].Obj()) {
+                BSONForEach(op, w["ops"].Obj()) {
+                    // Later lines are later runs, keep the latest.
+                    _baseline[resultKey(suite, w["name"].String(), op.fieldName())] = op.Obj().getOwned();
+                }
+            }
+        }
+    }
+
+    void compareToBaseline(const BSONObj &result) {
+        if (_baseline.empty()) {
+            return;
+        }
+        const string suite = result["suite"].String();
+        BSONForEach(w, result["workloads"].Obj()) {
+            BSONForEach(op, w["ops"].Obj()) {
+                const string key = resultKey(suite, w["name"].String(), op.fieldName());
+                map<string, BSONObj>::const_iterator it = _baseline.find(key);
+                if (it == _baseline.end()) {
+                    continue;
+                }
+                const double opsBefore = it->second["opsPerSec"].number();
+                const double opsNow = op.Obj()["opsPerSec"].number();
+                const double p99Before = it->second["p99"].number();
+                const double p99Now = op.Obj()["p99"].number();
+                const double opsChange = opsBefore > 0 ? (opsNow - opsBefore) / opsBefore : 0;
+                const double p99Change = p99Before > 0 ? (p99Now - p99Before) / p99Before : 0;
+                const bool regressed = opsChange < -_tolerance || p99Change > _tolerance;
+                cerr << (regressed ? "REGRESSION " : "") << key << ": "
+                     << opsNow << " ops/s (" << showpos << 100 * opsChange << "%), p99 "
+                     << noshowpos << p99Now << "us (" << showpos << 100 * p99Change << "%)"
+                     << noshowpos << endl;
+                if (regressed) {
+                    _regressed = true;
+                }
+            }
+        }
+    }
+};
+
+int main( int argc , char** argv, char **envp ) {
+    mongo::runGlobalInitializersOrDie(argc, argv, envp);
+    BenchTool t;
+    return t.main( argc , argv );
+}
@@ -25,10 +25,14 @@
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/convenience.hpp>
+#include <boost/thread/thread.hpp>
 
 #include "mongo/base/initializer.h"
+#include "mongo/client/dbclient_rs.h"
 #include "mongo/client/dbclientcursor.h"
+#include "mongo/client/remote_transaction.h"
 #include "mongo/db/namespacestring.h"
+#include "mongo/platform/atomic_word.h"
 #include "mongo/tools/tool.h"
 
 using namespace mongo;
@@ -44,14 +48,27 @@ class Dump : public Tool {
     private:
         FILE* _f;
     };
+
+    /** One _id range of a collection being dumped by writeCollectionSegments(). */
+    struct RangeDump : boost::noncopyable {
+        BSONObj min;    // empty for the first range
+        BSONObj max;    // empty for the last range
+        boost::filesystem::path file;
+        scoped_ptr<DBClientBase> conn;
+        scoped_ptr<RemoteTransaction> txn;
+        AtomicUInt64 nobjects;
+        string error;
+    };
+
 public:
-    Dump() : Tool( "dump" , ALL , "" , "" , true ) {
+    Dump() : Tool( "dump" , ALL , "" , "" , true ), _numRanges(1) {
         add_options()
         ("out,o", po::value<string>()->default_value("dump"), "output directory or \"-\" for stdout")
         ("query,q", po::value<string>() , "json query" )
         ("oplog", "Use oplog for point-in-time snapshotting" )
         ("repair", "try to recover a crashed database" )
         ("forceTableScan", "force a table scan (do not use $snapshot)" )
+        ("numRanges", po::value<int>()->default_value(1), "split each collection into up to this many _id ranges, dumped concurrently into numbered files, each from its own snapshot (requires the splitVector privilege)" )
         ;
     }
 
@@ -70,7 +87,7 @@ public:
 
     // This is a functor that writes a BSONObj to a file
     struct Writer {
-        Writer(FILE* out, ProgressMeter* m) :_out(out), _m(m) {}
+        Writer(FILE* out, ProgressMeter* m, AtomicUInt64* count = NULL) :_out(out), _m(m), _count(count) {}
 
         void operator () (const BSONObj& obj) {
             size_t toWrite = obj.objsize();
@@ -87,10 +104,14 @@ public:
             if (_m) {
                 _m->hit();
             }
+            if (_count) {
+                _count->fetchAndAdd(1);
+            }
         }
 
         FILE* _out;
         ProgressMeter* _m;
+        AtomicUInt64* _count;
     };
 
     void doCollection( const string coll , FILE* out , ProgressMeter *m ) {
@@ -102,10 +123,12 @@ public:
         else if ( _query.isEmpty() && !hasParam("dbpath") && !hasParam("forceTableScan") ) {
             q.snapshot();
         }
-        
-        DBClientBase& connBase = conn(true);
-        Writer writer(out, m);
 
+        doQuery( conn(true), coll, q, queryOptions, Writer(out, m) );
+    }
+
+    void doQuery( DBClientBase& connBase, const string& coll, const Query& q, int queryOptions,
+                  const Writer& writer ) {
         // use low-latency "exhaust" mode if going over the network
         if (!_usingMongos && typeid(connBase) == typeid(DBClientConnection&)) {
             DBClientConnection& conn = static_cast<DBClientConnection&>(connBase);
@@ -115,13 +138,158 @@ public:
         else {
             //This branch should only be taken with DBDirectClient or mongos which doesn't support exhaust mode
             scoped_ptr<DBClientCursor> cursor(connBase.query( coll.c_str() , q , 0 , 0 , 0 , queryOptions ));
+            Writer w = writer;
             while ( cursor->more() ) {
-                writer(cursor->next());
+                w(cursor->next());
+            }
+        }
+    }
+
+    /**
+     * @return up to _numRanges - 1 _id values that split coll into ranges of roughly equal size,
+     * or none if coll is too small to split or its split points can't be found.
+     */
+    vector<BSONObj> rangeSplitPoints( const string& coll ) {
+        vector<BSONObj> points;
+        if ( _numRanges <= 1 || _usingMongos || hasParam( "dbpath" ) ||
+             nsToCollectionSubstring( coll ).startsWith( "system." ) ||
+             startsWith( coll.c_str(), "local.oplog." ) ) {
+            return points;
+        }
+
+        const string db = nsToDatabase( coll );
+        BSONObj stats;
+        if ( !conn().runCommand( db, BSON( "collStats" << nsToCollectionSubstring( coll ) ), stats ) ) {
+            warning() << "couldn't get the size of " << coll << ", not splitting it: " << stats << endl;
+            return points;
+        }
+        const long long size = stats["size"].numberLong();
+        if ( size < MinRangeBytes * 2 ) {
+            return points;
+        }
+
+        // splitVector aims for chunks of half the requested size, so this asks for about twice as
+        // many split points as we need, and we pick evenly spaced ones out of them below.
+        BSONObj res;
+        if ( !conn().runCommand( db, BSON( "splitVector" << coll <<
+                                           "keyPattern" << BSON( "_id" << 1 ) <<
+                                           "maxChunkSizeBytes" << std::max( size / _numRanges, MinRangeBytes ) ),
+                                 res ) ) {
+            warning() << "couldn't find split points for " << coll << ", not splitting it: " << res << endl;
+            return points;
+        }
+        vector<BSONElement> keys = res["splitKeys"].Array();
+        const size_t nranges = std::min( keys.size() + 1, (size_t) _numRanges );
+        for ( size_t i = 1; i < nranges; i++ ) {
+            points.push_back( keys[ i * ( keys.size() + 1 ) / nranges - 1 ].Obj().getOwned() );
+        }
+        return points;
+    }
+
+    /** Dumps _id range r into r.file, on r's own connection and transaction. */
+    void dumpRange( const string& coll, RangeDump* r ) {
+        try {
+            FilePtr f (fopen(r->file.string().c_str(), "wb"));
+            uassert(17042, errnoWithPrefix("couldn't open file"), f);
+
+            Query q = _query;
+            q.hint( BSON( "_id" << 1 ) );
+            if ( !r->min.isEmpty() ) {
+                q.minKey( r->min );
+            }
+            if ( !r->max.isEmpty() ) {
+                q.maxKey( r->max );
+            }
+            doQuery( readConn( *r->conn ), coll, q, QueryOption_SlaveOk | QueryOption_NoCursorTimeout,
+                     Writer( f, NULL, &r->nobjects ) );
+        }
+        catch ( DBException& e ) {
+            r->error = e.toString();
+        }
+        _runningRanges.fetchAndSubtract( 1 );
+    }
+
+    DBClientBase& readConn( DBClientBase& c ) {
+        // Read from a secondary when we can, like conn(true).
+        if ( c.type() == ConnectionString::SET ) {
+            return static_cast<DBClientReplicaSet&>( c ).slaveConn();
+        }
+        return c;
+    }
+
+    /**
+     * Dumps coll split at splitPoints, each _id range on its own thread and connection.  The
+     * first range goes to outputFile and range i to outputFile.i.
+     *
+     * Each range reads from its own MVCC snapshot, because a transaction can't span
+     * connections.  The snapshots are all taken before any range starts reading, but writes
+     * that commit between them can be in some ranges and not others, so unlike a single range
+     * dump the segments together are not one point in time.  --numRanges 1 dumps from one.
+     */
+    void writeCollectionSegments( const string& coll, const boost::filesystem::path& outputFile,
+                                  const vector<BSONObj>& splitPoints ) {
+        const size_t nranges = splitPoints.size() + 1;
+        log() << "\t" << coll << " to " << outputFile.string() << " in " << nranges << " segments" << endl;
+
+        // Start every range's snapshot before any of them reads, so the segments are as close to
+        // a single point in time as separate connections can get.
+        vector<shared_ptr<RangeDump> > ranges;
+        for ( size_t i = 0; i < nranges; i++ ) {
+            shared_ptr<RangeDump> r( new RangeDump );
+            if ( i > 0 ) {
+                r->min = BSON( "_id" << splitPoints[i - 1]["_id"] );
+            }
+            if ( i < splitPoints.size() ) {
+                r->max = BSON( "_id" << splitPoints[i]["_id"] );
             }
+            r->file = i == 0 ? outputFile : boost::filesystem::path( str::stream() << outputFile.string() << "." << i );
+            r->conn.reset( newConnection() );
+            r->txn.reset( new RemoteTransaction( readConn( *r->conn ), "mvcc" ) );
+            uassert( 17043, "couldn't begin a transaction to dump " + coll, r->txn->isLive() );
+            ranges.push_back( r );
+        }
+
+        ProgressMeter m( conn(true).count( coll.c_str(), BSONObj(), QueryOption_SlaveOk ) );
+        m.setName( "Collection File Writing Progress" );
+        m.setUnits( "objects" );
+
+        _runningRanges.store( nranges );
+        boost::thread_group threads;
+        for ( size_t i = 0; i < nranges; i++ ) {
+            threads.create_thread( boost::bind( &Dump::dumpRange, this, coll, ranges[i].get() ) );
         }
+        unsigned long long reported = 0;
+        bool running = true;
+        while ( running ) {
+            running = _runningRanges.load() > 0;
+            if ( running ) {
+                sleepmillis( 100 );
+            }
+            unsigned long long n = 0;
+            for ( size_t i = 0; i < nranges; i++ ) {
+                n += ranges[i]->nobjects.load();
+            }
+            m.hit( n - reported );
+            reported = n;
+        }
+        threads.join_all();
+
+        for ( size_t i = 0; i < nranges; i++ ) {
+            uassert( 17044, str::stream() << "error dumping " << coll << " to "
+                            << ranges[i]->file.string() << ": " << ranges[i]->error,
+                     ranges[i]->error.empty() );
+        }
+        log() << "\t\t " << reported << " objects" << endl;
     }
 
-    void writeCollectionFile( const string coll , boost::filesystem::path outputFile ) {
+    /** @return the number of files coll was written to, more than one if it was split into ranges */
+    int writeCollectionFile( const string coll , boost::filesystem::path outputFile ) {
+        const vector<BSONObj> splitPoints = rangeSplitPoints( coll );
+        if ( !splitPoints.empty() ) {
+            writeCollectionSegments( coll, outputFile, splitPoints );
+            return splitPoints.size() + 1;
+        }
+
         log() << "\t" << coll << " to " << outputFile.string() << endl;
 
         FilePtr f (fopen(outputFile.string().c_str(), "wb"));
@@ -134,10 +302,12 @@ public:
         doCollection(coll, f, &m);
 
         log() << "\t\t " << m.done() << " objects" << endl;
+        return 1;
     }
 
     void writeMetadataFile( const string coll, boost::filesystem::path outputFile, 
-                            map<string, BSONObj> options, multimap<string, BSONObj> indexes ) {
+                            map<string, BSONObj> options, multimap<string, BSONObj> indexes,
+                            int segments ) {
         log() << "\tMetadata for " << coll << " to " << outputFile.string() << endl;
 
         bool hasOptions = options.count(coll) > 0;
@@ -145,6 +315,11 @@ public:
 
         BSONObjBuilder metadata;
 
+        // mongorestore reads the numbered segments after the first one when this is present.
+        if (segments > 1) {
+            metadata << "segments" << segments;
+        }
+
         if (hasOptions) {
             metadata << "options" << options.find(coll)->second;
         }
@@ -236,8 +411,8 @@ public:
         for (vector<string>::iterator it = collections.begin(); it != collections.end(); ++it) {
             string name = *it;
             const string filename = name.substr( db.size() + 1 );
-            writeCollectionFile( name , outdir / ( filename + ".bson" ) );
-            writeMetadataFile( name, outdir / (filename + ".metadata.json"), collectionOptions, indexes);
+            int segments = writeCollectionFile( name , outdir / ( filename + ".bson" ) );
+            writeMetadataFile( name, outdir / (filename + ".metadata.json"), collectionOptions, indexes, segments);
         }
 
     }
@@ -322,6 +497,11 @@ public:
         }
 
         _usingMongos = isMongos();
+        _numRanges = getParam( "numRanges" , 1 );
+        if ( _numRanges < 1 ) {
+            log() << "--numRanges must be at least 1" << endl;
+            return -1;
+        }
 
         boost::filesystem::path root( out );
         string db = _db;
@@ -375,8 +555,13 @@ public:
         return 0;
     }
 
+    // Collections smaller than twice this are never split.
+    static const long long MinRangeBytes = 4 * 1024 * 1024;
+
     bool _usingMongos;
     BSONObj _query;
+    int _numRanges;
+    AtomicUInt32 _runningRanges;
 };
 
 int main( int argc , char ** argv, char ** envp ) {
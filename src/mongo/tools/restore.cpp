@@ -24,6 +24,7 @@
 #include <boost/program_options.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
 #include <fcntl.h>
 #include <fstream>
 #include <set>
@@ -35,6 +36,11 @@
 #include "mongo/db/json.h"
 #include "mongo/client/dbclientcursor.h"
 #include "mongo/client/remote_loader.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/platform/posix_fadvise.h"
+#include "mongo/util/queue.h"
+#include "mongo/util/scopeguard.h"
+#include "mongo/util/timer.h"
 
 using namespace mongo;
 
@@ -43,19 +49,68 @@ namespace po = boost::program_options;
 class Restore : public BSONTool {
 public:
 
+    /**
+     * A collection to be loaded by one of the --numParallelCollections workers.  Everything else
+     * about restoring it (dropping it, reading its metadata) has already been done by drillDown().
+     */
+    struct CollectionTask : boost::noncopyable {
+        vector<boost::filesystem::path> files;  // more than one if mongodump split it into ranges
+        string ns;
+        string db;
+        string coll;
+        vector<BSONObj> indexes;
+        BSONObj options;
+        unsigned long long fileLength;
+        AtomicUInt64 bytesRead;
+        AtomicUInt64 objectsRead;
+        AtomicUInt32 active;    // 1 while a worker is loading it
+        AtomicUInt32 abandoned; // tells the reader thread to stop early
+    };
+
+    /** Objects read ahead from a collection's BSON file, waiting to be inserted. */
+    struct ReadBatch {
+        ReadBatch() : bytes(0), last(false) {}
+        vector<BSONObj> objs;
+        size_t bytes;
+        bool last;      // the file has been read completely, or reading failed
+        string error;
+    };
+    typedef shared_ptr<ReadBatch> ReadBatchPtr;
+
+    static size_t readBatchBytes(const ReadBatchPtr &batch) {
+        return batch->bytes;
+    }
+
+    // A batch is handed to the loading thread once it holds this many bytes, and each file's
+    // reader may get this far ahead of its loader.  A batch is sent as a single insert message,
+    // so it must stay well under the server's message size limit even with one more maximum size
+    // object in it.
+    static const size_t ReadBatchBytes = 4 * 1024 * 1024;
+    static const size_t ReadAheadBytes = 64 * 1024 * 1024;
+    static const int ProgressIntervalSecs = 5;
+
     bool _drop;
     bool _restoreOptions;
     bool _restoreIndexes;
     int _w;
     bool _doBulkLoad;
+    int _numParallelCollections;
     string _curns;
     string _curdb;
     string _curcoll;
     set<string> _users; // For restoring users with --drop
 
+    // Collections left for the parallel workers, see restoreCollections().
+    vector<shared_ptr<CollectionTask> > _tasks;
+    size_t _nextTask;
+    mongo::mutex _tasksMutex;
+    AtomicUInt32 _runningWorkers;
+    AtomicUInt32 _failed;
+
     Restore() : BSONTool( "restore" ),
         _drop(false), _restoreOptions(false), _restoreIndexes(false),
-        _w(0), _doBulkLoad(false) {
+        _w(0), _doBulkLoad(false), _numParallelCollections(1),
+        _nextTask(0), _tasksMutex("restoreTasks") {
         // Default values set here will show up in help text, but will supercede any default value
         // used when calling getParam below.
         add_options()
@@ -66,6 +121,7 @@ public:
         ("noOptionsRestore" , "don't restore collection options")
         ("noIndexRestore" , "don't restore indexes")
         ("w" , po::value<int>()->default_value(0) , "minimum number of replicas per write. WARNING, setting w > 1 prevents the bulk load optimization." )
+        ("numParallelCollections,j" , po::value<int>()->default_value(1) , "number of collections to restore in parallel, each over its own connection" )
         ;
         add_hidden_options()
         ("dir", po::value<string>()->default_value("dump"), "directory to restore from")
@@ -111,6 +167,15 @@ public:
         if (hasParam( "oplogLimit" )) {
             log() << "warning: --oplogLimit is deprecated in TokuMX" << endl;
         }
+        _numParallelCollections = getParam( "numParallelCollections" , 1 );
+        if (_numParallelCollections < 1) {
+            log() << "--numParallelCollections must be at least 1" << endl;
+            return -1;
+        }
+        if (_numParallelCollections > 1 && hasParam( "dbpath" )) {
+            log() << "warning: --numParallelCollections is ignored with --dbpath" << endl;
+            _numParallelCollections = 1;
+        }
 
         /* If _db is not "" then the user specified a db name to restore as.
          *
@@ -122,6 +187,9 @@ public:
          * .bson file, or a single .bson file itself (a collection).
          */
         drillDown(root, _db != "", _coll != "", true);
+        if (!_tasks.empty() && !restoreCollections()) {
+            return -1;
+        }
         string err = conn().getLastError(_db == "" ? "admin" : _db);
         if (!err.empty()) {
             error() << err;
@@ -180,6 +248,12 @@ public:
             return;
         }
 
+        if ( isSegmentFile( root ) ) {
+            // Later segments of a collection dumped with --numRanges are handled with the first
+            LOG(1) << "\tskipping segment file " << root.string() << endl;
+            return;
+        }
+
         if ( ! ( endsWith( root.string().c_str() , ".bson" ) ||
                  endsWith( root.string().c_str() , ".bin" ) ) ) {
             error() << "don't know what to do with file [" << root.string() << "]" << endl;
@@ -231,13 +305,15 @@ public:
             }
         }
 
+        // Always read the metadata, it also says whether there are more segments to restore.
         BSONObj metadataObject;
-        if (_restoreOptions || _restoreIndexes) {
+        {
             boost::filesystem::path metadataFile = (root.branch_path() / (oldCollName + ".metadata.json"));
             if (!boost::filesystem::exists(metadataFile.string())) {
                 // This is fine because dumps from before 2.1 won't have a metadata file, just print a warning.
                 // System collections shouldn't have metadata so don't warn if that file is missing.
-                if (!startsWith(metadataFile.leaf().string(), "system.")) {
+                if ((_restoreOptions || _restoreIndexes) &&
+                    !startsWith(metadataFile.leaf().string(), "system.")) {
                     log() << metadataFile.string() << " not found. Skipping." << endl;
                 }
             } else {
@@ -245,6 +321,16 @@ public:
             }
         }
 
+        vector<boost::filesystem::path> files;
+        files.push_back(root);
+        const int segments = metadataObject["segments"].numberInt();
+        for (int i = 1; i < segments; i++) {
+            boost::filesystem::path segment(str::stream() << root.string() << "." << i);
+            uassert(17045, "missing segment file " + segment.string(),
+                    boost::filesystem::exists(segment));
+            files.push_back(segment);
+        }
+
         _curns = ns.c_str();
         NamespaceString nss(_curns);
         _curdb = nss.db;
@@ -276,9 +362,30 @@ public:
         const BSONObj options = _restoreOptions && metadataObject.hasField("options") ?
                                 metadataObject["options"].Obj() : BSONObj();
 
+        if (_numParallelCollections > 1 && !startsWith(_curcoll, "system.")) {
+            // System collections need the special handling in gotObject(), so they are always
+            // restored right here.  Everything else is queued for restoreCollections().
+            if (!_doBulkLoad && !options.isEmpty()) {
+                createCollectionWithOptions(options);
+            }
+            shared_ptr<CollectionTask> task(new CollectionTask);
+            task->files = files;
+            task->ns = _curns;
+            task->db = _curdb;
+            task->coll = _curcoll;
+            task->indexes = indexes;
+            task->options = options;
+            task->fileLength = 0;
+            for (vector<boost::filesystem::path>::const_iterator it = files.begin(); it != files.end(); ++it) {
+                task->fileLength += boost::filesystem::file_size(*it);
+            }
+            _tasks.push_back(task);
+            return;
+        }
+
         if (_doBulkLoad) {
             RemoteLoader loader(conn(), _curdb, _curcoll, indexes, options);
-            processFile( root );
+            processFiles( files );
             loader.commit();
         } else {
             // No bulk load. Create collection and indexes manually.
@@ -286,9 +393,9 @@ public:
                 createCollectionWithOptions(options);
             }
             // Build indexes last - it's a little faster.
-            processFile( root );
+            processFiles( files );
             for (vector<BSONObj>::iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                createIndex(*it);
+                createIndex(conn(), _curdb, *it);
             }
         }
 
@@ -328,6 +435,263 @@ public:
 
 private:
 
+    void processFiles(const vector<boost::filesystem::path> &files) {
+        for (vector<boost::filesystem::path>::const_iterator it = files.begin(); it != files.end(); ++it) {
+            processFile( *it );
+        }
+    }
+
+    /** @return true for "coll.bson.N", the Nth range of a collection dumped with --numRanges. */
+    static bool isSegmentFile(const boost::filesystem::path &p) {
+        const string name = p.leaf().string();
+        const size_t dot = name.find_last_of('.');
+        if (dot == string::npos || dot + 1 == name.size() ||
+            name.find_first_not_of("0123456789", dot + 1) != string::npos) {
+            return false;
+        }
+        return endsWith(name.substr(0, dot).c_str(), ".bson");
+    }
+
+    static bool largerFile(const shared_ptr<CollectionTask> &a, const shared_ptr<CollectionTask> &b) {
+        return a->fileLength > b->fileLength;
+    }
+
+    /**
+     * Loads the collections queued by drillDown() with _numParallelCollections workers, and
+     * reports their progress until they are done.
+     * @return false if any collection failed to restore.
+     */
+    bool restoreCollections() {
+        // Starting with the biggest files keeps one huge collection from being left for last.
+        std::stable_sort(_tasks.begin(), _tasks.end(), largerFile);
+
+        const size_t nworkers = std::min(_tasks.size(), (size_t) _numParallelCollections);
+        log() << "restoring " << _tasks.size() << " collections using " << nworkers
+              << " connections" << endl;
+
+        unsigned long long totalBytes = 0;
+        for (vector<shared_ptr<CollectionTask> >::const_iterator it = _tasks.begin(); it != _tasks.end(); ++it) {
+            totalBytes += (*it)->fileLength;
+        }
+
+        Timer t;
+        boost::thread_group workers;
+        _runningWorkers.store(nworkers);
+        for (size_t i = 0; i < nworkers; i++) {
+            workers.create_thread(boost::bind(&Restore::collectionWorker, this));
+        }
+        int lastReport = 0;
+        while (_runningWorkers.load() > 0) {
+            sleepmillis(100);
+            const int secs = t.seconds();
+            if (secs - lastReport >= ProgressIntervalSecs) {
+                lastReport = secs;
+                reportProgress(totalBytes, t.micros());
+            }
+        }
+        workers.join_all();
+
+        const double mb = totalBytes / (1024.0 * 1024.0);
+        log() << "restored " << _tasks.size() << " collections, " << mb << "MB in "
+              << t.millis() / 1000.0 << "s (" << mb / (t.micros() / 1000000.0 + 1e-9) << "MB/s)" << endl;
+        return _failed.load() == 0;
+    }
+
+    void reportProgress(unsigned long long totalBytes, unsigned long long micros) {
+        unsigned long long bytesRead = 0;
+        for (vector<shared_ptr<CollectionTask> >::const_iterator it = _tasks.begin(); it != _tasks.end(); ++it) {
+            const CollectionTask &task = **it;
+            bytesRead += task.bytesRead.load();
+            if (task.active.load()) {
+                const unsigned long long n = task.bytesRead.load();
+                log() << "\t" << task.ns << "\t" << n << "/" << task.fileLength << "\t"
+                      << (task.fileLength ? n * 100 / task.fileLength : 100) << "%" << endl;
+            }
+        }
+        const double mb = bytesRead / (1024.0 * 1024.0);
+        log() << "\tread " << mb << "MB of " << totalBytes / (1024.0 * 1024.0) << "MB ("
+              << mb / (micros / 1000000.0) << "MB/s)" << endl;
+    }
+
+    shared_ptr<CollectionTask> nextTask() {
+        scoped_lock lk(_tasksMutex);
+        if (_failed.load() || _nextTask >= _tasks.size()) {
+            return shared_ptr<CollectionTask>();
+        }
+        return _tasks[_nextTask++];
+    }
+
+    void collectionWorker() {
+        shared_ptr<CollectionTask> task;
+        try {
+            scoped_ptr<DBClientBase> c(newConnection());
+            while ((task = nextTask())) {
+                restoreCollection(*c, *task);
+            }
+        }
+        catch (DBException &e) {
+            error() << "error restoring " << (task ? task->ns : string("collections")) << ": "
+                    << e.toString() << endl;
+            _failed.store(1);
+        }
+        _runningWorkers.fetchAndSubtract(1);
+    }
+
+    /**
+     * Loads task's files over c, with its own RemoteLoader if bulk loading.  A separate thread
+     * per file reads and validates it ahead of the inserts.
+     */
+    void restoreCollection(DBClientBase &c, CollectionTask &task) {
+        Timer t;
+        task.active.store(1);
+
+        BlockingQueue<ReadBatchPtr> queue(ReadAheadBytes, &Restore::readBatchBytes);
+        boost::thread_group readers;
+        for (vector<boost::filesystem::path>::const_iterator it = task.files.begin(); it != task.files.end(); ++it) {
+            readers.create_thread(boost::bind(&Restore::readCollectionFile, this, &task, *it, &queue));
+        }
+        size_t readersLeft = task.files.size();
+        try {
+            scoped_ptr<RemoteLoader> loader;
+            if (_doBulkLoad) {
+                loader.reset(new RemoteLoader(c, task.db, task.coll, task.indexes, task.options));
+            }
+
+            while (readersLeft > 0) {
+                ReadBatchPtr batch = queue.blockingPop();
+                if (batch->last) {
+                    readersLeft--;
+                }
+                uassert(17038, str::stream() << "error restoring " << task.ns << ": " << batch->error,
+                        batch->error.empty());
+                if (batch->objs.empty()) {
+                    continue;
+                }
+                insertBatch(c, task, batch->objs);
+            }
+
+            if (loader) {
+                loader->commit();
+            } else {
+                for (vector<BSONObj>::iterator it = task.indexes.begin(); it != task.indexes.end(); ++it) {
+                    createIndex(c, task.db, *it);
+                }
+            }
+        }
+        catch (...) {
+            task.abandoned.store(1);
+            while (readersLeft > 0) {
+                if (queue.blockingPop()->last) {
+                    readersLeft--;
+                }
+            }
+            readers.join_all();
+            task.active.store(0);
+            throw;
+        }
+        readers.join_all();
+        task.active.store(0);
+
+        const double mb = task.fileLength / (1024.0 * 1024.0);
+        log() << "\tfinished restoring " << task.ns << " (" << task.objectsRead.load()
+              << " objects, " << mb / (t.micros() / 1000000.0 + 1e-9) << "MB/s)" << endl;
+    }
+
+    /**
+     * Inserts a batch of task's objects.  The batch is applied as one transaction, which an error
+     * on its last object rolls back, so after any error the objects are inserted again one at a
+     * time, and the ones that fail are reported.
+     */
+    void insertBatch(DBClientBase &c, const CollectionTask &task, const vector<BSONObj> &objs) {
+        c.insert(task.ns, objs, InsertOption_ContinueOnError);
+
+        // wait for inserts to propagate to "w" nodes (doesn't warn if w used without replset)
+        string err = c.getLastError(task.db, false, false, _w);
+        if (err.empty()) {
+            return;
+        }
+        LOG(1) << task.ns << ": " << err << ", inserting the batch's " << objs.size()
+               << " objects one at a time" << endl;
+        size_t dupKeys = 0;
+        for (vector<BSONObj>::const_iterator it = objs.begin(); it != objs.end(); ++it) {
+            c.insert(task.ns, *it);
+            BSONObj res = c.getLastErrorDetailed(task.db, false, false, _w);
+            if (res["err"].isNull()) {
+                continue;
+            }
+            if (res["code"].numberInt() == ASSERT_ID_DUPKEY) {
+                dupKeys++;
+                continue;
+            }
+            error() << task.ns << ": error inserting " << (*it)["_id"] << ": " << res["err"] << endl;
+        }
+        if (dupKeys > 0) {
+            log() << task.ns << ": " << dupKeys << " objects were already there" << endl;
+        }
+    }
+
+    /** Reads one of task's files into batches of objects on queue, ending with one marked last. */
+    void readCollectionFile(CollectionTask *task, const boost::filesystem::path &path,
+                            BlockingQueue<ReadBatchPtr> *queue) {
+        ReadBatchPtr batch(new ReadBatch);
+        try {
+            const string fileName = path.string();
+            const unsigned long long fileLength = boost::filesystem::file_size(path);
+            FILE *file = fopen(fileName.c_str(), "rb");
+            uassert(17039, str::stream() << "error opening file: " << fileName << " "
+                           << errnoWithDescription(),
+                    file);
+            ON_BLOCK_EXIT(fclose, file);
+#ifdef POSIX_FADV_SEQUENTIAL
+            posix_fadvise(fileno(file), 0, fileLength, POSIX_FADV_SEQUENTIAL);
+#endif
+
+            const int BUF_SIZE = BSONObjMaxUserSize + ( 1024 * 1024 );
+            boost::scoped_array<char> buf_holder(new char[BUF_SIZE]);
+            char *buf = buf_holder.get();
+
+            unsigned long long read = 0;
+            while (read < fileLength && !task->abandoned.load()) {
+                size_t amt = fread(buf, 1, 4, file);
+                uassert(17040, str::stream() << fileName << ": unexpected end of file at offset "
+                               << read,
+                        amt == 4);
+                int size = ((int*)buf)[0];
+                uassert(17041, str::stream() << fileName << ": invalid object size: " << size,
+                        size >= 5 && size < BUF_SIZE);
+                amt = fread(buf + 4, 1, size - 4, file);
+                uassert(17046, str::stream() << fileName << ": truncated object at offset " << read,
+                        amt == (size_t) (size - 4));
+
+                BSONObj o(buf);
+                checkObject(o);
+                if (matchesFilter(o)) {
+                    batch->objs.push_back(o.getOwned());
+                    batch->bytes += size;
+                }
+                read += size;
+                task->bytesRead.fetchAndAdd(size);
+                task->objectsRead.fetchAndAdd(1);
+
+                if (batch->bytes >= ReadBatchBytes) {
+                    queue->push(batch);
+                    batch.reset(new ReadBatch);
+                }
+            }
+        }
+        catch (DBException &e) {
+            batch->error = e.toString();
+        }
+        catch (const std::exception &e) {
+            batch->error = e.what();
+        }
+        catch (...) {
+            batch->error = "unknown error";
+        }
+        batch->last = true;
+        queue->push(batch);
+    }
+
     BSONObj parseMetadataFile(string filePath) {
         long long fileSize = boost::filesystem::file_size(filePath);
         ifstream file(filePath.c_str(), ios_base::in);
@@ -433,12 +797,12 @@ private:
 
     /* We must handle if the dbname or collection name is different at restore time than what was dumped.
      */
-    void createIndex(BSONObj indexObj) {
+    void createIndex(DBClientBase &c, const string &db, BSONObj indexObj) {
         LOG(0) << "\tCreating index: " << indexObj << endl;
-        conn().insert( _curdb + ".system.indexes" ,  indexObj );
+        c.insert( db + ".system.indexes" ,  indexObj );
 
         // We're stricter about errors for indexes than for regular data
-        BSONObj err = conn().getLastErrorDetailed(_curdb, false, false, _w);
+        BSONObj err = c.getLastErrorDetailed(db, false, false, _w);
 
         if (err.hasField("err") && !err["err"].isNull()) {
             if (err["err"].str() == "norepl" && _w > 1) {
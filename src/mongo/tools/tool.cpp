@@ -425,10 +425,32 @@ namespace mongo {
             return;
         }
 
-        _conn->auth( BSON( saslCommandPrincipalSourceFieldName << getAuthenticationDatabase() <<
-                           saslCommandPrincipalFieldName << _username <<
-                           saslCommandPasswordFieldName << _password  <<
-                           saslCommandMechanismFieldName << _authenticationMechanism ) );
+        _conn->auth( authParams() );
+    }
+
+    BSONObj Tool::authParams() {
+        return BSON( saslCommandPrincipalSourceFieldName << getAuthenticationDatabase() <<
+                     saslCommandPrincipalFieldName << _username <<
+                     saslCommandPasswordFieldName << _password  <<
+                     saslCommandMechanismFieldName << _authenticationMechanism );
+    }
+
+    DBClientBase* Tool::newConnection() {
+        verify( !_noconnection && _host != "DIRECT" );
+
+        string errmsg;
+        ConnectionString cs = ConnectionString::parse( _host , errmsg );
+        uassert( 17036, str::stream() << "invalid hostname [" << _host << "] " << errmsg,
+                 cs.isValid() );
+
+        auto_ptr<DBClientBase> c( cs.connect( errmsg ) );
+        uassert( 17037, str::stream() << "couldn't connect to [" << _host << "] " << errmsg,
+                 c.get() );
+
+        if ( !_username.empty() ) {
+            c->auth( authParams() );
+        }
+        return c.release();
     }
 
     BSONTool::BSONTool( const char * name, DBAccess access , bool objcheck )
@@ -499,24 +521,9 @@ namespace mongo {
             verify( amt == (size_t)( size - 4 ) );
 
             BSONObj o( buf );
-            if ( _objcheck && ! o.valid() ) {
-                cerr << "INVALID OBJECT - going try and pring out " << endl;
-                cerr << "size: " << size << endl;
-                BSONObjIterator i(o);
-                while ( i.more() ) {
-                    BSONElement e = i.next();
-                    try {
-                        e.validate();
-                    }
-                    catch ( ... ) {
-                        cerr << "\t\t NEXT ONE IS INVALID" << endl;
-                    }
-                    cerr << "\t name : " << e.fieldName() << " " << e.type() << endl;
-                    cerr << "\t " << e << endl;
-                }
-            }
+            checkObject( o );
 
-            if ( _matcher.get() == 0 || _matcher->matches( o ) ) {
+            if ( matchesFilter( o ) ) {
                 gotObject( o );
                 processed++;
             }
@@ -536,4 +543,27 @@ namespace mongo {
         return processed;
     }
 
+    void BSONTool::checkObject( const BSONObj& o ) {
+        if ( _objcheck && ! o.valid() ) {
+            cerr << "INVALID OBJECT - going try and pring out " << endl;
+            cerr << "size: " << o.objsize() << endl;
+            BSONObjIterator i(o);
+            while ( i.more() ) {
+                BSONElement e = i.next();
+                try {
+                    e.validate();
+                }
+                catch ( ... ) {
+                    cerr << "\t\t NEXT ONE IS INVALID" << endl;
+                }
+                cerr << "\t name : " << e.fieldName() << " " << e.type() << endl;
+                cerr << "\t " << e << endl;
+            }
+        }
+    }
+
+    bool BSONTool::matchesFilter( const BSONObj& o ) const {
+        return _matcher.get() == 0 || _matcher->matches( o );
+    }
+
 }
@@ -106,6 +106,12 @@ namespace mongo {
 
         mongo::DBClientBase &conn( bool slaveIfPaired = false );
 
+        /**
+         * Opens another connection to the server conn() is connected to, authenticated as the
+         * same user.  The caller owns it.  Not available with --dbpath.
+         */
+        mongo::DBClientBase *newConnection();
+
         string _name;
 
         string _db;
@@ -144,6 +150,7 @@ namespace mongo {
 
     private:
         void auth();
+        BSONObj authParams();
     };
 
     class BSONTool : public Tool {
@@ -160,6 +167,12 @@ namespace mongo {
 
         long long processFile( const boost::filesystem::path& file );
 
+    protected:
+        /** Prints the offending elements if --objcheck is on and o is invalid. */
+        void checkObject( const BSONObj& o );
+        /** @return true if o passes --filter, if one was given. */
+        bool matchesFilter( const BSONObj& o ) const;
+
     };
 
 }
@@ -0,0 +1,163 @@
+// @file partitioned_counter.cpp
+
+/*    Copyright (C) 2013 Tokutek Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/pch.h"
+
+#include "mongo/util/concurrency/partitioned_counter.h"
+
+#include <stdlib.h>
+#include <new>
+#include <vector>
+
+#include "mongo/util/concurrency/mutex.h"
+
+namespace mongo {
+
+    TSP_DEFINE(PartitionedCounterThreadCells, partitionedCounterThreadCells);
+
+    namespace {
+
+        // Cells are padded to a multiple of this, and allocated aligned to it.
+        const size_t CacheLineSize = 64;
+
+        // Protected by idMutex().
+        size_t nextCounterId = 0;
+        std::vector<size_t> *freeCounterIds = NULL;
+
+        SimpleMutex &idMutex() {
+            // Global counters get constructed during static initialization, and may be
+            // destroyed during static destruction, so this must never be destroyed.
+            static SimpleMutex *m = new SimpleMutex("PartitionedCounter");
+            return *m;
+        }
+
+        AtomicUInt64 nextGeneration(1);
+
+    } // namespace
+
+    void *PartitionedCounterCell::operator new(size_t size) {
+#if defined(_WIN32)
+        void *p = _aligned_malloc(size, CacheLineSize);
+        if (p == NULL) {
+            throw std::bad_alloc();
+        }
+#else
+        void *p = NULL;
+        if (posix_memalign(&p, CacheLineSize, size) != 0) {
+            throw std::bad_alloc();
+        }
+#endif
+        return p;
+    }
+
+    void PartitionedCounterCell::operator delete(void *p) {
+#if defined(_WIN32)
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+
+    void PartitionedCounterCell::release(PartitionedCounterCell *cell) {
+        if (cell->_state.compareAndSwap(Owned, Free) != Owned) {
+            dassert(cell->_state.load() == Orphaned);
+            delete cell;
+        }
+    }
+
+    size_t PartitionedCounterBase::allocateId() {
+        SimpleMutex::scoped_lock lk(idMutex());
+        if (freeCounterIds == NULL) {
+            freeCounterIds = new std::vector<size_t>;
+        }
+        if (!freeCounterIds->empty()) {
+            size_t id = freeCounterIds->back();
+            freeCounterIds->pop_back();
+            return id;
+        }
+        return nextCounterId++;
+    }
+
+    PartitionedCounterBase::PartitionedCounterBase() :
+        _id(allocateId()), _generation(nextGeneration.fetchAndAdd(1)), _head(0) {}
+
+    PartitionedCounterBase::~PartitionedCounterBase() {
+        dassert(_head.load() == 0);
+        SimpleMutex::scoped_lock lk(idMutex());
+        freeCounterIds->push_back(_id);
+    }
+
+    PartitionedCounterCell *PartitionedCounterBase::registerCell() {
+        PartitionedCounterThreadCells *tc = partitionedCounterThreadCells.getMake();
+        if (tc->_cells.size() <= _id) {
+            tc->_cells.resize(_id + 1, NULL);
+        }
+        PartitionedCounterCell *&slot = tc->_cells[_id];
+        if (slot != NULL) {
+            // Left over from a destroyed counter that had the same id.
+            PartitionedCounterCell::release(slot);
+            slot = NULL;
+        }
+
+        // Cells are never unlinked before the counter is destroyed, so the list can be walked
+        // while other threads push onto it.
+        for (PartitionedCounterCell *c = reinterpret_cast<PartitionedCounterCell *>(_head.load());
+             c != NULL; c = c->_next) {
+            if (c->_state.compareAndSwap(PartitionedCounterCell::Free,
+                                         PartitionedCounterCell::Owned) == PartitionedCounterCell::Free) {
+                slot = c;
+                return c;
+            }
+        }
+
+        PartitionedCounterCell *cell = newCell();
+        cell->_generation = _generation;
+        uintptr_t head = _head.load();
+        while (true) {
+            cell->_next = reinterpret_cast<PartitionedCounterCell *>(head);
+            const uintptr_t old = _head.compareAndSwap(head, reinterpret_cast<uintptr_t>(cell));
+            if (old == head) {
+                break;
+            }
+            head = old;
+        }
+        slot = cell;
+        return cell;
+    }
+
+    void PartitionedCounterBase::destroyCells() {
+        PartitionedCounterCell *cell = reinterpret_cast<PartitionedCounterCell *>(_head.swap(0));
+        while (cell != NULL) {
+            PartitionedCounterCell *next = cell->_next;
+            // A cell still owned by a thread is deleted when that thread releases it.
+            if (cell->_state.compareAndSwap(PartitionedCounterCell::Owned,
+                                            PartitionedCounterCell::Orphaned) != PartitionedCounterCell::Owned) {
+                delete cell;
+            }
+            cell = next;
+        }
+    }
+
+    PartitionedCounterThreadCells::~PartitionedCounterThreadCells() {
+        for (std::vector<PartitionedCounterCell *>::iterator it = _cells.begin(); it != _cells.end(); ++it) {
+            if (*it != NULL) {
+                PartitionedCounterCell::release(*it);
+            }
+        }
+    }
+
+} // namespace mongo
@@ -20,16 +20,125 @@
 #include "mongo/pch.h"
 
 #include <limits>
-#include <list>
-#include <boost/thread/tss.hpp>
+#include <vector>
 
+#include "mongo/platform/atomic_word.h"
 #include "mongo/util/assert_util.h"
-#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/concurrency/threadlocal.h"
 
 namespace mongo {
 
-    using boost::thread_specific_ptr;
-    using std::list;
+    class PartitionedCounterBase;
+
+    /**
+     * One thread's part of one PartitionedCounter.  Cells are pushed onto their counter's list
+     * and stay there until the counter is destroyed, so reads walk the list without a lock.  When
+     * its thread exits, a cell keeps its sum and is marked free, and the next thread to use the
+     * counter takes it over.  Cells are allocated cache line aligned.
+     */
+    class PartitionedCounterCell : boost::noncopyable {
+      public:
+        PartitionedCounterCell() : _next(NULL), _generation(0), _state(Owned) {}
+        virtual ~PartitionedCounterCell() {}
+
+        static void *operator new(size_t size);
+        static void operator delete(void *p);
+
+      private:
+        enum State {
+            Owned,    // a live thread's table refers to it
+            Free,     // its thread exited, another thread may take it over
+            Orphaned  // its counter was destroyed while a thread still referred to it
+        };
+
+        /**
+         * Called when the thread referring to cell no longer does.  Whichever of this and the
+         * counter's destruction comes last deletes the cell.
+         */
+        static void release(PartitionedCounterCell *cell);
+
+        PartitionedCounterCell *_next;
+        unsigned long long _generation;  // of the counter it belongs to
+        AtomicUInt32 _state;
+
+        friend class PartitionedCounterBase;
+        friend class PartitionedCounterThreadCells;
+    };
+
+    /**
+     * Per-thread table of cells, indexed by counter id.  Only its own thread uses it.  When the
+     * thread exits, its destructor releases each cell.
+     */
+    class PartitionedCounterThreadCells : boost::noncopyable {
+      public:
+        PartitionedCounterThreadCells() {}
+        ~PartitionedCounterThreadCells();
+
+        /**
+         * @return the cell for the counter with id and generation, or NULL if there isn't one.
+         *         A cell with another generation is left over from a destroyed counter with the
+         *         same id.
+         */
+        PartitionedCounterCell *get(size_t id, unsigned long long generation) const {
+            if (id < _cells.size()) {
+                PartitionedCounterCell *cell = _cells[id];
+                if (cell != NULL && cell->_generation == generation) {
+                    return cell;
+                }
+            }
+            return NULL;
+        }
+      private:
+        std::vector<PartitionedCounterCell *> _cells;
+        friend class PartitionedCounterBase;
+    };
+
+    TSP_DECLARE(PartitionedCounterThreadCells, partitionedCounterThreadCells);
+
+    /**
+     * The part of PartitionedCounter that doesn't depend on the value type: id allocation, the
+     * thread-local lookup, and publishing cells to counters.
+     *
+     * Incrementing only touches the calling thread's cell, found through a __thread pointer to
+     * the thread's table (see TSP in threadlocal.h).  A thread's first increment pushes its cell
+     * with a compare and swap, or takes over the cell of a thread that exited, and thread exit
+     * just marks its cells free, so neither takes a lock.  Only constructing and destroying
+     * counters, which allocate and free ids, synchronize on a mutex.
+     */
+    class PartitionedCounterBase : boost::noncopyable {
+      protected:
+        PartitionedCounterBase();
+        virtual ~PartitionedCounterBase();
+
+        /** @return the calling thread's cell for this counter, or NULL if it has none yet. */
+        PartitionedCounterCell *localCell() const {
+            PartitionedCounterThreadCells *tc = partitionedCounterThreadCells.get();
+            return MONGO_likely(tc != NULL) ? tc->get(_id, _generation) : NULL;
+        }
+
+        /**
+         * Makes a cell the calling thread's cell for this counter: a free one if there is one,
+         * otherwise one from newCell().
+         */
+        PartitionedCounterCell *registerCell();
+
+        /** Destroys all cells.  Must be called by the subclass destructor. */
+        void destroyCells();
+
+        virtual PartitionedCounterCell *newCell() const = 0;
+
+        const PartitionedCounterCell *cellsBegin() const {
+            return reinterpret_cast<const PartitionedCounterCell *>(_head.load());
+        }
+        static const PartitionedCounterCell *cellsNext(const PartitionedCounterCell *cell) { return cell->_next; }
+
+      private:
+        static size_t allocateId();
+
+        const size_t _id;
+        const unsigned long long _generation;
+        AtomicWord<uintptr_t> _head;
+    };
 
     /**
      * PartitionedCounter is a number that can be incremented, decremented, and read.
@@ -45,16 +154,15 @@ namespace mongo {
      *   - Signed or unsigned types are supported, because it's templated.
      *   - Decrement is supported, and if Value is an unsigned type, decrements check for underflow.
      *   - There is no global cleanup like partitioned_counters_destroy, if there are global objects
-     *     they get destructed just like everything else.  This is possible because there is no
-     *     global state.
-     *   - This implementation is expected to be slower.  boost::thread_specific_ptr is known to be
-     *     slow, but in the original implementation we rolled our own pthread keys, so maybe this
-     *     isn't so bad.  The linked list removal on thread destruction is slower because the
-     *     element doesn't know where in the list it is.  This could be made better if it is shown
-     *     to stall other threads.
+     *     they get destructed just like everything else.
+     *
+     * Like the original, each thread's part of the counter lives in its own cache line, and it is
+     * found through a thread-local array indexed by a per-counter id.  Unlike the original, a
+     * thread's part isn't folded into the counter when it exits, but handed on to the next thread,
+     * which is constant time and needs no lock.
      */
     template<typename Value>
-    class PartitionedCounter : boost::noncopyable {
+    class PartitionedCounter : public PartitionedCounterBase {
       public:
         PartitionedCounter(Value init=0);
         ~PartitionedCounter();
@@ -80,95 +188,68 @@ namespace mongo {
         PartitionedCounter& operator-=(Value x) { return dec(x); }
 
       private:
-        class ThreadStateData : boost::noncopyable {
-            PartitionedCounter *_pc;
-            Value _sum;
+        class CellData : public PartitionedCounterCell {
           public:
-            ThreadStateData(PartitionedCounter *);
-            ~ThreadStateData();
-            friend class PartitionedCounter;
+            CellData() : _sum(0) {}
+            Value _sum;
         };
-        class ThreadState : public ThreadStateData {
-            char _pad[64 - sizeof(ThreadStateData)];
-          public:
-            ThreadState(PartitionedCounter *pc) : ThreadStateData(pc) {}
+        class Cell : public CellData {
+            char _pad[64 - sizeof(CellData) % 64];
         };
-        friend class ThreadStateData;
 
-        ThreadState& ts();
+        Value& local();
+        Value& makeLocal();
 
-        Value _sumOfDead;
-        mutable SimpleMutex _mutex;
-        thread_specific_ptr<ThreadState> _ts;
-        mutable list<ThreadState *> _threadStates;
-        typedef typename list<ThreadState *>::iterator states_iterator;
-    };
-
-    template<typename Value>
-    PartitionedCounter<Value>::ThreadStateData::ThreadStateData(PartitionedCounter *pc) : _pc(pc), _sum(0) {}
+        virtual PartitionedCounterCell *newCell() const { return new Cell; }
 
-    template<typename Value>
-    PartitionedCounter<Value>::ThreadStateData::~ThreadStateData() {
-        if (_pc != NULL) {
-            SimpleMutex::scoped_lock lk(_pc->_mutex);
-            _pc->_sumOfDead += _sum;
-            for (states_iterator it = _pc->_threadStates.begin(); it != _pc->_threadStates.end(); ++it) {
-                if (*it == this) {
-                    _pc->_threadStates.erase(it);
-                    break;
-                }
-            }
-        }
-    }
+        // The cells only hold changes from this.
+        const Value _init;
+    };
 
     template<typename Value>
-    PartitionedCounter<Value>::PartitionedCounter(Value init) : _sumOfDead(init), _mutex("PartitionedCounter") {}
+    PartitionedCounter<Value>::PartitionedCounter(Value init) : _init(init) {}
 
     template<typename Value>
     PartitionedCounter<Value>::~PartitionedCounter() {
-        // Prevent recursive lock and modification of _threadStates when we destroy all the _ts
-        // objects, we don't care about incrementing _sumOfDead because this pc is dying anyway.
-        //
-        // We need this lock to protect against the race between a terminating thread in
-        // ~ThreadState, and us.
-        SimpleMutex::scoped_lock lk(_mutex);
-        for (states_iterator it = _threadStates.begin(); it != _threadStates.end(); ++it) {
-            (*it)->_pc = NULL;
-        }
+        destroyCells();
     }
 
     template<typename Value>
     Value PartitionedCounter<Value>::get() const {
-        SimpleMutex::scoped_lock lk(_mutex);
-        Value sum = _sumOfDead;
-        for (states_iterator it = _threadStates.begin(); it != _threadStates.end(); ++it) {
-            sum += (*it)->_sum;
+        Value sum = _init;
+        for (const PartitionedCounterCell *c = cellsBegin(); c != NULL; c = cellsNext(c)) {
+            sum += static_cast<const Cell *>(c)->_sum;
         }
         return sum;
     }
 
     template<typename Value>
-    typename PartitionedCounter<Value>::ThreadState& PartitionedCounter<Value>::ts() {
-        if (_ts.get() == NULL) {
-            _ts.reset(new ThreadState(this));
-            SimpleMutex::scoped_lock lk(_mutex);
-            _threadStates.push_back(_ts.get());
+    inline Value& PartitionedCounter<Value>::local() {
+        PartitionedCounterCell *c = localCell();
+        if (MONGO_likely(c != NULL)) {
+            return static_cast<Cell *>(c)->_sum;
         }
-        return *_ts;
+        return makeLocal();
+    }
+
+    template<typename Value>
+    Value& PartitionedCounter<Value>::makeLocal() {
+        return static_cast<Cell *>(registerCell())->_sum;
     }
 
     template<typename Value>
     PartitionedCounter<Value>& PartitionedCounter<Value>::inc(Value x) {
-        ts()._sum += x;
+        local() += x;
         return *this;
     }
 
     template<typename Value>
     PartitionedCounter<Value>& PartitionedCounter<Value>::dec(Value x) {
+        Value &sum = local();
         if (!std::numeric_limits<Value>::is_signed) {
-            massert(17022, "cannot decrement partitioned counter below zero", ts()._sum > x);
+            massert(17022, "cannot decrement partitioned counter below zero", sum > x);
         }
-        ts()._sum -= x;
+        sum -= x;
         return *this;
     }
 
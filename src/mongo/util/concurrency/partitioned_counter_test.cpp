@@ -167,20 +167,88 @@ namespace {
     }
 
     TEST(PartitionedCounterTest, Timing) {
-        for (int nthreads = 1; nthreads <= 1<<10; nthreads <<= 1) {
+        for (int nthreads = 1; nthreads <= 64; nthreads <<= 1) {
             unsigned long long atomic = timeit<AtomicWordCounter<uint64_t> >(nthreads);
             unsigned long long partitioned = timeit<PartitionedCounter<uint64_t> >(nthreads);
             LOG(0) << nthreads << " threads" << endl
                    << "  atomic:      " << atomic << endl
                    << "  partitioned: " << partitioned << endl;
-// TODO: optimize partitioned counters and restore this test before using them
-#if 0 // !_DEBUG
-            // 4 threads seems to be the tipping point for most processors
-            // maybe TODO figure out how to make it faster (don't use boost tsp?)
-            if (nthreads > 2) {
-                ASSERT_LESS_THAN(partitioned, atomic);
+            // Only the sums are checked (in timeit), the timings depend too much on the machine
+            // and whatever else it's running.
+        }
+    }
+
+    TEST(PartitionedCounterTest, Scaling) {
+        // The same number of increments, spread over more threads.  With no cache line shared
+        // between threads they can't take much longer than on one thread, even on one core,
+        // whereas a contended atomic typically takes several times longer.
+        unsigned long long one = timeit<PartitionedCounter<uint64_t> >(1);
+        unsigned long long many = timeit<PartitionedCounter<uint64_t> >(64);
+        LOG(0) << "1 thread: " << one << ", 64 threads: " << many << endl;
+        ASSERT_LESS_THAN(many, 4 * one + 100000);
+    }
+
+    TEST(PartitionedCounterTest, CellAlignment) {
+        for (int i = 0; i < 10; ++i) {
+            PartitionedCounterCell *cell = new PartitionedCounterCell;
+            ASSERT_EQUALS(reinterpret_cast<uintptr_t>(cell) % 64, 0U);
+            delete cell;
+        }
+    }
+
+    TEST(PartitionedCounterTest, ReuseAfterDestroy) {
+        // Counter ids get reused, make sure a new counter doesn't pick up the cell this thread
+        // had for the old one.
+        for (int i = 0; i < 10; ++i) {
+            PartitionedCounter<int> pc;
+            ASSERT_EQUALS(pc, 0);
+            pc += i;
+            ASSERT_EQUALS(pc, i);
+        }
+    }
+
+    static void incAndExit(int n, PartitionedCounter<int>& pc) {
+        for (int i = 0; i < n; ++i) {
+            ++pc;
+        }
+    }
+
+    TEST(PartitionedCounterTest, ThreadExit) {
+        PartitionedCounter<int> pc;
+        for (int round = 1; round <= 10; ++round) {
+            boost::thread_group group;
+            for (int i = 0; i < 8; ++i) {
+                group.add_thread(new boost::thread(incAndExit, 1000, boost::ref(pc)));
+            }
+            group.join_all();
+            // All the threads have exited, their cells keep their sums for the next threads.
+            ASSERT_EQUALS(pc, round * 8 * 1000);
+        }
+    }
+
+    static void incAndWait(PartitionedCounter<int>* pc, volatile bool& incremented,
+                           volatile bool& destroyed) {
+        ++*pc;
+        incremented = true;
+        while (!destroyed) {
+            sleepmillis(1);
+        }
+        // The cell for pc is released when this thread exits, after pc is gone.
+    }
+
+    TEST(PartitionedCounterTest, DestroyBeforeThreadExit) {
+        for (int i = 0; i < 10; ++i) {
+            PartitionedCounter<int>* pc = new PartitionedCounter<int>;
+            volatile bool incremented = false;
+            volatile bool destroyed = false;
+            boost::thread t(incAndWait, pc, boost::ref(incremented), boost::ref(destroyed));
+            while (!incremented) {
+                sleepmillis(1);
             }
-#endif
+            ASSERT_EQUALS(*pc, 1);
+            delete pc;
+            destroyed = true;
+            t.join();
         }
     }
 
@@ -80,6 +80,7 @@ namespace mongo {
     struct TSP {
         boost::thread_specific_ptr<T> tsp;
     public:
+        TSP() : tsp( &TSP::cleanup ) {}
         T* get() const;
         void reset(T* v);
         T* getMake() { 
@@ -88,6 +89,10 @@ namespace mongo {
                 reset( t = new T() );
             return t;
         }
+    private:
+        /* called by tsp on reset and at thread exit.  clears the intrinsic too, so that whatever
+           runs later in the thread's teardown doesn't get the deleted object. */
+        static void cleanup(T* v);
     };
 
 # if defined(_WIN32)
@@ -95,6 +100,11 @@ namespace mongo {
 #  define TSP_DECLARE(T,p) extern TSP<T> p;
 
 #  define TSP_DEFINE(T,p) __declspec( thread ) T* _ ## p; \
+    template<> void TSP<T>::cleanup(T* v) { \
+        delete v; \
+        if ( _ ## p == v ) \
+            _ ## p = 0; \
+    } \
     TSP<T> p; \
     template<> T* TSP<T>::get() const { return _ ## p; } \
     void TSP<T>::reset(T* v) { \
@@ -110,6 +120,11 @@ namespace mongo {
 
 #  define TSP_DEFINE(T,p) \
     __thread T* _ ## p; \
+    template<> void TSP<T>::cleanup(T* v) { \
+        delete v; \
+        if ( _ ## p == v ) \
+            _ ## p = 0; \
+    } \
     template<> void TSP<T>::reset(T* v) { \
         tsp.reset(v); \
         _ ## p = v; \
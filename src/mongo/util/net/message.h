@@ -223,6 +223,9 @@ namespace mongo {
             if ( r._data.size() > 0 ) {
                 _data.swap( r._data );
             }
+            if ( r._dataPins.size() > 0 ) {
+                _dataPins.swap( r._dataPins );
+            }
             r._freeIt = false;
             _freeIt = true;
             return *this;
@@ -233,12 +236,16 @@ namespace mongo {
                 if ( _buf ) {
                     free( _buf );
                 }
-                for( vector< pair< char *, int > >::const_iterator i = _data.begin(); i != _data.end(); ++i ) {
-                    free(i->first);
+                for( size_t i = 0; i < _data.size(); ++i ) {
+                    if ( i < _dataPins.size() && _dataPins[i] ) {
+                        continue;
+                    }
+                    free(_data[i].first);
                 }
             }
             _buf = 0;
             _data.clear();
+            _dataPins.clear();
             _freeIt = false;
         }
 
@@ -260,9 +267,38 @@ namespace mongo {
                 _buf = 0;
             }
             _data.push_back( make_pair( d, size ) );
+            if ( !_dataPins.empty() ) {
+                _dataPins.push_back( boost::shared_ptr<void>() );
+            }
             header()->len += size;
         }
 
+        // use to add a buffer the message doesn't own, which pin keeps valid until the
+        // message is reset.  the first buffer added must contain at least a full MsgData.
+        void appendPinnedData(const char *d, int size, const boost::shared_ptr<void> &pin) {
+            verify( pin );
+            if ( size <= 0 ) {
+                return;
+            }
+            if ( empty() ) {
+                _freeIt = true;
+            }
+            verify( _freeIt );
+            if ( _buf ) {
+                _data.push_back( make_pair( (char*)_buf, _buf->len ) );
+                _buf = 0;
+            }
+            _dataPins.resize( _data.size() );
+            _data.push_back( make_pair( const_cast<char*>( d ), size ) );
+            _dataPins.push_back( pin );
+            if ( _data.size() == 1 ) {
+                header()->len = size;
+            }
+            else {
+                header()->len += size;
+            }
+        }
+
         // use to set first buffer if empty
         void setData(MsgData *d, bool freeIt) {
             verify( empty() );
@@ -299,6 +335,9 @@ namespace mongo {
         // byte buffer(s) - the first must contain at least a full MsgData unless using _buf for storage instead
         typedef vector< pair< char*, int > > MsgVec;
         MsgVec _data;
+        // if not empty, has an entry for each buffer in _data: the pin keeping it valid, or
+        // null if the message frees it.
+        vector< boost::shared_ptr<void> > _dataPins;
         bool _freeIt;
     };
 
@@ -29,7 +29,9 @@
 # include <netinet/tcp.h>
 # include <arpa/inet.h>
 # include <errno.h>
+# include <limits.h>
 # include <netdb.h>
+# include <poll.h>
 # if defined(__openbsd__)
 #  include <sys/uio.h>
 # endif
@@ -593,12 +595,15 @@ namespace mongo {
                 _bytesOut += j->second;
             }
         }
+        // Empty buffers were skipped, and sendmsg() takes at most IOV_MAX buffers at a time,
+        // which a reply referencing many documents can go over.
+        struct iovec *iovEnd = &d[ 0 ] + i;
         struct msghdr meta;
         memset( &meta, 0, sizeof( meta ) );
         meta.msg_iov = &d[ 0 ];
-        meta.msg_iovlen = d.size();
 
-        while( meta.msg_iovlen > 0 ) {
+        while( meta.msg_iov != iovEnd ) {
+            meta.msg_iovlen = std::min<size_t>( iovEnd - meta.msg_iov, IOV_MAX );
             int ret = -1;
             if (MONGO_FAIL_POINT(throwSockExcep)) {
 #if defined(_WIN32)
@@ -634,7 +639,6 @@ namespace mongo {
                     else {
                         ret -= i->iov_len;
                         ++i;
-                        --(meta.msg_iovlen);
                     }
                 }
             }
@@ -762,6 +766,49 @@ namespace mongo {
         setSockTimeouts( _fd, secs );
     }
 
+    bool Socket::waitForReadable( double secs ) {
+        const long long deadline = static_cast<long long>( curTimeMicros64() ) +
+                                   static_cast<long long>( secs * 1000000 );
+        while ( true ) {
+            const long long micros = deadline - static_cast<long long>( curTimeMicros64() );
+            if ( micros <= 0 ) {
+                return false;
+            }
+#if defined(_WIN32)
+            fd_set fds;
+            FD_ZERO( &fds );
+            FD_SET( _fd, &fds );
+            struct timeval tv;
+            tv.tv_sec = static_cast<long>( micros / 1000000 );
+            tv.tv_usec = static_cast<long>( micros % 1000000 );
+            const int ret = select( _fd + 1, &fds, NULL, NULL, &tv );
+            const int e = ret < 0 ? WSAGetLastError() : 0;
+#else
+            struct pollfd pfd;
+            pfd.fd = _fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            // Round up, so a wait of less than a millisecond doesn't spin.
+            const int ret = ::poll( &pfd, 1, static_cast<int>( ( micros + 999 ) / 1000 ) );
+            const int e = ret < 0 ? errno : 0;
+#endif
+            if ( ret > 0 ) {
+                // Errors and hangups are readable too, the recv that follows reports them.
+                return true;
+            }
+            if ( ret == 0 ) {
+                return false;
+            }
+#if defined(EINTR) && !defined(_WIN32)
+            if ( e == EINTR ) {
+                continue;
+            }
+#endif
+            LOG(_logLevel) << "Socket poll() " << errnoWithDescription( e ) << " " << remoteString() << endl;
+            throw SocketException( SocketException::RECV_ERROR , remoteString() );
+        }
+    }
+
 #if defined(_WIN32)
     struct WinsockInit {
         WinsockInit() {
@@ -213,6 +213,14 @@ namespace mongo {
         
         void setTimeout( double secs );
 
+        /**
+         * Waits up to secs for data to read, or for an error.  Data already buffered by SSL
+         * isn't seen.
+         * @return false if there still isn't any.
+         * @throw SocketException if waiting fails.
+         */
+        bool waitForReadable( double secs );
+
 #ifdef MONGO_SSL
         /** secures inline */
         void secure( SSLManager * ssl );